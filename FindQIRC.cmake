@@ -22,17 +22,29 @@ find_library(QIRC_LIBRARIES QIRC
   /usr/lib
 )
 
+#
+# Look for the protocol core libQIRC depends on
+find_library(QIRC_CORE_LIBRARY QIRCCore
+  PATHS
+  "$ENV{QIRC}/lib"
+  /usr/local/lib
+  /usr/pkg/lib
+  /usr/lib
+)
+
 set(QIRC_FOUND FALSE)
 if(QIRC_INCLUDE_DIR)
-  if(QIRC_LIBRARIES)
+  if(QIRC_LIBRARIES AND QIRC_CORE_LIBRARY)
+    set(QIRC_LIBRARIES ${QIRC_LIBRARIES} ${QIRC_CORE_LIBRARY})
     set(QIRC_FOUND TRUE)
     if(NOT QIRC_FIND_QUIETLY)
       message(STATUS "Found libQIRC: ${QIRC_LIBRARIES}")
     endif(NOT QIRC_FIND_QUIETLY)
-  endif(QIRC_LIBRARIES)
+  endif(QIRC_LIBRARIES AND QIRC_CORE_LIBRARY)
 endif(QIRC_INCLUDE_DIR)
 
 mark_as_advanced(
   QIRC_INCLUDE_DIR
   QIRC_LIBRARIES
+  QIRC_CORE_LIBRARY
 )
\ No newline at end of file
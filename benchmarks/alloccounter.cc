@@ -0,0 +1,55 @@
+/// \file
+/// \brief Counting heap allocations in benchmarks
+///
+/// \author png!das-system
+#include <cstddef>
+
+#include "alloccounter.h"
+
+
+/// \brief Number of allocations so far
+///
+/// Updated with atomic builtins (GCC and Clang, as used with glibc):
+/// Qt allocates in threads of its own, e.g. for host lookups.
+static unsigned long long allocations = 0;
+
+#ifdef __GLIBC__
+extern "C" {
+  void* __libc_malloc(size_t size);
+  void* __libc_calloc(size_t n, size_t size);
+  void* __libc_realloc(void* p, size_t size);
+
+  void* malloc(size_t size) throw() {
+    __sync_fetch_and_add(&allocations, 1);
+    return __libc_malloc(size);
+  }
+
+  void* calloc(size_t n, size_t size) throw() {
+    __sync_fetch_and_add(&allocations, 1);
+    return __libc_calloc(n, size);
+  }
+
+  void* realloc(void* p, size_t size) throw() {
+    __sync_fetch_and_add(&allocations, 1);
+    return __libc_realloc(p, size);
+  }
+}
+#endif
+
+
+unsigned long long allocationCount() {
+#ifdef __GLIBC__
+  return __sync_fetch_and_add(&allocations, 0);
+#else
+  return allocations;
+#endif
+}
+
+
+bool countingAllocations() {
+#ifdef __GLIBC__
+  return true;
+#else
+  return false;
+#endif
+}
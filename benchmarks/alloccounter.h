@@ -0,0 +1,18 @@
+/// \file
+/// \brief Counting heap allocations in benchmarks
+///
+/// \author png!das-system
+#ifndef ALLOCCOUNTER_H
+#define ALLOCCOUNTER_H 1
+
+/// \brief Number of malloc(), calloc() and realloc() calls so far
+///
+/// Linking alloccounter.cc into a program wraps glibc's allocator;
+/// operator new and Qt's qMalloc() end up there as well. Allocations
+/// of all threads are counted, including the ones Qt starts itself.
+unsigned long long allocationCount();
+
+/// \brief Are allocations counted at all (glibc only)?
+bool countingAllocations();
+
+#endif // !ALLOCCOUNTER_H
@@ -0,0 +1,14 @@
+/// \file
+/// \brief Helpers shared by the benchmark programs
+///
+/// \author png!das-system
+#include <cstdio>
+
+#include "benchutil.h"
+
+
+void quietMessageHandler(QtMsgType type, const char* msg) {
+  if (type != QtDebugMsg) {
+    std::fprintf(stderr, "%s\n", msg);
+  }
+}
@@ -0,0 +1,23 @@
+/// \file
+/// \brief Helpers shared by the benchmark programs
+///
+/// \author png!das-system
+#ifndef BENCHUTIL_H
+#define BENCHUTIL_H 1
+
+#include <QtGlobal>
+
+#include "Connection"
+
+/// \brief Handler that only makes the connection decode every line
+struct DecodeAll {
+  void operator()(const QIRC::RawMessage&) const {}
+};
+
+/// \brief Drop qDebug() output, which would dominate the timing
+///
+/// Install with qInstallMsgHandler(); warnings and errors still go to
+/// stderr.
+void quietMessageHandler(QtMsgType type, const char* msg);
+
+#endif // !BENCHUTIL_H
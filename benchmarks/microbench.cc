@@ -0,0 +1,644 @@
+/// \file
+/// \brief Microbenchmarks of the parser and the utility classes
+///
+/// Usage: microbench [options]
+///
+/// Runs every benchmark over a corpus of IRC traffic (by default the
+/// one in benchmarks/corpus) and reports the time and the number of
+/// heap allocations (glibc only) per operation. An operation is one
+/// corpus line; the hostmask and serverinfo benchmarks take one value
+/// from each line. Options:
+/// \code
+/// --corpus <file>      corpus: text with one line per message ('#'
+///                      starts a comment) or a TrafficRecorder recording
+/// --filter <text>      only run benchmarks whose name contains text
+/// --min-time <ms>      run each benchmark at least this long (default
+///                      500, 0: a single pass)
+/// --format <format>    text (default), json or csv
+/// --output <file>      write the results to file instead of stdout
+/// --label <text>       label of the run in json and csv, e.g. a commit
+/// --list               list the benchmarks and exit
+/// \endcode
+///
+/// json and csv keep the same names and fields from run to run, so
+/// results of different commits can be compared by a script.
+///
+/// \author png!das-system
+#include <cstdio>
+#include <cstring>
+
+#include <QByteArray>
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QHash>
+#include <QList>
+#include <QString>
+#include <QStringList>
+#include <QtAlgorithms>
+
+#include "Connection"
+#include "HostMask"
+#include "IrcMessage"
+#include "LineFramer"
+#include "ServerInfo"
+#include "TrafficReader"
+#include "TrafficRecorder"
+
+#include "alloccounter.h"
+#include "benchutil.h"
+#include "nulltransport.h"
+
+using namespace QIRC;
+
+#ifndef QIRC_BENCH_CORPUS
+#define QIRC_BENCH_CORPUS "corpus/traffic.txt"
+#endif
+
+
+/// \brief Size of the chunks the framing benchmark appends
+static const int FramingChunkSize = 4096;
+
+/// \brief Results are added here, so the compiler can't drop the work
+static volatile quint64 sink = 0;
+
+
+/// \brief Connection that lets the benchmarks call parseMessage()
+class BenchConnection : public Connection {
+public:
+  bool dispatch(const IrcMessage& msg) {
+    return parseMessage(msg);
+  }
+};
+
+
+/// \brief Parts of a hostmask as strings
+struct MaskParts {
+  QString nick;
+  QString user;
+  QString host;
+};
+
+
+/// \brief Corpus and everything the benchmarks prepare from it
+struct Corpus {
+  Corpus() : conn(NULL) {}
+
+  /// \brief The lines, without terminators
+  QList<QByteArray> lines;
+
+  /// \brief The lines with CR LF, as a server sends them
+  QByteArray stream;
+
+  /// \brief Lines by command
+  QHash<QByteArray, QList<QByteArray> > byCommand;
+
+  /// \brief Texts of PRIVMSG and NOTICE
+  QList<QString> texts;
+
+  /// \brief Messages with a nick!user\@host prefix
+  QList<IrcMessage> userMessages;
+
+  /// \brief Senders of userMessages, as strings
+  QList<MaskParts> maskParts;
+
+  /// \brief Senders of userMessages
+  QList<HostMask> masks;
+
+  /// \brief A server for every line, from its prefix
+  QList<ServerInfo> servers;
+
+  /// \brief Connection the parse benchmarks use
+  BenchConnection* conn;
+};
+
+
+/// \brief A benchmark
+///
+/// The function runs one pass over the corpus and returns the number
+/// of operations it did.
+struct Benchmark {
+  QByteArray name;
+  quint64 (*run)(Corpus& c, const QByteArray& arg);
+  QByteArray arg;
+};
+
+
+/// \brief Measurements of a benchmark
+struct Result {
+  QByteArray name;
+  quint64 ops;
+  double nsPerOp;
+  double allocsPerOp;
+};
+
+
+/// \brief Load the lines of a corpus
+///
+/// A file starting with TrafficRecorder::Magic is read as recording,
+/// anything else as text.
+static bool loadCorpus(const QString& fileName, QList<QByteArray>* lines) {
+  QFile file(fileName);
+  if (!file.open(QIODevice::ReadOnly)) {
+    std::fprintf(stderr, "Unable to open %s: %s\n", qPrintable(fileName),
+		 qPrintable(file.errorString()));
+    return false;
+  }
+
+  if (file.peek(8) == QByteArray(TrafficRecorder::Magic, 8)) {
+    file.close();
+
+    TrafficReader reader;
+    if (!reader.open(fileName)) {
+      return false;
+    }
+
+    LineFramer framer;
+    qint64 time;
+    QByteArray data;
+    while (reader.next(&time, &data)) {
+      if (framer.append(data) == 0) {
+	continue;
+      }
+
+      for (int i = 0; i < framer.lines().size(); ++i) {
+	const LineFramer::Line& l = framer.lines().at(i);
+	lines->append(framer.buffer().mid(l.offset, l.length));
+      }
+    }
+
+    return reader.errorString().isEmpty();
+  }
+
+  while (!file.atEnd()) {
+    QByteArray line = file.readLine();
+    while (line.endsWith('\n') || line.endsWith('\r')) {
+      line.chop(1);
+    }
+
+    if (!line.isEmpty() && !line.startsWith('#')) {
+      lines->append(line);
+    }
+  }
+
+  return true;
+}
+
+
+/// \brief Fill in everything the benchmarks need besides the lines
+static void prepareCorpus(Corpus& c) {
+  IrcMessage msg;
+
+  for (int i = 0; i < c.lines.size(); ++i) {
+    const QByteArray& line = c.lines.at(i);
+    c.stream += line;
+    c.stream += "\r\n";
+
+    if (!msg.parse(line) || !msg.isValid()) {
+      c.byCommand["(unparsable)"].append(line);
+      continue;
+    }
+
+    const QByteArray command(msg.commandData(), msg.commandLength());
+    c.byCommand[command].append(line);
+
+    if ((msg.isCommand("PRIVMSG") || msg.isCommand("NOTICE")) &&
+	msg.paramCount() >= 2) {
+      c.texts.append(msg.param(msg.paramCount() - 1));
+    }
+
+    if (msg.hasUserPrefix()) {
+      const HostMask mask = msg.sender();
+      MaskParts parts;
+      parts.nick = mask.nick();
+      parts.user = mask.user();
+      parts.host = mask.host();
+
+      c.userMessages.append(msg);
+      c.maskParts.append(parts);
+      c.masks.append(mask);
+    }
+
+    const QString server = msg.hasUserPrefix() ? msg.sender().host() :
+      msg.prefix();
+    c.servers.append(ServerInfo(server, quint16(6660 + i % 10)));
+  }
+
+  c.conn = new BenchConnection();
+  c.conn->setTransport(new NullTransport());
+  c.conn->setRegistrationTimeout(0);
+  c.conn->on<RawMessage>(DecodeAll());
+  c.conn->connect();
+
+  // registers the connection and joins the channels of the corpus, so
+  // the per command benchmarks see the state they would see live
+  c.conn->feed(c.stream);
+}
+
+
+/// \brief IrcMessage::parse() and Connection::parseMessage()
+///
+/// \param arg Command whose lines are parsed
+static quint64 benchParse(Corpus& c, const QByteArray& arg) {
+  const QList<QByteArray>& lines = c.byCommand[arg];
+  IrcMessage msg;
+  quint64 handled = 0;
+
+  for (int i = 0; i < lines.size(); ++i) {
+    msg.parse(lines.at(i));
+    handled += c.conn->dispatch(msg);
+  }
+
+  sink += handled;
+  return lines.size();
+}
+
+
+/// \brief Connection::feed() of the whole corpus
+static quint64 benchFeed(Corpus& c, const QByteArray&) {
+  c.conn->feed(c.stream);
+  return c.lines.size();
+}
+
+
+/// \brief LineFramer over chunks of FramingChunkSize bytes
+static quint64 benchFraming(Corpus& c, const QByteArray&) {
+  LineFramer framer;
+  quint64 lines = 0;
+
+  for (int offset = 0; offset < c.stream.size();
+       offset += FramingChunkSize) {
+    lines += framer.append(c.stream.mid(offset, FramingChunkSize));
+  }
+
+  return lines;
+}
+
+
+/// \brief QIRC::stripFormat() of the texts
+static quint64 benchStripFormat(Corpus& c, const QByteArray&) {
+  quint64 length = 0;
+
+  for (int i = 0; i < c.texts.size(); ++i) {
+    length += stripFormat(c.texts.at(i)).size();
+  }
+
+  sink += length;
+  return c.texts.size();
+}
+
+
+/// \brief QIRC::stripColors() of the texts
+static quint64 benchStripColors(Corpus& c, const QByteArray&) {
+  quint64 length = 0;
+
+  for (int i = 0; i < c.texts.size(); ++i) {
+    length += stripColors(c.texts.at(i)).size();
+  }
+
+  sink += length;
+  return c.texts.size();
+}
+
+
+/// \brief HostMask from nick, user and host strings
+static quint64 benchHostMaskConstruct(Corpus& c, const QByteArray&) {
+  quint64 handles = 0;
+
+  for (int i = 0; i < c.maskParts.size(); ++i) {
+    const MaskParts& p = c.maskParts.at(i);
+    const HostMask mask(p.nick, p.user, p.host);
+    handles += mask.pooledNick().handle();
+  }
+
+  sink += handles;
+  return c.maskParts.size();
+}
+
+
+/// \brief HostMask from the prefix of a message (IrcMessage::sender())
+static quint64 benchHostMaskSender(Corpus& c, const QByteArray&) {
+  quint64 handles = 0;
+
+  for (int i = 0; i < c.userMessages.size(); ++i) {
+    handles += c.userMessages.at(i).sender().pooledNick().handle();
+  }
+
+  sink += handles;
+  return c.userMessages.size();
+}
+
+
+/// \brief HostMask::operator ==() of neighbouring senders
+static quint64 benchHostMaskCompare(Corpus& c, const QByteArray&) {
+  quint64 equal = 0;
+
+  for (int i = 1; i < c.masks.size(); ++i) {
+    equal += (c.masks.at(i) == c.masks.at(i - 1));
+  }
+
+  sink += equal;
+  return c.masks.size() - 1;
+}
+
+
+/// \brief HostMask::toString()
+static quint64 benchHostMaskToString(Corpus& c, const QByteArray&) {
+  quint64 length = 0;
+
+  for (int i = 0; i < c.masks.size(); ++i) {
+    length += c.masks.at(i).toString().size();
+  }
+
+  sink += length;
+  return c.masks.size();
+}
+
+
+/// \brief ServerInfo copy constructor
+static quint64 benchServerInfoCopy(Corpus& c, const QByteArray&) {
+  quint64 ports = 0;
+
+  for (int i = 0; i < c.servers.size(); ++i) {
+    const ServerInfo copy(c.servers.at(i));
+    ports += copy.port();
+  }
+
+  sink += ports;
+  return c.servers.size();
+}
+
+
+/// \brief ServerInfo::operator =()
+static quint64 benchServerInfoAssign(Corpus& c, const QByteArray&) {
+  ServerInfo copy;
+  quint64 ports = 0;
+
+  for (int i = 0; i < c.servers.size(); ++i) {
+    copy = c.servers.at(i);
+    ports += copy.port();
+  }
+
+  sink += ports;
+  return c.servers.size();
+}
+
+
+/// \brief All benchmarks, a parse benchmark for every command
+static QList<Benchmark> benchmarks(const Corpus& c) {
+  QList<Benchmark> list;
+  Benchmark b;
+
+  QList<QByteArray> commands = c.byCommand.keys();
+  qSort(commands);
+  for (int i = 0; i < commands.size(); ++i) {
+    b.name = "parse/" + commands.at(i);
+    b.run = benchParse;
+    b.arg = commands.at(i);
+    list.append(b);
+  }
+
+  b.arg = QByteArray();
+
+  b.name = "parse/all";
+  b.run = benchFeed;
+  list.append(b);
+
+  b.name = "framing";
+  b.run = benchFraming;
+  list.append(b);
+
+  b.name = "format/stripFormat";
+  b.run = benchStripFormat;
+  list.append(b);
+
+  b.name = "format/stripColors";
+  b.run = benchStripColors;
+  list.append(b);
+
+  b.name = "hostmask/construct";
+  b.run = benchHostMaskConstruct;
+  list.append(b);
+
+  b.name = "hostmask/sender";
+  b.run = benchHostMaskSender;
+  list.append(b);
+
+  b.name = "hostmask/compare";
+  b.run = benchHostMaskCompare;
+  list.append(b);
+
+  b.name = "hostmask/toString";
+  b.run = benchHostMaskToString;
+  list.append(b);
+
+  b.name = "serverinfo/copy";
+  b.run = benchServerInfoCopy;
+  list.append(b);
+
+  b.name = "serverinfo/assign";
+  b.run = benchServerInfoAssign;
+  list.append(b);
+
+  return list;
+}
+
+
+/// \brief Run a benchmark for at least minTime ms
+///
+/// A first pass isn't measured, so pools and caches are filled before
+/// the allocations are counted.
+static Result measure(const Benchmark& b, Corpus& c, qint64 minTime) {
+  b.run(c, b.arg);
+
+  Result r;
+  r.name = b.name;
+  r.ops = 0;
+
+  QElapsedTimer clock;
+  const unsigned long long allocationsBefore = allocationCount();
+
+  clock.start();
+  do {
+    r.ops += b.run(c, b.arg);
+  } while (clock.elapsed() < minTime);
+  const qint64 elapsed = clock.nsecsElapsed();
+
+  const unsigned long long allocations =
+    allocationCount() - allocationsBefore;
+
+  r.nsPerOp = r.ops > 0 ? double(elapsed) / r.ops : 0.0;
+  r.allocsPerOp = r.ops > 0 ? double(allocations) / r.ops : 0.0;
+
+  return r;
+}
+
+
+/// \brief Escape a string for JSON (the names are plain ASCII)
+static QByteArray jsonString(const QByteArray& s) {
+  QByteArray escaped = s;
+  escaped.replace('\\', "\\\\");
+  escaped.replace('"', "\\\"");
+
+  return '"' + escaped + '"';
+}
+
+
+/// \brief Write the results in the format selected by --format
+static void report(FILE* out, const QByteArray& format,
+		   const QByteArray& label, const QString& corpus,
+		   const Corpus& c, const QList<Result>& results) {
+  const QByteArray corpusName = corpus.toLocal8Bit();
+
+  if (format == "json") {
+    std::fprintf(out, "{\n  \"label\": %s,\n  \"corpus\": %s,\n"
+		 "  \"lines\": %d,\n  \"bytes\": %d,\n"
+		 "  \"allocations_counted\": %s,\n  \"benchmarks\": [",
+		 jsonString(label).constData(),
+		 jsonString(corpusName).constData(), c.lines.size(),
+		 c.stream.size(), countingAllocations() ? "true" : "false");
+
+    for (int i = 0; i < results.size(); ++i) {
+      const Result& r = results.at(i);
+      std::fprintf(out, "%s\n    {\"name\": %s, \"ops\": %llu, "
+		   "\"ns_per_op\": %.2f, \"allocs_per_op\": %.3f}",
+		   i > 0 ? "," : "", jsonString(r.name).constData(),
+		   (unsigned long long) r.ops, r.nsPerOp, r.allocsPerOp);
+    }
+
+    std::fprintf(out, "\n  ]\n}\n");
+    return;
+  }
+
+  if (format == "csv") {
+    std::fprintf(out, "label,benchmark,ops,ns_per_op,allocs_per_op\n");
+
+    for (int i = 0; i < results.size(); ++i) {
+      const Result& r = results.at(i);
+      std::fprintf(out, "%s,%s,%llu,%.2f,%.3f\n", label.constData(),
+		   r.name.constData(), (unsigned long long) r.ops,
+		   r.nsPerOp, r.allocsPerOp);
+    }
+    return;
+  }
+
+  std::fprintf(out, "corpus: %s (%d lines, %d bytes)\n",
+	       corpusName.constData(), c.lines.size(), c.stream.size());
+  if (!countingAllocations()) {
+    std::fprintf(out, "allocations not counted (needs glibc)\n");
+  }
+
+  std::fprintf(out, "\n%-24s %12s %10s %10s\n", "benchmark", "ops",
+	       "ns/op", "allocs/op");
+  for (int i = 0; i < results.size(); ++i) {
+    const Result& r = results.at(i);
+    std::fprintf(out, "%-24s %12llu %10.1f %10.2f\n", r.name.constData(),
+		 (unsigned long long) r.ops, r.nsPerOp, r.allocsPerOp);
+  }
+}
+
+
+/// \brief Print the usage
+///
+/// \return Exit code for wrong arguments
+static int usage(const char* name) {
+  std::fprintf(stderr, "usage: %s [--corpus <file>] [--filter <text>] "
+	       "[--min-time <ms>]\n  [--format text|json|csv] "
+	       "[--output <file>] [--label <text>] [--list]\n", name);
+  return 1;
+}
+
+
+int main(int argc, char** argv) {
+  QCoreApplication app(argc, argv);
+
+  QString corpusFile = QString::fromLocal8Bit(QIRC_BENCH_CORPUS);
+  QByteArray filter;
+  qint64 minTime = 500;
+  QByteArray format("text");
+  QString outputFile;
+  QByteArray label;
+  bool list = false;
+
+  const QStringList args = app.arguments();
+  for (int i = 1; i < args.size(); ++i) {
+    const QString& a = args.at(i);
+
+    if (a == "--list") {
+      list = true;
+      continue;
+    }
+
+    if (i + 1 >= args.size()) {
+      return usage(argv[0]);
+    }
+    const QString value = args.at(++i);
+
+    bool ok = true;
+    if (a == "--corpus") {
+      corpusFile = value;
+    } else if (a == "--filter") {
+      filter = value.toLocal8Bit();
+    } else if (a == "--min-time") {
+      minTime = value.toLongLong(&ok);
+    } else if (a == "--format") {
+      format = value.toLatin1();
+      ok = (format == "text" || format == "json" || format == "csv");
+    } else if (a == "--output") {
+      outputFile = value;
+    } else if (a == "--label") {
+      label = value.toLocal8Bit();
+    } else {
+      ok = false;
+    }
+
+    if (!ok || minTime < 0) {
+      return usage(argv[0]);
+    }
+  }
+
+  Corpus c;
+  if (!loadCorpus(corpusFile, &c.lines)) {
+    return 1;
+  }
+  if (c.lines.isEmpty()) {
+    std::fprintf(stderr, "%s: no lines\n", qPrintable(corpusFile));
+    return 1;
+  }
+
+  qInstallMsgHandler(quietMessageHandler);
+  prepareCorpus(c);
+
+  const QList<Benchmark> all = benchmarks(c);
+  if (list) {
+    for (int i = 0; i < all.size(); ++i) {
+      std::printf("%s\n", all.at(i).name.constData());
+    }
+    return 0;
+  }
+
+  QList<Result> results;
+  for (int i = 0; i < all.size(); ++i) {
+    if (all.at(i).name.contains(filter)) {
+      results.append(measure(all.at(i), c, minTime));
+    }
+  }
+  delete c.conn;
+
+  FILE* out = stdout;
+  if (!outputFile.isEmpty()) {
+    out = std::fopen(QFile::encodeName(outputFile).constData(), "w");
+    if (out == NULL) {
+      std::fprintf(stderr, "Unable to write %s\n", qPrintable(outputFile));
+      return 1;
+    }
+  }
+
+  report(out, format, label, corpusFile, c, results);
+
+  if (out != stdout) {
+    std::fclose(out);
+  }
+
+  return 0;
+}
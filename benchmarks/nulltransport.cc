@@ -0,0 +1,51 @@
+/// \file
+/// \brief Implementation of NullTransport class
+///
+/// \author png!das-system
+#include "nulltransport.h"
+
+
+NullTransport::NullTransport() :
+  m_open(false) {}
+
+
+/// \brief "Connect" right away
+void NullTransport::connectToHost(const QString&, quint16) {
+  m_open = true;
+  emit connected();
+}
+
+
+void NullTransport::disconnectFromHost() {
+  abort();
+}
+
+
+void NullTransport::abort() {
+  if (m_open) {
+    m_open = false;
+    emit disconnected();
+  }
+}
+
+
+bool NullTransport::isOpen() const {
+  return m_open;
+}
+
+
+/// \brief Nothing is ever received
+QByteArray NullTransport::readAll() {
+  return QByteArray();
+}
+
+
+/// \brief Discard data
+qint64 NullTransport::write(const QByteArray& data) {
+  return data.size();
+}
+
+
+QString NullTransport::errorString() const {
+  return QString();
+}
@@ -0,0 +1,31 @@
+/// \file
+/// \brief Declaration of NullTransport class
+///
+/// \author png!das-system
+#ifndef NULLTRANSPORT_H
+#define NULLTRANSPORT_H 1
+
+#include "Transport"
+
+/// \brief Transport that connects at once and discards all writes
+///
+/// Lets benchmarks feed data to a Connection that believes it's
+/// connected, without any sockets.
+class NullTransport : public QIRC::Transport {
+public:
+  NullTransport();
+
+  virtual void connectToHost(const QString& host, quint16 port);
+  virtual void disconnectFromHost();
+  virtual void abort();
+  virtual bool isOpen() const;
+  virtual QByteArray readAll();
+  virtual qint64 write(const QByteArray& data);
+  virtual QString errorString() const;
+
+protected:
+  /// \brief Set by connectToHost()
+  bool m_open;
+};
+
+#endif // !NULLTRANSPORT_H
@@ -0,0 +1,247 @@
+/// \file
+/// \brief Replays a recorded inbound byte stream through a Connection
+///
+/// Reads a recording made with TrafficRecorder (see
+/// Connection::setTrafficRecorder()) and feeds it to a Connection
+/// through Connection::feed(), i.e. through the same framing and
+/// parsing as data from a real server. Writes go to a transport that
+/// discards them.
+///
+/// Usage: replaybench <recording> [fast|paced] [repeat] [all|none]
+///
+/// fast (the default) feeds the chunks back to back, paced keeps the
+/// recorded timing. The recording is replayed repeat times (default 1).
+/// With all (the default) a RawMessage handler is registered, so every
+/// line is decoded as it would be for a client listening to everything;
+/// with none only what the connection handles itself is decoded.
+///
+/// Reports lines per second of parsing time, the number of heap
+/// allocations per line (glibc only) and the time per line broken down
+/// by command. The breakdown comes from a second, fast pass feeding
+/// one line at a time.
+///
+/// \author png!das-system
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+
+#include <QByteArray>
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QHash>
+#include <QList>
+#include <QPair>
+#include <QtAlgorithms>
+
+#include "Connection"
+#include "Histogram"
+#include "LineFramer"
+#include "TrafficReader"
+
+#include "alloccounter.h"
+#include "benchutil.h"
+#include "nulltransport.h"
+
+using namespace QIRC;
+
+
+/// \brief A recorded chunk
+struct Chunk {
+  /// \brief Time since the recording started in ns
+  qint64 time;
+
+  /// \brief Received data
+  QByteArray data;
+};
+
+
+/// \brief Time and allocations of the lines of one command
+struct CommandProfile {
+  CommandProfile() : allocations(0) {}
+
+  /// \brief Time per line in ns
+  Histogram time;
+
+  /// \brief Allocations of all lines
+  unsigned long long allocations;
+};
+
+
+/// \brief Sleep until clock reaches nsecs
+static void waitUntil(const QElapsedTimer& clock, qint64 nsecs) {
+  const qint64 remaining = nsecs - clock.nsecsElapsed();
+  if (remaining <= 0) {
+    return;
+  }
+
+  struct timespec ts;
+  ts.tv_sec = time_t(remaining / 1000000000);
+  ts.tv_nsec = long(remaining % 1000000000);
+  nanosleep(&ts, NULL);
+}
+
+
+/// \brief Create a connection that is connected to a NullTransport
+static Connection* createConnection(bool decodeAll) {
+  Connection* conn = new Connection();
+  conn->setTransport(new NullTransport());
+  conn->setRegistrationTimeout(0);
+  if (decodeAll) {
+    conn->on<RawMessage>(DecodeAll());
+  }
+  conn->connect();
+  conn->resetStatistics();
+
+  return conn;
+}
+
+
+int main(int argc, char** argv) {
+  QCoreApplication app(argc, argv);
+
+  const bool paced = (argc > 2 && std::strcmp(argv[2], "paced") == 0);
+  const int repeat = (argc > 3) ? std::atoi(argv[3]) : 1;
+  const bool decodeAll = (argc < 5 || std::strcmp(argv[4], "none") != 0);
+
+  if (argc < 2 || repeat <= 0) {
+    std::fprintf(stderr, "usage: %s <recording> [fast|paced] [repeat] "
+		 "[all|none]\n", argv[0]);
+    return 1;
+  }
+
+  // load everything first, so file I/O doesn't show up in the timing
+  TrafficReader reader;
+  if (!reader.open(QString::fromLocal8Bit(argv[1]))) {
+    return 1;
+  }
+
+  QList<Chunk> chunks;
+  qint64 bytes = 0;
+  Chunk chunk;
+  while (reader.next(&chunk.time, &chunk.data)) {
+    chunks.append(chunk);
+    bytes += chunk.data.size();
+  }
+  if (!reader.errorString().isEmpty()) {
+    return 1;
+  }
+
+  qInstallMsgHandler(quietMessageHandler);
+
+  // pass 1: chunks as they were received
+  Connection* conn = createConnection(decodeAll);
+
+  QElapsedTimer clock;
+  qint64 busy = 0;
+  const unsigned long long allocationsBefore = allocationCount();
+
+  clock.start();
+  for (int r = 0; r < repeat; ++r) {
+    const qint64 start = clock.nsecsElapsed();
+
+    for (int i = 0; i < chunks.size(); ++i) {
+      if (paced) {
+	waitUntil(clock, start + chunks.at(i).time);
+      }
+
+      const qint64 before = clock.nsecsElapsed();
+      conn->feed(chunks.at(i).data);
+      busy += clock.nsecsElapsed() - before;
+    }
+  }
+  const qint64 wall = clock.nsecsElapsed();
+
+  const unsigned long long passAllocations =
+    allocationCount() - allocationsBefore;
+  const ConnectionStatistics stats = conn->statistics();
+  delete conn;
+
+  // pass 2: one line at a time, by command
+  conn = createConnection(decodeAll);
+
+  QHash<QByteArray, CommandProfile> profiles;
+  LineFramer framer;
+  IrcMessage msg;
+
+  for (int i = 0; i < chunks.size(); ++i) {
+    if (framer.append(chunks.at(i).data) == 0) {
+      continue;
+    }
+
+    const QByteArray& buffer = framer.buffer();
+    const QVector<LineFramer::Line>& lines = framer.lines();
+
+    for (int l = 0; l < lines.size(); ++l) {
+      const LineFramer::Line& fl = lines.at(l);
+      const QByteArray line = buffer.mid(fl.offset, fl.length) + "\r\n";
+
+      QByteArray command = "(unparsable)";
+      if (msg.parse(buffer, fl.offset, fl.length) && msg.isValid()) {
+	command = QByteArray(msg.commandData(), msg.commandLength());
+      }
+
+      const unsigned long long a = allocationCount();
+      const qint64 before = clock.nsecsElapsed();
+      conn->feed(line);
+      const qint64 elapsed = clock.nsecsElapsed() - before;
+
+      CommandProfile& p = profiles[command];
+      p.time.record(quint64(elapsed));
+      p.allocations += allocationCount() - a;
+    }
+  }
+  delete conn;
+
+  // report
+  const double busySeconds = qMax(busy, qint64(1)) * 1e-9;
+  const quint64 lines = stats.linesIn;
+
+  std::printf("recording:     %s (%d chunks, %lld bytes, %.1f s)\n", argv[1],
+	      chunks.size(), (long long) bytes,
+	      chunks.isEmpty() ? 0.0 : chunks.last().time * 1e-9);
+  std::printf("mode:          %s, %d time(s), %s\n", paced ? "paced" : "fast",
+	      repeat, decodeAll ? "decoding all lines" : "decoding handled lines");
+  std::printf("lines:         %llu in %.1f ms busy, %.1f ms wall "
+	      "(%.0f lines/s)\n", (unsigned long long) lines,
+	      busySeconds * 1e3, wall * 1e-6, lines / busySeconds);
+  std::printf("parse time:    p50 %llu ns, p99 %llu ns per line\n",
+	      (unsigned long long) stats.parseTime.percentile(50),
+	      (unsigned long long) stats.parseTime.percentile(99));
+  if (countingAllocations()) {
+    std::printf("allocations:   %llu (%.2f per line)\n", passAllocations,
+		lines > 0 ? double(passAllocations) / lines : 0.0);
+  } else {
+    std::printf("allocations:   not counted (needs glibc)\n");
+  }
+  if (stats.parseFailures > 0) {
+    std::printf("failures:      %llu line(s) not understood\n",
+		(unsigned long long) stats.parseFailures);
+  }
+
+  // commands by total time, largest last
+  QList<QPair<quint64, QByteArray> > commands;
+  quint64 total = 0;
+  for (QHash<QByteArray, CommandProfile>::const_iterator it =
+	 profiles.constBegin(); it != profiles.constEnd(); ++it) {
+    commands.append(qMakePair(it.value().time.sum(), it.key()));
+    total += it.value().time.sum();
+  }
+  qSort(commands.begin(), commands.end());
+
+  std::printf("\n%-14s %10s %7s %9s %9s %9s %12s\n", "command", "lines",
+	      "time", "mean ns", "p50 ns", "p99 ns", "allocs/line");
+  for (int i = commands.size() - 1; i >= 0; --i) {
+    const CommandProfile& p = profiles[commands.at(i).second];
+    const quint64 n = p.time.count();
+
+    std::printf("%-14s %10llu %6.1f%% %9.0f %9llu %9llu %12.2f\n",
+		commands.at(i).second.constData(), (unsigned long long) n,
+		total > 0 ? 100.0 * p.time.sum() / total : 0.0, p.time.mean(),
+		(unsigned long long) p.time.percentile(50),
+		(unsigned long long) p.time.percentile(99),
+		double(p.allocations) / n);
+  }
+
+  return 0;
+}
@@ -0,0 +1,446 @@
+/// \file
+/// \brief Benchmark for many concurrent connections
+///
+/// Opens lots of Connections to a minimal IRC server running in a
+/// thread of the same process, waits until all of them are registered
+/// and then lets the server send a burst of PRIVMSGs to each of them.
+///
+/// Usage: transportbench [qt|epoll] [connections] [messages] [timeout]
+///
+/// Defaults are epoll, 10000 connections, 100 messages per connection
+/// and a timeout of 120 seconds. Both ends of every connection live in
+/// this process, so the file descriptor limit is raised to the hard
+/// limit; it has to be at least twice the number of connections.
+///
+/// Note that Qt's own event dispatcher uses select() when Qt isn't
+/// built with glib support, which limits the qt transport to about
+/// 500 connections.
+///
+/// \author png!das-system
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <QAtomicInt>
+#include <QByteArray>
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QList>
+#include <QThread>
+#include <QTimer>
+
+#include "Connection"
+#include "EpollTransport"
+
+using namespace QIRC;
+
+
+/// \brief Minimal IRC server for the benchmark
+///
+/// Runs its own epoll loop in a separate thread. Every client gets a
+/// 001 reply after its NICK; once all clients are registered, each of
+/// them is sent the configured number of PRIVMSGs.
+class BenchServer : public QThread {
+public:
+  BenchServer(int clients, int messages);
+  virtual ~BenchServer();
+
+  bool listen();
+  quint16 port() const;
+  void stop();
+
+protected:
+  /// \brief State of a connected client
+  struct Client {
+    /// \brief Socket descriptor
+    int fd;
+
+    /// \brief Received data without complete lines
+    QByteArray in;
+
+    /// \brief Data waiting to be sent
+    QByteArray out;
+
+    /// \brief Number of bytes of out already sent
+    int outOffset;
+
+    /// \brief Nickname from the NICK command
+    QByteArray nick;
+  };
+
+  virtual void run();
+
+  void acceptClients();
+  void readClient(Client* c);
+  void writeClient(Client* c);
+  void sendBurst();
+
+  /// \brief Number of clients to wait for
+  int m_clients;
+
+  /// \brief Number of PRIVMSGs sent to each client
+  int m_messages;
+
+  /// \brief Listening socket
+  int m_listenFd;
+
+  /// \brief epoll descriptor
+  int m_epoll;
+
+  /// \brief Port the server listens on
+  quint16 m_port;
+
+  /// \brief Number of clients that sent NICK
+  int m_registered;
+
+  /// \brief Set by stop()
+  QAtomicInt m_stop;
+
+  /// \brief Connected clients
+  QList<Client*> m_connected;
+};
+
+
+/// \brief Construct server for the given number of clients
+BenchServer::BenchServer(int clients, int messages) :
+  m_clients(clients), m_messages(messages), m_listenFd(-1), m_epoll(-1),
+  m_port(0), m_registered(0), m_stop(0) {}
+
+
+BenchServer::~BenchServer() {
+  for (int i = 0; i < m_connected.size(); ++i) {
+    ::close(m_connected.at(i)->fd);
+    delete m_connected.at(i);
+  }
+
+  if (m_listenFd >= 0) {
+    ::close(m_listenFd);
+  }
+  if (m_epoll >= 0) {
+    ::close(m_epoll);
+  }
+}
+
+
+/// \brief Listen on a free port of 127.0.0.1
+bool BenchServer::listen() {
+  m_listenFd = ::socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+  if (m_listenFd < 0) {
+    perror("socket");
+    return false;
+  }
+
+  struct sockaddr_in sin;
+  std::memset(&sin, 0, sizeof(sin));
+  sin.sin_family = AF_INET;
+  sin.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+  socklen_t length = sizeof(sin);
+  if (::bind(m_listenFd, reinterpret_cast<struct sockaddr*>(&sin),
+	     sizeof(sin)) < 0 ||
+      ::listen(m_listenFd, SOMAXCONN) < 0 ||
+      ::getsockname(m_listenFd, reinterpret_cast<struct sockaddr*>(&sin),
+		    &length) < 0) {
+    perror("bind/listen");
+    return false;
+  }
+  m_port = ntohs(sin.sin_port);
+
+  m_epoll = epoll_create1(EPOLL_CLOEXEC);
+  if (m_epoll < 0) {
+    perror("epoll_create1");
+    return false;
+  }
+
+  struct epoll_event ev;
+  ev.events = EPOLLIN;
+  ev.data.ptr = NULL;
+  return (epoll_ctl(m_epoll, EPOLL_CTL_ADD, m_listenFd, &ev) == 0);
+}
+
+
+/// \brief Port the server listens on
+quint16 BenchServer::port() const {
+  return m_port;
+}
+
+
+/// \brief Make run() return
+void BenchServer::stop() {
+  m_stop.fetchAndStoreOrdered(1);
+}
+
+
+/// \brief Server loop
+void BenchServer::run() {
+  struct epoll_event events[256];
+
+  while (int(m_stop) == 0) {
+    int n = epoll_wait(m_epoll, events, 256, 100);
+
+    for (int i = 0; i < n; ++i) {
+      Client* c = static_cast<Client*>(events[i].data.ptr);
+      if (c == NULL) {
+	acceptClients();
+	continue;
+      }
+
+      if ((events[i].events & EPOLLIN) != 0) {
+	readClient(c);
+      }
+      if ((events[i].events & EPOLLOUT) != 0) {
+	writeClient(c);
+      }
+    }
+  }
+}
+
+
+/// \brief Accept all pending connections
+void BenchServer::acceptClients() {
+  for (;;) {
+    int fd = ::accept4(m_listenFd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+    if (fd < 0) {
+      if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+	perror("accept4");
+      }
+      return;
+    }
+
+    Client* c = new Client;
+    c->fd = fd;
+    c->outOffset = 0;
+    m_connected.append(c);
+
+    struct epoll_event ev;
+    ev.events = EPOLLIN | EPOLLOUT | EPOLLET;
+    ev.data.ptr = c;
+    epoll_ctl(m_epoll, EPOLL_CTL_ADD, fd, &ev);
+  }
+}
+
+
+/// \brief Read commands of a client
+void BenchServer::readClient(Client* c) {
+  char buffer[4096];
+  ssize_t n;
+
+  while ((n = ::recv(c->fd, buffer, sizeof(buffer), 0)) > 0) {
+    c->in.append(buffer, n);
+  }
+
+  int start = 0;
+  int end;
+  while ((end = c->in.indexOf('\n', start)) >= 0) {
+    QByteArray line = c->in.mid(start, end - start).trimmed();
+    start = end + 1;
+
+    if (!line.startsWith("NICK ")) {
+      continue;
+    }
+
+    c->nick = line.mid(5);
+    c->out.append(":bench.local 001 " + c->nick + " :Welcome\r\n");
+    writeClient(c);
+
+    if (++m_registered == m_clients) {
+      sendBurst();
+    }
+  }
+  c->in.remove(0, start);
+}
+
+
+/// \brief Send as much pending data to a client as possible
+void BenchServer::writeClient(Client* c) {
+  while (c->outOffset < c->out.size()) {
+    ssize_t n = ::send(c->fd, c->out.constData() + c->outOffset,
+		       c->out.size() - c->outOffset, MSG_NOSIGNAL);
+    if (n <= 0) {
+      return;
+    }
+    c->outOffset += n;
+  }
+
+  c->out.clear();
+  c->outOffset = 0;
+}
+
+
+/// \brief Send the PRIVMSGs to all clients
+void BenchServer::sendBurst() {
+  for (int i = 0; i < m_connected.size(); ++i) {
+    Client* c = m_connected.at(i);
+
+    for (int j = 0; j < m_messages; ++j) {
+      c->out.append(":sender!user@bench.local PRIVMSG " + c->nick +
+		    " :benchmark message " + QByteArray::number(j) + "\r\n");
+    }
+    writeClient(c);
+  }
+}
+
+
+/// \brief Progress shared by the handlers of all connections
+struct BenchState {
+  /// \brief Number of connections
+  int connections;
+
+  /// \brief Number of PRIVMSGs expected in total
+  qint64 expected;
+
+  /// \brief Connections that received 001
+  int registered;
+
+  /// \brief PRIVMSGs received
+  qint64 received;
+
+  /// \brief Started before connecting
+  QElapsedTimer clock;
+
+  /// \brief Time at which all connections were registered (ms)
+  qint64 registeredAt;
+
+  /// \brief Time at which all PRIVMSGs were received (ms)
+  qint64 doneAt;
+};
+
+
+/// \brief Handler counting registrations
+struct CountWelcome {
+  BenchState* state;
+
+  void operator()(const RawMessage& e) const {
+    if (e.message.numeric() != 1) {
+      return;
+    }
+
+    if (++state->registered == state->connections) {
+      state->registeredAt = state->clock.elapsed();
+      if (state->expected == 0) {
+	QCoreApplication::quit();
+      }
+    }
+  }
+};
+
+
+/// \brief Handler counting PRIVMSGs
+struct CountPrivmsg {
+  BenchState* state;
+
+  void operator()(const Privmsg&) const {
+    if (++state->received == state->expected) {
+      state->doneAt = state->clock.elapsed();
+      QCoreApplication::quit();
+    }
+  }
+};
+
+
+/// \brief Raise the limit for open files as far as possible
+static void raiseFileLimit(rlim_t wanted) {
+  struct rlimit rl;
+  if (getrlimit(RLIMIT_NOFILE, &rl) != 0) {
+    return;
+  }
+
+  if (rl.rlim_cur < wanted) {
+    rl.rlim_cur = (rl.rlim_max == RLIM_INFINITY || rl.rlim_max >= wanted) ?
+      wanted : rl.rlim_max;
+    setrlimit(RLIMIT_NOFILE, &rl);
+  }
+
+  if (rl.rlim_cur < wanted) {
+    std::fprintf(stderr, "warning: only %lu file descriptors available, "
+		 "%lu needed\n", (unsigned long) rl.rlim_cur,
+		 (unsigned long) wanted);
+  }
+}
+
+
+int main(int argc, char** argv) {
+  QCoreApplication app(argc, argv);
+
+  bool epoll = (argc < 2 || std::strcmp(argv[1], "qt") != 0);
+  int connections = (argc > 2) ? std::atoi(argv[2]) : 10000;
+  int messages = (argc > 3) ? std::atoi(argv[3]) : 100;
+  int timeout = (argc > 4) ? std::atoi(argv[4]) : 120;
+
+  if (connections <= 0 || messages < 0 || timeout <= 0) {
+    std::fprintf(stderr, "usage: %s [qt|epoll] [connections] [messages] "
+		 "[timeout]\n", argv[0]);
+    return 1;
+  }
+
+  raiseFileLimit(2 * connections + 64);
+
+  BenchServer server(connections, messages);
+  if (!server.listen()) {
+    return 1;
+  }
+  server.start();
+
+  BenchState state;
+  state.connections = connections;
+  state.expected = qint64(connections) * messages;
+  state.registered = 0;
+  state.received = 0;
+  state.registeredAt = -1;
+  state.doneAt = -1;
+
+  CountWelcome countWelcome = { &state };
+  CountPrivmsg countPrivmsg = { &state };
+
+  QList<Connection*> clients;
+  for (int i = 0; i < connections; ++i) {
+    Connection* c = new Connection("127.0.0.1", server.port());
+    if (epoll) {
+      c->setTransport(new EpollTransport());
+    }
+    c->setNick(QString("bench%1").arg(i));
+    c->on<RawMessage>(countWelcome);
+    c->on<Privmsg>(countPrivmsg);
+    clients.append(c);
+  }
+
+  state.clock.start();
+  for (int i = 0; i < clients.size(); ++i) {
+    clients.at(i)->connect();
+  }
+
+  QTimer::singleShot(timeout * 1000, &app, SLOT(quit()));
+  app.exec();
+
+  server.stop();
+  server.wait();
+
+  std::printf("transport:     %s\n", epoll ? "epoll" : "qt");
+  std::printf("connections:   %d\n", connections);
+  std::printf("registered:    %d", state.registered);
+  if (state.registeredAt >= 0) {
+    std::printf(" in %lld ms", (long long) state.registeredAt);
+  }
+  std::printf("\nmessages:      %lld of %lld", (long long) state.received,
+	      (long long) state.expected);
+  if (state.doneAt >= 0 && state.expected > 0) {
+    qint64 ms = qMax(state.doneAt - state.registeredAt, qint64(1));
+    std::printf(" in %lld ms (%.0f messages/s)", (long long) ms,
+		state.expected * 1000.0 / ms);
+  }
+  std::printf("\n");
+
+  qDeleteAll(clients);
+
+  bool complete = (state.registered == connections &&
+		   state.received == state.expected);
+  return complete ? 0 : 1;
+}
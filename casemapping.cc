@@ -0,0 +1,68 @@
+#include "core/qirccore.h"
+
+#include "qirc.h"
+
+/// \brief Core case mapping with the same rules
+///
+/// QIRC::CaseMapping and QIRCCore::CaseMapping have the same values.
+static inline QIRCCore::CaseMapping coreMapping(QIRC::CaseMapping mapping) {
+  return static_cast<QIRCCore::CaseMapping>(mapping);
+}
+
+
+/// \brief Look up case mapping by its ISUPPORT name
+///
+/// Unknown names (e.g. "rfc7613") fall back to RFC1459 rules.
+QIRC::CaseMapping QIRC::caseMappingFromName(const QByteArray& name) {
+  return static_cast<CaseMapping>(
+    QIRCCore::caseMappingFromName(name.constData(), name.size()));
+}
+
+
+/// \brief Lower case a nick or channel name according to a case mapping
+QString QIRC::ircToLower(const QString& s, CaseMapping mapping) {
+  QString r(s);
+  QChar* d = r.data();
+
+  for (int i = 0; i < r.size(); ++i) {
+    ushort c = d[i].unicode();
+    if (c < 0x80) {
+      d[i] = QChar(ushort(QIRCCore::foldChar(c, coreMapping(mapping))));
+    }
+  }
+
+  return r;
+}
+
+
+/// \brief Lower case a UTF-8 encoded nick or channel name
+QByteArray QIRC::ircToLower(const QByteArray& s, CaseMapping mapping) {
+  QByteArray r(s);
+  QIRCCore::ircToLower(r.data(), r.size(), coreMapping(mapping));
+
+  return r;
+}
+
+
+/// \brief Compare two nicks or channel names according to a case mapping
+bool QIRC::ircEquals(const QString& a, const QString& b,
+		     CaseMapping mapping) {
+  if (a.size() != b.size())
+    return false;
+
+  const QChar* da = a.constData();
+  const QChar* db = b.constData();
+
+  for (int i = 0; i < a.size(); ++i) {
+    ushort ca = da[i].unicode();
+    ushort cb = db[i].unicode();
+    if (ca == cb)
+      continue;
+    if (ca >= 0x80 || cb >= 0x80 ||
+	QIRCCore::foldChar(ca, coreMapping(mapping)) !=
+	QIRCCore::foldChar(cb, coreMapping(mapping)))
+      return false;
+  }
+
+  return true;
+}
@@ -0,0 +1,841 @@
+/// \file
+/// \brief Implementation of ChannelStateTracker class
+///
+/// \author png!das-system
+#include "ChannelStateTracker"
+
+using namespace QIRC;
+
+
+/// \brief Construct empty member table
+ChannelStateTracker::MemberTable::MemberTable() :
+  m_size(0) {}
+
+
+/// \brief Number of members
+int ChannelStateTracker::MemberTable::size() const {
+  return m_size;
+}
+
+
+/// \brief Number of slots (for iteration with slot())
+int ChannelStateTracker::MemberTable::capacity() const {
+  return m_slots.size();
+}
+
+
+/// \brief Raw slot value (0 for empty slots)
+quint32 ChannelStateTracker::MemberTable::slot(int i) const {
+  return m_slots.at(i);
+}
+
+
+/// \brief User id stored in a non-empty slot
+int ChannelStateTracker::MemberTable::slotId(quint32 slot) {
+  return static_cast<int>(slot >> 8) - 1;
+}
+
+
+/// \brief Prefix mode bits stored in a non-empty slot
+quint8 ChannelStateTracker::MemberTable::slotModes(quint32 slot) {
+  return static_cast<quint8>(slot & 0xff);
+}
+
+
+/// \brief Preferred slot for a user id
+int ChannelStateTracker::MemberTable::home(int id) const {
+  // Fibonacci hashing; capacity is always a power of two
+  return static_cast<int>((static_cast<quint32>(id) * 2654435769u) &
+			  (m_slots.size() - 1));
+}
+
+
+/// \brief Slot holding the given user id or -1
+int ChannelStateTracker::MemberTable::find(int id) const {
+  if (m_size == 0)
+    return -1;
+
+  const int mask = m_slots.size() - 1;
+  const quint32* table = m_slots.constData();
+
+  for (int i = home(id); table[i] != 0; i = (i + 1) & mask) {
+    if (slotId(table[i]) == id)
+      return i;
+  }
+
+  return -1;
+}
+
+
+/// \brief Is the user a member?
+bool ChannelStateTracker::MemberTable::contains(int id) const {
+  return (find(id) >= 0);
+}
+
+
+/// \brief Prefix mode bits of a member (0 if not a member)
+quint8 ChannelStateTracker::MemberTable::modes(int id) const {
+  int i = find(id);
+  return (i < 0) ? 0 : slotModes(m_slots.at(i));
+}
+
+
+/// \brief Add a member or update its prefix modes
+void ChannelStateTracker::MemberTable::insert(int id, quint8 modes) {
+  quint32 value = (static_cast<quint32>(id + 1) << 8) | modes;
+
+  int i = find(id);
+  if (i >= 0) {
+    m_slots[i] = value;
+    return;
+  }
+
+  // keep the load factor below 3/4
+  if ((m_size + 1) * 4 > m_slots.size() * 3)
+    rehash(qMax(8, m_slots.size() * 2));
+
+  const int mask = m_slots.size() - 1;
+  quint32* table = m_slots.data();
+  for (i = home(id); table[i] != 0; i = (i + 1) & mask)
+    ;
+
+  table[i] = value;
+  ++m_size;
+}
+
+
+/// \brief Remove a member
+///
+/// Uses backward shift deletion, so the table never accumulates
+/// tombstones.
+///
+/// \return true if the user was a member
+bool ChannelStateTracker::MemberTable::remove(int id) {
+  int i = find(id);
+  if (i < 0)
+    return false;
+
+  const int mask = m_slots.size() - 1;
+  quint32* table = m_slots.data();
+  int j = i;
+
+  for (;;) {
+    j = (j + 1) & mask;
+    if (table[j] == 0)
+      break;
+
+    // move the entry at j into the hole at i unless its home slot
+    // lies cyclically in (i, j]
+    int k = home(slotId(table[j]));
+    bool stays = (i <= j) ? (i < k && k <= j) : (i < k || k <= j);
+    if (!stays) {
+      table[i] = table[j];
+      i = j;
+    }
+  }
+
+  table[i] = 0;
+  --m_size;
+
+  // give memory back after mass parts/quits
+  if (m_slots.size() > 16 && m_size * 8 < m_slots.size())
+    rehash(m_slots.size() / 2);
+
+  return true;
+}
+
+
+/// \brief Remove all members
+void ChannelStateTracker::MemberTable::clear() {
+  m_slots.clear();
+  m_size = 0;
+}
+
+
+/// \brief Resize the table to the given (power of two) capacity
+void ChannelStateTracker::MemberTable::rehash(int capacity) {
+  QVector<quint32> old = m_slots;
+  m_slots = QVector<quint32>(capacity, 0);
+
+  const int mask = capacity - 1;
+  quint32* table = m_slots.data();
+
+  for (int j = 0; j < old.size(); ++j) {
+    if (old.at(j) == 0)
+      continue;
+
+    int i = home(slotId(old.at(j)));
+    while (table[i] != 0)
+      i = (i + 1) & mask;
+    table[i] = old.at(j);
+  }
+}
+
+
+/// \brief Construct empty tracker
+///
+/// Prefix and channel modes default to the RFC1459 set until the server
+/// announces its own with ISUPPORT (005).
+ChannelStateTracker::ChannelStateTracker() :
+  m_caseMapping(Rfc1459CaseMapping),
+  m_prefixModes("ov"), m_prefixSymbols("@+"),
+  m_paramModes("beIk"), m_setParamModes("l") {}
+
+
+ChannelStateTracker::~ChannelStateTracker() {
+  clear();
+}
+
+
+/// \brief Forget all channels and users
+void ChannelStateTracker::clear() {
+  for (int i = 0; i < m_channels.size(); ++i) {
+    delete m_channels.at(i);
+  }
+
+  m_channels.clear();
+  m_channelIndex.clear();
+  m_users.clear();
+  m_freeUsers.clear();
+  m_userIndex.clear();
+}
+
+
+/// \brief Case mapping used to compare nicks and channel names
+CaseMapping ChannelStateTracker::caseMapping() const {
+  return m_caseMapping;
+}
+
+
+/// \brief Set case mapping used to compare nicks and channel names
+void ChannelStateTracker::setCaseMapping(CaseMapping mapping) {
+  if (mapping != m_caseMapping) {
+    m_caseMapping = mapping;
+    rebuildIndex();
+  }
+}
+
+
+/// \brief Prefix modes in ISUPPORT notation, e.g. "(ov)@+"
+QString ChannelStateTracker::prefixModes() const {
+  return "(" + m_prefixModes + ")" + m_prefixSymbols;
+}
+
+
+/// \brief Set prefix modes from ISUPPORT notation, e.g. "(qaohv)~&@%+"
+///
+/// At most 8 prefix modes are tracked.
+void ChannelStateTracker::setPrefixModes(const QString& prefix) {
+  int close = prefix.indexOf(QChar(')'));
+  if (!prefix.startsWith(QChar('(')) || close < 0)
+    return;
+
+  QString modes = prefix.mid(1, close - 1);
+  QString symbols = prefix.mid(close + 1);
+  if (modes.size() != symbols.size())
+    return;
+
+  m_prefixModes = modes.left(8);
+  m_prefixSymbols = symbols.left(8);
+}
+
+
+/// \brief Channel modes in ISUPPORT notation, e.g. "beI,k,l,imnpst"
+QString ChannelStateTracker::channelModes() const {
+  return m_paramModes + "," + m_setParamModes;
+}
+
+
+/// \brief Set channel modes from ISUPPORT CHANMODES notation
+///
+/// Only the first three groups matter: modes of type A and B always
+/// take a parameter, modes of type C only when they're set.
+void ChannelStateTracker::setChannelModes(const QString& modes) {
+  QStringList groups = modes.split(QChar(','));
+  if (groups.size() < 3)
+    return;
+
+  m_paramModes = groups.at(0) + groups.at(1);
+  m_setParamModes = groups.at(2);
+}
+
+
+/// \brief Update state from a received message
+///
+/// \param msg Message received from the server
+/// \param ownNick Our nickname at the time the message was received
+void ChannelStateTracker::processMessage(const IrcMessage& msg,
+					 const QString& ownNick) {
+  if (msg.isNumeric()) {
+    switch (msg.numeric()) {
+    case 1:
+      // RPL_WELCOME: new session
+      clear();
+      break;
+
+    case 5:
+      handleISupport(msg);
+      break;
+
+    case 332: {
+      // RPL_TOPIC: <target> <channel> :<topic>
+      int id = findChannel(msg.param(1));
+      if (id >= 0 && msg.paramCount() >= 3)
+	m_channels.at(id)->topic = msg.param(2);
+      break;
+    }
+
+    case 353:
+      handleNames(msg);
+      break;
+
+    case 366: {
+      // RPL_ENDOFNAMES: <target> <channel> :End of /NAMES list
+      int id = findChannel(msg.param(1));
+      if (id >= 0) {
+	m_channels.at(id)->receivingNames = false;
+	m_channels.at(id)->complete = true;
+      }
+      break;
+    }
+
+    default:
+      break;
+    }
+
+    return;
+  }
+
+  if (msg.isCommand("JOIN")) {
+    handleJoin(msg, ownNick);
+  } else if (msg.isCommand("PART")) {
+    handlePart(msg, ownNick);
+  } else if (msg.isCommand("QUIT")) {
+    handleQuit(msg);
+  } else if (msg.isCommand("NICK")) {
+    handleNick(msg);
+  } else if (msg.isCommand("MODE")) {
+    handleMode(msg);
+  } else if (msg.isCommand("KICK")) {
+    handleKick(msg, ownNick);
+  } else if (msg.isCommand("TOPIC")) {
+    int id = findChannel(msg.param(0));
+    if (id >= 0 && msg.paramCount() >= 2)
+      m_channels.at(id)->topic = msg.param(1);
+  }
+}
+
+
+/// \brief Id of the user with the given nick or -1
+int ChannelStateTracker::findUser(const QString& nick) const {
+  return m_userIndex.value(ircToLower(nick, m_caseMapping), -1);
+}
+
+
+/// \brief Id of the channel with the given name or -1
+int ChannelStateTracker::findChannel(const QString& channel) const {
+  return m_channelIndex.value(ircToLower(channel, m_caseMapping), -1);
+}
+
+
+/// \brief Id of the user with the given nick, adding them if necessary
+int ChannelStateTracker::addUser(const QString& nick) {
+  QString key = ircToLower(nick, m_caseMapping);
+  int id = m_userIndex.value(key, -1);
+  if (id >= 0)
+    return id;
+
+  if (!m_freeUsers.isEmpty()) {
+    id = m_freeUsers.last();
+    m_freeUsers.remove(m_freeUsers.size() - 1);
+  } else {
+    id = m_users.size();
+    m_users.append(User());
+  }
+
+  m_users[id].nick = nick;
+  m_userIndex.insert(key, id);
+
+  return id;
+}
+
+
+/// \brief Forget a user that is on none of our channels anymore
+void ChannelStateTracker::releaseUser(int id) {
+  User& u = m_users[id];
+
+  m_userIndex.remove(ircToLower(u.nick.toString(), m_caseMapping));
+  u.nick = PooledString();
+  u.user = PooledString();
+  u.host = PooledString();
+  u.channels.clear();
+  m_freeUsers.append(id);
+}
+
+
+/// \brief Id of the channel with the given name, adding it if necessary
+int ChannelStateTracker::addChannel(const QString& name) {
+  QString key = ircToLower(name, m_caseMapping);
+  int id = m_channelIndex.value(key, -1);
+  if (id >= 0)
+    return id;
+
+  Channel* c = new Channel;
+  c->name = name;
+  c->receivingNames = false;
+  c->complete = false;
+
+  id = m_channels.indexOf(NULL);
+  if (id < 0) {
+    id = m_channels.size();
+    m_channels.append(c);
+  } else {
+    m_channels[id] = c;
+  }
+
+  m_channelIndex.insert(key, id);
+
+  return id;
+}
+
+
+/// \brief Forget a channel (after we left it)
+void ChannelStateTracker::removeChannel(int id) {
+  clearMembers(id);
+
+  m_channelIndex.remove(ircToLower(m_channels.at(id)->name, m_caseMapping));
+  delete m_channels.at(id);
+  m_channels[id] = NULL;
+}
+
+
+/// \brief Add a user to a channel or update their prefix modes
+void ChannelStateTracker::addMember(int channel, int user, quint8 modes) {
+  MemberTable& members = m_channels.at(channel)->members;
+
+  if (!members.contains(user))
+    m_users[user].channels.append(channel);
+
+  members.insert(user, modes);
+}
+
+
+/// \brief Remove a user from a channel
+///
+/// Users that aren't on any of our channels anymore are forgotten.
+void ChannelStateTracker::removeMember(int channel, int user) {
+  if (!m_channels.at(channel)->members.remove(user))
+    return;
+
+  QVector<int>& channels = m_users[user].channels;
+  int i = channels.indexOf(channel);
+  if (i >= 0) {
+    channels[i] = channels.last();
+    channels.remove(channels.size() - 1);
+  }
+
+  if (channels.isEmpty())
+    releaseUser(user);
+}
+
+
+/// \brief Remove all members of a channel
+void ChannelStateTracker::clearMembers(int channel) {
+  MemberTable& members = m_channels.at(channel)->members;
+
+  for (int i = 0; i < members.capacity(); ++i) {
+    quint32 slot = members.slot(i);
+    if (slot == 0)
+      continue;
+
+    int user = MemberTable::slotId(slot);
+    QVector<int>& channels = m_users[user].channels;
+    int j = channels.indexOf(channel);
+    if (j >= 0) {
+      channels[j] = channels.last();
+      channels.remove(channels.size() - 1);
+    }
+
+    if (channels.isEmpty())
+      releaseUser(user);
+  }
+
+  members.clear();
+}
+
+
+/// \brief Recreate the lookup tables after the case mapping changed
+void ChannelStateTracker::rebuildIndex() {
+  m_userIndex.clear();
+  for (int i = 0; i < m_users.size(); ++i) {
+    if (!m_users.at(i).nick.isEmpty())
+      m_userIndex.insert(ircToLower(m_users.at(i).nick.toString(),
+				    m_caseMapping), i);
+  }
+
+  m_channelIndex.clear();
+  for (int i = 0; i < m_channels.size(); ++i) {
+    if (m_channels.at(i) != NULL)
+      m_channelIndex.insert(ircToLower(m_channels.at(i)->name,
+				       m_caseMapping), i);
+  }
+}
+
+
+/// \brief Handle JOIN: track new channel or add member
+void ChannelStateTracker::handleJoin(const IrcMessage& msg,
+				     const QString& ownNick) {
+  if (msg.paramCount() < 1 || !msg.hasPrefix())
+    return;
+
+  HostMask sender = msg.sender();
+  QString channel = msg.param(0);
+
+  if (ircEquals(sender.nick(), ownNick, m_caseMapping)) {
+    int id = findChannel(channel);
+    if (id >= 0)
+      removeChannel(id);
+    id = addChannel(channel);
+    addMember(id, addUser(sender.nick()), 0);
+    return;
+  }
+
+  int id = findChannel(channel);
+  if (id < 0)
+    return;
+
+  int user = addUser(sender.nick());
+  m_users[user].user = sender.pooledUser();
+  m_users[user].host = sender.pooledHost();
+  addMember(id, user, 0);
+}
+
+
+/// \brief Handle PART: forget channel or remove member
+void ChannelStateTracker::handlePart(const IrcMessage& msg,
+				     const QString& ownNick) {
+  if (msg.paramCount() < 1 || !msg.hasPrefix())
+    return;
+
+  QString nick = msg.senderNick();
+  QStringList channels = msg.param(0).split(QChar(','));
+
+  for (int i = 0; i < channels.size(); ++i) {
+    int id = findChannel(channels.at(i));
+    if (id < 0)
+      continue;
+
+    if (ircEquals(nick, ownNick, m_caseMapping)) {
+      removeChannel(id);
+    } else {
+      int user = findUser(nick);
+      if (user >= 0)
+	removeMember(id, user);
+    }
+  }
+}
+
+
+/// \brief Handle KICK: forget channel or remove member
+void ChannelStateTracker::handleKick(const IrcMessage& msg,
+				     const QString& ownNick) {
+  // KICK <channel> <nick> [:<reason>]
+  if (msg.paramCount() < 2)
+    return;
+
+  int id = findChannel(msg.param(0));
+  if (id < 0)
+    return;
+
+  QString victim = msg.param(1);
+  if (ircEquals(victim, ownNick, m_caseMapping)) {
+    removeChannel(id);
+    return;
+  }
+
+  int user = findUser(victim);
+  if (user >= 0)
+    removeMember(id, user);
+}
+
+
+/// \brief Handle QUIT: remove user from all channels
+void ChannelStateTracker::handleQuit(const IrcMessage& msg) {
+  int user = findUser(msg.senderNick());
+  if (user < 0)
+    return;
+
+  // removeMember() changes the user's channel list
+  QVector<int> channels = m_users.at(user).channels;
+  for (int i = 0; i < channels.size(); ++i) {
+    removeMember(channels.at(i), user);
+  }
+}
+
+
+/// \brief Handle NICK: rename user
+///
+/// Channels only store user ids, so this doesn't touch any channel.
+void ChannelStateTracker::handleNick(const IrcMessage& msg) {
+  if (msg.paramCount() < 1)
+    return;
+
+  int user = findUser(msg.senderNick());
+  if (user < 0)
+    return;
+
+  QString newNick = msg.param(0);
+  m_userIndex.remove(ircToLower(m_users.at(user).nick.toString(),
+				m_caseMapping));
+  m_userIndex.insert(ircToLower(newNick, m_caseMapping), user);
+  m_users[user].nick = newNick;
+}
+
+
+/// \brief Handle MODE: update prefix modes of channel members
+void ChannelStateTracker::handleMode(const IrcMessage& msg) {
+  // MODE <channel> <modes> [<param>...]
+  if (msg.paramCount() < 2)
+    return;
+
+  int id = findChannel(msg.param(0));
+  if (id < 0)
+    return;
+
+  QString modes = msg.param(1);
+  int arg = 2;
+  bool adding = true;
+
+  for (int i = 0; i < modes.size(); ++i) {
+    QChar m = modes.at(i);
+
+    if (m == QChar('+')) {
+      adding = true;
+    } else if (m == QChar('-')) {
+      adding = false;
+    } else if (m_prefixModes.contains(m)) {
+      if (arg >= msg.paramCount())
+	break;
+
+      int user = findUser(msg.param(arg++));
+      if (user < 0 || !m_channels.at(id)->members.contains(user))
+	continue;
+
+      quint8 bit = 1 << m_prefixModes.indexOf(m);
+      quint8 bits = m_channels.at(id)->members.modes(user);
+      bits = adding ? (bits | bit) : (bits & ~bit);
+      m_channels.at(id)->members.insert(user, bits);
+    } else if (m_paramModes.contains(m) ||
+	       (adding && m_setParamModes.contains(m))) {
+      // skip the parameter of non-prefix modes
+      ++arg;
+    }
+  }
+}
+
+
+/// \brief Handle RPL_NAMREPLY (353)
+///
+/// The first reply of a NAMES burst replaces the channel's roster.
+/// Supports multi-prefix and userhost-in-names entries.
+void ChannelStateTracker::handleNames(const IrcMessage& msg) {
+  // RFC2812: <target> <symbol> <channel> :<names>
+  // RFC1459: <target> <channel> :<names>
+  if (msg.paramCount() < 3)
+    return;
+
+  int id = findChannel(msg.param(msg.paramCount() - 2));
+  if (id < 0)
+    return;
+
+  Channel* c = m_channels.at(id);
+  if (!c->receivingNames) {
+    clearMembers(id);
+    c->receivingNames = true;
+    c->complete = false;
+  }
+
+  QStringList names = msg.param(msg.paramCount() - 1)
+    .split(QChar(' '), QString::SkipEmptyParts);
+
+  for (int i = 0; i < names.size(); ++i) {
+    const QString& entry = names.at(i);
+    quint8 bits = 0;
+    int pos = 0;
+
+    while (pos < entry.size()) {
+      int rank = m_prefixSymbols.indexOf(entry.at(pos));
+      if (rank < 0)
+	break;
+      bits |= 1 << rank;
+      ++pos;
+    }
+
+    QString nick = entry.mid(pos);
+    int bang = nick.indexOf(QChar('!'));
+    int at = nick.indexOf(QChar('@'), bang + 1);
+    QString user, host;
+    if (bang > 0 && at > bang) {
+      user = nick.mid(bang + 1, at - bang - 1);
+      host = nick.mid(at + 1);
+      nick = nick.left(bang);
+    }
+
+    if (nick.isEmpty())
+      continue;
+
+    int uid = addUser(nick);
+    if (!host.isEmpty()) {
+      m_users[uid].user = user;
+      m_users[uid].host = host;
+    }
+    addMember(id, uid, bits);
+  }
+}
+
+
+/// \brief Handle RPL_ISUPPORT (005)
+void ChannelStateTracker::handleISupport(const IrcMessage& msg) {
+  for (int i = 1; i < msg.paramCount() - 1; ++i) {
+    QString token = msg.param(i);
+
+    if (token.startsWith("PREFIX=")) {
+      setPrefixModes(token.mid(7));
+    } else if (token.startsWith("CHANMODES=")) {
+      setChannelModes(token.mid(10));
+    } else if (token.startsWith("CASEMAPPING=")) {
+      setCaseMapping(caseMappingFromName(token.mid(12).toUtf8()));
+    }
+  }
+}
+
+
+/// \brief Names of all channels we're on
+QStringList ChannelStateTracker::channels() const {
+  QStringList r;
+  for (int i = 0; i < m_channels.size(); ++i) {
+    if (m_channels.at(i) != NULL)
+      r.append(m_channels.at(i)->name);
+  }
+
+  return r;
+}
+
+
+/// \brief Are we on the given channel?
+bool ChannelStateTracker::hasChannel(const QString& channel) const {
+  return (findChannel(channel) >= 0);
+}
+
+
+/// \brief Has a complete NAMES reply been received for the channel?
+bool ChannelStateTracker::hasCompleteNames(const QString& channel) const {
+  int id = findChannel(channel);
+  return (id >= 0 && m_channels.at(id)->complete);
+}
+
+
+/// \brief Current topic of a channel
+QString ChannelStateTracker::topic(const QString& channel) const {
+  int id = findChannel(channel);
+  return (id >= 0) ? m_channels.at(id)->topic : QString();
+}
+
+
+/// \brief Number of members of a channel
+int ChannelStateTracker::memberCount(const QString& channel) const {
+  int id = findChannel(channel);
+  return (id >= 0) ? m_channels.at(id)->members.size() : 0;
+}
+
+
+/// \brief Nicknames of all members of a channel
+QStringList ChannelStateTracker::members(const QString& channel) const {
+  QStringList r;
+  int id = findChannel(channel);
+  if (id < 0)
+    return r;
+
+  const MemberTable& members = m_channels.at(id)->members;
+  for (int i = 0; i < members.capacity(); ++i) {
+    if (members.slot(i) != 0)
+      r.append(m_users.at(MemberTable::slotId(members.slot(i))).nick
+	       .toString());
+  }
+
+  return r;
+}
+
+
+/// \brief Is the user on the given channel?
+bool ChannelStateTracker::isMember(const QString& channel,
+				   const QString& nick) const {
+  int id = findChannel(channel);
+  int user = findUser(nick);
+
+  return (id >= 0 && user >= 0 && m_channels.at(id)->members.contains(user));
+}
+
+
+/// \brief Highest ranked prefix symbol of a member (e.g. "@"), if any
+QString ChannelStateTracker::memberPrefix(const QString& channel,
+					  const QString& nick) const {
+  int id = findChannel(channel);
+  int user = findUser(nick);
+  if (id < 0 || user < 0)
+    return QString();
+
+  quint8 bits = m_channels.at(id)->members.modes(user);
+  for (int i = 0; i < m_prefixSymbols.size(); ++i) {
+    if (bits & (1 << i))
+      return QString(m_prefixSymbols.at(i));
+  }
+
+  return QString();
+}
+
+
+/// \brief Does a member have the given prefix mode (e.g. 'o')?
+bool ChannelStateTracker::hasMemberMode(const QString& channel,
+					const QString& nick, QChar mode) const {
+  int rank = m_prefixModes.indexOf(mode);
+  int id = findChannel(channel);
+  int user = findUser(nick);
+  if (rank < 0 || id < 0 || user < 0)
+    return false;
+
+  return ((m_channels.at(id)->members.modes(user) & (1 << rank)) != 0);
+}
+
+
+/// \brief Number of distinct users on all our channels
+int ChannelStateTracker::userCount() const {
+  return m_userIndex.size();
+}
+
+
+/// \brief Names of our channels the user is on
+QStringList ChannelStateTracker::channelsOf(const QString& nick) const {
+  QStringList r;
+  int user = findUser(nick);
+  if (user < 0)
+    return r;
+
+  const QVector<int>& channels = m_users.at(user).channels;
+  for (int i = 0; i < channels.size(); ++i) {
+    r.append(m_channels.at(channels.at(i))->name);
+  }
+
+  return r;
+}
+
+
+/// \brief Host mask of a user, as far as it is known
+HostMask ChannelStateTracker::userHostMask(const QString& nick) const {
+  int user = findUser(nick);
+  if (user < 0)
+    return HostMask(nick, "", "");
+
+  const User& u = m_users.at(user);
+  return HostMask(u.nick, u.user, u.host);
+}
@@ -0,0 +1,186 @@
+/// \file
+/// \brief Declaration of ChannelStateTracker class
+///
+/// \author png!das-system
+#ifndef CHANNELSTATETRACKER_H
+#define CHANNELSTATETRACKER_H 1
+
+#include <QHash>
+#include <QString>
+#include <QStringList>
+#include <QVector>
+
+#include "HostMask"
+#include "IrcMessage"
+
+#include "qirc.h"
+
+namespace QIRC {
+  /// \brief Keeps track of the channels we're on and their members
+  ///
+  /// The tracker is fed every message received by a Connection (see
+  /// Connection::setChannelStateTracker()). It builds channel rosters
+  /// from NAMES replies (353/366) and keeps them up to date with JOIN,
+  /// PART, KICK, QUIT, NICK and MODE messages, so applications don't
+  /// have to re-request NAMES to know who is on a channel.
+  ///
+  /// Every user is stored once, no matter how many channels they share
+  /// with us; channels only store small integer user ids together with
+  /// the user's prefix modes (op, voice, ...). Joins, parts, nick
+  /// changes and mode changes therefore take constant time even on
+  /// channels with tens of thousands of members.
+  class ChannelStateTracker {
+  public:
+    ChannelStateTracker();
+    ~ChannelStateTracker();
+
+    void processMessage(const IrcMessage& msg, const QString& ownNick);
+    void clear();
+
+    CaseMapping caseMapping() const;
+    void setCaseMapping(CaseMapping mapping);
+
+    QString prefixModes() const;
+    void setPrefixModes(const QString& prefix);
+
+    QString channelModes() const;
+    void setChannelModes(const QString& modes);
+
+    QStringList channels() const;
+    bool hasChannel(const QString& channel) const;
+    bool hasCompleteNames(const QString& channel) const;
+    QString topic(const QString& channel) const;
+
+    int memberCount(const QString& channel) const;
+    QStringList members(const QString& channel) const;
+    bool isMember(const QString& channel, const QString& nick) const;
+    QString memberPrefix(const QString& channel, const QString& nick) const;
+    bool hasMemberMode(const QString& channel, const QString& nick,
+		       QChar mode) const;
+
+    int userCount() const;
+    QStringList channelsOf(const QString& nick) const;
+    HostMask userHostMask(const QString& nick) const;
+
+  protected:
+    /// \brief Set of channel members with their prefix modes
+    ///
+    /// Open addressing hash table with linear probing. Every slot is a
+    /// single 32 bit word holding the user id (plus one, so 0 marks an
+    /// empty slot) in the upper 24 bits and the prefix mode bits in the
+    /// lower 8 bits.
+    class MemberTable {
+    public:
+      MemberTable();
+
+      int size() const;
+      bool contains(int id) const;
+      quint8 modes(int id) const;
+      void insert(int id, quint8 modes);
+      bool remove(int id);
+      void clear();
+
+      int capacity() const;
+      quint32 slot(int i) const;
+
+      static int slotId(quint32 slot);
+      static quint8 slotModes(quint32 slot);
+
+    protected:
+      /// \brief Hash table slots, 0 for empty
+      QVector<quint32> m_slots;
+
+      /// \brief Number of used slots
+      int m_size;
+
+      int find(int id) const;
+      int home(int id) const;
+      void rehash(int capacity);
+    };
+
+    /// \brief A user on at least one of our channels
+    struct User {
+      /// \brief Current nickname
+      PooledString nick;
+
+      /// \brief Username, if known
+      PooledString user;
+
+      /// \brief Hostname, if known
+      PooledString host;
+
+      /// \brief Ids of the channels the user is on
+      QVector<int> channels;
+    };
+
+    /// \brief A channel we're on
+    struct Channel {
+      /// \brief Channel name
+      QString name;
+
+      /// \brief Current topic
+      QString topic;
+
+      /// \brief Members of the channel
+      MemberTable members;
+
+      /// \brief Flag indicating that a NAMES reply is being received
+      bool receivingNames;
+
+      /// \brief Flag indicating that a complete NAMES reply was received
+      bool complete;
+    };
+
+    /// \brief Users by id; unused entries have an empty nick
+    QVector<User> m_users;
+
+    /// \brief Ids of unused entries in m_users
+    QVector<int> m_freeUsers;
+
+    /// \brief Lookup of user ids by case-folded nick
+    QHash<QString, int> m_userIndex;
+
+    /// \brief Channels by id; unused entries are NULL
+    QVector<Channel*> m_channels;
+
+    /// \brief Lookup of channel ids by case-folded name
+    QHash<QString, int> m_channelIndex;
+
+    /// \brief Case mapping used for the lookups
+    CaseMapping m_caseMapping;
+
+    /// \brief Prefix mode letters, highest rank first (e.g. "ov")
+    QString m_prefixModes;
+
+    /// \brief Prefix symbols matching m_prefixModes (e.g. "@+")
+    QString m_prefixSymbols;
+
+    /// \brief Channel modes that always take a parameter (types A and B)
+    QString m_paramModes;
+
+    /// \brief Channel modes that take a parameter when set (type C)
+    QString m_setParamModes;
+
+    int findUser(const QString& nick) const;
+    int findChannel(const QString& channel) const;
+    int addUser(const QString& nick);
+    void releaseUser(int id);
+    int addChannel(const QString& name);
+    void removeChannel(int id);
+    void addMember(int channel, int user, quint8 modes);
+    void removeMember(int channel, int user);
+    void clearMembers(int channel);
+    void rebuildIndex();
+
+    void handleJoin(const IrcMessage& msg, const QString& ownNick);
+    void handlePart(const IrcMessage& msg, const QString& ownNick);
+    void handleKick(const IrcMessage& msg, const QString& ownNick);
+    void handleQuit(const IrcMessage& msg);
+    void handleNick(const IrcMessage& msg);
+    void handleMode(const IrcMessage& msg);
+    void handleNames(const IrcMessage& msg);
+    void handleISupport(const IrcMessage& msg);
+  };
+};
+
+#endif // !CHANNELSTATETRACKER_H
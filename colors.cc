@@ -1,21 +1,363 @@
-#include <QRegExp>
+#include <cstring>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
 
 #include "qirc.h"
 
-/// \brief Remove mIRC color codes from message
+using QIRC::FormatSpan;
+
+namespace {
+  /// \brief Formatting control codes
+  enum Code {
+    NoCode = 0,
+    BoldCode,
+    ColorCode,
+    HexColorCode,
+    ResetCode,
+    MonospaceCode,
+    ReverseCode,
+    ItalicCode,
+    StrikethroughCode,
+    UnderlineCode
+  };
+
+  /// \brief Control code for each character below 0x20
+  const unsigned char codeTable[32] = {
+    NoCode, NoCode, BoldCode, ColorCode,                      // 00-03
+    HexColorCode, NoCode, NoCode, NoCode,                     // 04-07
+    NoCode, NoCode, NoCode, NoCode,                           // 08-0b
+    NoCode, NoCode, NoCode, ResetCode,                        // 0c-0f
+    NoCode, MonospaceCode, NoCode, NoCode,                    // 10-13
+    NoCode, NoCode, ReverseCode, NoCode,                      // 14-17
+    NoCode, NoCode, NoCode, NoCode,                           // 18-1b
+    NoCode, ItalicCode, StrikethroughCode, UnderlineCode      // 1c-1f
+  };
+
+  /// \brief Attribute toggled by a code (0 for codes that aren't toggles)
+  const int codeFlags[] = {
+    0, FormatSpan::Bold, 0, 0, 0, FormatSpan::Monospace,
+    FormatSpan::Reverse, FormatSpan::Italic, FormatSpan::Strikethrough,
+    FormatSpan::Underline
+  };
+
+
+  /// \brief Index of the first character below 0x20 at or after i
+  ///
+  /// Returns n if there is none. Runs of ordinary text are skipped 16
+  /// bytes at a time when SSE2 is available.
+  inline int findControl(const uchar* d, int i, int n) {
+#if defined(__SSE2__)
+    const __m128i limit = _mm_set1_epi8(0x1f);
+    for (; i + 16 <= n; i += 16) {
+      __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(d + i));
+      // v <= 0x1f <=> max(v, 0x1f) == 0x1f
+      int mask = _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_max_epu8(v, limit),
+						  limit));
+      if (mask != 0)
+	return i + __builtin_ctz(mask);
+    }
+#endif
+    for (; i < n; ++i) {
+      if (d[i] < 0x20)
+	return i;
+    }
+
+    return n;
+  }
+
+
+  /// \brief Index of the first character below 0x20 at or after i
+  inline int findControl(const ushort* d, int i, int n) {
+#if defined(__SSE2__)
+    const __m128i limit = _mm_set1_epi16(0x1f);
+    const __m128i zero = _mm_setzero_si128();
+    for (; i + 8 <= n; i += 8) {
+      __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(d + i));
+      // v <= 0x1f <=> v - 0x1f (saturated) == 0
+      int mask = _mm_movemask_epi8(_mm_cmpeq_epi16(_mm_subs_epu16(v, limit),
+						   zero));
+      if (mask != 0)
+	return i + (__builtin_ctz(mask) >> 1);
+    }
+#endif
+    for (; i < n; ++i) {
+      if (d[i] < 0x20)
+	return i;
+    }
+
+    return n;
+  }
+
+
+  /// \brief Value of a decimal digit or -1
+  template<typename Char> inline int decDigit(Char c) {
+    return (c >= '0' && c <= '9') ? (c - '0') : -1;
+  }
+
+
+  /// \brief Value of a hex digit or -1
+  template<typename Char> inline int hexDigit(Char c) {
+    if (c >= '0' && c <= '9')
+      return c - '0';
+    if (c >= 'a' && c <= 'f')
+      return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F')
+      return c - 'A' + 10;
+    return -1;
+  }
+
+
+  /// \brief Parse the arguments of a color code ("fg[,bg]")
+  ///
+  /// \param d Text
+  /// \param i Index after the color code
+  /// \param n Length of text
+  /// \param hex Parse hex colors (RRGGBB) instead of mIRC colors
+  /// \param fg Foreground color, -1 if none was given
+  /// \param bg Background color, unchanged if none was given
+  /// \return Index after the arguments
+  template<typename Char>
+  int parseColor(const Char* d, int i, int n, bool hex, int& fg, int& bg) {
+    const int maxDigits = hex ? 6 : 2;
+    const int minDigits = hex ? 6 : 1;
+    int value, digits, j;
+
+    fg = -1;
+
+    // foreground
+    value = 0;
+    for (digits = 0, j = i; j < n && digits < maxDigits; ++j, ++digits) {
+      int v = hex ? hexDigit(d[j]) : decDigit(d[j]);
+      if (v < 0)
+	break;
+      value = value * (hex ? 16 : 10) + v;
+    }
+    if (digits < minDigits)
+      return i;
+
+    fg = hex ? (value | FormatSpan::HexColor) : value;
+    i = j;
+
+    // optional ",background"; a comma without color stays text
+    if (i + 1 >= n || d[i] != ',')
+      return i;
+
+    value = 0;
+    for (digits = 0, j = i + 1; j < n && digits < maxDigits; ++j, ++digits) {
+      int v = hex ? hexDigit(d[j]) : decDigit(d[j]);
+      if (v < 0)
+	break;
+      value = value * (hex ? 16 : 10) + v;
+    }
+    if (digits < minDigits)
+      return i;
+
+    bg = hex ? (value | FormatSpan::HexColor) : value;
+
+    return j;
+  }
+
+
+  /// \brief Current formatting while stripping
+  struct Format {
+    int flags;
+    int foreground;
+    int background;
+
+    bool isDefault() const {
+      return (flags == 0 && foreground < 0 && background < 0);
+    }
+  };
+
+
+  /// \brief Record the text written with format f since start
+  void closeSpan(QVector<FormatSpan>* spans, const Format& f,
+		 int start, int end) {
+    if (spans == NULL || end <= start || f.isDefault())
+      return;
+
+    // merge with the previous span if nothing changed in between
+    if (!spans->isEmpty()) {
+      FormatSpan& last = (*spans)[spans->size() - 1];
+      if (last.begin + last.length == start && last.flags == f.flags &&
+	  last.foreground == f.foreground && last.background == f.background) {
+	last.length += end - start;
+	return;
+      }
+    }
+
+    FormatSpan span;
+    span.begin = start;
+    span.length = end - start;
+    span.flags = f.flags;
+    span.foreground = f.foreground;
+    span.background = f.background;
+    spans->append(span);
+  }
+
+
+  /// \brief Remove control codes in a single pass
+  ///
+  /// Text is moved towards the front of the buffer as codes are
+  /// removed; runs without codes are located with findControl().
+  ///
+  /// \param d Text, modified in place
+  /// \param n Length of text
+  /// \param first Index of the first control character
+  /// \param colorsOnly Only remove color codes, keep everything else
+  /// \param spans Receives the formatting of the stripped text, if
+  /// not NULL
+  /// \return Length of the stripped text
+  template<typename Char>
+  int stripCodes(Char* d, int n, int first, bool colorsOnly,
+		 QVector<FormatSpan>* spans) {
+    Format f;
+    f.flags = 0;
+    f.foreground = -1;
+    f.background = -1;
+
+    int r = first;  // read position
+    int w = first;  // write position
+    int spanStart = 0;
+
+    while (r < n) {
+      // copy the text up to the next control character
+      int next = findControl(d, r, n);
+      if (w != r)
+	std::memmove(d + w, d + r, (next - r) * sizeof(Char));
+      w += next - r;
+      r = next;
+
+      if (r == n)
+	break;
+
+      int code = codeTable[d[r]];
+      bool isColor = (code == ColorCode || code == HexColorCode);
+
+      if (code == NoCode || (colorsOnly && !isColor)) {
+	d[w++] = d[r++];
+	continue;
+      }
+
+      Format g = f;
+      ++r;
+
+      if (isColor) {
+	int fg, bg = g.background;
+	r = parseColor(d, r, n, code == HexColorCode, fg, bg);
+	if (fg < 0) {
+	  // a color code without arguments resets both colors
+	  g.foreground = -1;
+	  g.background = -1;
+	} else {
+	  g.foreground = fg;
+	  g.background = bg;
+	}
+      } else if (code == ResetCode) {
+	g.flags = 0;
+	g.foreground = -1;
+	g.background = -1;
+      } else {
+	g.flags ^= codeFlags[code];
+      }
+
+      if (g.flags != f.flags || g.foreground != f.foreground ||
+	  g.background != f.background) {
+	closeSpan(spans, f, spanStart, w);
+	spanStart = w;
+	f = g;
+      }
+    }
+
+    closeSpan(spans, f, spanStart, w);
+
+    return w;
+  }
+
+
+  /// \brief Strip a QString in place (no copy if there's nothing to do)
+  void stripString(QString& s, bool colorsOnly,
+		   QVector<FormatSpan>* spans) {
+    const int n = s.size();
+    int first = findControl(s.utf16(), 0, n);
+    if (first == n)
+      return;
+
+    ushort* d = reinterpret_cast<ushort*>(s.data());
+    s.resize(stripCodes(d, n, first, colorsOnly, spans));
+  }
+
+
+  /// \brief Strip UTF-8 text in place (no copy if there's nothing to do)
+  ///
+  /// Control codes are ASCII, so they can't be part of a multi-byte
+  /// sequence and the text doesn't need to be decoded.
+  void stripUtf8(QByteArray& s, bool colorsOnly,
+		 QVector<FormatSpan>* spans) {
+    const int n = s.size();
+    int first = findControl(reinterpret_cast<const uchar*>(s.constData()),
+			    0, n);
+    if (first == n)
+      return;
+
+    uchar* d = reinterpret_cast<uchar*>(s.data());
+    s.resize(stripCodes(d, n, first, colorsOnly, spans));
+  }
+};
+
+
+/// \brief Remove mIRC color codes (\\x03 and \\x04) from message
 QString QIRC::stripColors(QString s) {
-  QRegExp reColorCodes("\\x03(?:\\d{1,2}(?:,\\d{1,2})?)?");
-  s = s.replace(reColorCodes, "");
+  stripString(s, true, NULL);
   return s;
 }
 
+
 /// \brief Remove all formatting codes from message
+///
+/// Removes colors and the bold, italic, underline, strikethrough,
+/// monospace, reverse and reset codes.
 QString QIRC::stripFormat(QString s) {
-  // remove \x02 (bold)
-  s = s.replace("\x02", "");
+  stripString(s, false, NULL);
+  return s;
+}
 
-  // remove all color codes
-  s = QIRC::stripColors(s);
 
-  return s;
+/// \brief Remove all formatting codes from message in place
+///
+/// \param s Message text
+/// \param spans If not NULL, receives the formatted ranges of the
+/// stripped text (offsets in QChars)
+void QIRC::stripFormatInPlace(QString& s, QVector<FormatSpan>* spans) {
+  if (spans != NULL)
+    spans->clear();
+
+  stripString(s, false, spans);
+}
+
+
+/// \brief Remove all formatting codes from UTF-8 message in place
+///
+/// \param utf8 Message text
+/// \param spans If not NULL, receives the formatted ranges of the
+/// stripped text (offsets in bytes)
+void QIRC::stripFormatInPlace(QByteArray& utf8, QVector<FormatSpan>* spans) {
+  if (spans != NULL)
+    spans->clear();
+
+  stripUtf8(utf8, false, spans);
+}
+
+
+/// \brief Remove mIRC color codes from message in place
+void QIRC::stripColorsInPlace(QString& s) {
+  stripString(s, true, NULL);
+}
+
+
+/// \brief Remove mIRC color codes from UTF-8 message in place
+void QIRC::stripColorsInPlace(QByteArray& utf8) {
+  stripUtf8(utf8, true, NULL);
 }
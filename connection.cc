@@ -1,78 +1,105 @@
-#include <QRegExp>
+#include <cstring>
+
+#include <QEvent>
 #include <QStringList>
+#include <QtAlgorithms>
 
 #include "HostMask"
 #include "Connection"
+#include "QtTransport"
 
 using namespace QIRC;
 
 /// \brief Construct without server information
 Connection::Connection() :
-  m_currentServer("127.0.0.1", 6667), m_socket(NULL),
+  m_currentServer("127.0.0.1", 6667), m_transport(NULL),
   m_serverPassword(""), m_connected(false),
   m_ident("QIRC"), m_nick("QIRC"), m_realName("QIRC"),
   m_desiredNick(""),
-  m_tMessageQueue(NULL) {
+  m_queueTimer(&Connection::queueTimerExpired, this),
+  m_ownHostLength(63), m_tracker(NULL),
+  m_eventRing(NULL), m_interests(0), m_interestMask(0),
+  m_registrationTimer(&Connection::registrationTimerExpired, this),
+  m_registrationTimeout(60000),
+  m_reconnectTimer(&Connection::reconnectTimerExpired, this),
+  m_reconnectDelay(0), m_maxReconnectDelay(300000),
+  m_nextReconnectDelay(0), m_userDisconnect(false),
+  m_keepaliveTimer(&Connection::keepaliveTimerExpired, this),
+  m_keepaliveInterval(0), m_pingTimeout(60000), m_registered(false),
+  m_lastReceived(0), m_pingSentAt(-1), m_rttNext(0), m_recorder(NULL) {
   if (!setupSocket()) {
-    qCritical() << "Connection: Unable to setup m_socket!";
+    qCritical() << "Connection: Unable to setup m_transport!";
     exit(1);
   }
 
-  if (!setupMessageQueue()) {
-    qCritical() << "Connection: Unable to setup m_tMessageQueue!";
-    exit(1);
-  }
+  setupTimers();
 
+  updateInterests();
 }
 
 
 /// \brief Construct from given ServerInfo
 Connection::Connection(const ServerInfo& si) :
-  m_currentServer(si), m_socket(NULL),
+  m_currentServer(si), m_transport(NULL),
   m_serverPassword(""), m_connected(false),
   m_ident("QIRC"), m_nick("QIRC"), m_realName("QIRC"),
   m_desiredNick(""),
-  m_tMessageQueue(NULL) {
+  m_queueTimer(&Connection::queueTimerExpired, this),
+  m_ownHostLength(63), m_tracker(NULL),
+  m_eventRing(NULL), m_interests(0), m_interestMask(0),
+  m_registrationTimer(&Connection::registrationTimerExpired, this),
+  m_registrationTimeout(60000),
+  m_reconnectTimer(&Connection::reconnectTimerExpired, this),
+  m_reconnectDelay(0), m_maxReconnectDelay(300000),
+  m_nextReconnectDelay(0), m_userDisconnect(false),
+  m_keepaliveTimer(&Connection::keepaliveTimerExpired, this),
+  m_keepaliveInterval(0), m_pingTimeout(60000), m_registered(false),
+  m_lastReceived(0), m_pingSentAt(-1), m_rttNext(0), m_recorder(NULL) {
   if (!setupSocket()) {
-    qCritical() << "Connection: Unable to setup m_socket!";
+    qCritical() << "Connection: Unable to setup m_transport!";
     exit(1);
   }
 
-  if (!setupMessageQueue()) {
-    qCritical() << "Connection: Unable to setup m_tMessageQueue!";
-    exit(1);
-  }
+  setupTimers();
 
+  updateInterests();
 }
 
 
 /// \brief Construct from host/port
 Connection::Connection(QString h, quint16 p) :
-  m_currentServer(h, p), m_socket(NULL),
+  m_currentServer(h, p), m_transport(NULL),
   m_serverPassword(""), m_connected(false),
   m_ident("QIRC"), m_nick ("QIRC"), m_realName("QIRC"),
   m_desiredNick(""),
-  m_tMessageQueue(NULL) {
+  m_queueTimer(&Connection::queueTimerExpired, this),
+  m_ownHostLength(63), m_tracker(NULL),
+  m_eventRing(NULL), m_interests(0), m_interestMask(0),
+  m_registrationTimer(&Connection::registrationTimerExpired, this),
+  m_registrationTimeout(60000),
+  m_reconnectTimer(&Connection::reconnectTimerExpired, this),
+  m_reconnectDelay(0), m_maxReconnectDelay(300000),
+  m_nextReconnectDelay(0), m_userDisconnect(false),
+  m_keepaliveTimer(&Connection::keepaliveTimerExpired, this),
+  m_keepaliveInterval(0), m_pingTimeout(60000), m_registered(false),
+  m_lastReceived(0), m_pingSentAt(-1), m_rttNext(0), m_recorder(NULL) {
   if (!setupSocket()) {
-    qCritical() << "Connection: Unable to setup m_socket!";
+    qCritical() << "Connection: Unable to setup m_transport!";
     exit(1);
   }
 
-  if (!setupMessageQueue()) {
-    qCritical() << "Connection: Unable to setup m_tMessageQueue!";
-    exit(1);
-  }
+  setupTimers();
 
+  updateInterests();
 }
 
 
 Connection::~Connection() {
-  if (m_tMessageQueue != NULL) {
-    delete m_tMessageQueue;
-  }
+  // the transport may still report the disconnect
+  m_userDisconnect = true;
 
-  if (m_socket != NULL) {
-    delete m_socket;
+  if (m_transport != NULL) {
+    delete m_transport;
   }
 }
 
@@ -84,13 +111,20 @@ void Connection::connect() {
     disconnect();
   }
 
-  m_socket->connectToHost(m_currentServer.host(), m_currentServer.port());
+  m_userDisconnect = false;
+  m_reconnectTimer.stop();
+
+  m_transport->connectToHost(m_currentServer.host(), m_currentServer.port());
 }
 
 
 /// \brief Disconnect from IRC server
 void Connection::disconnect() {
-  m_socket->disconnectFromHost();
+  // no automatic reconnect
+  m_userDisconnect = true;
+  m_reconnectTimer.stop();
+
+  m_transport->disconnectFromHost();
 }
 
 
@@ -126,92 +160,149 @@ void Connection::setServer(QString h, quint16 p) {
 }
 
 
-/// \brief Set up m_socket
+/// \brief Set up m_transport
 ///
-/// Creates the QTcpSocket instance for m_socket
+/// Creates the default QtTransport instance for m_transport
 bool Connection::setupSocket() {
-  if (m_socket != NULL) {
-    qWarning() << "Called Connection::setupSocket with non-null m_socket!";
-    delete m_socket;
+  if (m_transport != NULL) {
+    qWarning() << "Called Connection::setupSocket with non-null m_transport!";
+    delete m_transport;
+    m_transport = NULL;
   }
 
   try {
-    m_socket = new QTcpSocket(this);
+    attachTransport(new QtTransport(this));
   }
 
   catch (std::bad_alloc &ex) {
     qCritical() << "Caught std::bad_alloc when trying to setup "
-		<< "Connection::m_socket: " << ex.what();
+		<< "Connection::m_transport: " << ex.what();
     return false;
   }
 
-  // connect the socket's signals to our slots
-  QObject::connect(m_socket, SIGNAL(connected()),
+  return true;
+}
+
+
+/// \brief Make transport the connection's transport
+void Connection::attachTransport(Transport* transport) {
+  m_transport = transport;
+  m_transport->setParent(this);
+
+  // connect the transport's signals to our slots
+  QObject::connect(m_transport, SIGNAL(connected()),
 		   this, SLOT(socket_connected()));
-  QObject::connect(m_socket, SIGNAL(disconnected()),
+  QObject::connect(m_transport, SIGNAL(disconnected()),
 		   this, SLOT(socket_disconnected()));
-  QObject::connect(m_socket, SIGNAL(error(QAbstractSocket::SocketError)),
+  QObject::connect(m_transport, SIGNAL(error(QAbstractSocket::SocketError)),
 		   this, SLOT(socket_error(QAbstractSocket::SocketError)));
-  QObject::connect(m_socket, SIGNAL(readyRead()),
+  QObject::connect(m_transport, SIGNAL(readyRead()),
 		   this, SLOT(socket_readyRead()));
-
-  return true;
 }
 
 
-/// \brief Slot for m_socket::connected()
+/// \brief Slot for m_transport::connected()
 void Connection::socket_connected() {
   m_connected = true;
+  m_reconnectTimer.stop();
+
+  // start with a full flood control budget
+  m_floodControl.reset(m_clock.elapsed());
+
+  // target limits and other features are announced again by the
+  // new server
+  m_messageQueue.resetMaxTargets();
+  m_isupport.clear();
+  m_motd.clear();
+
   // authenticate to server if we have a password set for
   // the connection
   authenticate();
 
-  // start timer for outbound message queue
-  m_tMessageQueue->start();
+  if (m_registrationTimeout > 0) {
+    TimerService::instance()->start(&m_registrationTimer,
+				    m_registrationTimeout);
+  }
 
   emit connected(m_currentServer);
 }
 
 
-/// \brief Slot for m_socket::disconnected()
+/// \brief Slot for m_transport::disconnected()
 void Connection::socket_disconnected() {
-  // stop timer for outbound message queue and clear the queue
-  m_tMessageQueue->stop();
+  // stop timers for outbound message queue, registration and
+  // keepalive and clear the queue
+  m_queueTimer.stop();
+  m_registrationTimer.stop();
+  m_keepaliveTimer.stop();
   m_messageQueue.clear();
+  m_framer.clear();
 
   m_connected = false;
+  m_registered = false;
+  m_pingSentAt = -1;
   emit disconnected(m_currentServer);
+
+  scheduleReconnect();
 }
 
 
-/// \brief Slot for m_socket::error()
+/// \brief Slot for m_transport::error()
 ///
-/// This slot is connected to the error() signal of m_socket.
+/// This slot is connected to the error() signal of m_transport.
 /// It fetches the error message belonging to err and re-emits
 /// the signal to the controlling application as
 /// socketError().
 ///
-/// \param err Socket error as received from m_socket's error() signal
+/// \param err Socket error as received from m_transport's error() signal
 void Connection::socket_error(QAbstractSocket::SocketError err) {
-  QString msg = m_socket->errorString();
-  qWarning() << "Connection::m_socket (connected to" << m_currentServer
+  QString msg = m_transport->errorString();
+  qWarning() << "Connection::m_transport (connected to" << m_currentServer
 	     << ") generated an error: " << msg;
   emit socketError(err, msg);
+
+  // errors of established connections are followed by disconnected()
+  if (!m_connected) {
+    scheduleReconnect();
+  }
 }
 
 
-/// \brief Slot for m_socket::readyRead()
+/// \brief Slot for m_transport::readyRead()
+///
+/// Reads all available data at once, records it if a TrafficRecorder
+/// is attached and hands it to feed().
 void Connection::socket_readyRead() {
-  QString line;
+  const QByteArray data = m_transport->readAll();
 
-  while (m_socket->canReadLine()) {
-    line = m_socket->readLine();
-    if (!line.isNull()) {
-      if (!parseMessage(line.trimmed())) {
-	qDebug() << "Unable to parse message:" << line.trimmed();
-      }
-    }
+  if (m_recorder != NULL) {
+    m_recorder->record(data);
+  }
+
+  feed(data);
+}
+
+
+/// \brief Handle data as if it had been received from the server
+///
+/// Runs the data through the same framing and parsing as data read
+/// from the transport, e.g. to replay a recording made with a
+/// TrafficRecorder. Incomplete lines at the end are kept until the
+/// next call.
+///
+/// \param data Raw bytes in the server's encoding
+void Connection::feed(const QByteArray& data) {
+  quint64 discarded = m_framer.discardedLines();
+
+  m_stats.bytesIn += data.size();
+  m_lastReceived = m_clock.elapsed();
+
+  if (m_framer.append(data) > 0) {
+    m_stats.linesIn += m_framer.lines().size();
+    parseMessages(m_framer.buffer(), m_framer.lines());
   }
+
+  m_stats.discardedLines += m_framer.discardedLines() - discarded;
 }
 
 
@@ -250,7 +341,7 @@ void Connection::setNick(QString nick) {
     m_nick = nick;
   } else {
     m_desiredNick = nick;
-    sendMessage("NICK " + m_desiredNick);
+    sendLine(m_writer.begin("NICK").param(m_desiredNick).line());
   }
 }
 
@@ -276,24 +367,106 @@ QString Connection::realName() const {
 /// \brief Send message to server
 ///
 /// Sends the given message to the IRC server. A message can be either
-/// queued or sent right away. The message Queue is checked by m_tMessageQueue
-/// every 10ms.
+/// queued or sent right away. Queued messages are sent as fast as
+/// m_floodControl allows; messages sent right away still count against
+/// its budget.
 ///
 /// \param msg Message text
 /// \param queued Flag to indicate wether the message should be queued
 /// or sent right away
 void Connection::sendMessage(QString msg, bool queued) {
-  if (m_connected) {
-    if (!queued) {
-      QTextStream s(m_socket);
-      s << msg.trimmed() << "\n";
-    } else {
-      m_messageQueue.append(msg.trimmed() + "\n");
-    }
-  } else {
-    qWarning() << "Tried to use Connection::sendMessage() while "
-	       << "m_connected!=true! Message was:" << msg.trimmed();
+  sendLine(m_writer.begin("").raw(msg.trimmed()).line(), queued);
+}
+
+
+/// \brief Queue message in a specific lane
+///
+/// Like sendMessage(QString, bool) for queued messages, but overrides
+/// the lane that would be chosen by MessageQueue::laneFor().
+///
+/// \param msg Message text
+/// \param lane Lane of the outbound queue to use
+void Connection::sendMessage(QString msg, MessageQueue::Lane lane) {
+  sendLine(m_writer.begin("").raw(msg.trimmed()).line(), lane);
+}
+
+
+/// \brief Send encoded message line to server
+///
+/// \param line Encoded message including CR/LF, usually built with
+/// m_writer
+/// \param queued Flag to indicate wether the message should be queued
+/// or sent right away
+void Connection::sendLine(const QByteArray& line, bool queued) {
+  if (!m_connected) {
+    qWarning() << "Tried to use Connection::sendLine() while "
+	       << "m_connected!=true! Message was:" << line.trimmed();
+    return;
+  }
+
+  if (!queued) {
+    m_floodControl.consume(line.size(), m_clock.elapsed());
+    m_transport->write(line);
+
+    m_stats.bytesOut += line.size();
+    ++m_stats.linesOut;
+    return;
+  }
+
+  const quint64 dropped = m_messageQueue.droppedMessages();
+
+  // queue times are kept in microseconds for m_stats.queueLatency;
+  // rejected messages are counted in m_stats.droppedMessages
+  m_messageQueue.enqueue(line, m_clock.nsecsElapsed() / 1000);
+  m_stats.droppedMessages += m_messageQueue.droppedMessages() - dropped;
+  m_stats.maxQueueDepth = qMax(m_stats.maxQueueDepth, m_messageQueue.size());
+  scheduleMessageQueue();
+}
+
+
+/// \brief Queue encoded message line in a specific lane
+void Connection::sendLine(const QByteArray& line, MessageQueue::Lane lane) {
+  if (!m_connected) {
+    qWarning() << "Tried to use Connection::sendLine() while "
+	       << "m_connected!=true! Message was:" << line.trimmed();
+    return;
   }
+
+  QByteArray target;
+  MessageQueue::laneFor(line, &target);
+
+  const quint64 dropped = m_messageQueue.droppedMessages();
+
+  // rejected messages are counted in m_stats.droppedMessages
+  m_messageQueue.enqueue(line, lane, target, m_clock.nsecsElapsed() / 1000);
+  m_stats.droppedMessages += m_messageQueue.droppedMessages() - dropped;
+  m_stats.maxQueueDepth = qMax(m_stats.maxQueueDepth, m_messageQueue.size());
+  scheduleMessageQueue();
+}
+
+
+/// \brief Maximum length of the text of a PRIVMSG or NOTICE
+///
+/// The server relays the message with our nick!user@host prefix
+/// prepended, which counts against the 512 byte line limit as well.
+/// Until we've seen our own host mask the longest possible host name
+/// is assumed.
+///
+/// \param command Command name, e.g. "PRIVMSG"
+/// \param target Target of the message
+///
+/// \return Maximum number of bytes of UTF-8 text
+int Connection::maxTextLength(const char* command, const QString& target) const {
+  // ":nick!~user@host COMMAND target :text\r\n"
+  int overhead = 1 + MessageWriter::utf8Length(m_nick.constData(),
+					       m_nick.size())
+    + 2 + MessageWriter::utf8Length(m_ident.constData(), m_ident.size())
+    + 1 + m_ownHostLength + 1
+    + qstrlen(command) + 1
+    + MessageWriter::utf8Length(target.constData(), target.size())
+    + 2 + 2;
+
+  return (m_messageQueue.maxLineLength() - overhead);
 }
 
 
@@ -311,15 +484,16 @@ void Connection::authenticate() {
   }
 
   if (m_serverPassword.length() > 0) {
-    sendMessage("PASS " + m_serverPassword, false);
+    sendLine(m_writer.begin("PASS").param(m_serverPassword).line(), false);
   }
 
-  // USER username hostname servername: realname
-  sendMessage("USER " + m_ident + " " + m_currentServer.host() + " "
-	      + m_currentServer.host() + ": " + m_realName, false);
+  // USER username hostname servername :realname
+  sendLine(m_writer.begin("USER").param(m_ident)
+	   .param(m_currentServer.host()).param(m_currentServer.host())
+	   .trailing(m_realName).line(), false);
 
   // NICK nickname
-  sendMessage("NICK " + m_nick, false);
+  sendLine(m_writer.begin("NICK").param(m_nick).line(), false);
 }
 
 
@@ -329,312 +503,1767 @@ bool Connection::isConnected() const {
 }
 
 
-/// \brief Parse incoming message
-bool Connection::parseMessage(QString msg) {
-  static const QRegExp reNOTICE_AUTH("^:(.+) NOTICE AUTH :(.+)$");
-  if (reNOTICE_AUTH.exactMatch(msg)) {
-    QStringList tmp = reNOTICE_AUTH.capturedTexts();
-    QString serverName = tmp.value(1);
-    QString message = tmp.value(2);
-
-    emit irc_notice_auth(serverName, message);
+/// \brief Dispatch table for incoming messages
+///
+/// Looks up the member function that handles the command of the
+/// given message. The command is compared on the raw bytes, so the
+/// lookup doesn't need to decode anything.
+/// Numeric replies are not listed here; they are routed to
+/// handleNumeric() by parseMessage().
+///
+/// \param msg The message
+/// \param interest If not NULL, receives the Interest the command
+/// belongs to (0 if there is no handler)
+/// \return Handler for the command or NULL if there is none
+Connection::MessageHandler Connection::messageHandler(const IrcMessage& msg,
+						      int* interest) {
+  static const struct {
+    const char* command;
+    int length;
+    MessageHandler handler;
+    int interest;
+  } handlers[] = {
+    { "PRIVMSG", 7, &Connection::handlePrivmsg, PrivmsgInterest },
+    { "NOTICE", 6, &Connection::handleNotice, NoticeInterest },
+    { "JOIN", 4, &Connection::handleJoin, JoinInterest },
+    { "PART", 4, &Connection::handlePart, PartInterest },
+    { "MODE", 4, &Connection::handleMode, ModeInterest },
+    { "NICK", 4, &Connection::handleNick, NickInterest },
+    { "PING", 4, &Connection::handlePing, PingInterest },
+    { "PONG", 4, &Connection::handlePong, PingInterest },
+    { "TOPIC", 5, &Connection::handleTopic, TopicInterest },
+    { "INVITE", 6, &Connection::handleInvite, InviteInterest }
+  };
+  static const int handlerCount = sizeof(handlers) / sizeof(handlers[0]);
+
+  const char* cmd = msg.commandData();
+  const int length = msg.commandLength();
+
+  for (int i = 0; i < handlerCount; ++i) {
+    if (handlers[i].length == length &&
+	std::memcmp(handlers[i].command, cmd, length) == 0) {
+      if (interest != NULL) {
+	*interest = handlers[i].interest;
+      }
+      return handlers[i].handler;
+    }
+  }
 
-    return true;
+  if (interest != NULL) {
+    *interest = 0;
   }
+  return NULL;
+}
 
-  static const QRegExp reNumeric("^:(.+) ([0-9]{3}) (.+) :(.+)$");
-  if (reNumeric.exactMatch(msg)) {
-    QStringList tmp = reNumeric.capturedTexts();
-    QString serverName = tmp.value(1);
-    int messageNumber = tmp.value(2).toInt();
-    QString target = tmp.value(3);
-    QString message = tmp.value(4);
 
-    // TODO(png): handle numeric messages according to RFC1459
+/// \brief Dispatch table for numeric replies
+///
+/// The kind of each numeric comes from the compile-time table in
+/// numerics.cc; this maps kinds to member functions, so the lookup is
+/// two array accesses.
+///
+/// \return Handler for the numeric or NULL if there is none
+Connection::MessageHandler Connection::numericHandler(int numeric) {
+  // indexed by NumericKind
+  static const MessageHandler handlers[NumericKindCount] = {
+    NULL,
+    &Connection::handleWelcome,
+    &Connection::handleMyInfo,
+    &Connection::handleISupport,
+    &Connection::handleAway,
+    &Connection::handleWhoisUser,
+    &Connection::handleWhoisServer,
+    &Connection::handleWhoisOperator,
+    &Connection::handleWhoisIdle,
+    &Connection::handleWhoisChannels,
+    &Connection::handleEndOfWhois,
+    &Connection::handleWhoReply,
+    &Connection::handleEndOfWho,
+    &Connection::handleListStart,
+    &Connection::handleList,
+    &Connection::handleListEnd,
+    &Connection::handleNoTopic,
+    &Connection::handleTopicReply,
+    &Connection::handleTopicWhoTime,
+    &Connection::handleNames,
+    &Connection::handleEndOfNames,
+    &Connection::handleMotdStart,
+    &Connection::handleMotd,
+    &Connection::handleEndOfMotd,
+    &Connection::handleError
+  };
+
+  return handlers[numericKind(numeric)];
+}
 
-    return true;
-  }
 
-  static const QRegExp reNOTICE("^:(.+)!(.+)@(.+) NOTICE ([\\w#\\-|\\[\\]\\.]+) :(.+)$");
-  if (reNOTICE.exactMatch(msg)) {
-    QStringList tmp = reNOTICE.capturedTexts();
-    HostMask sender(tmp.value(1), tmp.value(2), tmp.value(3));
-    QString target = tmp.value(4);
-    QString message = tmp.value(5);
+/// \brief Interest a numeric reply belongs to (0 if it isn't handled)
+int Connection::numericInterest(int numeric) {
+  // indexed by NumericKind
+  static const int interests[NumericKindCount] = {
+    0,
+    ServerInterest,             // WelcomeNumeric
+    ServerInterest,             // MyInfoNumeric
+    ServerInterest,             // ISupportNumeric
+    WhoisInterest,              // AwayNumeric
+    WhoisInterest,              // WhoisUserNumeric
+    WhoisInterest,              // WhoisServerNumeric
+    WhoisInterest,              // WhoisOperatorNumeric
+    WhoisInterest,              // WhoisIdleNumeric
+    WhoisInterest,              // WhoisChannelsNumeric
+    WhoisInterest,              // EndOfWhoisNumeric
+    WhoInterest,                // WhoReplyNumeric
+    WhoInterest,                // EndOfWhoNumeric
+    ListInterest,               // ListStartNumeric
+    ListInterest,               // ListNumeric
+    ListInterest,               // ListEndNumeric
+    ChannelInfoInterest,        // NoTopicNumeric
+    ChannelInfoInterest,        // TopicNumeric
+    ChannelInfoInterest,        // TopicWhoTimeNumeric
+    NamesInterest,              // NamesNumeric
+    NamesInterest,              // EndOfNamesNumeric
+    ServerInterest,             // MotdStartNumeric
+    ServerInterest,             // MotdNumeric
+    ServerInterest,             // EndOfMotdNumeric
+    ErrorInterest               // ErrorNumeric
+  };
+
+  return interests[numericKind(numeric)];
+}
+
 
-    emit irc_notice(sender, target, message);
+/// \brief Does anyone need this message decoded?
+///
+/// Only looks at the command and, for NICK, JOIN and PART, compares
+/// the sender's nick with ours on the raw bytes: our own ones change
+/// the connection's state and are always handled.
+bool Connection::isWanted(const IrcMessage& msg) const {
+  const int interests = m_interests;
 
+  if ((interests & RawInterest) != 0) {
     return true;
   }
 
-  static const QRegExp rePRIVMSG("^:(.+)!(.+)@(.+) PRIVMSG ([\\w#\\-\\[\\]|\\.]+) :(.+$)");
-  if (rePRIVMSG.exactMatch(msg)) {
-    QStringList tmp = rePRIVMSG.capturedTexts();
-    HostMask sender(tmp.value(1), tmp.value(2), tmp.value(3));
-    QString target = tmp.value(4);
-    QString message = tmp.value(5);
+  if (msg.isNumeric()) {
+    return ((interests & numericInterest(msg.numeric())) != 0);
+  }
 
-    emit irc_privmsg(sender, target, message);
+  int interest;
+  if (messageHandler(msg, &interest) == NULL) {
+    return false;
+  }
 
+  if ((interests & interest) != 0) {
     return true;
   }
 
-  static const QRegExp reMODE("^:(.+)!(.+)@(.+) MODE ([\\w#\\-|\\[\\]\\.]+) :(.+)$");
-  if (reMODE.exactMatch(msg)) {
-    QStringList tmp = reMODE.capturedTexts();
-    HostMask sender(tmp.value(1), tmp.value(2), tmp.value(3));
-    QString target = tmp.value(4);
-    QString modeString = tmp.value(5);
+  if ((interest & (NickInterest | JoinInterest | PartInterest)) != 0) {
+    return msg.senderNickEquals(m_nick);
+  }
+
+  return false;
+}
 
-    emit irc_mode(sender, target, modeString);
 
-    return true;
+/// \brief Parse incoming message
+///
+/// Convenience overload that parses a message given as string.
+///
+/// \return true if the message was understood, false otherwise
+bool Connection::parseMessage(QString msg) {
+  IrcMessage m;
+  if (!m.parse(msg.toUtf8())) {
+    return false;
   }
 
-  static const QRegExp reNICK("^:(.+)!(.+)@(.+) NICK :(.+)$");
-  if (reNICK.exactMatch(msg)) {
-    QStringList tmp = reNICK.capturedTexts();
-    HostMask sender(tmp.value(1), tmp.value(2), tmp.value(3));
-    QString newNick = tmp.value(4);
-
-    if (sender.nick() == m_nick && newNick == m_desiredNick) {
-      // we changed our own nick
-      QString oldNick = m_nick;
-      m_nick = newNick;
-      m_desiredNick = "";
+  return parseMessage(m);
+}
 
-      emit nickChanged(oldNick, newNick);
-    } else {
-      // another user changed their nickname
-      emit irc_nick(sender, newNick);
-    }
 
-    return true;
+/// \brief Parse a batch of incoming message lines
+///
+/// \param buffer Buffer holding the lines
+/// \param lines Locations of the lines within buffer
+///
+/// \return Number of messages that were understood
+int Connection::parseMessages(const QByteArray& buffer,
+			      const QVector<LineFramer::Line>& lines) {
+  IrcMessage msg;
+  int parsed = 0;
+
+  // only collect a batch if someone is listening for it
+  const bool batching =
+    (receivers(SIGNAL(irc_messages(QVector<QIRC::IrcMessage>))) > 0);
+  if (batching && m_batch.capacity() < lines.size()) {
+    m_batch.reserve(lines.size());
   }
 
-  static const QRegExp reJOIN("^:(.+)!(.+)@(.+) JOIN :(.+)$");
-  if (reJOIN.exactMatch(msg)) {
-    QStringList tmp = reJOIN.capturedTexts();
-    HostMask sender(tmp.value(1), tmp.value(2), tmp.value(3));
-    QString channel = tmp.value(4);
+  // one clock read per line: each line ends where the next one starts
+  qint64 lineStart = m_clock.nsecsElapsed();
+
+  for (int i = 0; i < lines.size(); ++i) {
+    const LineFramer::Line& l = lines.at(i);
+    // failures are only counted (see statistics()), logging them
+    // would cost more than parsing
+    if (!msg.parse(buffer, l.offset, l.length)) {
+      countParseFailure(msg);
+    } else if (isWanted(msg)) {
+      // (lines nobody subscribed to are skipped)
+      if (batching) {
+	m_batch.append(msg);
+      }
 
-    if (sender.nick() != m_nick) {
-      emit irc_join(sender, channel);
-    } else {
-      emit joinedChannel(channel);
+      if (parseMessage(msg)) {
+	++parsed;
+      } else {
+	countParseFailure(msg);
+      }
     }
 
-    return true;
+    const qint64 lineEnd = m_clock.nsecsElapsed();
+    m_stats.parseTime.record(lineEnd - lineStart);
+    lineStart = lineEnd;
   }
 
-  static const QRegExp rePART("^:(.+)!(.+)@(.+) PART (.+)$");
-  if (rePART.exactMatch(msg)) {
-    QStringList tmp = rePART.capturedTexts();
-    HostMask sender(tmp.value(1), tmp.value(2), tmp.value(3));
-    QString channel = tmp.value(4);
-
-    if (sender.nick() != m_nick) {
-      emit irc_part(sender, channel);
-    } else {
-      emit partedChannel(channel);
-    }
+  if (batching && !m_batch.isEmpty()) {
+    emit irc_messages(m_batch);
 
-    return true;
+    // drop the references to the receive buffer, keep the capacity
+    m_batch.resize(0);
   }
 
-  // PING: <servername>
-  static const QRegExp rePING("^PING :(.+)$");
-  if (rePING.exactMatch(msg)) {
-    QString serverName = rePING.capturedTexts().value(1);
+  return parsed;
+}
 
-    sendPong(serverName);
-    emit irc_ping(serverName);
 
-    return true;
+/// \brief Handle incoming message
+///
+/// Hands the message to the handler registered for its command in
+/// messageHandler().
+///
+/// \return false if the message is invalid or its handler couldn't
+/// make sense of it; commands without a handler count as understood
+bool Connection::parseMessage(const IrcMessage& msg) {
+  if (!msg.isValid()) {
+    return false;
+  }
+
+  if (m_tracker != NULL) {
+    m_tracker->processMessage(msg, m_nick);
+  }
+
+  // messages that don't fit are counted by the ring
+  if (m_eventRing != NULL) {
+    m_eventRing->push(msg);
   }
 
-  static const QRegExp reTOPIC("^:(.+)!(.+)@(.+) TOPIC (.+) :(.+)$");
-  if (reTOPIC.exactMatch(msg)) {
-    QStringList tmp = reTOPIC.capturedTexts();
-    HostMask sender(tmp.value(1), tmp.value(2), tmp.value(3));
-    QString channel = tmp.value(4);
-    QString newTopic = tmp.value(5);
+  emit irc_message(msg);
+
+  if (m_dispatcher.has<RawMessage>()) {
+    RawMessage e = { msg };
+    m_dispatcher.dispatch(e);
+  }
 
-    emit irc_topic(sender, channel, newTopic);
+  if (msg.isNumeric()) {
+    return handleNumeric(msg);
+  }
 
+  // commands we don't decode are still available through irc_message()
+  MessageHandler handler = messageHandler(msg);
+  if (handler == NULL) {
     return true;
   }
 
-  static const QRegExp reINVITE("^:(.+)!(.+)@(.+) INVITE (.+) :(.+)$");
-  if (reINVITE.exactMatch(msg)) {
-    QStringList tmp = reINVITE.capturedTexts();
-    HostMask sender(tmp.value(1), tmp.value(2), tmp.value(3));
-    QString target = tmp.value(4);
-    QString channel = tmp.value(5);
+  return (this->*handler)(msg);
+}
+
+
+/// \brief Handle NOTICE and NOTICE AUTH messages
+bool Connection::handleNotice(const IrcMessage& msg) {
+  if (msg.paramCount() < 2) {
+    return false;
+  }
 
-    emit irc_invite(sender, target, channel);
+  if (msg.paramEquals(0, "AUTH")) {
+    if (!msg.hasPrefix()) {
+      return false;
+    }
 
+    emit irc_notice_auth(msg.prefix(), msg.param(1));
     return true;
   }
 
-  static const QRegExp
-    reChannelInfo("^:(.+) 333 (.+) (.+) (.+)!(.+)@(.+) ([0-9]+)$");
-  if (reChannelInfo.exactMatch(msg)) {
-    QStringList tmp = reChannelInfo.capturedTexts();
-    QString serverName = tmp.value(1);
-    QString target = tmp.value(2);
-    QString channel = tmp.value(3);
-    HostMask creator(tmp.value(4), tmp.value(5), tmp.value(6));
-    quint32 channelTS = tmp.value(7).toInt();
+  if (!msg.hasUserPrefix()) {
+    return false;
+  }
 
-    emit irc_channelInfo(channel, creator, channelTS);
+  emit irc_notice(msg.sender(), msg.param(0), msg.param(1));
 
-    return true;
+  if (m_dispatcher.has<Notice>()) {
+    Notice e = { msg.sender(), msg.param(0), msg.param(1) };
+    m_dispatcher.dispatch(e);
   }
 
-  return false;
+  return true;
 }
 
 
-/// \brief Send PONG response to PING command
-void Connection::sendPong(QString serverName) {
-  sendMessage("PONG " + serverName, false);
-}
+/// \brief Handle PRIVMSG messages
+bool Connection::handlePrivmsg(const IrcMessage& msg) {
+  if (msg.paramCount() < 2 || !msg.hasUserPrefix()) {
+    return false;
+  }
 
+  emit irc_privmsg(msg.sender(), msg.param(0), msg.param(1));
 
-/// \brief Setup queue for outbound messages
-bool Connection::setupMessageQueue() {
-  try {
-    m_tMessageQueue = new QTimer(this);
+  if (m_dispatcher.has<Privmsg>()) {
+    Privmsg e = { msg.sender(), msg.param(0), msg.param(1) };
+    m_dispatcher.dispatch(e);
   }
 
-  catch (std::bad_alloc& ex) {
-    qCritical() << "Unable to allocate memory for "
-		<< "Connection::m_tMessageQueue:" << ex.what();
+  return true;
+}
+
+
+/// \brief Handle MODE messages
+///
+/// The mode string passed on to irc_mode() contains the mode changes
+/// together with their arguments, separated by spaces.
+bool Connection::handleMode(const IrcMessage& msg) {
+  if (msg.paramCount() < 2 || !msg.hasUserPrefix()) {
     return false;
   }
 
-  m_tMessageQueue->setInterval(10);
-  QObject::connect(m_tMessageQueue, SIGNAL(timeout()),
-		   this, SLOT(timer_messageQueue()));
+  QString modeString = msg.param(1);
+  for (int i = 2; i < msg.paramCount(); ++i) {
+    modeString += " " + msg.param(i);
+  }
+
+  emit irc_mode(msg.sender(), msg.param(0), modeString);
+
+  if (m_dispatcher.has<Mode>()) {
+    Mode e = { msg.sender(), msg.param(0), modeString };
+    m_dispatcher.dispatch(e);
+  }
 
   return true;
 }
 
 
-/// \brief Slot for m_tMessageQueue::timeout()
-///
-/// This slot is connected to the timeout() signal of m_tMessageQueue.
-/// It fetches the first message from the queue and sends it to the IRC
-/// server. If no messages are queued it simply does nothing.
-void Connection::timer_messageQueue() {
-  if (!m_messageQueue.isEmpty()) {
-    QString message = m_messageQueue.takeFirst();
-    QTextStream s(m_socket);
-    s << message;
+/// \brief Handle NICK messages
+bool Connection::handleNick(const IrcMessage& msg) {
+  if (msg.paramCount() < 1 || !msg.hasUserPrefix()) {
+    return false;
   }
-}
 
+  HostMask sender = msg.sender();
+  QString newNick = msg.param(0);
 
-/// \brief Attempt to join a channel
-void Connection::joinChannel(QString channel, QString key) {
-  if (isConnected()) {
-    if (key != "") {
-      sendMessage("JOIN " + channel + " " + key);
-    } else {
-      sendMessage("JOIN " + channel);
-    }
+  if (sender.nick() == m_nick && newNick == m_desiredNick) {
+    // we changed our own nick
+    QString oldNick = m_nick;
+    m_nick = newNick;
+    m_desiredNick = "";
+
+    emit nickChanged(oldNick, newNick);
   } else {
-    qWarning() << "Connection::joinChannel(" << channel << ") used "
-	       << "while Connection instance isn't connected!";
+    // another user changed their nickname
+    emit irc_nick(sender, newNick);
+
+    if (m_dispatcher.has<Nick>()) {
+      Nick e = { sender, newNick };
+      m_dispatcher.dispatch(e);
+    }
   }
+
+  return true;
 }
 
 
-/// \brief Attempt to leave a channel
-void Connection::partChannel(QString channel) {
-  if (isConnected()) {
-    sendMessage("PART " + channel);
-  } else {
-    qWarning() << "Connection::partChannel(" << channel << ") used "
-	       << "while Connection instance isn't connected!";
+/// \brief Handle JOIN messages
+bool Connection::handleJoin(const IrcMessage& msg) {
+  if (msg.paramCount() < 1 || !msg.hasUserPrefix()) {
+    return false;
   }
-}
 
+  HostMask sender = msg.sender();
+  QString channel = msg.param(0);
 
-/// \brief Quit IRC
-///
-/// Sends a QUIT message to the IRC server and thereby disconnects
-/// from it.
-///
-/// \param message Message text to use in QUIT command
-/// \param disconnect Flag that indicates wether we want to immediately
-/// disconnect after sending the QUIT command instead of waiting for
-/// the server to close the connection.
-void Connection::quit(QString message, bool disconnect) {
-  if (isConnected()) {
-    sendMessage("QUIT :" + message, false);
-    if (disconnect) {
-      this->disconnect();
+  if (sender.nick() != m_nick) {
+    emit irc_join(sender, channel);
+
+    if (m_dispatcher.has<Join>()) {
+      Join e = { sender, channel };
+      m_dispatcher.dispatch(e);
     }
   } else {
-    qWarning() << "Tried to use Connection::quit() on a Connection "
-	       << "instance that isn't currently connected!";
+    // the server tells us how it sees our host; use it to compute how
+    // much text fits into a message
+    m_ownHostLength = sender.host().toUtf8().size();
+
+    emit joinedChannel(channel);
   }
+
+  return true;
 }
 
 
-/// \brief Get channel topic
-void Connection::getChannelTopic(QString channel) {
-  if (isConnected()) {
-    sendMessage("TOPIC " + channel);
-  } else {
-    qWarning() << "Tried to use Connection::getChannelTopic("
-	       << channel << ") while connection instance isn't connected!";
+/// \brief Handle PART messages
+bool Connection::handlePart(const IrcMessage& msg) {
+  if (msg.paramCount() < 1 || !msg.hasUserPrefix()) {
+    return false;
   }
-}
 
+  HostMask sender = msg.sender();
+  QString channel = msg.param(0);
 
-/// \brief Change channel topic
-void Connection::setChannelTopic(QString channel, QString topic) {
-  if (isConnected()) {
-    sendMessage("TOPIC " + channel + " :" + topic);
+  if (sender.nick() != m_nick) {
+    emit irc_part(sender, channel);
+
+    if (m_dispatcher.has<Part>()) {
+      Part e = { sender, channel };
+      m_dispatcher.dispatch(e);
+    }
   } else {
-    qWarning() << "Tried to use Connection::setChannelTopic("
-	       << channel << "," << topic << ") while Connection instance "
-	       << "isn't connected!";
+    emit partedChannel(channel);
   }
+
+  return true;
 }
 
 
-/// \brief Get list of users on a channel
-void Connection::getChannelNames(QString channel) {
-  if (isConnected()) {
-    sendMessage("NAMES " + channel);
-  } else {
-    qWarning() << "Tried to use Connection::getChannelMembers("
-	       << channel << ") while connection instance isn't connected!";
+/// \brief Handle PING messages
+///
+/// Answers the PING with a matching PONG before re-emitting it as
+/// irc_ping().
+bool Connection::handlePing(const IrcMessage& msg) {
+  if (msg.paramCount() < 1) {
+    return false;
+  }
+
+  QString serverName = msg.param(0);
+
+  sendPong(serverName);
+  emit irc_ping(serverName);
+
+  if (m_dispatcher.has<Ping>()) {
+    Ping e = { serverName };
+    m_dispatcher.dispatch(e);
   }
+
+  return true;
 }
 
 
-/// \brief Invite user to channel
-void Connection::inviteUser(QString nick, QString channel) {
-  if (isConnected()) {
-    sendMessage("INVITE " + nick + " " + channel);
-  } else {
-    qWarning() << "Tried to use Connection::inviteUser(" << nick << ","
-	       << channel << ") while Connection instance isn't connected!";
+/// \brief Handle PONG messages
+///
+/// A PONG carrying the token of our keepalive PING completes the lag
+/// measurement; others (e.g. answers to PINGs sent with raw()) are
+/// ignored.
+bool Connection::handlePong(const IrcMessage& msg) {
+  // [<server>] :<token>
+  if (msg.paramCount() < 1) {
+    return false;
+  }
+
+  if (m_pingSentAt < 0 ||
+      !msg.paramEquals(msg.paramCount() - 1, m_pingToken.constData())) {
+    return true;
   }
+
+  const int rtt = static_cast<int>(m_clock.elapsed() - m_pingSentAt);
+  m_pingSentAt = -1;
+
+  recordRtt(rtt);
+  emit lagMeasured(rtt);
+
+  m_keepaliveTimer.stop();
+  scheduleKeepalive();
+
+  return true;
 }
 
 
-void Connection::privmsg(QString target, QString text) {
-  if (isConnected()) {
-    sendMessage("PRIVMSG " + target + " :" + text);
-  } else {
-    qWarning() << "Tried to use Connection::privmsg() while "
-	       << "Connection instance isn't connected!";
+/// \brief Handle TOPIC messages
+bool Connection::handleTopic(const IrcMessage& msg) {
+  if (msg.paramCount() < 2 || !msg.hasUserPrefix()) {
+    return false;
+  }
+
+  emit irc_topic(msg.sender(), msg.param(0), msg.param(1));
+
+  if (m_dispatcher.has<Topic>()) {
+    Topic e = { msg.sender(), msg.param(0), msg.param(1) };
+    m_dispatcher.dispatch(e);
   }
+
+  return true;
 }
 
+
+/// \brief Handle INVITE messages
+bool Connection::handleInvite(const IrcMessage& msg) {
+  if (msg.paramCount() < 2 || !msg.hasUserPrefix()) {
+    return false;
+  }
+
+  emit irc_invite(msg.sender(), msg.param(0), msg.param(1));
+
+  if (m_dispatcher.has<Invite>()) {
+    Invite e = { msg.sender(), msg.param(0), msg.param(1) };
+    m_dispatcher.dispatch(e);
+  }
+
+  return true;
+}
+
+
+/// \brief Handle numeric server replies
+bool Connection::handleNumeric(const IrcMessage& msg) {
+  MessageHandler handler = numericHandler(msg.numeric());
+
+  // numerics we don't decode are still available through irc_message()
+  if (handler == NULL) {
+    return true;
+  }
+
+  return (this->*handler)(msg);
+}
+
+
+/// \brief Handle RPL_WELCOME, RPL_YOURHOST and RPL_CREATED
+///
+/// The target of RPL_WELCOME is the nick the server registered us with.
+bool Connection::handleWelcome(const IrcMessage& msg) {
+  // <target> :<message>
+  if (msg.paramCount() < 2) {
+    return false;
+  }
+
+  if (msg.numeric() == RPL_WELCOME) {
+    m_nick = msg.param(0);
+
+    // registered; the next outage starts with the shortest backoff
+    m_registrationTimer.stop();
+    m_nextReconnectDelay = m_reconnectDelay;
+
+    m_registered = true;
+    scheduleKeepalive();
+  }
+
+  emit irc_welcome(msg.numeric(), msg.param(1));
+
+  return true;
+}
+
+
+/// \brief Handle RPL_MYINFO
+bool Connection::handleMyInfo(const IrcMessage& msg) {
+  // <target> <server> <version> <user modes> <channel modes> [...]
+  if (msg.paramCount() < 5) {
+    return false;
+  }
+
+  emit irc_myInfo(msg.param(1), msg.param(2), msg.param(3), msg.param(4));
+
+  return true;
+}
+
+
+/// \brief Handle RPL_ISUPPORT
+///
+/// Stores the announced tokens and applies the target limits to the
+/// message queue.
+bool Connection::handleISupport(const IrcMessage& msg) {
+  // <target> <token>... :are supported by this server
+  QStringList tokens;
+
+  for (int i = 1; i < msg.paramCount() - 1; ++i) {
+    QByteArray token(msg.paramData(i), msg.paramLength(i));
+    tokens.append(QString::fromUtf8(token.constData(), token.size()));
+
+    // "-KEY" withdraws a previously announced token
+    if (token.startsWith('-')) {
+      m_isupport.remove(token.mid(1));
+      continue;
+    }
+
+    int eq = token.indexOf('=');
+    QByteArray key = (eq < 0) ? token : token.left(eq);
+    QByteArray value = (eq < 0) ? QByteArray() : token.mid(eq + 1);
+    m_isupport.insert(key, value);
+
+    if (key == "MAXTARGETS") {
+      int count = value.toInt();
+      m_messageQueue.setMaxTargets("PRIVMSG", count);
+      m_messageQueue.setMaxTargets("NOTICE", count);
+    } else if (key == "TARGMAX") {
+      // TARGMAX=PRIVMSG:4,NOTICE:4,JOIN:,...
+      QList<QByteArray> limits = value.split(',');
+      for (int j = 0; j < limits.size(); ++j) {
+	int colon = limits.at(j).indexOf(':');
+	if (colon > 0) {
+	  m_messageQueue.setMaxTargets(limits.at(j).left(colon),
+				       limits.at(j).mid(colon + 1).toInt());
+	}
+      }
+    }
+  }
+
+  emit irc_isupport(tokens);
+
+  return true;
+}
+
+
+/// \brief Handle RPL_AWAY
+bool Connection::handleAway(const IrcMessage& msg) {
+  // <target> <nick> :<away message>
+  if (msg.paramCount() < 3) {
+    return false;
+  }
+
+  emit irc_away(msg.param(1), msg.param(2));
+
+  return true;
+}
+
+
+/// \brief Handle RPL_WHOISUSER
+bool Connection::handleWhoisUser(const IrcMessage& msg) {
+  // <target> <nick> <user> <host> * :<real name>
+  if (msg.paramCount() < 6) {
+    return false;
+  }
+
+  emit irc_whoisUser(HostMask(msg.param(1), msg.param(2), msg.param(3)),
+		     msg.param(5));
+
+  return true;
+}
+
+
+/// \brief Handle RPL_WHOISSERVER
+bool Connection::handleWhoisServer(const IrcMessage& msg) {
+  // <target> <nick> <server> :<server info>
+  if (msg.paramCount() < 4) {
+    return false;
+  }
+
+  emit irc_whoisServer(msg.param(1), msg.param(2), msg.param(3));
+
+  return true;
+}
+
+
+/// \brief Handle RPL_WHOISOPERATOR
+bool Connection::handleWhoisOperator(const IrcMessage& msg) {
+  // <target> <nick> :is an IRC operator
+  if (msg.paramCount() < 2) {
+    return false;
+  }
+
+  emit irc_whoisOperator(msg.param(1));
+
+  return true;
+}
+
+
+/// \brief Handle RPL_WHOISIDLE
+///
+/// RFC1459 only sends the idle time; most servers add the sign-on
+/// time before the trailing text.
+bool Connection::handleWhoisIdle(const IrcMessage& msg) {
+  // <target> <nick> <idle> [<signon>] :seconds idle
+  if (msg.paramCount() < 4) {
+    return false;
+  }
+
+  quint32 signon = (msg.paramCount() >= 5) ? msg.param(3).toUInt() : 0;
+
+  emit irc_whoisIdle(msg.param(1), msg.param(2).toUInt(), signon);
+
+  return true;
+}
+
+
+/// \brief Handle RPL_WHOISCHANNELS
+bool Connection::handleWhoisChannels(const IrcMessage& msg) {
+  // <target> <nick> :{[@|+]<channel><space>}
+  if (msg.paramCount() < 3) {
+    return false;
+  }
+
+  emit irc_whoisChannels(msg.param(1),
+			 msg.param(2).split(QChar(' '),
+					    QString::SkipEmptyParts));
+
+  return true;
+}
+
+
+/// \brief Handle RPL_ENDOFWHOIS
+bool Connection::handleEndOfWhois(const IrcMessage& msg) {
+  // <target> <nick> :End of WHOIS list
+  if (msg.paramCount() < 2) {
+    return false;
+  }
+
+  emit irc_endOfWhois(msg.param(1));
+
+  return true;
+}
+
+
+/// \brief Handle RPL_WHOREPLY
+bool Connection::handleWhoReply(const IrcMessage& msg) {
+  // <target> <channel> <user> <host> <server> <nick> <flags>
+  //   :<hopcount> <real name>
+  if (msg.paramCount() < 8) {
+    return false;
+  }
+
+  QString last = msg.param(7);
+  int space = last.indexOf(QChar(' '));
+  int hops = last.left(space).toInt();
+  QString realName = (space < 0) ? QString() : last.mid(space + 1);
+
+  emit irc_whoReply(msg.param(1),
+		    HostMask(msg.param(5), msg.param(2), msg.param(3)),
+		    msg.param(4), msg.param(6), hops, realName);
+
+  return true;
+}
+
+
+/// \brief Handle RPL_ENDOFWHO
+bool Connection::handleEndOfWho(const IrcMessage& msg) {
+  // <target> <mask> :End of WHO list
+  if (msg.paramCount() < 2) {
+    return false;
+  }
+
+  emit irc_endOfWho(msg.param(1));
+
+  return true;
+}
+
+
+/// \brief Handle RPL_LISTSTART
+bool Connection::handleListStart(const IrcMessage&) {
+  emit irc_listStart();
+
+  return true;
+}
+
+
+/// \brief Handle RPL_LIST
+bool Connection::handleList(const IrcMessage& msg) {
+  // <target> <channel> <# visible> :<topic>
+  if (msg.paramCount() < 3) {
+    return false;
+  }
+
+  QString topic = (msg.paramCount() >= 4) ? msg.param(3) : QString();
+
+  emit irc_list(msg.param(1), msg.param(2).toInt(), topic);
+
+  return true;
+}
+
+
+/// \brief Handle RPL_LISTEND
+bool Connection::handleListEnd(const IrcMessage&) {
+  emit irc_listEnd();
+
+  return true;
+}
+
+
+/// \brief Handle RPL_NOTOPIC
+bool Connection::handleNoTopic(const IrcMessage& msg) {
+  // <target> <channel> :No topic is set
+  if (msg.paramCount() < 2) {
+    return false;
+  }
+
+  emit irc_channelTopic(msg.param(1), QString());
+
+  return true;
+}
+
+
+/// \brief Handle RPL_TOPIC
+bool Connection::handleTopicReply(const IrcMessage& msg) {
+  // <target> <channel> :<topic>
+  if (msg.paramCount() < 3) {
+    return false;
+  }
+
+  emit irc_channelTopic(msg.param(1), msg.param(2));
+
+  return true;
+}
+
+
+/// \brief Handle RPL_TOPICWHOTIME (333)
+bool Connection::handleTopicWhoTime(const IrcMessage& msg) {
+  // <target> <channel> <nick!user@host> <timestamp>
+  if (msg.paramCount() < 4) {
+    return false;
+  }
+
+  QString setter = msg.param(2);
+  int bang = setter.indexOf(QChar('!'));
+  int at = setter.indexOf(QChar('@'), bang + 1);
+  HostMask creator(setter, "", "");
+  if (bang > 0 && at > bang) {
+    creator = HostMask(setter.left(bang), setter.mid(bang + 1, at - bang - 1),
+		       setter.mid(at + 1));
+  }
+
+  quint32 channelTS = msg.param(3).toUInt();
+
+  emit irc_channelInfo(msg.param(1), creator, channelTS);
+
+  return true;
+}
+
+
+/// \brief Handle RPL_NAMREPLY
+bool Connection::handleNames(const IrcMessage& msg) {
+  // RFC2812: <target> <symbol> <channel> :<names>
+  // RFC1459: <target> <channel> :<names>
+  if (msg.paramCount() < 3) {
+    return false;
+  }
+
+  emit irc_names(msg.param(msg.paramCount() - 2),
+		 msg.param(msg.paramCount() - 1)
+		 .split(QChar(' '), QString::SkipEmptyParts));
+
+  return true;
+}
+
+
+/// \brief Handle RPL_ENDOFNAMES
+bool Connection::handleEndOfNames(const IrcMessage& msg) {
+  // <target> <channel> :End of NAMES list
+  if (msg.paramCount() < 2) {
+    return false;
+  }
+
+  emit irc_endOfNames(msg.param(1));
+
+  return true;
+}
+
+
+/// \brief Handle RPL_MOTDSTART
+bool Connection::handleMotdStart(const IrcMessage&) {
+  m_motd.clear();
+
+  return true;
+}
+
+
+/// \brief Handle RPL_MOTD
+bool Connection::handleMotd(const IrcMessage& msg) {
+  // <target> :- <text>
+  if (msg.paramCount() < 2) {
+    return false;
+  }
+
+  QString line = msg.param(1);
+  if (line.startsWith("- ")) {
+    line.remove(0, 2);
+  }
+  m_motd.append(line);
+
+  return true;
+}
+
+
+/// \brief Handle RPL_ENDOFMOTD and ERR_NOMOTD
+bool Connection::handleEndOfMotd(const IrcMessage&) {
+  QStringList lines = m_motd;
+  m_motd.clear();
+
+  emit irc_motd(lines);
+
+  return true;
+}
+
+
+/// \brief Handle numerics in the error range
+bool Connection::handleError(const IrcMessage& msg) {
+  // <target> [<nick|channel|command>...] :<message>
+  if (msg.paramCount() < 2) {
+    return false;
+  }
+
+  QString target = (msg.paramCount() >= 3) ? msg.param(1) : QString();
+
+  emit irc_error(msg.numeric(), target, msg.param(msg.paramCount() - 1));
+
+  if (m_dispatcher.has<Error>()) {
+    Error e = { msg.numeric(), target, msg.param(msg.paramCount() - 1) };
+    m_dispatcher.dispatch(e);
+  }
+
+  return true;
+}
+
+
+/// \brief Send PONG response to PING command
+void Connection::sendPong(QString serverName) {
+  sendLine(m_writer.begin("PONG").trailing(serverName).line(), false);
+}
+
+
+/// \brief Setup timers and queue for outbound messages
+void Connection::setupTimers() {
+  m_clock.start();
+  m_writeBuffer.reserve(4096);
+}
+
+
+/// \brief Move the timers along when the connection changes threads
+///
+/// The WheelTimers are linked into the TimerService of the thread they
+/// were started in, which must not run them once the connection lives
+/// in another thread. QEvent::ThreadChange is delivered in the old
+/// thread right before the move, so the active timers are stopped
+/// there and restarted by resumeTimers() in the new thread.
+bool Connection::event(QEvent* e) {
+  if (e->type() == QEvent::ThreadChange) {
+    suspendTimers();
+  }
+
+  return QObject::event(e);
+}
+
+
+/// \brief Stop the active timers and remember their remaining time
+void Connection::suspendTimers() {
+  WheelTimer* timers[] = {
+    &m_queueTimer, &m_registrationTimer, &m_reconnectTimer,
+    &m_keepaliveTimer
+  };
+
+  const qint64 now = TimerService::instance()->now();
+  for (unsigned i = 0; i < sizeof(timers) / sizeof(timers[0]); ++i) {
+    if (timers[i]->isActive()) {
+      m_movedTimers.append(qMakePair(timers[i],
+				     qMax(timers[i]->deadline() - now,
+					  qint64(0))));
+      timers[i]->stop();
+    }
+  }
+
+  if (!m_movedTimers.isEmpty()) {
+    // posted events move along with the object
+    QMetaObject::invokeMethod(this, "resumeTimers", Qt::QueuedConnection);
+  }
+}
+
+
+/// \brief Restart the timers stopped by suspendTimers()
+///
+/// Runs in the new thread, so they go to its TimerService. Timers
+/// restarted in the meantime keep their new deadline.
+void Connection::resumeTimers() {
+  for (int i = 0; i < m_movedTimers.size(); ++i) {
+    WheelTimer* timer = m_movedTimers.at(i).first;
+    if (!timer->isActive()) {
+      TimerService::instance()->start(timer,
+				      static_cast<int>(m_movedTimers.at(i).second));
+    }
+  }
+
+  m_movedTimers.clear();
+}
+
+
+/// \brief Callback for m_queueTimer
+void Connection::queueTimerExpired(void* self) {
+  static_cast<Connection*>(self)->drainMessageQueue();
+}
+
+
+/// \brief Callback for m_registrationTimer
+///
+/// Reports the timeout as socketError() and disconnects, which
+/// schedules a reconnect attempt if enabled.
+void Connection::registrationTimerExpired(void* self) {
+  Connection* conn = static_cast<Connection*>(self);
+
+  qWarning() << "Connection: registration with" << conn->m_currentServer
+	     << "timed out";
+  emit conn->socketError(QAbstractSocket::SocketTimeoutError,
+			 "Registration timed out");
+
+  conn->m_transport->disconnectFromHost();
+}
+
+
+/// \brief Callback for m_reconnectTimer
+void Connection::reconnectTimerExpired(void* self) {
+  Connection* conn = static_cast<Connection*>(self);
+
+  if (!conn->m_connected) {
+    conn->connect();
+  }
+}
+
+
+/// \brief Callback for m_keepaliveTimer
+///
+/// Sends a PING if nothing was received for keepaliveInterval(), or
+/// gives up on the connection if the last one is overdue.
+void Connection::keepaliveTimerExpired(void* self) {
+  Connection* conn = static_cast<Connection*>(self);
+  const qint64 now = conn->m_clock.elapsed();
+
+  if (conn->m_pingSentAt >= 0) {
+    conn->keepaliveTimedOut();
+    return;
+  }
+
+  // the timer isn't moved for every read; catch up with the last one
+  const qint64 idle = now - conn->m_lastReceived;
+  if (idle < conn->m_keepaliveInterval) {
+    TimerService::instance()->start(&conn->m_keepaliveTimer,
+				    static_cast<int>(conn->m_keepaliveInterval - idle));
+    return;
+  }
+
+  conn->sendKeepalive(now);
+}
+
+
+/// \brief Arm m_queueTimer for the next queued message
+///
+/// Computes how long the first queued message has to wait for the flood
+/// control budget and starts the timer accordingly. Does nothing if the
+/// queue is empty or the timer is already running.
+void Connection::scheduleMessageQueue() {
+  if (m_messageQueue.isEmpty() || m_queueTimer.isActive())
+    return;
+
+  qint64 delay = m_floodControl.delayFor(m_messageQueue.head().size(),
+					 m_clock.elapsed());
+  if (delay < 0) {
+    qWarning() << "Connection: flood control doesn't refill; "
+	       << m_messageQueue.size() << "message(s) stay queued";
+    return;
+  }
+
+  TimerService::instance()->start(&m_queueTimer, static_cast<int>(delay));
+}
+
+
+/// \brief Send queued messages when m_queueTimer expired
+///
+/// Takes as many messages from the queue as the flood control budget
+/// allows and sends them to the IRC server in a single write. If any
+/// messages remain, the timer is re-armed for the time when the next
+/// one may be sent.
+void Connection::drainMessageQueue() {
+  if (!m_connected)
+    return;
+
+  qint64 now = m_clock.elapsed();
+  qint64 nowUsec = m_clock.nsecsElapsed() / 1000;
+
+  // collect everything into the reused write buffer; unlike a
+  // QByteArray, a QVarLengthArray keeps its allocation when resized
+  // to 0
+  m_writeBuffer.resize(0);
+  while (!m_messageQueue.isEmpty() &&
+	 m_floodControl.tryConsume(m_messageQueue.head().size(), now)) {
+    qint64 queuedAt;
+    const QByteArray line = m_messageQueue.takeHead(&queuedAt);
+    m_writeBuffer.append(line.constData(), line.size());
+
+    m_stats.queueLatency.record(qMax(nowUsec - queuedAt, qint64(0)));
+    ++m_stats.linesOut;
+  }
+
+  if (!m_writeBuffer.isEmpty()) {
+    // Transport::write() copies what it can't send right away
+    m_transport->write(QByteArray::fromRawData(m_writeBuffer.constData(),
+					       m_writeBuffer.size()));
+    m_stats.bytesOut += m_writeBuffer.size();
+  }
+
+  scheduleMessageQueue();
+}
+
+
+/// \brief Current flood control settings
+FloodControl Connection::floodControl() const {
+  return m_floodControl;
+}
+
+
+/// \brief Change flood control settings for queued messages
+void Connection::setFloodControl(const FloodControl& fc) {
+  m_floodControl = fc;
+  m_floodControl.reset(m_clock.elapsed());
+
+  // the new limits may allow sending earlier (or require waiting longer)
+  m_queueTimer.stop();
+  scheduleMessageQueue();
+}
+
+
+/// \brief Attempt to join a channel
+void Connection::joinChannel(QString channel, QString key) {
+  if (isConnected()) {
+    m_writer.begin("JOIN").param(channel);
+    if (!key.isEmpty()) {
+      m_writer.param(key);
+    }
+    sendLine(m_writer.line());
+  } else {
+    qWarning() << "Connection::joinChannel(" << channel << ") used "
+	       << "while Connection instance isn't connected!";
+  }
+}
+
+
+/// \brief Attempt to leave a channel
+void Connection::partChannel(QString channel) {
+  if (isConnected()) {
+    sendLine(m_writer.begin("PART").param(channel).line());
+  } else {
+    qWarning() << "Connection::partChannel(" << channel << ") used "
+	       << "while Connection instance isn't connected!";
+  }
+}
+
+
+/// \brief Quit IRC
+///
+/// Sends a QUIT message to the IRC server and thereby disconnects
+/// from it.
+///
+/// \param message Message text to use in QUIT command
+/// \param disconnect Flag that indicates wether we want to immediately
+/// disconnect after sending the QUIT command instead of waiting for
+/// the server to close the connection.
+void Connection::quit(QString message, bool disconnect) {
+  if (isConnected()) {
+    // the server closes the connection; don't reconnect
+    m_userDisconnect = true;
+
+    sendLine(m_writer.begin("QUIT").trailing(message).line(), false);
+    if (disconnect) {
+      this->disconnect();
+    }
+  } else {
+    qWarning() << "Tried to use Connection::quit() on a Connection "
+	       << "instance that isn't currently connected!";
+  }
+}
+
+
+/// \brief Get channel topic
+void Connection::getChannelTopic(QString channel) {
+  if (isConnected()) {
+    sendLine(m_writer.begin("TOPIC").param(channel).line());
+  } else {
+    qWarning() << "Tried to use Connection::getChannelTopic("
+	       << channel << ") while connection instance isn't connected!";
+  }
+}
+
+
+/// \brief Change channel topic
+void Connection::setChannelTopic(QString channel, QString topic) {
+  if (isConnected()) {
+    sendLine(m_writer.begin("TOPIC").param(channel).trailing(topic).line());
+  } else {
+    qWarning() << "Tried to use Connection::setChannelTopic("
+	       << channel << "," << topic << ") while Connection instance "
+	       << "isn't connected!";
+  }
+}
+
+
+/// \brief Get list of users on a channel
+void Connection::getChannelNames(QString channel) {
+  if (isConnected()) {
+    sendLine(m_writer.begin("NAMES").param(channel).line());
+  } else {
+    qWarning() << "Tried to use Connection::getChannelMembers("
+	       << channel << ") while connection instance isn't connected!";
+  }
+}
+
+
+/// \brief Invite user to channel
+void Connection::inviteUser(QString nick, QString channel) {
+  if (isConnected()) {
+    sendLine(m_writer.begin("INVITE").param(nick).param(channel).line());
+  } else {
+    qWarning() << "Tried to use Connection::inviteUser(" << nick << ","
+	       << channel << ") while Connection instance isn't connected!";
+  }
+}
+
+
+/// \brief Send a message to a nick or channel
+///
+/// Text that doesn't fit into a single line is split into several
+/// messages, preferably between words.
+void Connection::privmsg(QString target, QString text) {
+  if (isConnected()) {
+    QStringList chunks =
+      MessageWriter::split(text, maxTextLength("PRIVMSG", target));
+    for (int i = 0; i < chunks.size(); ++i) {
+      sendLine(m_writer.begin("PRIVMSG").param(target)
+	       .trailing(chunks.at(i)).line());
+    }
+  } else {
+    qWarning() << "Tried to use Connection::privmsg() while "
+	       << "Connection instance isn't connected!";
+  }
+}
+
+
+/// \brief Send a notice to a nick or channel
+///
+/// Text that doesn't fit into a single line is split into several
+/// notices, preferably between words.
+void Connection::notice(QString target, QString text) {
+  if (isConnected()) {
+    QStringList chunks =
+      MessageWriter::split(text, maxTextLength("NOTICE", target));
+    for (int i = 0; i < chunks.size(); ++i) {
+      sendLine(m_writer.begin("NOTICE").param(target)
+	       .trailing(chunks.at(i)).line());
+    }
+  } else {
+    qWarning() << "Tried to use Connection::notice() while "
+	       << "Connection instance isn't connected!";
+  }
+}
+
+
+/// \brief Channel state tracker fed by this connection (may be NULL)
+ChannelStateTracker* Connection::channelStateTracker() const {
+  return m_tracker;
+}
+
+
+/// \brief Feed all received messages to the given tracker
+///
+/// The tracker isn't owned by the connection; pass NULL to stop
+/// tracking. The tracker should be set before connecting, since it
+/// can only build rosters for channels joined while it's attached.
+void Connection::setChannelStateTracker(ChannelStateTracker* tracker) {
+  m_tracker = tracker;
+  updateInterests();
+}
+
+
+/// \brief Ring receiving all messages (may be NULL)
+EventRing* Connection::eventRing() const {
+  return m_eventRing;
+}
+
+
+/// \brief Push all received messages into the given ring
+///
+/// This is meant for connections running on another thread than their
+/// consumer: instead of connecting to signals with queued connections,
+/// the consumer drains the ring. The ring isn't owned by the connection
+/// and must not be fed by connections on other threads. Set it before
+/// the connection is moved to its thread (e.g. before handing it to a
+/// ConnectionPool); pass NULL to stop.
+void Connection::setEventRing(EventRing* ring) {
+  m_eventRing = ring;
+  updateInterests();
+}
+
+
+/// \brief Recorder receiving the inbound byte stream (NULL if none)
+TrafficRecorder* Connection::trafficRecorder() const {
+  return m_recorder;
+}
+
+
+/// \brief Record the inbound byte stream
+///
+/// Every chunk read from the transport is passed to the recorder
+/// before it is parsed. The recorder isn't owned by the connection;
+/// pass NULL to stop.
+void Connection::setTrafficRecorder(TrafficRecorder* recorder) {
+  m_recorder = recorder;
+}
+
+
+/// \brief Transport used to talk to the server
+Transport* Connection::transport() const {
+  return m_transport;
+}
+
+
+/// \brief Use another transport (e.g. an EpollTransport)
+///
+/// The connection takes ownership of the transport and deletes the
+/// previous one. The transport can only be changed while the
+/// connection is disconnected.
+///
+/// \return false if the connection is connected or transport is NULL
+bool Connection::setTransport(Transport* transport) {
+  if (transport == NULL || transport == m_transport) {
+    return (transport != NULL);
+  }
+
+  if (m_connected) {
+    qWarning() << "Connection::setTransport() called while connected to"
+	       << m_currentServer;
+    return false;
+  }
+
+  delete m_transport;
+  attachTransport(transport);
+
+  return true;
+}
+
+
+/// \brief Snapshot of the connection's performance counters
+///
+/// Counting is always on; it costs a few additions per line and one
+/// clock read per received line. From other threads (e.g. for a
+/// connection in a ConnectionPool) use requestStatistics() instead.
+ConnectionStatistics Connection::statistics() const {
+  ConnectionStatistics stats = m_stats;
+
+  stats.queueDepth = m_messageQueue.size();
+
+  if (!m_rttWindow.isEmpty()) {
+    QVector<int> rtts = m_rttWindow;
+    qSort(rtts.begin(), rtts.end());
+
+    qint64 sum = 0;
+    for (int i = 0; i < rtts.size(); ++i) {
+      sum += rtts.at(i);
+    }
+
+    // nearest rank
+    const int rank = (99 * rtts.size() + 99) / 100;
+
+    stats.rttMin = rtts.first();
+    stats.rttAverage = static_cast<int>(sum / rtts.size());
+    stats.rttP99 = rtts.at(rank - 1);
+  }
+
+  return stats;
+}
+
+
+/// \brief Emit statisticsReady() with a snapshot of the counters
+///
+/// Meant to be queued from other threads (see
+/// ConnectionPool::requestStatistics()): unlike a blocking call, the
+/// caller isn't stuck if the connection is deleted before the request
+/// is delivered.
+void Connection::requestStatistics() {
+  emit statisticsReady(statistics());
+}
+
+
+/// \brief Set all performance counters to zero
+void Connection::resetStatistics() {
+  m_stats = ConnectionStatistics();
+  m_rttWindow.clear();
+  m_rttNext = 0;
+}
+
+
+/// \brief Count a line that couldn't be parsed or handled
+///
+/// The server chooses the commands, so only the first
+/// ConnectionStatistics::MaxFailureCommands distinct ones get a key of
+/// their own; later ones are counted as "other".
+void Connection::countParseFailure(const IrcMessage& msg) {
+  ++m_stats.parseFailures;
+
+  QByteArray command;
+  if (msg.isValid()) {
+    command = QByteArray(msg.commandData(), msg.commandLength());
+  }
+
+  QHash<QByteArray, quint64>& failures = m_stats.parseFailuresByCommand;
+  if (!failures.contains(command) &&
+      failures.size() >= ConnectionStatistics::MaxFailureCommands) {
+    command = "other";
+  }
+  ++failures[command];
+}
+
+
+/// \brief Time the server may take to accept our registration
+///
+/// \return Timeout in milliseconds or 0 if unlimited
+int Connection::registrationTimeout() const {
+  return m_registrationTimeout;
+}
+
+
+/// \brief Set time the server may take to accept our registration
+///
+/// If the server hasn't sent RPL_WELCOME this long after the connection
+/// was established, socketError() is emitted with SocketTimeoutError
+/// and the connection is closed. Defaults to 60 seconds.
+///
+/// \param msec Timeout in milliseconds or 0 to wait forever
+void Connection::setRegistrationTimeout(int msec) {
+  m_registrationTimeout = qMax(msec, 0);
+}
+
+
+/// \brief Delay before the first automatic reconnect
+///
+/// \return Delay in milliseconds or 0 if reconnecting is disabled
+int Connection::reconnectDelay() const {
+  return m_reconnectDelay;
+}
+
+
+/// \brief Reconnect automatically after connection losses
+///
+/// When the connection is lost or a connection attempt fails without
+/// disconnect() having been called, connect() is called again after
+/// msec milliseconds. The delay doubles with every further failed
+/// attempt (plus up to 25% random jitter, so many connections to the
+/// same server don't reconnect at once), up to maxReconnectDelay(),
+/// and is reset once the server accepted our registration.
+///
+/// \param msec Initial delay in milliseconds or 0 to disable (default)
+void Connection::setReconnectDelay(int msec) {
+  m_reconnectDelay = qMax(msec, 0);
+  m_nextReconnectDelay = m_reconnectDelay;
+
+  if (m_reconnectDelay == 0) {
+    m_reconnectTimer.stop();
+  }
+}
+
+
+/// \brief Upper limit for the reconnect backoff in milliseconds
+int Connection::maxReconnectDelay() const {
+  return m_maxReconnectDelay;
+}
+
+
+/// \brief Set upper limit for the reconnect backoff (default 5 minutes)
+void Connection::setMaxReconnectDelay(int msec) {
+  m_maxReconnectDelay = qMax(msec, 0);
+}
+
+
+/// \brief Schedule a reconnect attempt after an involuntary disconnect
+void Connection::scheduleReconnect() {
+  if (m_reconnectDelay <= 0 || m_userDisconnect ||
+      m_reconnectTimer.isActive()) {
+    return;
+  }
+
+  int delay = qBound(m_reconnectDelay, m_nextReconnectDelay,
+		     qMax(m_reconnectDelay, m_maxReconnectDelay));
+  m_nextReconnectDelay = (delay > m_maxReconnectDelay / 2) ?
+    m_maxReconnectDelay : 2 * delay;
+
+  delay += qrand() % (delay / 4 + 1);
+
+  qDebug() << "Connection: reconnecting to" << m_currentServer << "in"
+	   << delay << "ms";
+  TimerService::instance()->start(&m_reconnectTimer, delay);
+}
+
+
+/// \brief Idle time before a keepalive PING is sent
+///
+/// \return Interval in milliseconds or 0 if keepalive is disabled
+int Connection::keepaliveInterval() const {
+  return m_keepaliveInterval;
+}
+
+
+/// \brief Send PINGs on idle connections
+///
+/// Once the server accepted our registration, a PING is sent whenever
+/// nothing was received for msec milliseconds. The time until the
+/// server answers it is reported as lagMeasured() and collected in
+/// statistics(). If the answer takes longer than pingTimeout(), the
+/// link is considered dead: socketError() is emitted with
+/// SocketTimeoutError, the connection is aborted and reconnected
+/// (after the backoff if setReconnectDelay() is used, at once
+/// otherwise).
+///
+/// This detects half-open connections long before the operating
+/// system would.
+///
+/// \param msec Interval in milliseconds or 0 to disable (default)
+void Connection::setKeepaliveInterval(int msec) {
+  m_keepaliveInterval = qMax(msec, 0);
+
+  // an unanswered PING keeps its deadline
+  if (m_pingSentAt < 0) {
+    m_keepaliveTimer.stop();
+    scheduleKeepalive();
+  }
+}
+
+
+/// \brief Time the server may take to answer a keepalive PING
+///
+/// \return Timeout in milliseconds or 0 if unlimited
+int Connection::pingTimeout() const {
+  return m_pingTimeout;
+}
+
+
+/// \brief Set time the server may take to answer a keepalive PING
+///
+/// Applies to the PINGs sent after the call. Defaults to 60 seconds.
+///
+/// \param msec Timeout in milliseconds or 0 to wait forever
+void Connection::setPingTimeout(int msec) {
+  m_pingTimeout = qMax(msec, 0);
+}
+
+
+/// \brief Round trip time of the last answered keepalive PING
+///
+/// \return Lag in milliseconds or -1 if it wasn't measured yet
+int Connection::lag() const {
+  return m_stats.lag;
+}
+
+
+/// \brief Arm m_keepaliveTimer for the next keepalive PING
+///
+/// Does nothing unless keepalive is enabled and we're registered.
+void Connection::scheduleKeepalive() {
+  if (m_keepaliveInterval <= 0 || !m_registered ||
+      m_keepaliveTimer.isActive()) {
+    return;
+  }
+
+  const qint64 idle = m_clock.elapsed() - m_lastReceived;
+  TimerService::instance()->start(&m_keepaliveTimer,
+				  static_cast<int>(qMax(m_keepaliveInterval - idle,
+							qint64(0))));
+}
+
+
+/// \brief Send a keepalive PING and start waiting for its PONG
+///
+/// The token carries the send time, which makes answers to earlier
+/// PINGs distinguishable.
+///
+/// \param now Current m_clock time in ms
+void Connection::sendKeepalive(qint64 now) {
+  m_pingToken = "QIRC" + QByteArray::number(now);
+  m_pingSentAt = now;
+  ++m_stats.pingsSent;
+
+  // not queued, so the measurement isn't skewed by flood control
+  sendLine(m_writer.begin("PING")
+	   .trailing(QString::fromLatin1(m_pingToken)).line(), false);
+
+  if (m_pingTimeout > 0) {
+    TimerService::instance()->start(&m_keepaliveTimer, m_pingTimeout);
+  }
+}
+
+
+/// \brief Give up on a connection whose keepalive PING wasn't answered
+///
+/// Aborts the connection, since a graceful disconnect would wait for
+/// the dead link, and reconnects.
+void Connection::keepaliveTimedOut() {
+  const int waited = static_cast<int>(m_clock.elapsed() - m_pingSentAt);
+  m_pingSentAt = -1;
+  ++m_stats.pingTimeouts;
+
+  qWarning() << "Connection:" << m_currentServer << "didn't answer PING in"
+	     << waited << "ms";
+  emit socketError(QAbstractSocket::SocketTimeoutError,
+		   QString("Ping timeout: %1 ms").arg(waited));
+
+  // disconnected() schedules the reconnect if a backoff is configured
+  m_transport->abort();
+
+  if (!m_userDisconnect && !m_reconnectTimer.isActive()) {
+    connect();
+  }
+}
+
+
+/// \brief Add a round trip time to the RTT statistics
+void Connection::recordRtt(int msec) {
+  if (m_rttWindow.size() < RttWindow) {
+    m_rttWindow.append(msec);
+  } else {
+    m_rttWindow[m_rttNext] = msec;
+  }
+  m_rttNext = (m_rttNext + 1) % RttWindow;
+
+  m_stats.lag = msec;
+}
+
+
+/// \brief Remove a handler registered with on()
+///
+/// May be called from within a handler.
+///
+/// \return false if there is no handler with this id
+bool Connection::off(int handlerId) {
+  if (!m_dispatcher.off(handlerId)) {
+    return false;
+  }
+
+  updateInterests();
+  return true;
+}
+
+
+/// \brief Interests received messages are currently decoded for
+///
+/// Combination of Interest flags. It's updated automatically when
+/// signals are connected or disconnected and when handlers are
+/// registered with on(); a channel state tracker or event ring needs
+/// every message (RawInterest). PING and server messages are always
+/// decoded, as are NICK, JOIN and PART messages about ourselves.
+///
+/// Signals whose receivers are destroyed without disconnecting may
+/// keep their interest set; that only costs the decoding.
+int Connection::interests() const {
+  return m_interests;
+}
+
+
+/// \brief Interests decoded regardless of subscribers
+int Connection::interestMask() const {
+  return m_interestMask;
+}
+
+
+/// \brief Always decode messages of the given interests
+///
+/// Use this for subclasses or callers that read messages with means
+/// other than the signals of this class. AllInterests turns lazy
+/// decoding off.
+///
+/// \param mask Combination of Interest flags
+void Connection::setInterestMask(int mask) {
+  m_interestMask = mask;
+  updateInterests();
+}
+
+
+/// \brief Recompute interests when a signal is connected
+void Connection::connectNotify(const char* signal) {
+  QObject::connectNotify(signal);
+  updateInterests();
+}
+
+
+/// \brief Recompute interests when a signal is disconnected
+void Connection::disconnectNotify(const char* signal) {
+  QObject::disconnectNotify(signal);
+  updateInterests();
+}
+
+
+/// \brief Recompute m_interests from connected signals and handlers
+void Connection::updateInterests() {
+  static const struct {
+    const char* signal;
+    int interest;
+  } signalInterests[] = {
+    { SIGNAL(irc_message(QIRC::IrcMessage)), RawInterest },
+    { SIGNAL(irc_messages(QVector<QIRC::IrcMessage>)), RawInterest },
+    { SIGNAL(irc_notice_auth(QString,QString)), NoticeInterest },
+    { SIGNAL(irc_notice(QIRC::HostMask,QString,QString)), NoticeInterest },
+    { SIGNAL(irc_privmsg(QIRC::HostMask,QString,QString)), PrivmsgInterest },
+    { SIGNAL(irc_mode(QIRC::HostMask,QString,QString)), ModeInterest },
+    { SIGNAL(irc_nick(QIRC::HostMask,QString)), NickInterest },
+    { SIGNAL(irc_join(QIRC::HostMask,QString)), JoinInterest },
+    { SIGNAL(irc_part(QIRC::HostMask,QString)), PartInterest },
+    { SIGNAL(irc_topic(QIRC::HostMask,QString,QString)), TopicInterest },
+    { SIGNAL(irc_invite(QIRC::HostMask,QString,QString)), InviteInterest },
+    { SIGNAL(irc_away(QString,QString)), WhoisInterest },
+    { SIGNAL(irc_whoisUser(QIRC::HostMask,QString)), WhoisInterest },
+    { SIGNAL(irc_whoisServer(QString,QString,QString)), WhoisInterest },
+    { SIGNAL(irc_whoisOperator(QString)), WhoisInterest },
+    { SIGNAL(irc_whoisIdle(QString,quint32,quint32)), WhoisInterest },
+    { SIGNAL(irc_whoisChannels(QString,QStringList)), WhoisInterest },
+    { SIGNAL(irc_endOfWhois(QString)), WhoisInterest },
+    { SIGNAL(irc_whoReply(QString,QIRC::HostMask,QString,QString,int,QString)),
+      WhoInterest },
+    { SIGNAL(irc_endOfWho(QString)), WhoInterest },
+    { SIGNAL(irc_listStart()), ListInterest },
+    { SIGNAL(irc_list(QString,int,QString)), ListInterest },
+    { SIGNAL(irc_listEnd()), ListInterest },
+    { SIGNAL(irc_channelTopic(QString,QString)), ChannelInfoInterest },
+    { SIGNAL(irc_channelInfo(QString,QIRC::HostMask,quint32)),
+      ChannelInfoInterest },
+    { SIGNAL(irc_names(QString,QStringList)), NamesInterest },
+    { SIGNAL(irc_endOfNames(QString)), NamesInterest },
+    { SIGNAL(irc_error(int,QString,QString)), ErrorInterest }
+  };
+  static const int signalCount =
+    sizeof(signalInterests) / sizeof(signalInterests[0]);
+
+  // indexed by EventId
+  static const int eventInterests[EventCount] = {
+    RawInterest, PrivmsgInterest, NoticeInterest, ModeInterest,
+    NickInterest, JoinInterest, PartInterest, PingInterest,
+    TopicInterest, InviteInterest, ErrorInterest
+  };
+
+  int interests = m_interestMask | PingInterest | ServerInterest;
+
+  if (m_tracker != NULL || m_eventRing != NULL) {
+    interests |= RawInterest;
+  }
+
+  for (int i = 0; i < signalCount; ++i) {
+    if ((interests & signalInterests[i].interest) == 0 &&
+	receivers(signalInterests[i].signal) > 0) {
+      interests |= signalInterests[i].interest;
+    }
+  }
+
+  for (int e = 0; e < EventCount; ++e) {
+    if (m_dispatcher.has(e)) {
+      interests |= eventInterests[e];
+    }
+  }
+
+  m_interests.fetchAndStoreOrdered(interests);
+}
+
+
+/// \brief Has the server announced the given ISUPPORT token?
+bool Connection::hasISupport(const QString& key) const {
+  return m_isupport.contains(key.toUtf8());
+}
+
+
+/// \brief Value of an ISUPPORT token, e.g. "(ov)@+" for "PREFIX"
+///
+/// Returns an empty string for tokens without value or that weren't
+/// announced; use hasISupport() to tell them apart.
+QString Connection::isupport(const QString& key) const {
+  return QString::fromUtf8(m_isupport.value(key.toUtf8()));
+}
@@ -1,13 +1,31 @@
 #ifndef CONNECTION_H
 #define CONNECTION_H 1
 
+#include <QAtomicInt>
 #include <QObject>
-#include <QTcpSocket>
-#include <QTimer>
+#include <QAbstractSocket>
+#include <QElapsedTimer>
+#include <QHash>
+#include <QPair>
 #include <QStringList>
+#include <QVarLengthArray>
+#include <QVector>
 
 #include "ServerInfo"
 #include "HostMask"
+#include "IrcMessage"
+#include "LineFramer"
+#include "FloodControl"
+#include "MessageQueue"
+#include "MessageWriter"
+#include "ChannelStateTracker"
+#include "EventRing"
+#include "EventDispatcher"
+#include "Transport"
+#include "TimerService"
+#include "ConnectionStatistics"
+#include "TrafficRecorder"
+#include "numerics.h"
 
 #include "qirc.h"
 
@@ -15,9 +33,74 @@ namespace QIRC {
   /// \brief Connection to an IRC server
   ///
   /// This class maintains a connection to an IRC server.
+  ///
+  /// Commands sent to the server are Q_INVOKABLE, so they can be called
+  /// from other threads with QMetaObject::invokeMethod() (see
+  /// ConnectionPool).
   class Connection : public QObject {
     Q_OBJECT
   public:
+    /// \brief Groups of events messages are decoded for
+    ///
+    /// The connection only decodes received messages that someone is
+    /// interested in, see interests(). Other lines are dropped right
+    /// after their command has been looked at.
+    enum Interest {
+      /// \brief Every message (irc_message(), irc_messages(), RawMessage)
+      RawInterest = 0x00001,
+
+      /// \brief PING and PONG (always decoded, the connection answers
+      /// PINGs and measures the lag with PONGs)
+      PingInterest = 0x00002,
+
+      /// \brief NOTICE, including NOTICE AUTH
+      NoticeInterest = 0x00004,
+
+      /// \brief PRIVMSG
+      PrivmsgInterest = 0x00008,
+
+      /// \brief MODE
+      ModeInterest = 0x00010,
+
+      /// \brief NICK of other users
+      NickInterest = 0x00020,
+
+      /// \brief JOIN of other users
+      JoinInterest = 0x00040,
+
+      /// \brief PART of other users
+      PartInterest = 0x00080,
+
+      /// \brief TOPIC
+      TopicInterest = 0x00100,
+
+      /// \brief INVITE
+      InviteInterest = 0x00200,
+
+      /// \brief Registration, ISUPPORT and MOTD (always decoded)
+      ServerInterest = 0x00400,
+
+      /// \brief WHOIS and AWAY replies
+      WhoisInterest = 0x00800,
+
+      /// \brief WHO replies
+      WhoInterest = 0x01000,
+
+      /// \brief LIST replies
+      ListInterest = 0x02000,
+
+      /// \brief Channel topic and creation time replies
+      ChannelInfoInterest = 0x04000,
+
+      /// \brief NAMES replies
+      NamesInterest = 0x08000,
+
+      /// \brief Error replies
+      ErrorInterest = 0x10000,
+
+      AllInterests = 0x1ffff
+    };
+
     Connection();
     Connection(const ServerInfo& si);
     Connection(QString h, quint16 p);
@@ -34,35 +117,108 @@ namespace QIRC {
     void setIdent(QString ident);
 
     QString nick() const ;
-    void setNick(QString nick);
+    Q_INVOKABLE void setNick(QString nick);
 
     QString realName() const;
     void setRealName(QString realName);
 
-    void connect();
-    void disconnect();
+    Q_INVOKABLE void connect();
+    Q_INVOKABLE void disconnect();
     bool isConnected() const;
 
-    void joinChannel(QString channel, QString key="");
-    void partChannel(QString channel);
+    Q_INVOKABLE void joinChannel(QString channel, QString key="");
+    Q_INVOKABLE void partChannel(QString channel);
+
+    Q_INVOKABLE void getChannelTopic(QString channel);
+    Q_INVOKABLE void setChannelTopic(QString channel, QString topic);
+
+    Q_INVOKABLE void getChannelNames(QString channel);
+
+    Q_INVOKABLE void inviteUser(QString nick, QString channel);
+
+    Q_INVOKABLE void quit(QString message, bool disconnect=true);
+
+    int maxLineLength() const;
+    void setMaxLineLength(int length);
+
+    FloodControl floodControl() const;
+    void setFloodControl(const FloodControl& fc);
+
+    int queueLimit(MessageQueue::Lane lane) const;
+    void setQueueLimit(MessageQueue::Lane lane, int depth,
+		       MessageQueue::OverflowPolicy policy=MessageQueue::DropOldest);
+    int queuedMessages() const;
+
+    Q_INVOKABLE void privmsg(QString target, QString text);
+    Q_INVOKABLE void notice(QString target, QString text);
+
+    ChannelStateTracker* channelStateTracker() const;
+    void setChannelStateTracker(ChannelStateTracker* tracker);
+
+    EventRing* eventRing() const;
+    void setEventRing(EventRing* ring);
+
+    Transport* transport() const;
+    bool setTransport(Transport* transport);
+
+    TrafficRecorder* trafficRecorder() const;
+    void setTrafficRecorder(TrafficRecorder* recorder);
+    void feed(const QByteArray& data);
+
+    int registrationTimeout() const;
+    void setRegistrationTimeout(int msec);
 
-    void getChannelTopic(QString channel);
-    void setChannelTopic(QString channel, QString topic);
+    Q_INVOKABLE QIRC::ConnectionStatistics statistics() const;
+    Q_INVOKABLE void requestStatistics();
+    Q_INVOKABLE void resetStatistics();
 
-    void getChannelNames(QString channel);
+    int reconnectDelay() const;
+    void setReconnectDelay(int msec);
+    int maxReconnectDelay() const;
+    void setMaxReconnectDelay(int msec);
 
-    void inviteUser(QString nick, QString channel);
+    /// \brief Number of round trip times in the RTT statistics
+    enum { RttWindow = 100 };
 
-    void quit(QString message, bool disconnect=true);
+    int keepaliveInterval() const;
+    void setKeepaliveInterval(int msec);
+    int pingTimeout() const;
+    void setPingTimeout(int msec);
+    int lag() const;
 
-    void privmsg(QString target, QString text);
+    bool hasISupport(const QString& key) const;
+    QString isupport(const QString& key) const;
+
+    /// \brief Call handler for every received event of type E
+    ///
+    /// A lighter alternative to the irc_* signals: handlers are called
+    /// directly, in the thread the connection lives in, right after the
+    /// matching signal has been emitted. Events without handlers aren't
+    /// built at all. E is one of the structs from events.h and handler
+    /// any function or function object callable with a const E&, e.g.
+    /// \code
+    /// conn.on<Privmsg>(&onPrivmsg);
+    /// \endcode
+    ///
+    /// \return Id for removing the handler with off()
+    template<typename E, typename F> int on(F handler) {
+      int id = m_dispatcher.on<E>(handler);
+      updateInterests();
+      return id;
+    }
+
+    bool off(int handlerId);
+
+    int interests() const;
+    int interestMask() const;
+    void setInterestMask(int mask);
 
   protected:
     /// \brief ServerInfo for the currently connected server
     ServerInfo m_currentServer;
 
-    /// \brief TCP socket for connection to server
-    QTcpSocket* m_socket;
+    /// \brief Socket for connection to server
+    Transport* m_transport;
 
     /// \brief Flag indicating wether we're currently connected
     bool m_connected;
@@ -82,24 +238,146 @@ namespace QIRC {
     /// \brief Real name to use on IRC
     QString m_realName;
 
-    /// \brief Queue for outgoing IRC messages
-    QStringList m_messageQueue;
+    /// \brief Splits inbound data into message lines
+    LineFramer m_framer;
+
+    /// \brief Queue for outgoing IRC messages (encoded, with terminator)
+    MessageQueue m_messageQueue;
+
+    /// \brief Expires when the next queued message may be sent
+    WheelTimer m_queueTimer;
+
+    /// \brief Token bucket limiting the rate of queued messages
+    FloodControl m_floodControl;
+
+    /// \brief Monotonic clock for m_floodControl
+    QElapsedTimer m_clock;
+
+    /// \brief Builds outbound message lines
+    MessageWriter m_writer;
+
+    /// \brief Reused buffer for writing queued messages to the socket
+    ///
+    /// Allocated once in setupTimers() and never shrunk.
+    QVarLengthArray<char, 1> m_writeBuffer;
+
+    /// \brief Length of our host name as seen by the server
+    int m_ownHostLength;
+
+    /// \brief Channel state fed with received messages (not owned)
+    ChannelStateTracker* m_tracker;
+
+    /// \brief Messages of the current read for irc_messages()
+    QVector<IrcMessage> m_batch;
+
+    /// \brief Ring receiving all messages (not owned)
+    EventRing* m_eventRing;
+
+    /// \brief Handlers registered with on()
+    EventDispatcher m_dispatcher;
+
+    /// \brief Interests that currently have subscribers (see interests())
+    QAtomicInt m_interests;
+
+    /// \brief Interests that are decoded regardless of subscribers
+    int m_interestMask;
+
+    /// \brief ISUPPORT (005) tokens announced by the server
+    QHash<QByteArray, QByteArray> m_isupport;
+
+    /// \brief MOTD lines received so far
+    QStringList m_motd;
+
+    /// \brief Expires if the server doesn't accept our registration
+    WheelTimer m_registrationTimer;
+
+    /// \brief Time allowed for registration in ms (0: unlimited)
+    int m_registrationTimeout;
+
+    /// \brief Expires when the next reconnect attempt is due
+    WheelTimer m_reconnectTimer;
+
+    /// \brief Delay before the first reconnect attempt in ms (0: off)
+    int m_reconnectDelay;
+
+    /// \brief Upper limit for the reconnect backoff in ms
+    int m_maxReconnectDelay;
+
+    /// \brief Delay before the next reconnect attempt in ms
+    int m_nextReconnectDelay;
+
+    /// \brief Flag indicating that disconnect() was called
+    bool m_userDisconnect;
+
+    /// \brief Performance counters (see statistics())
+    ConnectionStatistics m_stats;
+
+    /// \brief Expires when a keepalive PING is due or overdue
+    WheelTimer m_keepaliveTimer;
+
+    /// \brief Idle time before a keepalive PING is sent in ms (0: off)
+    int m_keepaliveInterval;
+
+    /// \brief Time the server may take to answer a keepalive PING in ms
+    int m_pingTimeout;
 
-    /// \brief Timer to send queued messages
-    QTimer* m_tMessageQueue;
+    /// \brief Flag indicating that the server accepted our registration
+    bool m_registered;
+
+    /// \brief m_clock time in ms when data was last received
+    qint64 m_lastReceived;
+
+    /// \brief m_clock time in ms of the unanswered PING (-1: none)
+    qint64 m_pingSentAt;
+
+    /// \brief Token of the unanswered PING
+    QByteArray m_pingToken;
+
+    /// \brief Last RttWindow round trip times in ms (ring buffer)
+    QVector<int> m_rttWindow;
+
+    /// \brief Index in m_rttWindow overwritten by the next sample
+    int m_rttNext;
+
+    /// \brief Recorder for the inbound byte stream (not owned)
+    TrafficRecorder* m_recorder;
+
+    /// \brief Timers stopped by a thread change, with the remaining ms
+    QVector<QPair<WheelTimer*, qint64> > m_movedTimers;
+
+    /// \brief Pointer to a handler for one IRC command
+    typedef bool (Connection::*MessageHandler)(const IrcMessage&);
 
     void sendMessage(QString msg, bool queued=true);
+    void sendMessage(QString msg, MessageQueue::Lane lane);
+    void sendLine(const QByteArray& line, bool queued=true);
+    void sendLine(const QByteArray& line, MessageQueue::Lane lane);
+    int maxTextLength(const char* command, const QString& target) const;
     bool parseMessage(QString msg);
+    bool parseMessage(const IrcMessage& msg);
+    int parseMessages(const QByteArray& buffer,
+		      const QVector<LineFramer::Line>& lines);
     void authenticate();
 
     void sendPong(QString serverName);
+    void scheduleMessageQueue();
+    void drainMessageQueue();
+    void countParseFailure(const IrcMessage& msg);
+    void scheduleReconnect();
+    void scheduleKeepalive();
+    void sendKeepalive(qint64 now);
+    void keepaliveTimedOut();
+    void recordRtt(int msec);
+
+    virtual bool event(QEvent* e);
+    void suspendTimers();
 
   protected slots:
+    void resumeTimers();
     void socket_connected();
     void socket_disconnected();
     void socket_error(QAbstractSocket::SocketError);
     void socket_readyRead();
-    void timer_messageQueue();
 
   signals:
     /// \brief TCP/IP socket error
@@ -124,6 +402,39 @@ namespace QIRC {
     /// \param si ServerInfo object with the server that got disconnected
     void disconnected(QIRC::ServerInfo si);
 
+    /// \brief Measured the round trip time to the server
+    ///
+    /// This signal gets emitted whenever the server answers a keepalive
+    /// PING, see setKeepaliveInterval().
+    ///
+    /// \param msec Round trip time in milliseconds
+    void lagMeasured(int msec);
+
+    /// \brief Answer to requestStatistics()
+    ///
+    /// \param stats Snapshot of the performance counters
+    void statisticsReady(QIRC::ConnectionStatistics stats);
+
+    /// \brief Got IRC message
+    ///
+    /// This signal gets emitted for every message line received from the
+    /// IRC server, before it is handled by the connection itself.
+    /// The message only references the received data; fields get decoded
+    /// when they're accessed.
+    ///
+    /// \param msg The received message
+    void irc_message(const QIRC::IrcMessage& msg);
+
+    /// \brief Got a batch of IRC messages
+    ///
+    /// This signal gets emitted once per read from the socket with all
+    /// messages parsed from that read, in order, after each of them has
+    /// been handled (and the per-message signals were emitted). It is
+    /// only assembled while something is connected to it.
+    ///
+    /// \param messages The received messages
+    void irc_messages(const QVector<QIRC::IrcMessage>& messages);
+
     /// \brief Got IRC PING message
     ///
     /// This signal gets emitted whenever we receive a PING message from
@@ -258,9 +569,198 @@ namespace QIRC {
     /// \param channel Name of the channel into which we've been invited
     void irc_invite(QIRC::HostMask sender, QString target, QString channel);
 
+    /// \brief Registration completed
+    ///
+    /// This signal is emitted for each of the RPL_WELCOME, RPL_YOURHOST
+    /// and RPL_CREATED replies sent by the server after registration.
+    ///
+    /// \param numeric Reply code (1, 2 or 3)
+    /// \param message Message text as string
+    void irc_welcome(int numeric, QString message);
+
+    /// \brief Server information (RPL_MYINFO)
+    ///
+    /// \param serverName Name of the server
+    /// \param version Server software version
+    /// \param userModes Available user modes
+    /// \param channelModes Available channel modes
+    void irc_myInfo(QString serverName, QString version, QString userModes,
+		    QString channelModes);
+
+    /// \brief Server features (RPL_ISUPPORT)
+    ///
+    /// The tokens are also stored and can be queried with isupport().
+    ///
+    /// \param tokens Tokens of this reply, e.g. "PREFIX=(ov)@+"
+    void irc_isupport(QStringList tokens);
+
+    /// \brief User is away (RPL_AWAY)
+    ///
+    /// \param nick Nickname of the user
+    /// \param message Away message
+    void irc_away(QString nick, QString message);
+
+    /// \brief WHOIS reply: user information (RPL_WHOISUSER)
+    ///
+    /// \param user Host mask of the user
+    /// \param realName Real name of the user
+    void irc_whoisUser(QIRC::HostMask user, QString realName);
+
+    /// \brief WHOIS reply: server the user is on (RPL_WHOISSERVER)
+    ///
+    /// \param nick Nickname of the user
+    /// \param server Server name
+    /// \param info Server description
+    void irc_whoisServer(QString nick, QString server, QString info);
+
+    /// \brief WHOIS reply: user is an IRC operator (RPL_WHOISOPERATOR)
+    ///
+    /// \param nick Nickname of the user
+    void irc_whoisOperator(QString nick);
+
+    /// \brief WHOIS reply: idle time (RPL_WHOISIDLE)
+    ///
+    /// \param nick Nickname of the user
+    /// \param idle Seconds since the user's last message
+    /// \param signon Timestamp of the user's sign-on (0 if unknown)
+    void irc_whoisIdle(QString nick, quint32 idle, quint32 signon);
+
+    /// \brief WHOIS reply: channels (RPL_WHOISCHANNELS)
+    ///
+    /// \param nick Nickname of the user
+    /// \param channels Channel names, with prefix symbols like "@#chan"
+    void irc_whoisChannels(QString nick, QStringList channels);
+
+    /// \brief End of WHOIS reply (RPL_ENDOFWHOIS)
+    ///
+    /// \param nick Nickname that was queried
+    void irc_endOfWhois(QString nick);
+
+    /// \brief WHO reply entry (RPL_WHOREPLY)
+    ///
+    /// \param channel Channel name or "*"
+    /// \param user Host mask of the user
+    /// \param server Server the user is on
+    /// \param flags Status flags, e.g. "H@" (here, channel operator)
+    /// \param hops Hop count to the user's server
+    /// \param realName Real name of the user
+    void irc_whoReply(QString channel, QIRC::HostMask user, QString server,
+		      QString flags, int hops, QString realName);
+
+    /// \brief End of WHO reply (RPL_ENDOFWHO)
+    ///
+    /// \param mask Mask or channel that was queried
+    void irc_endOfWho(QString mask);
+
+    /// \brief Start of LIST reply (RPL_LISTSTART)
+    void irc_listStart();
+
+    /// \brief LIST reply entry (RPL_LIST)
+    ///
+    /// \param channel Channel name
+    /// \param users Number of visible users
+    /// \param topic Channel topic
+    void irc_list(QString channel, int users, QString topic);
+
+    /// \brief End of LIST reply (RPL_LISTEND)
+    void irc_listEnd();
+
+    /// \brief Channel topic (RPL_TOPIC / RPL_NOTOPIC)
+    ///
+    /// This signal is emitted when the server tells us the topic of a
+    /// channel, e.g. after joining it. Unlike irc_topic() it isn't a
+    /// change of the topic.
+    ///
+    /// \param channel Channel name as string
+    /// \param topic Topic, empty if none is set
+    void irc_channelTopic(QString channel, QString topic);
+
+    /// \brief NAMES reply entry (RPL_NAMREPLY)
+    ///
+    /// \param channel Channel name as string
+    /// \param names Nicknames with prefix symbols like "@nick"
+    void irc_names(QString channel, QStringList names);
+
+    /// \brief End of NAMES reply (RPL_ENDOFNAMES)
+    ///
+    /// \param channel Channel name as string
+    void irc_endOfNames(QString channel);
+
+    /// \brief Message of the day
+    ///
+    /// This signal is emitted once the server finished sending the MOTD
+    /// (RPL_ENDOFMOTD) or told us that there is none (ERR_NOMOTD).
+    ///
+    /// \param lines MOTD lines, empty if there is no MOTD
+    void irc_motd(QStringList lines);
+
+    /// \brief Error reply
+    ///
+    /// This signal is emitted for every numeric in the error range
+    /// (400-599), e.g. ERR_NICKNAMEINUSE.
+    ///
+    /// \param numeric Error code
+    /// \param target Nick, channel or command the error refers to
+    /// (empty if the reply has none)
+    /// \param message Error text as string
+    void irc_error(int numeric, QString target, QString message);
+
   private:
     bool setupSocket();
-    bool setupMessageQueue();
+    void attachTransport(Transport* transport);
+    void setupTimers();
+
+    static void queueTimerExpired(void* self);
+    static void registrationTimerExpired(void* self);
+    static void reconnectTimerExpired(void* self);
+    static void keepaliveTimerExpired(void* self);
+
+    static MessageHandler messageHandler(const IrcMessage& msg,
+					 int* interest=NULL);
+    static MessageHandler numericHandler(int numeric);
+    static int numericInterest(int numeric);
+
+    virtual void connectNotify(const char* signal);
+    virtual void disconnectNotify(const char* signal);
+    void updateInterests();
+    bool isWanted(const IrcMessage& msg) const;
+
+    bool handleNotice(const IrcMessage& msg);
+    bool handlePrivmsg(const IrcMessage& msg);
+    bool handleMode(const IrcMessage& msg);
+    bool handleNick(const IrcMessage& msg);
+    bool handleJoin(const IrcMessage& msg);
+    bool handlePart(const IrcMessage& msg);
+    bool handlePing(const IrcMessage& msg);
+    bool handlePong(const IrcMessage& msg);
+    bool handleTopic(const IrcMessage& msg);
+    bool handleInvite(const IrcMessage& msg);
+    bool handleNumeric(const IrcMessage& msg);
+
+    bool handleWelcome(const IrcMessage& msg);
+    bool handleMyInfo(const IrcMessage& msg);
+    bool handleISupport(const IrcMessage& msg);
+    bool handleAway(const IrcMessage& msg);
+    bool handleWhoisUser(const IrcMessage& msg);
+    bool handleWhoisServer(const IrcMessage& msg);
+    bool handleWhoisOperator(const IrcMessage& msg);
+    bool handleWhoisIdle(const IrcMessage& msg);
+    bool handleWhoisChannels(const IrcMessage& msg);
+    bool handleEndOfWhois(const IrcMessage& msg);
+    bool handleWhoReply(const IrcMessage& msg);
+    bool handleEndOfWho(const IrcMessage& msg);
+    bool handleListStart(const IrcMessage& msg);
+    bool handleList(const IrcMessage& msg);
+    bool handleListEnd(const IrcMessage& msg);
+    bool handleNoTopic(const IrcMessage& msg);
+    bool handleTopicReply(const IrcMessage& msg);
+    bool handleTopicWhoTime(const IrcMessage& msg);
+    bool handleNames(const IrcMessage& msg);
+    bool handleEndOfNames(const IrcMessage& msg);
+    bool handleMotdStart(const IrcMessage& msg);
+    bool handleMotd(const IrcMessage& msg);
+    bool handleEndOfMotd(const IrcMessage& msg);
+    bool handleError(const IrcMessage& msg);
 
   };
 };
@@ -0,0 +1,563 @@
+/// \file
+/// \brief Implementation of ConnectionPool class
+///
+/// \author png!das-system
+#include <QMetaObject>
+#include <QMutexLocker>
+
+#include "ConnectionPool"
+
+using namespace QIRC;
+
+
+/// \brief Construct worker helper
+ConnectionPoolWorker::ConnectionPoolWorker() :
+  QObject(NULL) {}
+
+
+/// \brief Move an object living in this worker's thread to another thread
+void ConnectionPoolWorker::migrate(QObject* obj, QThread* target) {
+  obj->moveToThread(target);
+}
+
+
+/// \brief Delete an object living in this worker's thread
+void ConnectionPoolWorker::destroy(QObject* obj) {
+  delete obj;
+}
+
+
+/// \brief Construct forwarder as a child of the connection
+///
+/// Nothing is forwarded until apply() is called.
+ConnectionPoolForwarder::ConnectionPoolForwarder(Connection* conn,
+						 ConnectionPool* pool) :
+  QObject(conn), m_connection(conn), m_pool(pool) {}
+
+
+/// \brief Connect the given message signals and disconnect the others
+///
+/// Must run in the connection's thread; the pool queues calls to it.
+///
+/// \param forwarding Combination of Forwarding flags
+void ConnectionPoolForwarder::apply(int forwarding) {
+  static const struct {
+    int flag;
+    const char* signal;
+    const char* slot;
+  } forwards[] = {
+    { ForwardMessages, SIGNAL(irc_message(QIRC::IrcMessage)),
+      SLOT(connection_message(QIRC::IrcMessage)) },
+    { ForwardPrivmsgs, SIGNAL(irc_privmsg(QIRC::HostMask,QString,QString)),
+      SLOT(connection_privmsg(QIRC::HostMask,QString,QString)) },
+    { ForwardNotices, SIGNAL(irc_notice(QIRC::HostMask,QString,QString)),
+      SLOT(connection_notice(QIRC::HostMask,QString,QString)) }
+  };
+
+  for (unsigned i = 0; i < sizeof(forwards) / sizeof(forwards[0]); ++i) {
+    if ((forwarding & forwards[i].flag) != 0) {
+      QObject::connect(m_connection, forwards[i].signal,
+		       m_pool, forwards[i].slot, Qt::UniqueConnection);
+    } else {
+      QObject::disconnect(m_connection, forwards[i].signal,
+			  m_pool, forwards[i].slot);
+    }
+  }
+}
+
+
+/// \brief Construct pool and start its worker threads
+///
+/// \param workers Number of worker threads; 0 uses one per CPU core
+/// \param parent Parent object
+ConnectionPool::ConnectionPool(int workers, QObject* parent) :
+  QObject(parent), m_nextId(0), m_policy(LeastLoadedAssignment),
+  m_forwarding(0) {
+  registerMetaTypes();
+  qRegisterMetaType<QThread*>("QThread*");
+
+  if (workers <= 0) {
+    workers = qMax(1, QThread::idealThreadCount());
+  }
+
+  for (int i = 0; i < workers; ++i) {
+    QThread* thread = new QThread(this);
+    ConnectionPoolWorker* worker = new ConnectionPoolWorker;
+    worker->moveToThread(thread);
+    thread->start();
+
+    m_threads.append(thread);
+    m_workers.append(worker);
+    m_load.append(0);
+  }
+}
+
+
+/// \brief Delete all connections and stop the worker threads
+ConnectionPool::~ConnectionPool() {
+  QList<int> ids = connections();
+  for (int i = 0; i < ids.size(); ++i) {
+    removeConnection(ids.at(i));
+  }
+
+  for (int i = 0; i < m_threads.size(); ++i) {
+    m_threads.at(i)->quit();
+    m_threads.at(i)->wait();
+    delete m_workers.at(i);
+  }
+}
+
+
+/// \brief Number of worker threads
+int ConnectionPool::workerCount() const {
+  return m_threads.size();
+}
+
+
+/// \brief Number of connections running on a worker
+int ConnectionPool::workerLoad(int worker) const {
+  QMutexLocker lock(&m_mutex);
+
+  if (worker < 0 || worker >= m_load.size())
+    return 0;
+
+  return m_load.at(worker);
+}
+
+
+/// \brief How new connections are assigned to workers
+ConnectionPool::AssignmentPolicy ConnectionPool::assignmentPolicy() const {
+  return m_policy;
+}
+
+
+/// \brief Set how new connections are assigned to workers
+void ConnectionPool::setAssignmentPolicy(AssignmentPolicy policy) {
+  m_policy = policy;
+}
+
+
+/// \brief Hand a connection over to the pool
+///
+/// The connection must not have a parent and must live in the calling
+/// thread; it should be fully configured (nick, ident, ...) since its
+/// setters aren't thread-safe once it runs on a worker. The pool takes
+/// ownership.
+///
+/// \return Id of the connection or -1 on error
+int ConnectionPool::addConnection(Connection* conn) {
+  if (conn == NULL || conn->parent() != NULL ||
+      conn->thread() != QThread::currentThread()) {
+    qWarning() << "ConnectionPool: Connection must be unparented and live"
+	       << "in the calling thread!";
+    return -1;
+  }
+
+  QMutexLocker lock(&m_mutex);
+
+  Entry e;
+  e.connection = conn;
+  e.forwarder = new ConnectionPoolForwarder(conn, this);
+  e.worker = pickWorker(conn);
+
+  int id = m_nextId++;
+  m_connections.insert(id, e);
+  m_ids.insert(conn, id);
+  ++m_load[e.worker];
+
+  // runs in the worker after the move; queued under the lock so it
+  // can't overtake a call queued by updateForwarding()
+  QMetaObject::invokeMethod(e.forwarder, "apply", Qt::QueuedConnection,
+			    Q_ARG(int, m_forwarding));
+
+  lock.unlock();
+
+  // the pool lives in the application thread, so these are queued
+  QObject::connect(conn, SIGNAL(connected(QIRC::ServerInfo)),
+		   this, SLOT(connection_connected()));
+  QObject::connect(conn, SIGNAL(disconnected(QIRC::ServerInfo)),
+		   this, SLOT(connection_disconnected()));
+  QObject::connect(conn, SIGNAL(socketError(QAbstractSocket::SocketError,
+					    QString)),
+		   this, SLOT(connection_socketError(QAbstractSocket::SocketError,
+						     QString)));
+  QObject::connect(conn, SIGNAL(statisticsReady(QIRC::ConnectionStatistics)),
+		   this, SLOT(connection_statistics(QIRC::ConnectionStatistics)));
+
+  conn->moveToThread(m_threads.at(e.worker));
+
+  return id;
+}
+
+
+/// \brief Create a connection to the given server in the pool
+///
+/// \return Id of the connection
+int ConnectionPool::addConnection(const ServerInfo& si) {
+  return addConnection(new Connection(si));
+}
+
+
+/// \brief Delete a connection
+///
+/// The connection is deleted in its worker thread; this blocks until
+/// that happened.
+///
+/// \return false if there is no connection with that id
+bool ConnectionPool::removeConnection(int id) {
+  QMutexLocker lock(&m_mutex);
+
+  if (!m_connections.contains(id))
+    return false;
+
+  Entry e = m_connections.take(id);
+  m_ids.remove(e.connection);
+  --m_load[e.worker];
+
+  lock.unlock();
+
+  // not disconnected here: that would call the connection's
+  // disconnectNotify() in this thread. Signals still queued to the
+  // pool are dropped by idOf().
+  runOnOwner(e.connection, "destroy", Q_ARG(QObject*, e.connection));
+
+  return true;
+}
+
+
+/// \brief Move a connection to another worker
+///
+/// Blocks until the connection was moved. Its transport is attached to
+/// the new thread (see EpollTransport::event()), its active timers are
+/// restarted on the new thread's TimerService (see Connection::event())
+/// and pending events are delivered in the new thread.
+///
+/// \return false if there is no such connection or worker
+bool ConnectionPool::migrate(int id, int worker) {
+  QMutexLocker lock(&m_mutex);
+
+  if (!m_connections.contains(id) || worker < 0 ||
+      worker >= m_threads.size())
+    return false;
+
+  Entry& e = m_connections[id];
+  if (e.worker == worker)
+    return true;
+
+  --m_load[e.worker];
+  ++m_load[worker];
+  e.worker = worker;
+  Connection* conn = e.connection;
+
+  lock.unlock();
+
+  runOnOwner(conn, "migrate", Q_ARG(QObject*, conn),
+	     Q_ARG(QThread*, m_threads.at(worker)));
+
+  return true;
+}
+
+
+/// \brief Even out the number of connections per worker
+///
+/// \return Number of migrated connections
+int ConnectionPool::rebalance() {
+  QMutexLocker lock(&m_mutex);
+
+  QVector<QList<int> > perWorker(m_threads.size());
+  QHash<int, Entry>::const_iterator it;
+  for (it = m_connections.constBegin(); it != m_connections.constEnd(); ++it) {
+    perWorker[it.value().worker].append(it.key());
+  }
+
+  lock.unlock();
+
+  int moved = 0;
+  for (;;) {
+    int most = 0, least = 0;
+    for (int i = 1; i < perWorker.size(); ++i) {
+      if (perWorker.at(i).size() > perWorker.at(most).size())
+	most = i;
+      if (perWorker.at(i).size() < perWorker.at(least).size())
+	least = i;
+    }
+
+    if (perWorker.at(most).size() - perWorker.at(least).size() <= 1)
+      break;
+
+    int id = perWorker[most].takeLast();
+    if (migrate(id, least))
+      ++moved;
+    perWorker[least].append(id);
+  }
+
+  return moved;
+}
+
+
+/// \brief Number of connections in the pool
+int ConnectionPool::connectionCount() const {
+  QMutexLocker lock(&m_mutex);
+  return m_connections.size();
+}
+
+
+/// \brief Ids of all connections
+QList<int> ConnectionPool::connections() const {
+  QMutexLocker lock(&m_mutex);
+  return m_connections.keys();
+}
+
+
+/// \brief Access a connection
+///
+/// The connection lives in a worker thread, so apart from connecting
+/// to its signals only its Q_INVOKABLE functions may be called, and only
+/// through QMetaObject::invokeMethod().
+///
+/// \return The connection or NULL if there is none with that id
+Connection* ConnectionPool::connection(int id) const {
+  QMutexLocker lock(&m_mutex);
+  return m_connections.value(id).connection;
+}
+
+
+/// \brief Worker a connection runs on or -1 if there is no such connection
+int ConnectionPool::workerOf(int id) const {
+  QMutexLocker lock(&m_mutex);
+
+  if (!m_connections.contains(id))
+    return -1;
+
+  return m_connections.value(id).worker;
+}
+
+
+/// \brief Connect to the connection's server
+bool ConnectionPool::connectToServer(int id) {
+  return invoke(id, "connect");
+}
+
+
+/// \brief Disconnect from the connection's server
+bool ConnectionPool::disconnectFromServer(int id) {
+  return invoke(id, "disconnect");
+}
+
+
+/// \brief Change nickname on a connection
+bool ConnectionPool::setNick(int id, QString nick) {
+  return invoke(id, "setNick", Q_ARG(QString, nick));
+}
+
+
+/// \brief Join a channel on a connection
+bool ConnectionPool::joinChannel(int id, QString channel, QString key) {
+  return invoke(id, "joinChannel", Q_ARG(QString, channel),
+		Q_ARG(QString, key));
+}
+
+
+/// \brief Leave a channel on a connection
+bool ConnectionPool::partChannel(int id, QString channel) {
+  return invoke(id, "partChannel", Q_ARG(QString, channel));
+}
+
+
+/// \brief Send a message on a connection
+bool ConnectionPool::privmsg(int id, QString target, QString text) {
+  return invoke(id, "privmsg", Q_ARG(QString, target), Q_ARG(QString, text));
+}
+
+
+/// \brief Send a notice on a connection
+bool ConnectionPool::notice(int id, QString target, QString text) {
+  return invoke(id, "notice", Q_ARG(QString, target), Q_ARG(QString, text));
+}
+
+
+/// \brief Quit IRC on a connection
+bool ConnectionPool::quit(int id, QString message, bool disconnect) {
+  return invoke(id, "quit", Q_ARG(QString, message), Q_ARG(bool, disconnect));
+}
+
+
+/// \brief Ask a connection for its statistics
+///
+/// The answer is emitted as connectionStatistics(). There is none if
+/// the connection is removed before the request reaches it.
+///
+/// \return false if there is no connection with that id
+bool ConnectionPool::requestStatistics(int id) {
+  return invoke(id, "requestStatistics");
+}
+
+
+/// \brief Pick the worker for a new connection
+///
+/// Must be called with m_mutex held.
+int ConnectionPool::pickWorker(Connection* conn) const {
+  if (m_policy == HashAssignment) {
+    return qHash(conn->server().toString()) % m_threads.size();
+  }
+
+  int best = 0;
+  for (int i = 1; i < m_load.size(); ++i) {
+    if (m_load.at(i) < m_load.at(best))
+      best = i;
+  }
+
+  return best;
+}
+
+
+/// \brief Queue a call of a Q_INVOKABLE function of a connection
+///
+/// \return false if there is no connection with that id
+bool ConnectionPool::invoke(int id, const char* method,
+			    QGenericArgument arg0, QGenericArgument arg1,
+			    QGenericArgument arg2) {
+  // hold the lock so the connection can't be deleted meanwhile
+  QMutexLocker lock(&m_mutex);
+
+  Connection* conn = m_connections.value(id).connection;
+  if (conn == NULL)
+    return false;
+
+  return QMetaObject::invokeMethod(conn, method, Qt::QueuedConnection,
+				   arg0, arg1, arg2);
+}
+
+
+/// \brief Id of a connection or -1
+int ConnectionPool::idOf(QObject* obj) const {
+  QMutexLocker lock(&m_mutex);
+  return m_ids.value(obj, -1);
+}
+
+
+/// \brief Call a worker helper function in the thread an object lives in
+///
+/// Blocks until the function returned.
+void ConnectionPool::runOnOwner(QObject* obj, const char* method,
+				QGenericArgument arg0, QGenericArgument arg1) {
+  for (int i = 0; i < m_threads.size(); ++i) {
+    if (m_threads.at(i) == obj->thread()) {
+      Qt::ConnectionType type = (QThread::currentThread() == obj->thread()) ?
+	Qt::DirectConnection : Qt::BlockingQueuedConnection;
+      QMetaObject::invokeMethod(m_workers.at(i), method, type, arg0, arg1);
+      return;
+    }
+  }
+
+  qWarning() << "ConnectionPool: Object doesn't live in a worker thread!";
+}
+
+
+/// \brief Forward message signals once they have receivers
+void ConnectionPool::connectNotify(const char* signal) {
+  QObject::connectNotify(signal);
+  updateForwarding();
+}
+
+
+/// \brief Stop forwarding message signals without receivers
+void ConnectionPool::disconnectNotify(const char* signal) {
+  QObject::disconnectNotify(signal);
+  updateForwarding();
+}
+
+
+/// \brief Connect or disconnect the message signals of all connections
+///
+/// Connections emitting irc_message() decode every line (see
+/// Connection::interests()) and every emission queues an event to the
+/// pool's thread, so they are only connected while the pool signal
+/// they feed has receivers.
+///
+/// The connections live in the worker threads, so the change is
+/// queued to their ConnectionPoolForwarder. Calls are queued with
+/// m_mutex held, so they arrive in the order m_forwarding changed.
+void ConnectionPool::updateForwarding() {
+  int wanted = 0;
+  if (receivers(SIGNAL(messageReceived(int,QIRC::IrcMessage))) > 0)
+    wanted |= ConnectionPoolForwarder::ForwardMessages;
+  if (receivers(SIGNAL(privmsgReceived(int,QIRC::HostMask,QString,
+				       QString))) > 0)
+    wanted |= ConnectionPoolForwarder::ForwardPrivmsgs;
+  if (receivers(SIGNAL(noticeReceived(int,QIRC::HostMask,QString,
+				      QString))) > 0)
+    wanted |= ConnectionPoolForwarder::ForwardNotices;
+
+  QMutexLocker lock(&m_mutex);
+
+  if (wanted == m_forwarding)
+    return;
+
+  m_forwarding = wanted;
+
+  QHash<int, Entry>::const_iterator it;
+  for (it = m_connections.constBegin(); it != m_connections.constEnd(); ++it) {
+    QMetaObject::invokeMethod(it.value().forwarder, "apply",
+			      Qt::QueuedConnection, Q_ARG(int, wanted));
+  }
+}
+
+
+/// \brief Slot for Connection::connected()
+void ConnectionPool::connection_connected() {
+  int id = idOf(sender());
+  if (id >= 0)
+    emit connectionConnected(id);
+}
+
+
+/// \brief Slot for Connection::disconnected()
+void ConnectionPool::connection_disconnected() {
+  int id = idOf(sender());
+  if (id >= 0)
+    emit connectionDisconnected(id);
+}
+
+
+/// \brief Slot for Connection::socketError()
+void ConnectionPool::connection_socketError(QAbstractSocket::SocketError,
+					    QString msg) {
+  int id = idOf(sender());
+  if (id >= 0)
+    emit connectionError(id, msg);
+}
+
+
+/// \brief Slot for Connection::irc_message()
+void ConnectionPool::connection_message(const QIRC::IrcMessage& msg) {
+  int id = idOf(sender());
+  if (id >= 0)
+    emit messageReceived(id, msg);
+}
+
+
+/// \brief Slot for Connection::irc_privmsg()
+void ConnectionPool::connection_privmsg(QIRC::HostMask sender,
+					QString target, QString message) {
+  int id = idOf(QObject::sender());
+  if (id >= 0)
+    emit privmsgReceived(id, sender, target, message);
+}
+
+
+/// \brief Slot for Connection::irc_notice()
+void ConnectionPool::connection_notice(QIRC::HostMask sender,
+				       QString target, QString message) {
+  int id = idOf(QObject::sender());
+  if (id >= 0)
+    emit noticeReceived(id, sender, target, message);
+}
+
+
+/// \brief Slot for Connection::statisticsReady()
+void ConnectionPool::connection_statistics(QIRC::ConnectionStatistics stats) {
+  int id = idOf(sender());
+  if (id >= 0)
+    emit connectionStatistics(id, stats);
+}
@@ -0,0 +1,245 @@
+/// \file
+/// \brief Declaration of ConnectionPool class
+///
+/// \author png!das-system
+#ifndef CONNECTIONPOOL_H
+#define CONNECTIONPOOL_H 1
+
+#include <QAbstractSocket>
+#include <QHash>
+#include <QMutex>
+#include <QObject>
+#include <QThread>
+#include <QVector>
+
+#include "Connection"
+#include "HostMask"
+#include "IrcMessage"
+#include "ServerInfo"
+
+#include "qirc.h"
+
+namespace QIRC {
+  /// \brief Helper living in a ConnectionPool worker thread
+  ///
+  /// Objects can only be moved to another thread or deleted safely from
+  /// the thread they live in; the pool uses this helper to do so.
+  class ConnectionPoolWorker : public QObject {
+    Q_OBJECT
+  public:
+    ConnectionPoolWorker();
+
+  public slots:
+    void migrate(QObject* obj, QThread* target);
+    void destroy(QObject* obj);
+  };
+
+
+  class ConnectionPool;
+
+
+  /// \brief Connects the message signals of a pooled connection
+  ///
+  /// Connecting to a signal calls the sender's connectNotify(), which
+  /// must run in the thread the Connection lives in. The forwarder is a
+  /// child of the connection, so calls queued to it follow the
+  /// connection when it migrates and are dropped when it is deleted.
+  class ConnectionPoolForwarder : public QObject {
+    Q_OBJECT
+  public:
+    /// \brief Message signals forwarded from the connection
+    enum Forwarding {
+      ForwardMessages = 1,
+      ForwardPrivmsgs = 2,
+      ForwardNotices = 4
+    };
+
+    ConnectionPoolForwarder(Connection* conn, ConnectionPool* pool);
+
+  public slots:
+    void apply(int forwarding);
+
+  protected:
+    /// \brief The connection whose signals are forwarded
+    Connection* m_connection;
+
+    /// \brief Pool receiving the signals
+    ConnectionPool* m_pool;
+  };
+
+
+  /// \brief Runs many Connection instances on a set of worker threads
+  ///
+  /// The pool owns a fixed number of threads, each running its own
+  /// event loop. Connections added to the pool are moved to one of the
+  /// workers, either by hashing their server address or by picking the
+  /// worker with the fewest connections, and can later be migrated to
+  /// another worker.
+  ///
+  /// Connections are addressed by an integer id. The command functions
+  /// of the pool may be called from any thread; they are queued to the
+  /// connection's worker. Events of all connections are re-emitted by
+  /// the pool, tagged with the connection id, in the thread the pool
+  /// lives in. messageReceived(), privmsgReceived() and noticeReceived()
+  /// are only forwarded while they have receivers, so the connections
+  /// don't decode and queue messages nobody listens to.
+  class ConnectionPool : public QObject {
+    Q_OBJECT
+  public:
+    /// \brief How new connections are assigned to workers
+    enum AssignmentPolicy {
+      /// \brief By hash of the server address
+      HashAssignment,
+
+      /// \brief To the worker with the fewest connections
+      LeastLoadedAssignment
+    };
+
+    ConnectionPool(int workers=0, QObject* parent=NULL);
+    virtual ~ConnectionPool();
+
+    int workerCount() const;
+    int workerLoad(int worker) const;
+
+    AssignmentPolicy assignmentPolicy() const;
+    void setAssignmentPolicy(AssignmentPolicy policy);
+
+    int addConnection(Connection* conn);
+    int addConnection(const ServerInfo& si);
+    bool removeConnection(int id);
+    bool migrate(int id, int worker);
+    int rebalance();
+
+    int connectionCount() const;
+    QList<int> connections() const;
+    Connection* connection(int id) const;
+    int workerOf(int id) const;
+
+    bool connectToServer(int id);
+    bool disconnectFromServer(int id);
+    bool setNick(int id, QString nick);
+    bool joinChannel(int id, QString channel, QString key="");
+    bool partChannel(int id, QString channel);
+    bool privmsg(int id, QString target, QString text);
+    bool notice(int id, QString target, QString text);
+    bool quit(int id, QString message, bool disconnect=true);
+    bool requestStatistics(int id);
+
+  protected:
+    /// \brief Book keeping for a connection
+    struct Entry {
+      Entry() : connection(NULL), forwarder(NULL), worker(-1) {}
+
+      /// \brief The connection
+      Connection* connection;
+
+      /// \brief Child of connection connecting its message signals
+      ConnectionPoolForwarder* forwarder;
+
+      /// \brief Index of the worker it runs on
+      int worker;
+    };
+
+    int pickWorker(Connection* conn) const;
+    bool invoke(int id, const char* method,
+		QGenericArgument arg0=QGenericArgument(),
+		QGenericArgument arg1=QGenericArgument(),
+		QGenericArgument arg2=QGenericArgument());
+    int idOf(QObject* obj) const;
+    void runOnOwner(QObject* obj, const char* method, QGenericArgument arg0,
+		    QGenericArgument arg1=QGenericArgument());
+
+    virtual void connectNotify(const char* signal);
+    virtual void disconnectNotify(const char* signal);
+    void updateForwarding();
+
+    /// \brief Worker threads
+    QVector<QThread*> m_threads;
+
+    /// \brief Helpers living in m_threads
+    QVector<ConnectionPoolWorker*> m_workers;
+
+    /// \brief Number of connections per worker
+    QVector<int> m_load;
+
+    /// \brief Connections by id
+    QHash<int, Entry> m_connections;
+
+    /// \brief Connection ids by object, for mapping signal senders
+    QHash<QObject*, int> m_ids;
+
+    /// \brief Next connection id
+    int m_nextId;
+
+    /// \brief How new connections are assigned to workers
+    AssignmentPolicy m_policy;
+
+    /// \brief ConnectionPoolForwarder flags of the signals that have
+    /// receivers
+    int m_forwarding;
+
+    /// \brief Protects the book keeping above
+    mutable QMutex m_mutex;
+
+  protected slots:
+    void connection_connected();
+    void connection_disconnected();
+    void connection_socketError(QAbstractSocket::SocketError err,
+				QString msg);
+    void connection_message(const QIRC::IrcMessage& msg);
+    void connection_privmsg(QIRC::HostMask sender, QString target,
+			    QString message);
+    void connection_notice(QIRC::HostMask sender, QString target,
+			   QString message);
+    void connection_statistics(QIRC::ConnectionStatistics stats);
+
+  signals:
+    /// \brief Connection established
+    ///
+    /// \param id Id of the connection
+    void connectionConnected(int id);
+
+    /// \brief Connection dropped
+    ///
+    /// \param id Id of the connection
+    void connectionDisconnected(int id);
+
+    /// \brief Socket error on a connection
+    ///
+    /// \param id Id of the connection
+    /// \param msg Error message in human-readable form
+    void connectionError(int id, QString msg);
+
+    /// \brief Message received on a connection
+    ///
+    /// \param id Id of the connection
+    /// \param msg The received message
+    void messageReceived(int id, const QIRC::IrcMessage& msg);
+
+    /// \brief PRIVMSG received on a connection
+    ///
+    /// \param id Id of the connection
+    /// \param sender Host mask of the sender
+    /// \param target Nick or channel the message was directed at
+    /// \param message Message text as string
+    void privmsgReceived(int id, QIRC::HostMask sender, QString target,
+			 QString message);
+
+    /// \brief NOTICE received on a connection
+    ///
+    /// \param id Id of the connection
+    /// \param sender Host mask of the sender
+    /// \param target Nick or channel the notice was sent to
+    /// \param message Message text as string
+    void noticeReceived(int id, QIRC::HostMask sender, QString target,
+			QString message);
+
+    /// \brief Answer to requestStatistics()
+    ///
+    /// \param id Id of the connection
+    /// \param stats Snapshot of its performance counters
+    void connectionStatistics(int id, QIRC::ConnectionStatistics stats);
+  };
+};
+
+#endif // !CONNECTIONPOOL_H
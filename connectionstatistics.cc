@@ -0,0 +1,15 @@
+/// \file
+/// \brief Implementation of ConnectionStatistics class
+///
+/// \author png!das-system
+#include "ConnectionStatistics"
+
+using namespace QIRC;
+
+
+/// \brief Construct with all counters set to zero
+ConnectionStatistics::ConnectionStatistics() :
+  bytesIn(0), bytesOut(0), linesIn(0), linesOut(0), parseFailures(0),
+  discardedLines(0), droppedMessages(0), queueDepth(0), maxQueueDepth(0),
+  pingsSent(0), pingTimeouts(0), lag(-1), rttMin(-1), rttAverage(-1),
+  rttP99(-1) {}
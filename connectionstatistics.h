@@ -0,0 +1,102 @@
+/// \file
+/// \brief Declaration of ConnectionStatistics class
+///
+/// \author png!das-system
+#ifndef CONNECTIONSTATISTICS_H
+#define CONNECTIONSTATISTICS_H 1
+
+#include <QByteArray>
+#include <QHash>
+#include <QMetaType>
+
+#include "Histogram"
+
+#include "qirc.h"
+
+namespace QIRC {
+  /// \brief Performance counters of a Connection
+  ///
+  /// Returned by Connection::statistics(). All counters start at the
+  /// construction of the connection (or the last call to
+  /// Connection::resetStatistics()) and cover all servers it was
+  /// connected to since.
+  struct ConnectionStatistics {
+    /// \brief Number of distinct keys in parseFailuresByCommand
+    enum { MaxFailureCommands = 32 };
+
+    ConnectionStatistics();
+
+    /// \brief Bytes received from the server
+    quint64 bytesIn;
+
+    /// \brief Bytes sent to the server
+    quint64 bytesOut;
+
+    /// \brief Complete lines received
+    quint64 linesIn;
+
+    /// \brief Lines sent (merged messages count as one line)
+    quint64 linesOut;
+
+    /// \brief Received lines that couldn't be parsed or handled
+    quint64 parseFailures;
+
+    /// \brief parseFailures by command
+    ///
+    /// Lines without a command are counted with an empty key. Once
+    /// MaxFailureCommands commands have a key, further ones are counted
+    /// as "other".
+    QHash<QByteArray, quint64> parseFailuresByCommand;
+
+    /// \brief Overlong lines discarded by the line framer
+    quint64 discardedLines;
+
+    /// \brief Outbound messages dropped or rejected by the full queue
+    quint64 droppedMessages;
+
+    /// \brief Messages currently waiting in the outbound queue
+    int queueDepth;
+
+    /// \brief Largest number of messages waiting in the outbound queue
+    int maxQueueDepth;
+
+    /// \brief Time to parse and handle a received line in nanoseconds
+    ///
+    /// Includes the handlers that are called directly (on(), signals
+    /// connected in the same thread).
+    Histogram parseTime;
+
+    /// \brief Time queued messages waited before they were written, in
+    /// microseconds
+    Histogram queueLatency;
+
+    /// \brief Keepalive PINGs sent
+    quint64 pingsSent;
+
+    /// \brief Keepalive PINGs that weren't answered in time
+    quint64 pingTimeouts;
+
+    /// \brief Round trip time of the last keepalive PING in ms (-1 if
+    /// none was answered yet)
+    int lag;
+
+    /// \brief Smallest round trip time in ms of the recent keepalive
+    /// PINGs (-1 if none was answered yet)
+    ///
+    /// rttMin, rttAverage and rttP99 cover the last
+    /// Connection::RttWindow answered PINGs.
+    int rttMin;
+
+    /// \brief Average round trip time in ms of the recent keepalive
+    /// PINGs (-1 if none was answered yet)
+    int rttAverage;
+
+    /// \brief 99th percentile of the round trip times in ms of the
+    /// recent keepalive PINGs (-1 if none was answered yet)
+    int rttP99;
+  };
+};
+
+Q_DECLARE_METATYPE(QIRC::ConnectionStatistics)
+
+#endif // !CONNECTIONSTATISTICS_H
@@ -0,0 +1,52 @@
+/// \file
+/// \brief Case mapping functions of the protocol core
+///
+/// \author png!das-system
+#include <cstring>
+
+#include "qirccore.h"
+
+
+/// \brief Look up case mapping by its ISUPPORT name
+///
+/// Unknown names (e.g. "rfc7613") fall back to RFC1459 rules.
+QIRCCore::CaseMapping QIRCCore::caseMappingFromName(const char* name,
+						    int length) {
+  if (length == 5 && std::memcmp(name, "ascii", 5) == 0)
+    return AsciiCaseMapping;
+  if (length == 14 && std::memcmp(name, "strict-rfc1459", 14) == 0)
+    return StrictRfc1459CaseMapping;
+
+  return Rfc1459CaseMapping;
+}
+
+
+/// \brief Lower case a UTF-8 encoded nick or channel name in place
+void QIRCCore::ircToLower(char* s, int length, CaseMapping mapping) {
+  for (int i = 0; i < length; ++i) {
+    unsigned char c = s[i];
+    if (c < 0x80) {
+      s[i] = foldChar(c, mapping);
+    }
+  }
+}
+
+
+/// \brief Compare two UTF-8 encoded nicks or channel names
+bool QIRCCore::ircEquals(const char* a, int aLength, const char* b,
+			 int bLength, CaseMapping mapping) {
+  if (aLength != bLength)
+    return false;
+
+  for (int i = 0; i < aLength; ++i) {
+    unsigned char ca = a[i];
+    unsigned char cb = b[i];
+    if (ca == cb)
+      continue;
+    if (ca >= 0x80 || cb >= 0x80 ||
+	foldChar(ca, mapping) != foldChar(cb, mapping))
+      return false;
+  }
+
+  return true;
+}
@@ -0,0 +1,159 @@
+/// \file
+/// \brief Implementation of FloodControl utility class
+///
+/// \author png!das-system
+#include <cmath>
+
+#include "FloodControl"
+
+using namespace QIRCCore;
+
+
+/// \brief Construct token bucket with ircd-style default limits
+FloodControl::FloodControl() :
+  m_burst(10.0), m_refillRate(1.0), m_lineCost(2.0), m_byteCost(1.0 / 120),
+  m_tokens(10.0), m_lastRefill(0) {}
+
+
+/// \brief Construct token bucket with the given limits
+///
+/// \param burst Maximum number of tokens in the bucket
+/// \param refillRate Tokens added per second
+/// \param lineCost Fixed cost of a line
+/// \param byteCost Additional cost per byte of a line
+FloodControl::FloodControl(double burst, double refillRate, double lineCost,
+			   double byteCost) :
+  m_burst(burst), m_refillRate(refillRate), m_lineCost(lineCost),
+  m_byteCost(byteCost), m_tokens(burst), m_lastRefill(0) {}
+
+
+/// \brief Maximum number of tokens in the bucket
+double FloodControl::burst() const {
+  return m_burst;
+}
+
+
+/// \brief Set maximum number of tokens in the bucket
+void FloodControl::setBurst(double tokens) {
+  m_burst = tokens;
+  if (m_tokens > m_burst)
+    m_tokens = m_burst;
+}
+
+
+/// \brief Tokens added to the bucket per second
+double FloodControl::refillRate() const {
+  return m_refillRate;
+}
+
+
+/// \brief Set tokens added to the bucket per second
+void FloodControl::setRefillRate(double tokensPerSecond) {
+  m_refillRate = tokensPerSecond;
+}
+
+
+/// \brief Fixed cost of a line
+double FloodControl::lineCost() const {
+  return m_lineCost;
+}
+
+
+/// \brief Set fixed cost of a line
+void FloodControl::setLineCost(double tokens) {
+  m_lineCost = tokens;
+}
+
+
+/// \brief Additional cost per byte of a line
+double FloodControl::byteCost() const {
+  return m_byteCost;
+}
+
+
+/// \brief Set additional cost per byte of a line
+void FloodControl::setByteCost(double tokensPerByte) {
+  m_byteCost = tokensPerByte;
+}
+
+
+/// \brief Cost of a line with the given length
+double FloodControl::cost(int bytes) const {
+  return m_lineCost + bytes * m_byteCost;
+}
+
+
+/// \brief Tokens available at the given time
+double FloodControl::tokens(long long now) {
+  refill(now);
+  return m_tokens;
+}
+
+
+/// \brief Fill the bucket completely
+///
+/// Used when a new connection to a server is established.
+void FloodControl::reset(long long now) {
+  m_tokens = m_burst;
+  m_lastRefill = now;
+}
+
+
+/// \brief Add the tokens accumulated since the last refill
+void FloodControl::refill(long long now) {
+  if (now > m_lastRefill) {
+    m_tokens += (now - m_lastRefill) * m_refillRate / 1000.0;
+    if (m_tokens > m_burst)
+      m_tokens = m_burst;
+  }
+
+  m_lastRefill = now;
+}
+
+
+/// \brief Take the cost of a line from the bucket if possible
+///
+/// \return true if there were enough tokens to send the line, false
+/// if it has to wait
+bool FloodControl::tryConsume(int bytes, long long now) {
+  refill(now);
+
+  double c = cost(bytes);
+  if (m_tokens < c && m_tokens < m_burst)
+    return false;
+
+  // a line that costs more than the whole bucket may still be sent
+  // when the bucket is full; it just empties it below zero
+  m_tokens -= c;
+  return true;
+}
+
+
+/// \brief Unconditionally take the cost of a line from the bucket
+///
+/// Used for lines that bypass the queue (e.g. PONG replies) so they
+/// still count against the budget of the queued ones.
+void FloodControl::consume(int bytes, long long now) {
+  refill(now);
+  m_tokens -= cost(bytes);
+}
+
+
+/// \brief Time until a line of the given length can be sent
+///
+/// \return Delay in milliseconds, 0 if the line may be sent right away
+long long FloodControl::delayFor(int bytes, long long now) {
+  refill(now);
+
+  double c = cost(bytes);
+  double needed = ((c < m_burst) ? c : m_burst) - m_tokens;
+  if (needed <= 0)
+    return 0;
+
+  if (m_refillRate <= 0) {
+    // bucket never refills; don't spin
+    return -1;
+  }
+
+  return static_cast<long long>(std::ceil(needed * 1000.0 / m_refillRate));
+}
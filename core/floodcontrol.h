@@ -0,0 +1,74 @@
+/// \file
+/// \brief Declaration of FloodControl utility class
+///
+/// \author png!das-system
+#ifndef QIRCCORE_FLOODCONTROL_H
+#define QIRCCORE_FLOODCONTROL_H 1
+
+#include "qirccore.h"
+
+namespace QIRCCore {
+  /// \brief Token bucket limiting the rate of outbound messages
+  ///
+  /// Models the penalty rules most IRC servers use to detect excess
+  /// flood: every line costs a fixed amount plus an amount per byte,
+  /// the bucket holds at most burst() tokens and is refilled at
+  /// refillRate() tokens per second. A line may be sent whenever the
+  /// bucket holds enough tokens to pay for it.
+  ///
+  /// The defaults follow the classic ircd rules where tokens are
+  /// seconds of penalty: 2 seconds plus one second per 120 bytes per
+  /// line and at most 10 seconds in advance.
+  ///
+  /// All methods take the current time explicitly (in milliseconds of
+  /// any monotonic clock) so the bucket doesn't depend on a timer.
+  class FloodControl {
+  public:
+    FloodControl();
+    FloodControl(double burst, double refillRate, double lineCost,
+		 double byteCost);
+
+    double burst() const;
+    void setBurst(double tokens);
+
+    double refillRate() const;
+    void setRefillRate(double tokensPerSecond);
+
+    double lineCost() const;
+    void setLineCost(double tokens);
+
+    double byteCost() const;
+    void setByteCost(double tokensPerByte);
+
+    double cost(int bytes) const;
+    double tokens(long long now);
+
+    void reset(long long now);
+    bool tryConsume(int bytes, long long now);
+    void consume(int bytes, long long now);
+    long long delayFor(int bytes, long long now);
+
+  protected:
+    /// \brief Maximum number of tokens in the bucket
+    double m_burst;
+
+    /// \brief Tokens added per second
+    double m_refillRate;
+
+    /// \brief Fixed cost of a line
+    double m_lineCost;
+
+    /// \brief Additional cost per byte of a line
+    double m_byteCost;
+
+    /// \brief Tokens currently in the bucket
+    double m_tokens;
+
+    /// \brief Time of the last refill in milliseconds
+    long long m_lastRefill;
+
+    void refill(long long now);
+  };
+};
+
+#endif // !QIRCCORE_FLOODCONTROL_H
@@ -0,0 +1,179 @@
+/// \file
+/// \brief Implementation of Framer class
+///
+/// \author png!das-system
+#include <cstring>
+
+#include "Framer"
+
+using namespace QIRCCore;
+
+
+/// \brief Construct framer with default line length limits
+Framer::Framer() :
+  m_maxLineLength(DefaultMaxLineLength),
+  m_maxTagsLength(DefaultMaxTagsLength),
+  m_discarding(false), m_discardedLines(0) {}
+
+
+/// \brief Maximum length of a line including CR/LF
+int Framer::maxLineLength() const {
+  return m_maxLineLength;
+}
+
+
+/// \brief Set maximum length of a line including CR/LF
+void Framer::setMaxLineLength(int length) {
+  m_maxLineLength = length;
+}
+
+
+/// \brief Maximum length of IRCv3 message tags
+///
+/// Lines starting with '@' may exceed maxLineLength() by this many bytes.
+int Framer::maxTagsLength() const {
+  return m_maxTagsLength;
+}
+
+
+/// \brief Set maximum length of IRCv3 message tags
+void Framer::setMaxTagsLength(int length) {
+  m_maxTagsLength = length;
+}
+
+
+/// \brief Length limit (without CR/LF) for the line starting at line
+int Framer::limitFor(const char* line) const {
+  int limit = m_maxLineLength - 2;
+  if (*line == '@') {
+    limit += m_maxTagsLength;
+  }
+
+  return limit;
+}
+
+
+/// \brief Find the complete lines in a buffer
+///
+/// Calls callback for every complete line in data. Empty lines are
+/// skipped. Line terminators may be either CR/LF or a bare LF; they're
+/// located with memchr(), which the C library implements with
+/// vectorized instructions.
+///
+/// The bytes after the last line terminator (data + consumed up to
+/// data + size) are an incomplete line; the caller must pass them
+/// again, followed by new data, on the next call. An incomplete line
+/// that is already too long is consumed and the rest of it skipped.
+///
+/// \param data Buffer to scan
+/// \param size Number of bytes in data
+/// \param callback Function to call for each line
+/// \param context Passed to callback
+/// \param consumed Receives the number of bytes that were consumed
+///
+/// \return Number of complete lines found
+int Framer::scan(const char* data, int size, LineCallback callback,
+		 void* context, int& consumed) {
+  int pos = 0;
+  int lines = 0;
+
+  consumed = 0;
+
+  if (m_discarding) {
+    // skip the remainder of an overlong line
+    const char* nl = static_cast<const char*>(std::memchr(data, '\n', size));
+    if (nl == NULL) {
+      consumed = size;
+      return 0;
+    }
+
+    m_discarding = false;
+    pos = (nl - data) + 1;
+  }
+
+  while (pos < size) {
+    const char* nl = static_cast<const char*>(std::memchr(data + pos, '\n',
+							  size - pos));
+    if (nl == NULL)
+      break;
+
+    int end = nl - data;
+    int length = end - pos;
+    if (length > 0 && data[end - 1] == '\r')
+      --length;
+
+    if (length > limitFor(data + pos)) {
+      ++m_discardedLines;
+    } else if (length > 0) {
+      callback(context, data + pos, length);
+      ++lines;
+    }
+
+    pos = end + 1;
+  }
+
+  // a final CR may be the terminator of a line whose LF is still to come
+  int tail = size - pos;
+  if (tail > 0 && data[size - 1] == '\r')
+    --tail;
+
+  if (tail > 0 && tail > limitFor(data + pos)) {
+    ++m_discardedLines;
+    m_discarding = true;
+    pos = size;
+  }
+
+  consumed = pos;
+  return lines;
+}
+
+
+/// \brief Append received data and report the complete lines
+///
+/// Like scan(), but keeps incomplete lines internally. Data is only
+/// copied if there was an incomplete line left over from the last call.
+///
+/// \param data Chunk of data as read from the socket
+/// \param size Number of bytes in data
+/// \param callback Function to call for each line
+/// \param context Passed to callback
+///
+/// \return Number of complete lines found
+int Framer::feed(const char* data, int size, LineCallback callback,
+		 void* context) {
+  int consumed;
+  int lines;
+
+  if (m_pending.empty()) {
+    lines = scan(data, size, callback, context, consumed);
+    m_pending.assign(data + consumed, data + size);
+    return lines;
+  }
+
+  m_pending.insert(m_pending.end(), data, data + size);
+  lines = scan(&m_pending[0], m_pending.size(), callback, context, consumed);
+  m_pending.erase(m_pending.begin(), m_pending.begin() + consumed);
+
+  return lines;
+}
+
+
+/// \brief Are we skipping the rest of an overlong line?
+bool Framer::isDiscarding() const {
+  return m_discarding;
+}
+
+
+/// \brief Number of overlong lines discarded so far
+unsigned long long Framer::discardedLines() const {
+  return m_discardedLines;
+}
+
+
+/// \brief Drop all pending data
+///
+/// Used when the underlying connection is reset.
+void Framer::clear() {
+  m_pending.clear();
+  m_discarding = false;
+}
@@ -0,0 +1,72 @@
+/// \file
+/// \brief Declaration of Framer class
+///
+/// \author png!das-system
+#ifndef QIRCCORE_FRAMER_H
+#define QIRCCORE_FRAMER_H 1
+
+#include <vector>
+
+#include "qirccore.h"
+
+namespace QIRCCore {
+  /// \brief Splits an inbound byte stream into message lines
+  ///
+  /// Complete lines are reported to a callback as pointers into the
+  /// scanned data. Lines that exceed the configured length limit are
+  /// discarded, so a misbehaving server can't make buffers grow
+  /// without bounds.
+  ///
+  /// scan() leaves buffering of incomplete lines to the caller, which
+  /// allows zero-copy framing in a caller-owned buffer (see
+  /// QIRC::LineFramer); feed() keeps them itself.
+  class Framer {
+  public:
+    /// \brief Default limits (RFC1459 / IRCv3 message tags)
+    enum {
+      DefaultMaxLineLength = 512,
+      DefaultMaxTagsLength = 8191
+    };
+
+    /// \brief Called for each complete line (without line terminator)
+    typedef void (*LineCallback)(void* context, const char* line,
+				 int length);
+
+    Framer();
+
+    int maxLineLength() const;
+    void setMaxLineLength(int length);
+
+    int maxTagsLength() const;
+    void setMaxTagsLength(int length);
+
+    int scan(const char* data, int size, LineCallback callback,
+	     void* context, int& consumed);
+    int feed(const char* data, int size, LineCallback callback,
+	     void* context);
+
+    bool isDiscarding() const;
+    unsigned long long discardedLines() const;
+    void clear();
+
+  protected:
+    /// \brief Maximum length of a line including CR/LF
+    int m_maxLineLength;
+
+    /// \brief Maximum additional length of IRCv3 message tags
+    int m_maxTagsLength;
+
+    /// \brief Flag indicating that we're skipping the rest of an overlong line
+    bool m_discarding;
+
+    /// \brief Number of overlong lines discarded so far
+    unsigned long long m_discardedLines;
+
+    /// \brief Incomplete line left over from the last feed()
+    std::vector<char> m_pending;
+
+    int limitFor(const char* line) const;
+  };
+};
+
+#endif // !QIRCCORE_FRAMER_H
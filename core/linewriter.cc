@@ -0,0 +1,192 @@
+/// \file
+/// \brief Implementation of LineWriter class
+///
+/// \author png!das-system
+#include <cstring>
+
+#include "LineWriter"
+
+using namespace QIRCCore;
+
+
+namespace {
+  inline bool isHighSurrogate(unsigned int c) {
+    return ((c & 0xfc00) == 0xd800);
+  }
+
+  inline bool isLowSurrogate(unsigned int c) {
+    return ((c & 0xfc00) == 0xdc00);
+  }
+};
+
+
+/// \brief Construct writer with a buffer for one protocol line
+LineWriter::LineWriter() :
+  m_buffer(512), m_length(0) {}
+
+
+/// \brief Start a new line with the given command
+///
+/// \param command Command name
+/// \param length Length of command or -1 if it's NUL terminated
+LineWriter& LineWriter::begin(const char* command, int length) {
+  m_length = 0;
+  return raw(command, (length < 0) ? std::strlen(command) : length);
+}
+
+
+/// \brief Append bytes as-is
+LineWriter& LineWriter::raw(const char* s, int length) {
+  std::memcpy(reserve(length), s, length);
+  m_length += length;
+  return (*this);
+}
+
+
+/// \brief Append a middle parameter
+LineWriter& LineWriter::param(const char* p, int length) {
+  char* d = reserve(length + 1);
+  *d = ' ';
+  std::memcpy(d + 1, p, length);
+  m_length += length + 1;
+  return (*this);
+}
+
+
+/// \brief Append the trailing parameter
+LineWriter& LineWriter::trailing(const char* t, int length) {
+  char* d = reserve(length + 2);
+  d[0] = ' ';
+  d[1] = ':';
+  std::memcpy(d + 2, t, length);
+  m_length += length + 2;
+  return (*this);
+}
+
+
+/// \brief Append UTF-16 text encoded as UTF-8
+LineWriter& LineWriter::rawUtf16(const unsigned short* s, int count) {
+  // UTF-8 needs at most 3 bytes per UTF-16 code unit
+  m_length += encodeUtf8(reserve(count * 3), s, count);
+  return (*this);
+}
+
+
+/// \brief Append a middle parameter given as UTF-16 text
+LineWriter& LineWriter::paramUtf16(const unsigned short* p, int count) {
+  raw(" ", 1);
+  return rawUtf16(p, count);
+}
+
+
+/// \brief Append the trailing parameter given as UTF-16 text
+LineWriter& LineWriter::trailingUtf16(const unsigned short* t, int count) {
+  raw(" :", 2);
+  return rawUtf16(t, count);
+}
+
+
+/// \brief Terminate the current line with CR/LF
+///
+/// The line is available through data() and length() until the next
+/// call to begin().
+LineWriter& LineWriter::line() {
+  return raw("\r\n", 2);
+}
+
+
+/// \brief Bytes of the current line
+const char* LineWriter::data() const {
+  return &m_buffer[0];
+}
+
+
+/// \brief Number of bytes in the current line
+int LineWriter::length() const {
+  return m_length;
+}
+
+
+/// \brief Make room for count more bytes
+///
+/// \return Pointer to the first free byte
+char* LineWriter::reserve(int count) {
+  if (m_length + count > static_cast<int>(m_buffer.size())) {
+    int size = m_buffer.size() * 2;
+    if (size < m_length + count)
+      size = m_length + count;
+    m_buffer.resize(size);
+  }
+
+  return &m_buffer[m_length];
+}
+
+
+/// \brief Encode UTF-16 text as UTF-8
+///
+/// \param out Buffer to write to; must have room for 3 bytes per code unit
+/// \param s Text to encode
+/// \param count Number of UTF-16 code units in s
+/// \return Number of bytes written
+int LineWriter::encodeUtf8(char* out, const unsigned short* s, int count) {
+  unsigned char* d = reinterpret_cast<unsigned char*>(out);
+
+  for (int i = 0; i < count; ++i) {
+    unsigned int c = s[i];
+
+    if (c < 0x80) {
+      *d++ = c;
+    } else if (c < 0x800) {
+      *d++ = 0xc0 | (c >> 6);
+      *d++ = 0x80 | (c & 0x3f);
+    } else if (isHighSurrogate(c) && i + 1 < count &&
+	       isLowSurrogate(s[i + 1])) {
+      c = 0x10000 + ((c - 0xd800) << 10) + (s[++i] - 0xdc00);
+      *d++ = 0xf0 | (c >> 18);
+      *d++ = 0x80 | ((c >> 12) & 0x3f);
+      *d++ = 0x80 | ((c >> 6) & 0x3f);
+      *d++ = 0x80 | (c & 0x3f);
+    } else {
+      *d++ = 0xe0 | (c >> 12);
+      *d++ = 0x80 | ((c >> 6) & 0x3f);
+      *d++ = 0x80 | (c & 0x3f);
+    }
+  }
+
+  return d - reinterpret_cast<unsigned char*>(out);
+}
+
+
+/// \brief Number of bytes needed to encode UTF-16 text as UTF-8
+int LineWriter::utf8Length(const unsigned short* s, int count) {
+  int bytes = 0;
+  int units;
+
+  for (int i = 0; i < count; i += units) {
+    bytes += charWidth(s, i, count, units);
+  }
+
+  return bytes;
+}
+
+
+/// \brief UTF-8 length of the character at s[i]
+///
+/// \param units Receives the number of code units of the character
+/// (2 for surrogate pairs, 1 otherwise)
+int LineWriter::charWidth(const unsigned short* s, int i, int count,
+			  int& units) {
+  const unsigned int c = s[i];
+
+  units = 1;
+  if (c < 0x80)
+    return 1;
+  if (c < 0x800)
+    return 2;
+  if (isHighSurrogate(c) && i + 1 < count && isLowSurrogate(s[i + 1])) {
+    units = 2;
+    return 4;
+  }
+
+  return 3;
+}
@@ -0,0 +1,58 @@
+/// \file
+/// \brief Declaration of LineWriter class
+///
+/// \author png!das-system
+#ifndef QIRCCORE_LINEWRITER_H
+#define QIRCCORE_LINEWRITER_H 1
+
+#include <vector>
+
+#include "qirccore.h"
+
+namespace QIRCCore {
+  /// \brief Builds outbound message lines
+  ///
+  /// The command and its parameters are written into a reusable
+  /// buffer and the line is terminated with CR/LF. Parameters can be
+  /// given as UTF-8 bytes or as UTF-16 text, which is encoded straight
+  /// into the buffer.
+  ///
+  /// \code
+  /// writer.begin("PRIVMSG").param(target, targetLength)
+  ///   .trailing(text, textLength).line();
+  /// send(fd, writer.data(), writer.length(), 0);
+  /// \endcode
+  class LineWriter {
+  public:
+    LineWriter();
+
+    LineWriter& begin(const char* command, int length=-1);
+    LineWriter& raw(const char* s, int length);
+    LineWriter& param(const char* p, int length);
+    LineWriter& trailing(const char* t, int length);
+
+    LineWriter& rawUtf16(const unsigned short* s, int count);
+    LineWriter& paramUtf16(const unsigned short* p, int count);
+    LineWriter& trailingUtf16(const unsigned short* t, int count);
+
+    LineWriter& line();
+
+    const char* data() const;
+    int length() const;
+
+    static int encodeUtf8(char* out, const unsigned short* s, int count);
+    static int utf8Length(const unsigned short* s, int count);
+    static int charWidth(const unsigned short* s, int i, int count, int& units);
+
+  protected:
+    /// \brief Reusable buffer for the line being built
+    std::vector<char> m_buffer;
+
+    /// \brief Number of bytes used in m_buffer
+    int m_length;
+
+    char* reserve(int count);
+  };
+};
+
+#endif // !QIRCCORE_LINEWRITER_H
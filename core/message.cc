@@ -0,0 +1,327 @@
+/// \file
+/// \brief Implementation of Message class
+///
+/// \author png!das-system
+#include <cstring>
+
+#include "Message"
+
+using namespace QIRCCore;
+
+
+/// \brief Construct an empty (invalid) message
+Message::Message() {
+  reset();
+}
+
+
+/// \brief Clear all field locations
+void Message::reset() {
+  m_buffer = "";
+  m_line.begin = m_line.length = 0;
+  m_tags.begin = m_tags.length = 0;
+  m_prefix.begin = m_prefix.length = 0;
+  m_prefixBang = m_prefixAt = -1;
+  m_command.begin = m_command.length = 0;
+  m_numeric = -1;
+  m_paramCount = 0;
+  m_hasTrailing = false;
+}
+
+
+/// \brief Parse a message line
+///
+/// Splits the line in a single forward scan according to RFC1459 (with
+/// IRCv3 message tags):
+///
+///   [@tags ][:prefix ]command[ param...][ :trailing]
+///
+/// The line must not contain the CR/LF line terminator.
+///
+/// \param buffer Buffer containing the line
+/// \param offset Offset of the first byte of the line within buffer
+/// \param length Length of the line in bytes
+///
+/// \return true if the line contained at least a command, false otherwise
+bool Message::parse(const char* buffer, int offset, int length) {
+  reset();
+  m_buffer = buffer;
+
+  const char* d = buffer;
+  const int end = offset + length;
+  int pos = offset;
+
+  m_line.begin = offset;
+  m_line.length = length;
+
+  // @tags
+  if (pos < end && d[pos] == '@') {
+    m_tags.begin = ++pos;
+    while (pos < end && d[pos] != ' ')
+      ++pos;
+    m_tags.length = pos - m_tags.begin;
+    while (pos < end && d[pos] == ' ')
+      ++pos;
+  }
+
+  // :prefix
+  if (pos < end && d[pos] == ':') {
+    m_prefix.begin = ++pos;
+    while (pos < end && d[pos] != ' ') {
+      if (d[pos] == '!' && m_prefixBang < 0) {
+	m_prefixBang = pos;
+      } else if (d[pos] == '@' && m_prefixBang >= 0 && m_prefixAt < 0) {
+	m_prefixAt = pos;
+      }
+      ++pos;
+    }
+    m_prefix.length = pos - m_prefix.begin;
+    while (pos < end && d[pos] == ' ')
+      ++pos;
+  }
+
+  // command
+  m_command.begin = pos;
+  while (pos < end && d[pos] != ' ')
+    ++pos;
+  m_command.length = pos - m_command.begin;
+  if (m_command.length == 0) {
+    return false;
+  }
+
+  if (m_command.length == 3) {
+    const char* c = d + m_command.begin;
+    if (c[0] >= '0' && c[0] <= '9' && c[1] >= '0' && c[1] <= '9' &&
+	c[2] >= '0' && c[2] <= '9') {
+      m_numeric = (c[0] - '0') * 100 + (c[1] - '0') * 10 + (c[2] - '0');
+    }
+  }
+
+  // middle parameters and trailing parameter
+  while (pos < end) {
+    while (pos < end && d[pos] == ' ')
+      ++pos;
+    if (pos >= end)
+      break;
+
+    Span& p = m_params[m_paramCount++];
+
+    if (d[pos] == ':') {
+      ++pos;
+      p.begin = pos;
+      p.length = end - pos;
+      m_hasTrailing = true;
+      break;
+    }
+
+    p.begin = pos;
+    if (m_paramCount == MaxParams) {
+      // the last parameter takes the rest of the line
+      p.length = end - pos;
+      break;
+    }
+
+    while (pos < end && d[pos] != ' ')
+      ++pos;
+    p.length = pos - p.begin;
+  }
+
+  return true;
+}
+
+
+/// \brief Does this message contain a command?
+bool Message::isValid() const {
+  return (m_command.length > 0);
+}
+
+
+/// \brief Buffer the message was parsed from
+const char* Message::buffer() const {
+  return m_buffer;
+}
+
+
+/// \brief Use a copy of the buffer the message was parsed from
+///
+/// The field locations stay valid as long as the new buffer holds the
+/// same bytes.
+void Message::setBuffer(const char* buffer) {
+  m_buffer = buffer;
+}
+
+
+/// \brief Raw bytes of a field (not NUL terminated)
+const char* Message::data(const Span& s) const {
+  return m_buffer + s.begin;
+}
+
+
+/// \brief Location of the whole message line
+Span Message::line() const {
+  return m_line;
+}
+
+
+/// \brief Does the message carry IRCv3 tags?
+bool Message::hasTags() const {
+  return (m_tags.length > 0);
+}
+
+
+/// \brief Location of the raw IRCv3 tag string (without leading '@')
+Span Message::tags() const {
+  return m_tags;
+}
+
+
+/// \brief Does the message have a prefix?
+bool Message::hasPrefix() const {
+  return (m_prefix.length > 0);
+}
+
+
+/// \brief Is the prefix a full nick!user@host mask?
+bool Message::hasUserPrefix() const {
+  return (m_prefixAt >= 0 && m_prefixBang > m_prefix.begin);
+}
+
+
+/// \brief Location of the prefix (without leading ':')
+Span Message::prefix() const {
+  return m_prefix;
+}
+
+
+/// \brief Location of the nickname (or server name) part of the prefix
+Span Message::nick() const {
+  Span s = m_prefix;
+  if (m_prefixBang >= 0) {
+    s.length = m_prefixBang - m_prefix.begin;
+  }
+
+  return s;
+}
+
+
+/// \brief Location of the user part of the prefix (empty if there is none)
+Span Message::user() const {
+  Span s;
+  if (!hasUserPrefix()) {
+    s.begin = s.length = 0;
+  } else {
+    s.begin = m_prefixBang + 1;
+    s.length = m_prefixAt - m_prefixBang - 1;
+  }
+
+  return s;
+}
+
+
+/// \brief Location of the host part of the prefix (empty if there is none)
+Span Message::host() const {
+  Span s;
+  if (!hasUserPrefix()) {
+    s.begin = s.length = 0;
+  } else {
+    s.begin = m_prefixAt + 1;
+    s.length = m_prefix.begin + m_prefix.length - m_prefixAt - 1;
+  }
+
+  return s;
+}
+
+
+/// \brief Location of the command
+Span Message::command() const {
+  return m_command;
+}
+
+
+/// \brief Raw bytes of the command (not NUL terminated)
+const char* Message::commandData() const {
+  return m_buffer + m_command.begin;
+}
+
+
+/// \brief Length of the command in bytes
+int Message::commandLength() const {
+  return m_command.length;
+}
+
+
+/// \brief Compare the command
+///
+/// \param cmd NUL terminated command name, e.g. "PRIVMSG"
+bool Message::isCommand(const char* cmd) const {
+  const int len = std::strlen(cmd);
+  return (len == m_command.length &&
+	  std::memcmp(commandData(), cmd, len) == 0);
+}
+
+
+/// \brief Is this a numeric server reply?
+bool Message::isNumeric() const {
+  return (m_numeric >= 0);
+}
+
+
+/// \brief Numeric reply code or -1 for named commands
+int Message::numeric() const {
+  return m_numeric;
+}
+
+
+/// \brief Number of parameters (including the trailing one)
+int Message::paramCount() const {
+  return m_paramCount;
+}
+
+
+/// \brief Location of a parameter (empty if i is out of range)
+Span Message::param(int i) const {
+  if (i < 0 || i >= m_paramCount) {
+    Span s;
+    s.begin = s.length = 0;
+    return s;
+  }
+
+  return m_params[i];
+}
+
+
+/// \brief Raw bytes of a parameter (not NUL terminated)
+///
+/// \return Pointer into the buffer or NULL if i is out of range
+const char* Message::paramData(int i) const {
+  if (i < 0 || i >= m_paramCount)
+    return NULL;
+
+  return m_buffer + m_params[i].begin;
+}
+
+
+/// \brief Length of a parameter in bytes or -1 if i is out of range
+int Message::paramLength(int i) const {
+  if (i < 0 || i >= m_paramCount)
+    return -1;
+
+  return m_params[i].length;
+}
+
+
+/// \brief Compare a parameter
+bool Message::paramEquals(int i, const char* s) const {
+  if (i < 0 || i >= m_paramCount)
+    return false;
+
+  const int len = std::strlen(s);
+  return (len == m_params[i].length &&
+	  std::memcmp(paramData(i), s, len) == 0);
+}
+
+
+/// \brief Was the last parameter given as trailing parameter?
+bool Message::hasTrailing() const {
+  return m_hasTrailing;
+}
@@ -0,0 +1,94 @@
+/// \file
+/// \brief Declaration of Message class
+///
+/// \author png!das-system
+#ifndef QIRCCORE_MESSAGE_H
+#define QIRCCORE_MESSAGE_H 1
+
+#include "qirccore.h"
+
+namespace QIRCCore {
+  /// \brief Parsed view of a single IRC message line
+  ///
+  /// The message doesn't copy anything; it stores the locations of the
+  /// tags, prefix, command and parameters within a caller-owned buffer,
+  /// which has to stay alive and unchanged while the message is used.
+  /// Locations are offsets from the start of the buffer, so a line can
+  /// be parsed in place within a larger buffer holding several lines.
+  class Message {
+  public:
+    /// \brief Maximum number of parameters in a message (RFC1459)
+    enum { MaxParams = 15 };
+
+    Message();
+
+    bool parse(const char* buffer, int offset, int length);
+    void reset();
+    bool isValid() const;
+
+    const char* buffer() const;
+    void setBuffer(const char* buffer);
+    const char* data(const Span& s) const;
+    Span line() const;
+
+    bool hasTags() const;
+    Span tags() const;
+
+    bool hasPrefix() const;
+    bool hasUserPrefix() const;
+    Span prefix() const;
+    Span nick() const;
+    Span user() const;
+    Span host() const;
+
+    Span command() const;
+    const char* commandData() const;
+    int commandLength() const;
+    bool isCommand(const char* cmd) const;
+    bool isNumeric() const;
+    int numeric() const;
+
+    int paramCount() const;
+    Span param(int i) const;
+    const char* paramData(int i) const;
+    int paramLength(int i) const;
+    bool paramEquals(int i, const char* s) const;
+    bool hasTrailing() const;
+
+  protected:
+    /// \brief Buffer the message was parsed from
+    const char* m_buffer;
+
+    /// \brief Location of the whole message line
+    Span m_line;
+
+    /// \brief Location of the tags (without the leading '@')
+    Span m_tags;
+
+    /// \brief Location of the prefix (without the leading ':')
+    Span m_prefix;
+
+    /// \brief Offset of '!' within the prefix or -1
+    int m_prefixBang;
+
+    /// \brief Offset of '@' within the prefix or -1
+    int m_prefixAt;
+
+    /// \brief Location of the command
+    Span m_command;
+
+    /// \brief Numeric reply code or -1 for named commands
+    int m_numeric;
+
+    /// \brief Locations of the parameters
+    Span m_params[MaxParams];
+
+    /// \brief Number of valid entries in m_params
+    int m_paramCount;
+
+    /// \brief Flag indicating wether the last parameter was a trailing one
+    bool m_hasTrailing;
+  };
+};
+
+#endif // !QIRCCORE_MESSAGE_H
@@ -0,0 +1,67 @@
+/// \file
+/// \brief Common declarations of the QIRC protocol core
+///
+/// The protocol core (QIRCCore) contains the parts of libQIRC that
+/// don't need Qt: framing, parsing and serializing message lines,
+/// case mapping, flood control and timers. It works on plain byte
+/// spans and callbacks, so it can be embedded in any event loop.
+///
+/// \author png!das-system
+#ifndef QIRCCORE_H
+#define QIRCCORE_H 1
+
+namespace QIRCCore {
+  /// \brief Location of a field within a buffer
+  struct Span {
+    /// \brief Offset of the first byte
+    int begin;
+
+    /// \brief Length in bytes
+    int length;
+  };
+
+  /// \brief Rules for comparing nicks and channel names
+  ///
+  /// Same values as QIRC::CaseMapping.
+  enum CaseMapping {
+    /// \brief Only A-Z and a-z are equivalent
+    AsciiCaseMapping = 0,
+
+    /// \brief Like AsciiCaseMapping, plus four pairs of punctuation
+    ///
+    /// [ and {, ] and }, \\ and |, ~ and ^ are equivalent.
+    Rfc1459CaseMapping,
+
+    /// \brief Like Rfc1459CaseMapping, but without ~ and ^
+    ///
+    /// [ and {, ] and }, \\ and | are equivalent.
+    StrictRfc1459CaseMapping
+  };
+
+  /// \brief Lower case a single character according to a case mapping
+  ///
+  /// Works on bytes as well as UTF-16 code units; everything outside
+  /// of ASCII is returned unchanged.
+  inline unsigned int foldChar(unsigned int c, CaseMapping mapping) {
+    if (c >= 'A' && c <= 'Z')
+      return c + ('a' - 'A');
+
+    if (mapping == AsciiCaseMapping)
+      return c;
+
+    // '[' '\' ']' map to '{' '|' '}'; RFC1459 also maps '^' to '~'
+    if (c >= '[' && c <= ']')
+      return c + ('{' - '[');
+    if (c == '^' && mapping == Rfc1459CaseMapping)
+      return '~';
+
+    return c;
+  }
+
+  CaseMapping caseMappingFromName(const char* name, int length);
+  void ircToLower(char* s, int length, CaseMapping mapping);
+  bool ircEquals(const char* a, int aLength, const char* b, int bLength,
+		 CaseMapping mapping);
+};
+
+#endif // !QIRCCORE_H
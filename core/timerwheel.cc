@@ -0,0 +1,325 @@
+/// \file
+/// \brief Implementation of TimerWheel and WheelTimer classes
+///
+/// \author png!das-system
+#include <cstddef>
+
+#include "TimerWheel"
+
+using namespace QIRCCore;
+
+
+/// \brief Index of the lowest set bit (bits must not be 0)
+static inline int lowestBit(unsigned long long bits) {
+#ifdef __GNUC__
+  return __builtin_ctzll(bits);
+#else
+  int i = 0;
+  while ((bits & 1) == 0) {
+    bits >>= 1;
+    ++i;
+  }
+  return i;
+#endif
+}
+
+
+/// \brief Rotate a slot bitmap so bit n becomes bit 0
+static inline unsigned long long rotate(unsigned long long bits, int n) {
+  if (n == 0)
+    return bits;
+
+  return (bits >> n) | (bits << (TimerWheel::Slots - n));
+}
+
+
+/// \brief Construct inactive timer
+///
+/// \param callback Function called when the timer expires
+/// \param context Argument for callback, usually the owner
+WheelTimer::WheelTimer(Callback callback, void* context) :
+  m_callback(callback), m_context(context), m_wheel(NULL),
+  m_deadline(0), m_slot(-1) {
+  prev = NULL;
+  next = NULL;
+}
+
+
+WheelTimer::~WheelTimer() {
+  stop();
+}
+
+
+/// \brief Is the timer scheduled on a wheel?
+///
+/// A timer is no longer active while its callback runs.
+bool WheelTimer::isActive() const {
+  return (m_wheel != NULL);
+}
+
+
+/// \brief Time at which the timer expires (or expired)
+long long WheelTimer::deadline() const {
+  return m_deadline;
+}
+
+
+/// \brief Remove the timer from its wheel
+void WheelTimer::stop() {
+  if (m_wheel != NULL)
+    m_wheel->stop(this);
+}
+
+
+/// \brief Construct empty wheel
+///
+/// \param now Current time in milliseconds
+TimerWheel::TimerWheel(long long now) :
+  m_current(now), m_size(0) {
+  for (int i = 0; i < Levels * Slots; ++i) {
+    m_slots[i].prev = &m_slots[i];
+    m_slots[i].next = &m_slots[i];
+  }
+
+  for (int i = 0; i < Levels; ++i) {
+    m_occupied[i] = 0;
+  }
+}
+
+
+/// \brief Deactivate all timers still scheduled
+TimerWheel::~TimerWheel() {
+  for (int i = 0; i < Levels * Slots; ++i) {
+    TimerLink* link = m_slots[i].next;
+    while (link != &m_slots[i]) {
+      WheelTimer* timer = static_cast<WheelTimer*>(link);
+      link = link->next;
+
+      timer->prev = NULL;
+      timer->next = NULL;
+      timer->m_wheel = NULL;
+      timer->m_slot = -1;
+    }
+  }
+}
+
+
+/// \brief Schedule a timer
+///
+/// A timer that is already active (on this or another wheel) is
+/// rescheduled. Deadlines in the past expire with the next advance().
+///
+/// \param timer The timer
+/// \param deadline Expiry time in milliseconds
+void TimerWheel::start(WheelTimer* timer, long long deadline) {
+  if (timer->m_wheel != NULL)
+    timer->m_wheel->stop(timer);
+
+  timer->m_wheel = this;
+  timer->m_deadline = deadline;
+  ++m_size;
+
+  place(timer);
+}
+
+
+/// \brief Remove a timer from the wheel
+void TimerWheel::stop(WheelTimer* timer) {
+  if (timer->m_wheel != this)
+    return;
+
+  unlink(timer);
+  timer->m_wheel = NULL;
+  --m_size;
+}
+
+
+/// \brief Number of scheduled timers
+int TimerWheel::size() const {
+  return m_size;
+}
+
+
+/// \brief Are there no scheduled timers?
+bool TimerWheel::isEmpty() const {
+  return (m_size == 0);
+}
+
+
+/// \brief Time at which advance() has something to do
+///
+/// This is the deadline of the next timer if it is due within 64 ms.
+/// Otherwise it may be earlier: the start of the slot of a higher level
+/// the timer is in, when it has to be moved down to a lower level.
+///
+/// \return Time in milliseconds or -1 if the wheel is empty
+long long TimerWheel::nextExpiry() const {
+  long long next = -1;
+
+  for (int level = 0; level < Levels; ++level) {
+    if (m_occupied[level] == 0)
+      continue;
+
+    const int shift = level * SlotBits;
+    const int pos = static_cast<int>((m_current >> shift) & (Slots - 1));
+
+    // unless the current time is at the start of a slot of this level,
+    // timers in the current slot are a full turn ahead
+    const int skip = ((m_current & ((1LL << shift) - 1)) == 0) ? 0 : 1;
+    const int k = lowestBit(rotate(m_occupied[level],
+				   (pos + skip) & (Slots - 1))) + skip;
+    const long long t = ((m_current >> shift) + k) << shift;
+
+    if (next < 0 || t < next)
+      next = t;
+  }
+
+  return next;
+}
+
+
+/// \brief Move the wheel's time forward without expiring timers
+///
+/// Does nothing if timers are due at or before now. Starting a timer
+/// on a wheel that hasn't been advanced for a while places it in a
+/// higher level than necessary; owners should skip the idle time
+/// first.
+void TimerWheel::skipTo(long long now) {
+  const long long next = nextExpiry();
+
+  if ((next < 0 || next > now) && m_current <= now)
+    m_current = now + 1;
+}
+
+
+/// \brief Expire all timers due at or before now
+///
+/// The callbacks are called in the order of the deadlines; they may
+/// start and stop timers, including the one that expired.
+///
+/// \return Number of expired timers
+int TimerWheel::advance(long long now) {
+  int fired = 0;
+
+  for (;;) {
+    const long long t = nextExpiry();
+    if (t < 0 || t > now)
+      break;
+
+    m_current = t;
+
+    // move the timers of higher level slots starting now down
+    for (int level = 1; level < Levels; ++level) {
+      if ((t & ((1LL << (level * SlotBits)) - 1)) != 0)
+	break;
+
+      cascade(level, static_cast<int>((t >> (level * SlotBits)) &
+				      (Slots - 1)));
+    }
+
+    // take the expired timers out of the wheel first, so callbacks
+    // can reschedule them
+    const int index = static_cast<int>(t & (Slots - 1));
+    TimerLink& head = m_slots[index];
+    TimerLink expired;
+    expired.prev = &expired;
+    expired.next = &expired;
+
+    if (head.next != &head) {
+      expired.next = head.next;
+      expired.prev = head.prev;
+      expired.next->prev = &expired;
+      expired.prev->next = &expired;
+      head.prev = &head;
+      head.next = &head;
+      m_occupied[0] &= ~(1ULL << index);
+
+      for (TimerLink* link = expired.next; link != &expired;
+	   link = link->next) {
+	static_cast<WheelTimer*>(link)->m_slot = -1;
+      }
+    }
+
+    m_current = t + 1;
+
+    while (expired.next != &expired) {
+      WheelTimer* timer = static_cast<WheelTimer*>(expired.next);
+      stop(timer);
+
+      timer->m_callback(timer->m_context);
+      ++fired;
+    }
+  }
+
+  if (m_current <= now)
+    m_current = now + 1;
+
+  return fired;
+}
+
+
+/// \brief Link a timer into the slot for its deadline
+void TimerWheel::place(WheelTimer* timer) {
+  const long long range = 1LL << (Levels * SlotBits);
+  long long deadline = timer->m_deadline;
+
+  if (deadline < m_current)
+    deadline = m_current;
+
+  // too far away: wait in the last slot of the highest level
+  if (deadline - m_current >= range)
+    deadline = m_current + range - 1;
+
+  const long long delta = deadline - m_current;
+  int level = 0;
+  while (level < Levels - 1 && delta >= (1LL << ((level + 1) * SlotBits)))
+    ++level;
+
+  const int index = static_cast<int>((deadline >> (level * SlotBits)) &
+				     (Slots - 1));
+  const int slot = level * Slots + index;
+  TimerLink& head = m_slots[slot];
+
+  timer->prev = head.prev;
+  timer->next = &head;
+  head.prev->next = timer;
+  head.prev = timer;
+
+  timer->m_slot = slot;
+  m_occupied[level] |= (1ULL << index);
+}
+
+
+/// \brief Unlink a timer from its slot
+void TimerWheel::unlink(WheelTimer* timer) {
+  timer->prev->next = timer->next;
+  timer->next->prev = timer->prev;
+  timer->prev = NULL;
+  timer->next = NULL;
+
+  if (timer->m_slot >= 0) {
+    const TimerLink& head = m_slots[timer->m_slot];
+    if (head.next == &head) {
+      m_occupied[timer->m_slot / Slots] &=
+	~(1ULL << (timer->m_slot % Slots));
+    }
+    timer->m_slot = -1;
+  }
+}
+
+
+/// \brief Move the timers of a higher level slot to lower levels
+void TimerWheel::cascade(int level, int index) {
+  TimerLink& head = m_slots[level * Slots + index];
+  TimerLink* link = head.next;
+
+  head.prev = &head;
+  head.next = &head;
+  m_occupied[level] &= ~(1ULL << index);
+
+  while (link != &head) {
+    TimerLink* next = link->next;
+    place(static_cast<WheelTimer*>(link));
+    link = next;
+  }
+}
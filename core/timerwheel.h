@@ -0,0 +1,121 @@
+/// \file
+/// \brief Declaration of TimerWheel and WheelTimer classes
+///
+/// \author png!das-system
+#ifndef QIRCCORE_TIMERWHEEL_H
+#define QIRCCORE_TIMERWHEEL_H 1
+
+#include "qirccore.h"
+
+namespace QIRCCore {
+  class TimerWheel;
+
+  /// \brief Links a WheelTimer into a slot of a TimerWheel
+  struct TimerLink {
+    /// \brief Previous entry in the slot
+    TimerLink* prev;
+
+    /// \brief Next entry in the slot
+    TimerLink* next;
+  };
+
+
+  /// \brief Timer scheduled on a TimerWheel
+  ///
+  /// Timers are usually members of the object they call back into.
+  /// Deleting an active timer removes it from its wheel.
+  class WheelTimer : protected TimerLink {
+  public:
+    /// \brief Called when the timer expires
+    typedef void (*Callback)(void* context);
+
+    WheelTimer(Callback callback, void* context);
+    ~WheelTimer();
+
+    bool isActive() const;
+    long long deadline() const;
+    void stop();
+
+  protected:
+    friend class TimerWheel;
+
+    /// \brief Function called on expiry
+    Callback m_callback;
+
+    /// \brief Argument for m_callback
+    void* m_context;
+
+    /// \brief Wheel the timer is scheduled on or NULL
+    TimerWheel* m_wheel;
+
+    /// \brief Expiry time in milliseconds
+    long long m_deadline;
+
+    /// \brief Slot the timer is linked into (-1 while being fired)
+    int m_slot;
+
+  private:
+    WheelTimer(const WheelTimer&);
+    WheelTimer& operator =(const WheelTimer&);
+  };
+
+
+  /// \brief Hierarchical timer wheel
+  ///
+  /// Keeps any number of timers with millisecond resolution in Levels
+  /// wheels of Slots slots each: level 0 holds timers expiring within
+  /// the next 64 ms, one slot per millisecond, level 1 those within
+  /// 4 seconds in 64 ms slots, and so on up to about 4.6 hours;
+  /// timers further away wait in the last level. Starting and stopping
+  /// a timer is O(1). When the time reaches the start of a slot of a
+  /// higher level, its timers are moved down to lower levels.
+  ///
+  /// Like FloodControl, the wheel doesn't read a clock itself: the
+  /// owner passes the current time to advance() and uses nextExpiry()
+  /// to arm a single system timer for all timers on the wheel.
+  class TimerWheel {
+  public:
+    /// \brief Layout of the wheel
+    enum {
+      SlotBits = 6,
+      Slots = 1 << SlotBits,
+      Levels = 4
+    };
+
+    TimerWheel(long long now=0);
+    ~TimerWheel();
+
+    void start(WheelTimer* timer, long long deadline);
+    void stop(WheelTimer* timer);
+
+    int size() const;
+    bool isEmpty() const;
+
+    long long nextExpiry() const;
+    void skipTo(long long now);
+    int advance(long long now);
+
+  protected:
+    void place(WheelTimer* timer);
+    void unlink(WheelTimer* timer);
+    void cascade(int level, int index);
+
+    /// \brief Timers per slot (circular lists, the heads are sentinels)
+    TimerLink m_slots[Levels * Slots];
+
+    /// \brief Bit i of m_occupied[l] is set if slot i of level l is in use
+    unsigned long long m_occupied[Levels];
+
+    /// \brief All times before this one have been processed
+    long long m_current;
+
+    /// \brief Number of scheduled timers
+    int m_size;
+
+  private:
+    TimerWheel(const TimerWheel&);
+    TimerWheel& operator =(const TimerWheel&);
+  };
+};
+
+#endif // !QIRCCORE_TIMERWHEEL_H
@@ -0,0 +1,619 @@
+/// \file
+/// \brief Implementation of EpollTransport and EpollLoop classes
+///
+/// \author png!das-system
+#include <cerrno>
+#include <cstring>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <QEvent>
+#include <QPointer>
+#include <QThreadStorage>
+#include <QTimer>
+#include <QDebug>
+
+#include "EpollTransport"
+
+using namespace QIRC;
+
+
+/// \brief One EpollLoop per thread, deleted when the thread exits
+Q_GLOBAL_STATIC(QThreadStorage<EpollLoop*>, epollLoops)
+
+/// \brief Events every socket is registered for
+static const quint32 watchedEvents = EPOLLIN | EPOLLOUT | EPOLLRDHUP |
+  EPOLLET;
+
+
+/// \brief Create epoll instance and watch it
+EpollLoop::EpollLoop() :
+  m_notifier(NULL), m_nextKey(1) {
+  m_epoll = epoll_create1(EPOLL_CLOEXEC);
+  if (m_epoll < 0) {
+    qWarning() << "EpollLoop: Unable to create epoll instance:"
+	       << std::strerror(errno);
+    return;
+  }
+
+  m_notifier = new QSocketNotifier(m_epoll, QSocketNotifier::Read, this);
+  QObject::connect(m_notifier, SIGNAL(activated(int)),
+		   this, SLOT(epoll_activated()));
+}
+
+
+EpollLoop::~EpollLoop() {
+  if (m_epoll >= 0) {
+    ::close(m_epoll);
+  }
+}
+
+
+/// \brief Loop of the calling thread (created on first use)
+EpollLoop* EpollLoop::instance() {
+  QThreadStorage<EpollLoop*>* loops = epollLoops();
+  if (!loops->hasLocalData()) {
+    loops->setLocalData(new EpollLoop());
+  }
+
+  return loops->localData();
+}
+
+
+/// \brief Could the epoll instance be created?
+bool EpollLoop::isValid() const {
+  return (m_epoll >= 0);
+}
+
+
+/// \brief Number of registered transports
+int EpollLoop::transportCount() const {
+  return m_transports.size();
+}
+
+
+/// \brief Watch a socket of a transport
+///
+/// \return Registration key for remove() or 0 on failure
+quint64 EpollLoop::add(EpollTransport* transport, int fd) {
+  if (m_epoll < 0) {
+    errno = EBADF;
+    return 0;
+  }
+
+  quint64 key = m_nextKey++;
+
+  struct epoll_event ev;
+  ev.events = watchedEvents;
+  ev.data.u64 = key;
+  if (epoll_ctl(m_epoll, EPOLL_CTL_ADD, fd, &ev) < 0) {
+    return 0;
+  }
+
+  m_transports.insert(key, transport);
+  return key;
+}
+
+
+/// \brief Report a socket again if it is still ready
+///
+/// Edge-triggered sockets are only reported when their state changes.
+/// Modifying the registration makes epoll check the socket again, so
+/// one that still has data buffered shows up in a later batch.
+void EpollLoop::rearm(quint64 key, int fd) {
+  if (!m_transports.contains(key)) {
+    return;
+  }
+
+  struct epoll_event ev;
+  ev.events = watchedEvents;
+  ev.data.u64 = key;
+  if (epoll_ctl(m_epoll, EPOLL_CTL_MOD, fd, &ev) < 0) {
+    qWarning() << "EpollLoop: Unable to re-arm socket:"
+	       << std::strerror(errno);
+  }
+}
+
+
+/// \brief Stop watching a socket
+void EpollLoop::remove(quint64 key, int fd) {
+  if (m_transports.remove(key) > 0) {
+    epoll_ctl(m_epoll, EPOLL_CTL_DEL, fd, NULL);
+  }
+}
+
+
+/// \brief Slot for m_notifier::activated()
+///
+/// Fetches one batch of events; if there are more, the notifier fires
+/// again after Qt has processed its other events.
+void EpollLoop::epoll_activated() {
+  struct epoll_event events[BatchSize];
+
+  int n = epoll_wait(m_epoll, events, BatchSize, 0);
+  if (n < 0) {
+    if (errno != EINTR) {
+      qWarning() << "EpollLoop: epoll_wait() failed:" << std::strerror(errno);
+    }
+    return;
+  }
+
+  for (int i = 0; i < n; ++i) {
+    // handlers may delete other transports of this batch
+    EpollTransport* transport = m_transports.value(events[i].data.u64, NULL);
+    if (transport != NULL) {
+      transport->handleEvents(events[i].events);
+    }
+  }
+}
+
+
+/// \brief Construct unconnected transport
+EpollTransport::EpollTransport(QObject* parent) :
+  Transport(parent), m_fd(-1), m_state(UnconnectedState), m_port(0),
+  m_lookupId(-1), m_loop(NULL), m_key(0), m_writeOffset(0),
+  m_pendingError(QAbstractSocket::UnknownSocketError) {}
+
+
+EpollTransport::~EpollTransport() {
+  close();
+}
+
+
+/// \brief Start connecting to a server
+///
+/// Host names are resolved asynchronously with QHostInfo.
+void EpollTransport::connectToHost(const QString& host, quint16 port) {
+  close();
+
+  m_port = port;
+  m_errorString.clear();
+  m_readBuffer.clear();
+
+  QHostAddress address;
+  if (address.setAddress(host)) {
+    startConnect(address);
+    return;
+  }
+
+  m_state = HostLookupState;
+  m_lookupId = QHostInfo::lookupHost(host, this, SLOT(hostFound(QHostInfo)));
+}
+
+
+/// \brief Slot for QHostInfo::lookupHost()
+void EpollTransport::hostFound(const QHostInfo& info) {
+  if (info.lookupId() != m_lookupId || m_state != HostLookupState) {
+    return;
+  }
+
+  m_lookupId = -1;
+  m_state = UnconnectedState;
+
+  if (info.error() != QHostInfo::NoError || info.addresses().isEmpty()) {
+    m_errorString = info.errorString();
+    emit error(QAbstractSocket::HostNotFoundError);
+    return;
+  }
+
+  startConnect(info.addresses().first());
+}
+
+
+/// \brief Create the socket and start a non-blocking connect()
+void EpollTransport::startConnect(const QHostAddress& address) {
+  struct sockaddr_storage sa;
+  socklen_t length;
+
+  std::memset(&sa, 0, sizeof(sa));
+  if (address.protocol() == QAbstractSocket::IPv6Protocol) {
+    struct sockaddr_in6* sin6 = reinterpret_cast<struct sockaddr_in6*>(&sa);
+    Q_IPV6ADDR a = address.toIPv6Address();
+    sin6->sin6_family = AF_INET6;
+    sin6->sin6_port = htons(m_port);
+    std::memcpy(&sin6->sin6_addr, &a, sizeof(sin6->sin6_addr));
+    length = sizeof(*sin6);
+  } else {
+    struct sockaddr_in* sin = reinterpret_cast<struct sockaddr_in*>(&sa);
+    sin->sin_family = AF_INET;
+    sin->sin_port = htons(m_port);
+    sin->sin_addr.s_addr = htonl(address.toIPv4Address());
+    length = sizeof(*sin);
+  }
+
+  m_fd = ::socket(sa.ss_family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+  if (m_fd < 0) {
+    failLater(errno);
+    return;
+  }
+
+  m_loop = EpollLoop::instance();
+  m_key = m_loop->add(this, m_fd);
+  if (m_key == 0) {
+    failLater(errno);
+    return;
+  }
+
+  // completion is reported as EPOLLOUT
+  m_state = ConnectingState;
+  if (::connect(m_fd, reinterpret_cast<struct sockaddr*>(&sa), length) < 0 &&
+      errno != EINPROGRESS) {
+    failLater(errno);
+  }
+}
+
+
+/// \brief Handle readiness events reported by m_loop
+///
+/// Slots connected to the signals emitted here may delete the
+/// transport, so no member is touched after a signal once the guard
+/// reports that it is gone.
+void EpollTransport::handleEvents(quint32 events) {
+  QPointer<EpollTransport> guard(this);
+  int errnum = 0;
+
+  if (m_state == ConnectingState) {
+    if ((events & (EPOLLOUT | EPOLLERR | EPOLLHUP)) == 0) {
+      return;
+    }
+
+    socklen_t length = sizeof(errnum);
+    getsockopt(m_fd, SOL_SOCKET, SO_ERROR, &errnum, &length);
+    if (errnum != 0) {
+      fail(errnum);
+      return;
+    }
+
+    m_state = ConnectedState;
+    emit connected();
+
+    if (guard.isNull() || m_fd < 0) {
+      return;
+    }
+  }
+
+  if ((events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR)) != 0) {
+    int status = readAvailable(errnum);
+    if (status > 1) {
+      // read the rest after the other sockets had their turn
+      m_loop->rearm(m_key, m_fd);
+    }
+
+    if (!m_readBuffer.isEmpty()) {
+      emit readyRead();
+
+      if (guard.isNull()) {
+	return;
+      }
+    }
+
+    if (status <= 0) {
+      // the data received before is still delivered
+      if (m_fd >= 0) {
+	fail(errnum);
+      }
+      return;
+    }
+  }
+
+  if ((events & EPOLLOUT) != 0 && m_fd >= 0) {
+    if (!flush(errnum)) {
+      fail(errnum);
+    }
+  }
+}
+
+
+/// \brief Read what the kernel has buffered, up to MaxReadSize bytes
+///
+/// Sockets are edge-triggered, so unless the limit is reached this has
+/// to read until recv() would block; otherwise the caller must re-arm
+/// the socket.
+///
+/// \return 1 if the connection is still open, 2 if it is open and the
+/// limit was reached, 0 if the server closed it and -1 on errors
+/// (errnum receives the error)
+int EpollTransport::readAvailable(int& errnum) {
+  const int chunk = 16384;
+  int total = 0;
+
+  for (;;) {
+    int used = m_readBuffer.size();
+    m_readBuffer.resize(used + chunk);
+
+    ssize_t n = ::recv(m_fd, m_readBuffer.data() + used, chunk, 0);
+    m_readBuffer.resize(used + qMax(n, ssize_t(0)));
+
+    if (n > 0) {
+      total += n;
+      if (total >= MaxReadSize) {
+	return 2;
+      }
+      continue;
+    }
+
+    if (n == 0) {
+      errnum = 0;
+      return 0;
+    }
+
+    if (errno == EINTR) {
+      continue;
+    }
+    if (errno == EAGAIN || errno == EWOULDBLOCK) {
+      return 1;
+    }
+
+    errnum = errno;
+    return -1;
+  }
+}
+
+
+/// \brief Write as much of m_writeBuffer as possible
+///
+/// Finishes a pending disconnectFromHost() once everything is written.
+///
+/// \return false on errors (errnum receives the error)
+bool EpollTransport::flush(int& errnum) {
+  while (m_writeOffset < m_writeBuffer.size()) {
+    ssize_t n = ::send(m_fd, m_writeBuffer.constData() + m_writeOffset,
+		       m_writeBuffer.size() - m_writeOffset, MSG_NOSIGNAL);
+    if (n > 0) {
+      m_writeOffset += n;
+      continue;
+    }
+
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+      return true;
+    }
+
+    errnum = errno;
+    return false;
+  }
+
+  m_writeBuffer.resize(0);
+  m_writeOffset = 0;
+
+  if (m_state == ClosingState) {
+    close();
+    emit disconnected();
+  }
+
+  return true;
+}
+
+
+/// \brief Close the connection after pending data has been written
+void EpollTransport::disconnectFromHost() {
+  if (m_state == ConnectedState) {
+    if (m_writeOffset < m_writeBuffer.size()) {
+      // finished by flush()
+      m_state = ClosingState;
+      return;
+    }
+
+    close();
+    emit disconnected();
+    return;
+  }
+
+  if (m_state != ClosingState) {
+    close();
+  }
+}
+
+
+/// \brief Close the connection at once, discarding pending data
+void EpollTransport::abort() {
+  const bool wasConnected = (m_state == ConnectedState ||
+			     m_state == ClosingState);
+
+  close();
+
+  if (wasConnected) {
+    emit disconnected();
+  }
+}
+
+
+/// \brief Is the connection established?
+bool EpollTransport::isOpen() const {
+  return (m_state == ConnectedState);
+}
+
+
+/// \brief Take all data received so far
+QByteArray EpollTransport::readAll() {
+  QByteArray data = m_readBuffer;
+  m_readBuffer.clear();
+  return data;
+}
+
+
+/// \brief Send data, or queue it until the socket is writable
+///
+/// \return Number of bytes accepted or -1 if not connected
+qint64 EpollTransport::write(const QByteArray& data) {
+  if (m_state != ConnectedState) {
+    return -1;
+  }
+
+  if (m_writeOffset < m_writeBuffer.size()) {
+    // keep the order; flush() continues when the socket is writable
+    if (m_writeOffset > m_writeBuffer.size() / 2) {
+      m_writeBuffer.remove(0, m_writeOffset);
+      m_writeOffset = 0;
+    }
+    m_writeBuffer.append(data.constData(), data.size());
+    return data.size();
+  }
+
+  // nothing pending: send straight from the caller's buffer and only
+  // copy what the socket doesn't take (data may be raw data the
+  // caller reuses, so it must not be shared)
+  int sent = 0;
+  while (sent < data.size()) {
+    ssize_t n = ::send(m_fd, data.constData() + sent, data.size() - sent,
+		       MSG_NOSIGNAL);
+    if (n > 0) {
+      sent += n;
+      continue;
+    }
+
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+      break;
+    }
+
+    // reported with the next event for the socket
+    return -1;
+  }
+
+  m_writeBuffer.resize(0);
+  m_writeBuffer.append(data.constData() + sent, data.size() - sent);
+  m_writeOffset = 0;
+
+  return data.size();
+}
+
+
+/// \brief Human-readable description of the last error
+QString EpollTransport::errorString() const {
+  return m_errorString;
+}
+
+
+/// \brief Close the socket without emitting any signals
+void EpollTransport::close() {
+  if (m_lookupId >= 0) {
+    QHostInfo::abortHostLookup(m_lookupId);
+    m_lookupId = -1;
+  }
+
+  if (m_fd >= 0) {
+    if (m_key != 0) {
+      m_loop->remove(m_key, m_fd);
+    }
+    ::close(m_fd);
+  }
+
+  m_fd = -1;
+  m_key = 0;
+  m_state = UnconnectedState;
+  m_writeBuffer.clear();
+  m_writeOffset = 0;
+}
+
+
+/// \brief Close the connection and report an error
+///
+/// \param errnum errno value or 0 if the server closed the connection
+void EpollTransport::fail(int errnum) {
+  const bool wasConnected = (m_state == ConnectedState ||
+			     m_state == ClosingState);
+
+  m_errorString = (errnum == 0) ?
+    QString("The remote host closed the connection") :
+    QString::fromLocal8Bit(std::strerror(errnum));
+  close();
+
+  // a slot connected to error() may delete the transport
+  QPointer<EpollTransport> guard(this);
+  emit error(socketError(errnum));
+  if (wasConnected && !guard.isNull()) {
+    emit disconnected();
+  }
+}
+
+
+/// \brief Close the socket and report an error from the event loop
+///
+/// Used for errors while connecting, so error() isn't emitted from
+/// within connectToHost().
+void EpollTransport::failLater(int errnum) {
+  m_errorString = QString::fromLocal8Bit(std::strerror(errnum));
+  m_pendingError = socketError(errnum);
+  close();
+
+  QTimer::singleShot(0, this, SLOT(emitPendingError()));
+}
+
+
+/// \brief Emit the error recorded by failLater()
+void EpollTransport::emitPendingError() {
+  emit error(m_pendingError);
+}
+
+
+/// \brief Take the socket off its loop when moving to another thread
+///
+/// QEvent::ThreadChange is delivered in the old thread right before
+/// the move; reattach() registers the socket in the new thread.
+bool EpollTransport::event(QEvent* e) {
+  if (e->type() == QEvent::ThreadChange && m_key != 0) {
+    m_loop->remove(m_key, m_fd);
+    m_loop = NULL;
+    m_key = 0;
+
+    // posted events move along with the object
+    QMetaObject::invokeMethod(this, "reattach", Qt::QueuedConnection);
+  }
+
+  return Transport::event(e);
+}
+
+
+/// \brief Register the socket with the loop of the current thread
+///
+/// Adding an edge-triggered socket reports the readiness it already
+/// has, so nothing that arrived during the move is missed.
+void EpollTransport::reattach() {
+  if (m_fd < 0 || m_key != 0) {
+    return;
+  }
+
+  m_loop = EpollLoop::instance();
+  m_key = m_loop->add(this, m_fd);
+  if (m_key == 0) {
+    fail(errno);
+  }
+}
+
+
+/// \brief Socket error matching an errno value
+QAbstractSocket::SocketError EpollTransport::socketError(int errnum) {
+  switch (errnum) {
+  case 0:
+  case ECONNRESET:
+  case EPIPE:
+    return QAbstractSocket::RemoteHostClosedError;
+  case ECONNREFUSED:
+    return QAbstractSocket::ConnectionRefusedError;
+  case ETIMEDOUT:
+    return QAbstractSocket::SocketTimeoutError;
+  case EHOSTUNREACH:
+  case ENETUNREACH:
+  case ENETDOWN:
+    return QAbstractSocket::NetworkError;
+  case EACCES:
+  case EPERM:
+    return QAbstractSocket::SocketAccessError;
+  case EMFILE:
+  case ENFILE:
+  case ENOBUFS:
+  case ENOMEM:
+    return QAbstractSocket::SocketResourceError;
+  default:
+    return QAbstractSocket::UnknownSocketError;
+  }
+}
@@ -0,0 +1,161 @@
+/// \file
+/// \brief Declaration of EpollTransport and EpollLoop classes
+///
+/// \author png!das-system
+#ifndef EPOLLTRANSPORT_H
+#define EPOLLTRANSPORT_H 1
+
+#include <QHash>
+#include <QHostAddress>
+#include <QHostInfo>
+#include <QSocketNotifier>
+
+#include "Transport"
+
+#include "qirc.h"
+
+namespace QIRC {
+  class EpollTransport;
+
+
+  /// \brief Per-thread epoll instance shared by all EpollTransports
+  ///
+  /// Qt only watches the epoll descriptor itself, with a single
+  /// QSocketNotifier. When it becomes readable, the readiness events
+  /// of up to BatchSize sockets are fetched with one epoll_wait() call
+  /// and handed to their transports.
+  class EpollLoop : public QObject {
+    Q_OBJECT
+  public:
+    /// \brief Maximum number of events fetched at once
+    enum { BatchSize = 256 };
+
+    static EpollLoop* instance();
+    virtual ~EpollLoop();
+
+    bool isValid() const;
+    int transportCount() const;
+
+    quint64 add(EpollTransport* transport, int fd);
+    void rearm(quint64 key, int fd);
+    void remove(quint64 key, int fd);
+
+  protected:
+    EpollLoop();
+
+    /// \brief The epoll descriptor
+    int m_epoll;
+
+    /// \brief Watches m_epoll
+    QSocketNotifier* m_notifier;
+
+    /// \brief Registered transports by registration key
+    ///
+    /// Events carry the key instead of a pointer, so events for a
+    /// transport removed earlier in the same batch are dropped.
+    QHash<quint64, EpollTransport*> m_transports;
+
+    /// \brief Next registration key
+    quint64 m_nextKey;
+
+  protected slots:
+    void epoll_activated();
+  };
+
+
+  /// \brief Non-blocking socket transport driven by epoll (Linux only)
+  ///
+  /// All EpollTransports of a thread share one EpollLoop, so Qt's
+  /// event dispatcher only has to watch one descriptor per thread no
+  /// matter how many connections there are. Sockets are registered
+  /// edge-triggered for input and output. Each event reads at most
+  /// MaxReadSize bytes; a socket with more data buffered is re-armed
+  /// and read again with a later batch, so a flooding server can't
+  /// starve the other connections of the thread.
+  ///
+  /// The socket is registered with the loop of the thread that calls
+  /// connectToHost(). When the transport is moved to another thread,
+  /// the socket is taken off the old thread's loop before the move and
+  /// registered with the new thread's loop afterwards.
+  class EpollTransport : public Transport {
+    Q_OBJECT
+  public:
+    /// \brief Maximum number of bytes read per readiness event
+    enum { MaxReadSize = 65536 };
+
+    EpollTransport(QObject* parent=NULL);
+    virtual ~EpollTransport();
+
+    virtual void connectToHost(const QString& host, quint16 port);
+    virtual void disconnectFromHost();
+    virtual void abort();
+    virtual bool isOpen() const;
+    virtual QByteArray readAll();
+    virtual qint64 write(const QByteArray& data);
+    virtual QString errorString() const;
+
+  protected:
+    friend class EpollLoop;
+
+    /// \brief Connection state
+    enum State {
+      UnconnectedState,
+      HostLookupState,
+      ConnectingState,
+      ConnectedState,
+      ClosingState
+    };
+
+    void startConnect(const QHostAddress& address);
+    void handleEvents(quint32 events);
+    int readAvailable(int& errnum);
+    bool flush(int& errnum);
+    void close();
+    void fail(int errnum);
+    void failLater(int errnum);
+
+    virtual bool event(QEvent* e);
+
+    static QAbstractSocket::SocketError socketError(int errnum);
+
+    /// \brief Socket descriptor or -1
+    int m_fd;
+
+    /// \brief Connection state
+    State m_state;
+
+    /// \brief Port to connect to
+    quint16 m_port;
+
+    /// \brief Id of the running host lookup or -1
+    int m_lookupId;
+
+    /// \brief Loop the socket is registered with
+    EpollLoop* m_loop;
+
+    /// \brief Registration key within m_loop (0 if not registered)
+    quint64 m_key;
+
+    /// \brief Data received but not yet taken with readAll()
+    QByteArray m_readBuffer;
+
+    /// \brief Data waiting to be written
+    QByteArray m_writeBuffer;
+
+    /// \brief Number of bytes of m_writeBuffer already written
+    int m_writeOffset;
+
+    /// \brief Description of the last error
+    QString m_errorString;
+
+    /// \brief Error reported by emitPendingError()
+    QAbstractSocket::SocketError m_pendingError;
+
+  protected slots:
+    void hostFound(const QHostInfo& info);
+    void emitPendingError();
+    void reattach();
+  };
+};
+
+#endif // !EPOLLTRANSPORT_H
@@ -0,0 +1,96 @@
+/// \file
+/// \brief Implementation of EventDispatcher class
+///
+/// \author png!das-system
+#include <QtAlgorithms>
+
+#include "EventDispatcher"
+
+using namespace QIRC;
+
+
+EventDispatcher::EventDispatcher() :
+  m_nextId(1), m_dispatching(0) {}
+
+
+EventDispatcher::~EventDispatcher() {
+  clear();
+  qDeleteAll(m_removed);
+}
+
+
+/// \brief Remove a handler registered with on()
+///
+/// If called while events are dispatched, the handler isn't called
+/// anymore and is deleted when dispatching has finished.
+///
+/// \return false if there is no handler with this id
+bool EventDispatcher::off(HandlerId id) {
+  for (int e = 0; e < EventCount; ++e) {
+    QVector<HandlerBase*>& handlers = m_handlers[e];
+    for (int i = 0; i < handlers.size(); ++i) {
+      HandlerBase* h = handlers.at(i);
+      if (h == NULL || h->id != id)
+	continue;
+
+      if (m_dispatching > 0) {
+	handlers[i] = NULL;
+	m_removed.append(h);
+      } else {
+	handlers.remove(i);
+	delete h;
+      }
+
+      return true;
+    }
+  }
+
+  return false;
+}
+
+
+/// \brief Are there handlers for the given EventId?
+bool EventDispatcher::has(int eventId) const {
+  if (eventId < 0 || eventId >= EventCount)
+    return false;
+
+  return !m_handlers[eventId].isEmpty();
+}
+
+
+/// \brief Remove all handlers
+void EventDispatcher::clear() {
+  for (int e = 0; e < EventCount; ++e) {
+    QVector<HandlerBase*>& handlers = m_handlers[e];
+    if (m_dispatching == 0) {
+      qDeleteAll(handlers);
+      handlers.clear();
+      continue;
+    }
+
+    // the running handler may be among them
+    for (int i = 0; i < handlers.size(); ++i) {
+      if (handlers.at(i) != NULL) {
+	m_removed.append(handlers.at(i));
+	handlers[i] = NULL;
+      }
+    }
+  }
+}
+
+
+/// \brief Delete the handlers removed during dispatch
+void EventDispatcher::purge() {
+  qDeleteAll(m_removed);
+  m_removed.clear();
+
+  for (int e = 0; e < EventCount; ++e) {
+    QVector<HandlerBase*>& handlers = m_handlers[e];
+    int w = 0;
+    for (int r = 0; r < handlers.size(); ++r) {
+      if (handlers.at(r) != NULL)
+	handlers[w++] = handlers.at(r);
+    }
+    handlers.resize(w);
+  }
+}
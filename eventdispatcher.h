@@ -0,0 +1,119 @@
+/// \file
+/// \brief Declaration of EventDispatcher class
+///
+/// \author png!das-system
+#ifndef EVENTDISPATCHER_H
+#define EVENTDISPATCHER_H 1
+
+#include <QVector>
+
+#include "events.h"
+
+#include "qirc.h"
+
+namespace QIRC {
+  /// \brief Calls handlers registered for typed events
+  ///
+  /// Handlers are callables (functions or function objects) taking a
+  /// const reference to one of the event structs from events.h. They
+  /// are kept in a separate list per event type, so dispatching an
+  /// event calls its handlers directly, without looking up signatures
+  /// at runtime. Passing a handler with the wrong signature fails to
+  /// compile.
+  ///
+  /// Handlers may be added and removed from within a handler.
+  class EventDispatcher {
+  public:
+    /// \brief Identifies a registered handler, see off()
+    typedef int HandlerId;
+
+    EventDispatcher();
+    ~EventDispatcher();
+
+    /// \brief Register a handler for events of type E
+    ///
+    /// \return Id for removing the handler with off()
+    template<typename E, typename F> HandlerId on(F handler) {
+      Handler<E, F>* h = new Handler<E, F>(handler);
+      h->id = m_nextId++;
+      m_handlers[E::Id].append(h);
+      return h->id;
+    }
+
+    bool off(HandlerId id);
+    void clear();
+
+    /// \brief Are there handlers for events of type E?
+    template<typename E> bool has() const {
+      return !m_handlers[E::Id].isEmpty();
+    }
+
+    bool has(int eventId) const;
+
+    /// \brief Call all handlers for an event, in registration order
+    template<typename E> void dispatch(const E& event) {
+      const int count = m_handlers[E::Id].size();
+
+      ++m_dispatching;
+      for (int i = 0; i < count; ++i) {
+	// handlers removed during dispatch are NULL until it's finished
+	HandlerBase* h = m_handlers[E::Id].at(i);
+	if (h != NULL)
+	  static_cast<EventHandler<E>*>(h)->call(event);
+      }
+      --m_dispatching;
+
+      if (m_dispatching == 0 && !m_removed.isEmpty())
+	purge();
+    }
+
+  protected:
+    /// \brief Type independent part of a handler
+    struct HandlerBase {
+      virtual ~HandlerBase() {}
+
+      /// \brief Id returned by on()
+      HandlerId id;
+    };
+
+    /// \brief Handler for events of type E
+    template<typename E> struct EventHandler : public HandlerBase {
+      virtual void call(const E& event) = 0;
+    };
+
+    /// \brief Handler for events of type E calling an F
+    template<typename E, typename F> struct Handler : public EventHandler<E> {
+      Handler(const F& f) : m_f(f) {}
+
+      virtual void call(const E& event) {
+	m_f(event);
+      }
+
+      /// \brief The callable
+      F m_f;
+    };
+
+    void purge();
+
+    /// \brief Handlers per event type
+    QVector<HandlerBase*> m_handlers[EventCount];
+
+    /// \brief Next handler id
+    HandlerId m_nextId;
+
+    /// \brief Nesting depth of dispatch()
+    int m_dispatching;
+
+    /// \brief Handlers removed during dispatch, deleted by purge()
+    ///
+    /// A handler may remove itself, so it must not be deleted while it
+    /// may still be running.
+    QVector<HandlerBase*> m_removed;
+
+  private:
+    EventDispatcher(const EventDispatcher&);
+    EventDispatcher& operator =(const EventDispatcher&);
+  };
+};
+
+#endif // !EVENTDISPATCHER_H
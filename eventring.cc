@@ -0,0 +1,157 @@
+/// \file
+/// \brief Implementation of EventRing class
+///
+/// \author png!das-system
+#include "EventRing"
+
+using namespace QIRC;
+
+
+/// \brief Construct empty ring
+///
+/// \param capacity Maximum number of queued messages, rounded up to a
+/// power of two
+/// \param parent Parent object
+EventRing::EventRing(int capacity, QObject* parent) :
+  QObject(parent), m_head(0), m_tail(0), m_waiting(1), m_dropped(0) {
+  int size = 2;
+  while (size < capacity) {
+    size *= 2;
+  }
+
+  m_slots.resize(size);
+  m_mask = size - 1;
+}
+
+
+EventRing::~EventRing() {}
+
+
+/// \brief Maximum number of queued messages
+int EventRing::capacity() const {
+  return m_slots.size();
+}
+
+
+/// \brief Number of queued messages (a snapshot when used concurrently)
+int EventRing::size() const {
+  uint head = static_cast<uint>(int(m_head));
+  uint tail = static_cast<uint>(int(m_tail));
+
+  return static_cast<int>(tail - head);
+}
+
+
+/// \brief Is the ring empty? (a snapshot when used concurrently)
+bool EventRing::isEmpty() const {
+  return (size() == 0);
+}
+
+
+/// \brief Number of messages rejected by push() because the ring was full
+int EventRing::droppedEvents() const {
+  return m_dropped;
+}
+
+
+/// \brief Append a message (producer side)
+///
+/// Emits eventsAvailable() if the consumer is waiting.
+///
+/// \return false if the ring is full and the message was dropped
+bool EventRing::push(const IrcMessage& msg) {
+  uint tail = static_cast<uint>(int(m_tail));
+  uint head = static_cast<uint>(m_head.fetchAndAddAcquire(0));
+
+  if (tail - head >= static_cast<uint>(m_slots.size())) {
+    m_dropped.ref();
+    return false;
+  }
+
+  m_slots[tail & m_mask] = msg;
+  m_tail.fetchAndStoreRelease(static_cast<int>(tail + 1));
+
+  if (m_waiting.testAndSetOrdered(1, 0)) {
+    emit eventsAvailable();
+  }
+
+  return true;
+}
+
+
+/// \brief Take the oldest message (consumer side)
+///
+/// \return false if the ring is empty; the consumer is then waiting
+/// for eventsAvailable()
+bool EventRing::pop(IrcMessage& msg) {
+  uint head = static_cast<uint>(int(m_head));
+  uint tail = static_cast<uint>(m_tail.fetchAndAddAcquire(0));
+
+  if (head == tail) {
+    if (wait())
+      return false;
+    tail = static_cast<uint>(m_tail.fetchAndAddAcquire(0));
+  }
+
+  // release the slot's reference to the receive buffer
+  IrcMessage& slot = m_slots[head & m_mask];
+  msg = slot;
+  slot = IrcMessage();
+
+  m_head.fetchAndStoreRelease(static_cast<int>(head + 1));
+
+  return true;
+}
+
+
+/// \brief Take all queued messages (consumer side)
+///
+/// \param out Messages are appended here
+/// \param max Maximum number of messages to take, -1 for all
+/// \return Number of messages taken
+int EventRing::drain(QVector<IrcMessage>& out, int max) {
+  uint head = static_cast<uint>(int(m_head));
+  int taken = 0;
+
+  for (;;) {
+    uint tail = static_cast<uint>(m_tail.fetchAndAddAcquire(0));
+
+    while (head != tail && taken != max) {
+      IrcMessage& slot = m_slots[head & m_mask];
+      out.append(slot);
+      slot = IrcMessage();
+      ++head;
+      ++taken;
+    }
+
+    m_head.fetchAndStoreRelease(static_cast<int>(head));
+
+    if (taken == max || head != tail || wait())
+      break;
+  }
+
+  return taken;
+}
+
+
+/// \brief Mark the consumer as waiting after it found the ring empty
+///
+/// The ring is checked again after setting the flag, so a message
+/// pushed meanwhile isn't left without a notification.
+///
+/// \return true if the ring is still empty, false if the consumer
+/// should go on reading
+bool EventRing::wait() {
+  m_waiting.fetchAndStoreOrdered(1);
+
+  uint head = static_cast<uint>(int(m_head));
+  uint tail = static_cast<uint>(m_tail.fetchAndAddAcquire(0));
+  if (head == tail)
+    return true;
+
+  // the producer may have taken the flag already and emitted a
+  // notification; that one is spurious then
+  m_waiting.testAndSetOrdered(1, 0);
+
+  return false;
+}
@@ -0,0 +1,77 @@
+/// \file
+/// \brief Declaration of EventRing class
+///
+/// \author png!das-system
+#ifndef EVENTRING_H
+#define EVENTRING_H 1
+
+#include <QAtomicInt>
+#include <QObject>
+#include <QVector>
+
+#include "IrcMessage"
+
+#include "qirc.h"
+
+namespace QIRC {
+  /// \brief Bounded lock-free queue of received messages between threads
+  ///
+  /// An alternative to queued signal delivery when a Connection lives
+  /// on another thread than its consumer (see ConnectionPool). The
+  /// connection pushes every received message into the ring; the
+  /// consumer drains them in batches. Neither side takes a lock or
+  /// allocates memory per message.
+  ///
+  /// There must be exactly one producer (one Connection, or several
+  /// living in the same thread) and one consumer thread at a time.
+  ///
+  /// eventsAvailable() is only emitted when the ring goes from empty to
+  /// non-empty while the consumer is waiting, i.e. at most once per
+  /// drain().
+  class EventRing : public QObject {
+    Q_OBJECT
+  public:
+    EventRing(int capacity=4096, QObject* parent=NULL);
+    virtual ~EventRing();
+
+    int capacity() const;
+    int size() const;
+    bool isEmpty() const;
+    int droppedEvents() const;
+
+    bool push(const IrcMessage& msg);
+
+    bool pop(IrcMessage& msg);
+    int drain(QVector<IrcMessage>& out, int max=-1);
+
+  protected:
+    bool wait();
+
+    /// \brief Message slots; capacity is a power of two
+    QVector<IrcMessage> m_slots;
+
+    /// \brief capacity - 1
+    int m_mask;
+
+    /// \brief Index of the next slot to read (written by the consumer)
+    QAtomicInt m_head;
+
+    /// \brief Index of the next slot to write (written by the producer)
+    QAtomicInt m_tail;
+
+    /// \brief Set by the consumer when it found the ring empty
+    QAtomicInt m_waiting;
+
+    /// \brief Messages rejected because the ring was full
+    QAtomicInt m_dropped;
+
+  signals:
+    /// \brief Messages are available after the ring was empty
+    ///
+    /// Connect to this signal (queued across threads) and call drain()
+    /// until it returns 0.
+    void eventsAvailable();
+  };
+};
+
+#endif // !EVENTRING_H
@@ -0,0 +1,167 @@
+/// \file
+/// \brief Typed events for Connection::on()
+///
+/// \author png!das-system
+#ifndef EVENTS_H
+#define EVENTS_H 1
+
+#include <QString>
+
+#include "HostMask"
+#include "IrcMessage"
+
+#include "qirc.h"
+
+namespace QIRC {
+  /// \brief Index of each event type in an EventDispatcher
+  enum EventId {
+    RawMessageEvent = 0,
+    PrivmsgEvent,
+    NoticeEvent,
+    ModeEvent,
+    NickEvent,
+    JoinEvent,
+    PartEvent,
+    PingEvent,
+    TopicEvent,
+    InviteEvent,
+    ErrorEvent,
+
+    EventCount
+  };
+
+  /// \brief Any received message (like Connection::irc_message())
+  struct RawMessage {
+    enum { Id = RawMessageEvent };
+
+    /// \brief The received message
+    IrcMessage message;
+  };
+
+  /// \brief PRIVMSG (like Connection::irc_privmsg())
+  struct Privmsg {
+    enum { Id = PrivmsgEvent };
+
+    /// \brief Host mask of the sender
+    HostMask sender;
+
+    /// \brief Nick or channel the message was directed at
+    QString target;
+
+    /// \brief Message text
+    QString message;
+  };
+
+  /// \brief NOTICE (like Connection::irc_notice())
+  struct Notice {
+    enum { Id = NoticeEvent };
+
+    /// \brief Host mask of the sender
+    HostMask sender;
+
+    /// \brief Nick or channel the notice was sent to
+    QString target;
+
+    /// \brief Notice text
+    QString message;
+  };
+
+  /// \brief MODE (like Connection::irc_mode())
+  struct Mode {
+    enum { Id = ModeEvent };
+
+    /// \brief Host mask of the user that changed the modes
+    HostMask sender;
+
+    /// \brief Channel or nick whose modes changed
+    QString target;
+
+    /// \brief Mode changes with their arguments, separated by spaces
+    QString modes;
+  };
+
+  /// \brief Another user changed their nick (like Connection::irc_nick())
+  struct Nick {
+    enum { Id = NickEvent };
+
+    /// \brief Host mask of the user with the old nick
+    HostMask sender;
+
+    /// \brief New nickname
+    QString newNick;
+  };
+
+  /// \brief Another user joined a channel (like Connection::irc_join())
+  struct Join {
+    enum { Id = JoinEvent };
+
+    /// \brief Host mask of the user
+    HostMask user;
+
+    /// \brief Channel name
+    QString channel;
+  };
+
+  /// \brief Another user left a channel (like Connection::irc_part())
+  struct Part {
+    enum { Id = PartEvent };
+
+    /// \brief Host mask of the user
+    HostMask user;
+
+    /// \brief Channel name
+    QString channel;
+  };
+
+  /// \brief PING from the server (like Connection::irc_ping())
+  struct Ping {
+    enum { Id = PingEvent };
+
+    /// \brief Server name as sent by the server
+    QString serverName;
+  };
+
+  /// \brief TOPIC change (like Connection::irc_topic())
+  struct Topic {
+    enum { Id = TopicEvent };
+
+    /// \brief Host mask of the user that changed the topic
+    HostMask sender;
+
+    /// \brief Channel name
+    QString channel;
+
+    /// \brief New topic
+    QString topic;
+  };
+
+  /// \brief INVITE (like Connection::irc_invite())
+  struct Invite {
+    enum { Id = InviteEvent };
+
+    /// \brief Host mask of the user that sent the invite
+    HostMask sender;
+
+    /// \brief Nickname of the invited user
+    QString target;
+
+    /// \brief Channel name
+    QString channel;
+  };
+
+  /// \brief Error reply (like Connection::irc_error())
+  struct Error {
+    enum { Id = ErrorEvent };
+
+    /// \brief Error code (400-599)
+    int numeric;
+
+    /// \brief Nick, channel or command the error refers to, if any
+    QString target;
+
+    /// \brief Error text
+    QString message;
+  };
+};
+
+#endif // !EVENTS_H
@@ -0,0 +1,19 @@
+/// \file
+/// \brief Declaration of FloodControl utility class
+///
+/// The token bucket lives in the Qt-free protocol core.
+///
+/// \author png!das-system
+#ifndef FLOODCONTROL_H
+#define FLOODCONTROL_H 1
+
+#include "core/floodcontrol.h"
+
+#include "qirc.h"
+
+namespace QIRC {
+  /// \brief Token bucket limiting the rate of outbound messages
+  typedef QIRCCore::FloodControl FloodControl;
+};
+
+#endif // !FLOODCONTROL_H
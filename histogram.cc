@@ -0,0 +1,119 @@
+/// \file
+/// \brief Implementation of Histogram utility class
+///
+/// \author png!das-system
+#include "Histogram"
+
+using namespace QIRC;
+
+
+/// \brief Construct empty histogram
+Histogram::Histogram() {
+  clear();
+}
+
+
+/// \brief Count a value
+void Histogram::record(quint64 value) {
+  int i = 0;
+  if (value > 1) {
+#ifdef __GNUC__
+    i = 64 - __builtin_clzll(value - 1);
+#else
+    for (quint64 v = value - 1; v != 0; v >>= 1)
+      ++i;
+#endif
+    if (i >= BucketCount)
+      i = BucketCount - 1;
+  }
+
+  ++m_buckets[i];
+  ++m_count;
+  m_sum += value;
+  if (value > m_max)
+    m_max = value;
+}
+
+
+/// \brief Remove all recorded values
+void Histogram::clear() {
+  for (int i = 0; i < BucketCount; ++i) {
+    m_buckets[i] = 0;
+  }
+
+  m_count = 0;
+  m_sum = 0;
+  m_max = 0;
+}
+
+
+/// \brief Number of recorded values
+quint64 Histogram::count() const {
+  return m_count;
+}
+
+
+/// \brief Sum of all recorded values
+quint64 Histogram::sum() const {
+  return m_sum;
+}
+
+
+/// \brief Largest recorded value
+quint64 Histogram::max() const {
+  return m_max;
+}
+
+
+/// \brief Average of the recorded values (0 if there are none)
+double Histogram::mean() const {
+  if (m_count == 0)
+    return 0.0;
+
+  return double(m_sum) / m_count;
+}
+
+
+/// \brief Estimate a percentile
+///
+/// \param p Percentile between 0 and 100
+///
+/// \return Upper bound of the bucket containing the percentile (at
+/// most max()) or 0 if the histogram is empty
+quint64 Histogram::percentile(double p) const {
+  if (m_count == 0)
+    return 0;
+
+  // rank of the wanted value, counted from 1
+  quint64 rank = quint64(p / 100.0 * m_count + 0.5);
+  rank = qBound(quint64(1), rank, m_count);
+
+  quint64 seen = 0;
+  for (int i = 0; i < BucketCount - 1; ++i) {
+    seen += m_buckets[i];
+    if (seen >= rank)
+      return qMin(upperBound(i), m_max);
+  }
+
+  return m_max;
+}
+
+
+/// \brief Number of recorded values in bucket i
+quint64 Histogram::bucket(int i) const {
+  if (i < 0 || i >= BucketCount)
+    return 0;
+
+  return m_buckets[i];
+}
+
+
+/// \brief Largest value counted in bucket i
+///
+/// The last bucket has no upper bound; returns the largest quint64.
+quint64 Histogram::upperBound(int i) {
+  if (i >= BucketCount - 1)
+    return ~quint64(0);
+
+  return quint64(1) << i;
+}
@@ -0,0 +1,53 @@
+/// \file
+/// \brief Declaration of Histogram utility class
+///
+/// \author png!das-system
+#ifndef HISTOGRAM_H
+#define HISTOGRAM_H 1
+
+#include <QtGlobal>
+
+#include "qirc.h"
+
+namespace QIRC {
+  /// \brief Histogram with power-of-two buckets
+  ///
+  /// Bucket 0 counts the values 0 and 1, bucket i > 0 the values in
+  /// (2^(i-1), 2^i], and the last bucket everything larger. Recording
+  /// a value only increments a few counters, so histograms can stay
+  /// enabled in production.
+  class Histogram {
+  public:
+    /// \brief Number of buckets
+    enum { BucketCount = 40 };
+
+    Histogram();
+
+    void record(quint64 value);
+    void clear();
+
+    quint64 count() const;
+    quint64 sum() const;
+    quint64 max() const;
+    double mean() const;
+    quint64 percentile(double p) const;
+
+    quint64 bucket(int i) const;
+    static quint64 upperBound(int i);
+
+  protected:
+    /// \brief Number of recorded values per bucket
+    quint64 m_buckets[BucketCount];
+
+    /// \brief Number of recorded values
+    quint64 m_count;
+
+    /// \brief Sum of all recorded values
+    quint64 m_sum;
+
+    /// \brief Largest recorded value
+    quint64 m_max;
+  };
+};
+
+#endif // !HISTOGRAM_H
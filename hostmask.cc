@@ -8,6 +8,10 @@
 using namespace QIRC;
 
 
+/// \brief Construct empty hostmask
+HostMask::HostMask() {}
+
+
 /// \brief Default constructor from 3 separate strings
 ///
 /// \param nick Nickname part of hostmask
@@ -17,6 +21,12 @@ HostMask::HostMask(QString nick, QString user, QString host) :
   m_nick(nick), m_user(user), m_host(host) {}
 
 
+/// \brief Construct from already interned strings
+HostMask::HostMask(const PooledString& nick, const PooledString& user,
+		   const PooledString& host) :
+  m_nick(nick), m_user(user), m_host(host) {}
+
+
 /// \brief Copy constructor
 HostMask::HostMask(const HostMask& other) :
   m_nick(other.m_nick), m_user(other.m_user), m_host(other.m_host) {}
@@ -24,53 +34,68 @@ HostMask::HostMask(const HostMask& other) :
 
 /// \brief Access nickname part
 QString HostMask::nick() const {
-  return m_nick;
+  return m_nick.toString();
 }
 
 
 /// \brief Set nickname part to new value
 void HostMask::setNick(QString n) {
-  if (m_nick != n) {
-    m_nick = n;
-  }
+  m_nick = PooledString(n);
 }
 
 
 /// \brief Access username part
 QString HostMask::user() const {
-  return m_user;
+  return m_user.toString();
 }
 
 
 /// \brief Set username part to new value
 void HostMask::setUser(QString u) {
-  if (m_user != u) {
-    m_user = u;
-  }
+  m_user = PooledString(u);
 }
 
 
 /// \brief Access hostname part
 QString HostMask::host() const {
-  return m_host;
+  return m_host.toString();
 }
 
 
 /// \brief Set hostname part to new value
 void HostMask::setHost(QString h) {
-  if (m_host != h) {
-    m_host = h;
-  }
+  m_host = PooledString(h);
+}
+
+
+/// \brief Interned nickname part
+PooledString HostMask::pooledNick() const {
+  return m_nick;
+}
+
+
+/// \brief Interned username part
+PooledString HostMask::pooledUser() const {
+  return m_user;
+}
+
+
+/// \brief Interned hostname part
+PooledString HostMask::pooledHost() const {
+  return m_host;
 }
 
 
 /// \brief String representation for logging/debugging
 QString HostMask::toString() const {
-  return (m_nick + "!" + m_user + "@" + m_host);
+  return (m_nick.toString() + "!" + m_user.toString() + "@" +
+	  m_host.toString());
 }
 
 
 /// \brief Equality operator
+///
+/// Compares the interned handles, not the strings.
 bool HostMask::operator ==(const HostMask& o) const {
   return ((m_nick == o.m_nick) && (m_user == o.m_user) &&
 	  (m_host == o.m_host));
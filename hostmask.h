@@ -6,15 +6,24 @@
 #define HOSTMASK_H 1
 
 #include <QDebug>
+#include <QMetaType>
 #include <QString>
 
 #include "qirc.h"
+#include "StringPool"
 
 namespace QIRC {
   /// \brief Utility class to store an user hostmask
+  ///
+  /// The nick, user and host parts are interned in the StringPool, so a
+  /// HostMask is three handles in size and comparisons don't have to
+  /// look at the strings at all.
   class HostMask {
   public:
+    HostMask();
     HostMask(QString nick, QString user, QString host);
+    HostMask(const PooledString& nick, const PooledString& user,
+	     const PooledString& host);
     HostMask(const HostMask& other);
 
     QString nick() const;
@@ -26,6 +35,10 @@ namespace QIRC {
     QString host() const;
     void setHost(QString h);
 
+    PooledString pooledNick() const;
+    PooledString pooledUser() const;
+    PooledString pooledHost() const;
+
     QString toString() const;
 
     bool operator ==(const HostMask& o) const;
@@ -33,16 +46,18 @@ namespace QIRC {
 
   protected:
     /// \brief Nickname part of hostmask
-    QString m_nick;
+    PooledString m_nick;
 
     /// \brief Username part of hostmask
-    QString m_user;
+    PooledString m_user;
 
     /// \brief Hostname part of hostmask
-    QString m_host;
+    PooledString m_host;
   };
 };
 
+Q_DECLARE_METATYPE(QIRC::HostMask)
+
 QDebug& operator <<(QDebug& dbg, QIRC::HostMask& h);
 
 #endif // !HOSTMASK_H
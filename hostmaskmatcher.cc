@@ -0,0 +1,587 @@
+/// \file
+/// \brief Implementation of HostMaskMatcher class
+///
+/// \author png!das-system
+#include <QtAlgorithms>
+
+#include "HostMaskMatcher"
+
+using namespace QIRC;
+
+
+/// \brief Sort a list of ids and remove duplicates
+static void sortUnique(QVector<int>& v) {
+  if (v.size() < 2)
+    return;
+
+  qSort(v.begin(), v.end());
+
+  int n = 1;
+  for (int i = 1; i < v.size(); ++i) {
+    if (v.at(i) != v.at(n - 1))
+      v[n++] = v.at(i);
+  }
+  v.resize(n);
+}
+
+
+/// \brief Number of continuation bytes following a UTF-8 lead byte
+///
+/// Stray continuation bytes and invalid lead bytes count as a
+/// character of their own.
+static inline int sequenceTail(uchar c) {
+  if (c >= 0xc0 && c < 0xe0)
+    return 1;
+  if (c >= 0xe0 && c < 0xf0)
+    return 2;
+  if (c >= 0xf0 && c < 0xf8)
+    return 3;
+
+  return 0;
+}
+
+
+/// \brief Automaton state entry: a trie node and the number of
+/// continuation bytes still to skip before it is reached
+///
+/// The bytes are those of a multi-byte character matched by '?'.
+static inline int entry(int node, int pending) {
+  return (node << 2) | pending;
+}
+
+
+/// \brief Trie node of an automaton state entry
+static inline int entryNode(int e) {
+  return e >> 2;
+}
+
+
+/// \brief Continuation bytes to skip of an automaton state entry
+static inline int entryPending(int e) {
+  return e & 3;
+}
+
+
+/// \brief Construct empty matcher
+HostMaskMatcher::HostMaskMatcher(CaseMapping mapping) :
+  m_caseMapping(mapping), m_start(-1) {
+  for (int c = 0; c < 256; ++c) {
+    m_fold[c] = ircToLower(QByteArray(1, static_cast<char>(c)),
+			   m_caseMapping).at(0);
+  }
+
+  reset();
+}
+
+
+HostMaskMatcher::~HostMaskMatcher() {
+  invalidate();
+}
+
+
+/// \brief Case mapping used to compare masks and host masks
+CaseMapping HostMaskMatcher::caseMapping() const {
+  return m_caseMapping;
+}
+
+
+/// \brief Set case mapping and recompile all masks
+///
+/// Mask ids stay the same. Masks that become equal under the new
+/// mapping are kept as separate entries; find() and add() then return
+/// one of them until all are removed.
+void HostMaskMatcher::setCaseMapping(CaseMapping mapping) {
+  if (mapping == m_caseMapping)
+    return;
+
+  m_caseMapping = mapping;
+  for (int c = 0; c < 256; ++c) {
+    m_fold[c] = ircToLower(QByteArray(1, static_cast<char>(c)),
+			   m_caseMapping).at(0);
+  }
+
+  QVector<QString> masks = m_masks;
+  QVector<int> freeMasks = m_freeMasks;
+
+  reset();
+  m_masks.resize(masks.size());
+  m_patterns.resize(masks.size());
+  m_freeMasks = freeMasks;
+
+  for (int id = 0; id < masks.size(); ++id) {
+    if (!masks.at(id).isEmpty())
+      insert(id, masks.at(id));
+  }
+}
+
+
+/// \brief Add a mask
+///
+/// The mask is normalized first (see normalize()). Adding a mask that
+/// is already present returns the id of the existing entry.
+///
+/// \return Id of the mask, to be used with remove() and mask()
+int HostMaskMatcher::add(const QString& mask) {
+  QString n = normalize(mask);
+
+  int id = m_maskIndex.value(fold(n), -1);
+  if (id >= 0)
+    return id;
+
+  if (!m_freeMasks.isEmpty()) {
+    id = m_freeMasks.last();
+    m_freeMasks.remove(m_freeMasks.size() - 1);
+  } else {
+    id = m_masks.size();
+    m_masks.append(QString());
+    m_patterns.append(QByteArray());
+  }
+
+  insert(id, n);
+
+  return id;
+}
+
+
+/// \brief Remove a mask by id
+///
+/// \return true if there was a mask with that id
+bool HostMaskMatcher::remove(int id) {
+  if (id < 0 || id >= m_masks.size() || m_masks.at(id).isEmpty())
+    return false;
+
+  const QByteArray& pattern = m_patterns.at(id);
+  QVector<int> nodes = path(pattern);
+  Node& last = m_nodes[nodes.last()];
+  last.masks.remove(last.masks.indexOf(id));
+
+  // after setCaseMapping() other masks may have the same pattern; the
+  // index then moves on to one of them
+  QHash<QByteArray, int>::iterator it = m_maskIndex.find(pattern);
+  if (it != m_maskIndex.end() && it.value() == id) {
+    int other = -1;
+    for (int i = 0; i < last.masks.size(); ++i) {
+      if (m_patterns.at(last.masks.at(i)) == pattern) {
+	other = last.masks.at(i);
+	break;
+      }
+    }
+
+    if (other >= 0) {
+      it.value() = other;
+    } else {
+      m_maskIndex.erase(it);
+    }
+  }
+
+  for (int i = nodes.size() - 1; i > 0; --i) {
+    releaseNode(nodes.at(i - 1), nodes.at(i));
+  }
+
+  m_masks[id].clear();
+  m_patterns[id].clear();
+  m_freeMasks.append(id);
+  invalidate();
+
+  return true;
+}
+
+
+/// \brief Remove a mask
+///
+/// \return true if the mask was present
+bool HostMaskMatcher::remove(const QString& mask) {
+  return remove(find(mask));
+}
+
+
+/// \brief Remove all masks
+void HostMaskMatcher::clear() {
+  reset();
+}
+
+
+/// \brief Number of masks
+int HostMaskMatcher::size() const {
+  return m_masks.size() - m_freeMasks.size();
+}
+
+
+/// \brief Id of a mask or -1 if it isn't present
+int HostMaskMatcher::find(const QString& mask) const {
+  return m_maskIndex.value(fold(normalize(mask)), -1);
+}
+
+
+/// \brief Mask with the given id (normalized)
+QString HostMaskMatcher::mask(int id) const {
+  if (id < 0 || id >= m_masks.size())
+    return QString();
+
+  return m_masks.at(id);
+}
+
+
+/// \brief All masks
+QStringList HostMaskMatcher::masks() const {
+  QStringList r;
+  for (int id = 0; id < m_masks.size(); ++id) {
+    if (!m_masks.at(id).isEmpty())
+      r.append(m_masks.at(id));
+  }
+
+  return r;
+}
+
+
+/// \brief Ids of all masks matching the given host mask (sorted)
+QVector<int> HostMaskMatcher::matches(const HostMask& hm) const {
+  return m_states.at(run(hm))->masks;
+}
+
+
+/// \brief All masks matching the given host mask
+QStringList HostMaskMatcher::matchingMasks(const HostMask& hm) const {
+  const QVector<int>& ids = m_states.at(run(hm))->masks;
+
+  QStringList r;
+  for (int i = 0; i < ids.size(); ++i) {
+    r.append(m_masks.at(ids.at(i)));
+  }
+
+  return r;
+}
+
+
+/// \brief Does any mask match the given host mask?
+bool HostMaskMatcher::matchesAny(const HostMask& hm) const {
+  return !m_states.at(run(hm))->masks.isEmpty();
+}
+
+
+/// \brief Complete a partial mask to nick!user\@host form
+///
+/// "nick" becomes "nick!*@*", "user@host" becomes "*!user@host" and
+/// "nick!user" becomes "nick!user@*", like servers do for bans.
+QString HostMaskMatcher::normalize(const QString& mask) {
+  QString m = mask.trimmed();
+  if (m.isEmpty())
+    return "*!*@*";
+
+  int bang = m.indexOf(QChar('!'));
+  int at = m.indexOf(QChar('@'), (bang < 0) ? 0 : bang);
+
+  if (bang < 0 && at < 0)
+    return m + "!*@*";
+  if (bang < 0)
+    return "*!" + m;
+  if (at < 0)
+    return m + "@*";
+
+  return m;
+}
+
+
+/// \brief Drop all masks and cached states
+void HostMaskMatcher::reset() {
+  invalidate();
+
+  m_nodes.clear();
+  m_freeNodes.clear();
+  m_masks.clear();
+  m_patterns.clear();
+  m_freeMasks.clear();
+  m_maskIndex.clear();
+
+  newNode(false);
+}
+
+
+/// \brief Add a normalized mask to the trie under the given id
+void HostMaskMatcher::insert(int id, const QString& mask) {
+  QByteArray pattern = fold(mask);
+  int cur = 0;
+  bool afterStar = false;
+
+  for (int i = 0; i < pattern.size(); ++i) {
+    uchar c = pattern.at(i);
+    int next;
+
+    if (c == '*') {
+      // "**" is the same as "*"
+      if (afterStar)
+	continue;
+
+      next = m_nodes.at(cur).star;
+      if (next < 0) {
+	next = newNode(true);
+	m_nodes[cur].star = next;
+      }
+    } else if (c == '?') {
+      next = m_nodes.at(cur).any;
+      if (next < 0) {
+	next = newNode(false);
+	m_nodes[cur].any = next;
+      }
+    } else {
+      next = child(cur, c);
+      if (next < 0) {
+	next = newNode(false);
+	Edge e;
+	e.c = c;
+	e.node = next;
+	m_nodes[cur].edges.append(e);
+      }
+    }
+
+    afterStar = (c == '*');
+    ++m_nodes[next].refs;
+    cur = next;
+  }
+
+  m_nodes[cur].masks.append(id);
+  m_masks[id] = mask;
+  m_patterns[id] = pattern;
+  m_maskIndex.insert(pattern, id);
+  invalidate();
+}
+
+
+/// \brief Trie nodes along the path of an inserted pattern, from the root
+QVector<int> HostMaskMatcher::path(const QByteArray& pattern) const {
+  QVector<int> r;
+  int cur = 0;
+  bool afterStar = false;
+
+  r.append(cur);
+  for (int i = 0; i < pattern.size(); ++i) {
+    uchar c = pattern.at(i);
+
+    if (c == '*') {
+      if (afterStar)
+	continue;
+      cur = m_nodes.at(cur).star;
+    } else if (c == '?') {
+      cur = m_nodes.at(cur).any;
+    } else {
+      cur = child(cur, c);
+    }
+
+    afterStar = (c == '*');
+    r.append(cur);
+  }
+
+  return r;
+}
+
+
+/// \brief Allocate a trie node
+int HostMaskMatcher::newNode(bool isStar) {
+  Node n;
+  n.any = -1;
+  n.star = -1;
+  n.isStar = isStar;
+  n.refs = 0;
+
+  if (!m_freeNodes.isEmpty()) {
+    int id = m_freeNodes.last();
+    m_freeNodes.remove(m_freeNodes.size() - 1);
+    m_nodes[id] = n;
+    return id;
+  }
+
+  m_nodes.append(n);
+  return m_nodes.size() - 1;
+}
+
+
+/// \brief Drop one reference to a trie node, freeing it when unused
+void HostMaskMatcher::releaseNode(int parent, int node) {
+  Node& n = m_nodes[node];
+  if (--n.refs > 0)
+    return;
+
+  Node& p = m_nodes[parent];
+  if (p.star == node) {
+    p.star = -1;
+  } else if (p.any == node) {
+    p.any = -1;
+  } else {
+    for (int i = 0; i < p.edges.size(); ++i) {
+      if (p.edges.at(i).node == node) {
+	p.edges.remove(i);
+	break;
+      }
+    }
+  }
+
+  n.edges.clear();
+  n.masks.clear();
+  m_freeNodes.append(node);
+}
+
+
+/// \brief Child of a trie node for a literal byte or -1
+int HostMaskMatcher::child(int node, uchar c) const {
+  const QVector<Edge>& edges = m_nodes.at(node).edges;
+
+  for (int i = 0; i < edges.size(); ++i) {
+    if (edges.at(i).c == c)
+      return edges.at(i).node;
+  }
+
+  return -1;
+}
+
+
+/// \brief UTF-8 encoded, case folded mask
+QByteArray HostMaskMatcher::fold(const QString& mask) const {
+  return ircToLower(mask.toUtf8(), m_caseMapping);
+}
+
+
+/// \brief Discard all cached automaton states
+void HostMaskMatcher::invalidate() const {
+  for (int i = 0; i < m_states.size(); ++i) {
+    delete m_states.at(i);
+  }
+
+  m_states.clear();
+  m_stateIndex.clear();
+  m_start = -1;
+}
+
+
+/// \brief Cached state for a sorted set of entries (see entry())
+int HostMaskMatcher::state(const QVector<int>& nodes) const {
+  QByteArray key(reinterpret_cast<const char*>(nodes.constData()),
+		 nodes.size() * sizeof(int));
+
+  int s = m_stateIndex.value(key, -1);
+  if (s >= 0)
+    return s;
+
+  State* st = new State;
+  st->nodes = nodes;
+  for (int i = 0; i < nodes.size(); ++i) {
+    // a mask only matches at the end of a character
+    if (entryPending(nodes.at(i)) == 0)
+      st->masks += m_nodes.at(entryNode(nodes.at(i))).masks;
+  }
+  sortUnique(st->masks);
+  for (int c = 0; c < 256; ++c) {
+    st->next[c] = -1;
+  }
+
+  m_states.append(st);
+  s = m_states.size() - 1;
+  m_stateIndex.insert(key, s);
+
+  return s;
+}
+
+
+/// \brief Initial state: the root and what a leading '*' reaches
+int HostMaskMatcher::startState() const {
+  if (m_start < 0) {
+    QVector<int> nodes;
+    nodes.append(entry(0, 0));
+    if (m_nodes.at(0).star >= 0)
+      nodes.append(entry(m_nodes.at(0).star, 0));
+
+    sortUnique(nodes);
+    m_start = state(nodes);
+  }
+
+  return m_start;
+}
+
+
+/// \brief Follow (and cache) the transition of a state for a folded byte
+int HostMaskMatcher::step(int s, uchar c) const {
+  int t = m_states.at(s)->next[c];
+  if (t >= 0)
+    return t;
+
+  const QVector<int>& from = m_states.at(s)->nodes;
+  const bool continuation = ((c & 0xc0) == 0x80);
+  QVector<int> nodes;
+
+  for (int i = 0; i < from.size(); ++i) {
+    const int node = entryNode(from.at(i));
+    const int pending = entryPending(from.at(i));
+
+    // inside a character matched by '?', only its continuation bytes
+    // are accepted
+    if (pending > 0) {
+      if (continuation)
+	nodes.append(entry(node, pending - 1));
+      continue;
+    }
+
+    const Node& n = m_nodes.at(node);
+
+    if (n.isStar)
+      nodes.append(from.at(i));
+    if (n.any >= 0)
+      nodes.append(entry(n.any, sequenceTail(c)));
+
+    int next = child(node, c);
+    if (next >= 0)
+      nodes.append(entry(next, 0));
+  }
+
+  // a '*' may match nothing, so its node is reached right away
+  int reached = nodes.size();
+  for (int i = 0; i < reached; ++i) {
+    if (entryPending(nodes.at(i)) > 0)
+      continue;
+
+    const int star = m_nodes.at(entryNode(nodes.at(i))).star;
+    if (star >= 0)
+      nodes.append(entry(star, 0));
+  }
+  sortUnique(nodes);
+
+  // start over when the cache gets too large; the state we came from
+  // is gone then, so the transition isn't recorded
+  if (m_states.size() >= MaxCachedStates) {
+    invalidate();
+    return state(nodes);
+  }
+
+  t = state(nodes);
+  m_states.at(s)->next[c] = t;
+
+  return t;
+}
+
+
+/// \brief Feed bytes into the automaton
+int HostMaskMatcher::feed(int s, const QByteArray& data) const {
+  const uchar* d = reinterpret_cast<const uchar*>(data.constData());
+
+  for (int i = 0; i < data.size(); ++i) {
+    // nothing can match anymore
+    if (m_states.at(s)->nodes.isEmpty())
+      break;
+
+    s = step(s, m_fold[d[i]]);
+  }
+
+  return s;
+}
+
+
+/// \brief Run the automaton on nick!user\@host
+int HostMaskMatcher::run(const HostMask& hm) const {
+  int s = startState();
+
+  s = feed(s, hm.pooledNick().toUtf8());
+  s = step(s, '!');
+  s = feed(s, hm.pooledUser().toUtf8());
+  s = step(s, '@');
+  s = feed(s, hm.pooledHost().toUtf8());
+
+  return s;
+}
@@ -0,0 +1,155 @@
+/// \file
+/// \brief Declaration of HostMaskMatcher class
+///
+/// \author png!das-system
+#ifndef HOSTMASKMATCHER_H
+#define HOSTMASKMATCHER_H 1
+
+#include <QByteArray>
+#include <QHash>
+#include <QString>
+#include <QStringList>
+#include <QVector>
+
+#include "qirc.h"
+#include "HostMask"
+
+namespace QIRC {
+  /// \brief Matches host masks against a list of wildcard masks
+  ///
+  /// Masks like "*!*@*.example.com" (with '*' and '?' wildcards) are
+  /// compiled into a trie shaped automaton. Matching walks the
+  /// nick!user@host string once through a deterministic automaton that
+  /// is built lazily from the trie and cached, so the cost of a lookup
+  /// depends on the length of the host mask and the number of matches,
+  /// not on the number of masks.
+  ///
+  /// '?' matches exactly one character, which may be several bytes
+  /// of UTF-8. Comparisons follow the configured IRC case mapping. Masks can be
+  /// added and removed at any time; doing so discards the cached
+  /// automaton.
+  ///
+  /// The cache is updated by the (const) matching functions, so an
+  /// instance must not be used from several threads at once.
+  class HostMaskMatcher {
+  public:
+    HostMaskMatcher(CaseMapping mapping=Rfc1459CaseMapping);
+    ~HostMaskMatcher();
+
+    CaseMapping caseMapping() const;
+    void setCaseMapping(CaseMapping mapping);
+
+    int add(const QString& mask);
+    bool remove(int id);
+    bool remove(const QString& mask);
+    void clear();
+
+    int size() const;
+    int find(const QString& mask) const;
+    QString mask(int id) const;
+    QStringList masks() const;
+
+    QVector<int> matches(const HostMask& hm) const;
+    QStringList matchingMasks(const HostMask& hm) const;
+    bool matchesAny(const HostMask& hm) const;
+
+    static QString normalize(const QString& mask);
+
+  protected:
+    /// \brief Upper limit for cached automaton states
+    enum { MaxCachedStates = 2048 };
+
+    /// \brief Trie edge for a literal byte
+    struct Edge {
+      /// \brief Byte (after case folding)
+      uchar c;
+
+      /// \brief Target node
+      int node;
+    };
+
+    /// \brief Trie node
+    struct Node {
+      /// \brief Edges for literal bytes
+      QVector<Edge> edges;
+
+      /// \brief Child for '?' or -1
+      int any;
+
+      /// \brief Child for '*' or -1
+      int star;
+
+      /// \brief Is this node reached by a '*' (loops on any byte)?
+      bool isStar;
+
+      /// \brief Number of masks passing through this node
+      int refs;
+
+      /// \brief Masks ending in this node
+      QVector<int> masks;
+    };
+
+    /// \brief Cached automaton state (a set of trie nodes)
+    struct State {
+      /// \brief Sorted trie nodes, each with the number of UTF-8
+      /// continuation bytes still to skip before it is reached
+      QVector<int> nodes;
+
+      /// \brief Masks accepted in this state
+      QVector<int> masks;
+
+      /// \brief Next state per input byte, -1 if not computed yet
+      int next[256];
+    };
+
+    void reset();
+    void insert(int id, const QString& mask);
+    QVector<int> path(const QByteArray& pattern) const;
+    int newNode(bool isStar);
+    void releaseNode(int parent, int node);
+    int child(int node, uchar c) const;
+
+    QByteArray fold(const QString& mask) const;
+    void invalidate() const;
+    int state(const QVector<int>& nodes) const;
+    int startState() const;
+    int step(int s, uchar c) const;
+    int feed(int s, const QByteArray& data) const;
+    int run(const HostMask& hm) const;
+
+    /// \brief Case mapping used for folding
+    CaseMapping m_caseMapping;
+
+    /// \brief Case folding table for single bytes
+    uchar m_fold[256];
+
+    /// \brief Trie nodes; node 0 is the root
+    QVector<Node> m_nodes;
+
+    /// \brief Unused entries in m_nodes
+    QVector<int> m_freeNodes;
+
+    /// \brief Masks by id (normalized); empty for unused ids
+    QVector<QString> m_masks;
+
+    /// \brief Folded masks by id
+    QVector<QByteArray> m_patterns;
+
+    /// \brief Unused mask ids
+    QVector<int> m_freeMasks;
+
+    /// \brief Mask ids by folded mask
+    QHash<QByteArray, int> m_maskIndex;
+
+    /// \brief Cached automaton states
+    mutable QVector<State*> m_states;
+
+    /// \brief Cached automaton states by their trie node set
+    mutable QHash<QByteArray, int> m_stateIndex;
+
+    /// \brief Start state or -1 if not built yet
+    mutable int m_start;
+  };
+};
+
+#endif // !HOSTMASKMATCHER_H
@@ -0,0 +1,295 @@
+/// \file
+/// \brief Implementation of IrcMessage utility class
+///
+/// \author png!das-system
+#include "IrcMessage"
+
+using namespace QIRC;
+
+
+/// \brief Construct an empty (invalid) message
+IrcMessage::IrcMessage() {}
+
+
+/// \brief Construct by parsing a line from the given buffer
+///
+/// \see parse()
+IrcMessage::IrcMessage(const QByteArray& buffer, int offset, int length) {
+  parse(buffer, offset, length);
+}
+
+
+/// \brief Copy constructor
+///
+/// m_message has to point into our own copy of the buffer.
+IrcMessage::IrcMessage(const IrcMessage& other) :
+  m_buffer(other.m_buffer), m_message(other.m_message) {
+  m_message.setBuffer(m_buffer.constData());
+}
+
+
+/// \brief Assignment operator
+IrcMessage& IrcMessage::operator =(const IrcMessage& other) {
+  m_buffer = other.m_buffer;
+  m_message = other.m_message;
+  m_message.setBuffer(m_buffer.constData());
+
+  return (*this);
+}
+
+
+/// \brief Parse a message line
+///
+/// Splits the line in a single forward scan according to RFC1459 (with
+/// IRCv3 message tags):
+///
+///   [@tags ][:prefix ]command[ param...][ :trailing]
+///
+/// The line must not contain the CR/LF line terminator. Only the offsets
+/// of the fields are stored; the buffer itself is shared, not copied.
+///
+/// \param buffer Buffer containing the line
+/// \param offset Offset of the first byte of the line within buffer
+/// \param length Length of the line in bytes or -1 for the rest of buffer
+///
+/// \return true if the line contained at least a command, false otherwise
+bool IrcMessage::parse(const QByteArray& buffer, int offset, int length) {
+  m_buffer = buffer;
+
+  if (length < 0)
+    length = buffer.size() - offset;
+
+  return m_message.parse(m_buffer.constData(), offset, length);
+}
+
+
+/// \brief Does this message contain a command?
+bool IrcMessage::isValid() const {
+  return m_message.isValid();
+}
+
+
+/// \brief Access the buffer the message was parsed from
+QByteArray IrcMessage::buffer() const {
+  return m_buffer;
+}
+
+
+/// \brief Copy of the raw message line
+QByteArray IrcMessage::raw() const {
+  const Span line = m_message.line();
+  return m_buffer.mid(line.begin, line.length);
+}
+
+
+/// \brief Decoded message line for logging/debugging
+QString IrcMessage::toString() const {
+  return decode(m_message.line());
+}
+
+
+/// \brief Does the message carry IRCv3 tags?
+bool IrcMessage::hasTags() const {
+  return m_message.hasTags();
+}
+
+
+/// \brief Access the raw IRCv3 tag string (without leading '@')
+QString IrcMessage::tags() const {
+  return decode(m_message.tags());
+}
+
+
+/// \brief Does the message have a prefix?
+bool IrcMessage::hasPrefix() const {
+  return m_message.hasPrefix();
+}
+
+
+/// \brief Is the prefix a full nick!user@host mask?
+bool IrcMessage::hasUserPrefix() const {
+  return m_message.hasUserPrefix();
+}
+
+
+/// \brief Access the prefix (without leading ':')
+QString IrcMessage::prefix() const {
+  return decode(m_message.prefix());
+}
+
+
+/// \brief Access the nickname (or server name) part of the prefix
+QString IrcMessage::senderNick() const {
+  return decode(m_message.nick());
+}
+
+
+/// \brief Is nick the nickname (or server name) part of the prefix?
+///
+/// Compares against the raw prefix without decoding it as long as it
+/// is plain ASCII, which nicknames usually are.
+bool IrcMessage::senderNickEquals(const QString& nick) const {
+  const Span nickSpan = m_message.nick();
+  const int length = nickSpan.length;
+  const uchar* d =
+    reinterpret_cast<const uchar*>(m_message.data(nickSpan));
+  const ushort* n = nick.utf16();
+
+  for (int i = 0; i < length; ++i) {
+    if (d[i] >= 0x80) {
+      return (senderNick() == nick);
+    }
+
+    if (i >= nick.size() || n[i] != d[i]) {
+      return false;
+    }
+  }
+
+  return (length == nick.size());
+}
+
+
+/// \brief Host mask of the message's sender
+///
+/// If the prefix isn't a full nick!user@host mask (e.g. for messages
+/// sent by the server) the whole prefix is used as the nickname part.
+HostMask IrcMessage::sender() const {
+  if (!hasUserPrefix()) {
+    const Span prefix = m_message.prefix();
+    return HostMask(PooledString(m_message.data(prefix), prefix.length),
+		    PooledString(), PooledString());
+  }
+
+  const Span nick = m_message.nick();
+  const Span user = m_message.user();
+  const Span host = m_message.host();
+
+  // interning from the raw bytes skips decoding for known strings
+  return HostMask(PooledString(m_message.data(nick), nick.length),
+		  PooledString(m_message.data(user), user.length),
+		  PooledString(m_message.data(host), host.length));
+}
+
+
+/// \brief Access the command name or numeric as string
+QString IrcMessage::command() const {
+  return decode(m_message.command());
+}
+
+
+/// \brief Raw bytes of the command (not NUL terminated)
+const char* IrcMessage::commandData() const {
+  return m_message.commandData();
+}
+
+
+/// \brief Length of the command in bytes
+int IrcMessage::commandLength() const {
+  return m_message.commandLength();
+}
+
+
+/// \brief Compare the command without decoding it
+///
+/// \param cmd NUL terminated command name, e.g. "PRIVMSG"
+bool IrcMessage::isCommand(const char* cmd) const {
+  return m_message.isCommand(cmd);
+}
+
+
+/// \brief Is this a numeric server reply?
+bool IrcMessage::isNumeric() const {
+  return m_message.isNumeric();
+}
+
+
+/// \brief Numeric reply code or -1 for named commands
+int IrcMessage::numeric() const {
+  return m_message.numeric();
+}
+
+
+/// \brief Number of parameters (including the trailing one)
+int IrcMessage::paramCount() const {
+  return m_message.paramCount();
+}
+
+
+/// \brief Access a single parameter
+///
+/// \return Decoded parameter or a null string if i is out of range
+QString IrcMessage::param(int i) const {
+  if (i < 0 || i >= m_message.paramCount())
+    return QString();
+
+  return decode(m_message.param(i));
+}
+
+
+/// \brief Access all parameters as list of strings
+QStringList IrcMessage::params() const {
+  QStringList r;
+  for (int i = 0; i < m_message.paramCount(); ++i) {
+    r.append(decode(m_message.param(i)));
+  }
+
+  return r;
+}
+
+
+/// \brief Raw bytes of a parameter (not NUL terminated)
+///
+/// \return Pointer into the buffer or NULL if i is out of range
+const char* IrcMessage::paramData(int i) const {
+  return m_message.paramData(i);
+}
+
+
+/// \brief Length of a parameter in bytes or -1 if i is out of range
+int IrcMessage::paramLength(int i) const {
+  return m_message.paramLength(i);
+}
+
+
+/// \brief Compare a parameter without decoding it
+bool IrcMessage::paramEquals(int i, const char* s) const {
+  return m_message.paramEquals(i, s);
+}
+
+
+/// \brief Was the last parameter given as trailing parameter?
+bool IrcMessage::hasTrailing() const {
+  return m_message.hasTrailing();
+}
+
+
+/// \brief Access the trailing parameter
+///
+/// \return Decoded trailing parameter or a null string if the message
+/// doesn't have one
+QString IrcMessage::trailing() const {
+  if (!m_message.hasTrailing())
+    return QString();
+
+  return decode(m_message.param(m_message.paramCount() - 1));
+}
+
+
+/// \brief Decode a field from the buffer
+QString IrcMessage::decode(const Span& s) const {
+  return decode(m_message.data(s), s.length);
+}
+
+
+/// \brief Decode raw message bytes to a QString
+///
+/// All fields of a message are decoded as UTF-8.
+QString IrcMessage::decode(const char* data, int length) {
+  return QString::fromUtf8(data, length);
+}
+
+
+/// \brief Output an IrcMessage on a QDebug stream
+QDebug& operator <<(QDebug& dbg, const QIRC::IrcMessage& m) {
+  return (dbg << m.toString());
+}
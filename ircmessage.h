@@ -0,0 +1,98 @@
+/// \file
+/// \brief Declaration of IrcMessage utility class
+///
+/// \author png!das-system
+#ifndef IRCMESSAGE_H
+#define IRCMESSAGE_H 1
+
+#include <QByteArray>
+#include <QMetaType>
+#include <QString>
+#include <QStringList>
+#include <QVector>
+
+#include "HostMask"
+#include "core/message.h"
+
+#include "qirc.h"
+
+namespace QIRC {
+  /// \brief Parsed view of a single IRC message line
+  ///
+  /// An IrcMessage doesn't copy any part of the line it was parsed from.
+  /// It keeps a (implicitly shared) reference to the raw byte buffer that
+  /// was received from the server and only stores the offsets of the
+  /// message's tags, prefix, command and parameters within it.
+  /// Fields are decoded from UTF-8 to QString only when they're
+  /// requested, so code that only needs to look at the command or a
+  /// single parameter can use the raw accessors without allocating
+  /// anything.
+  ///
+  /// Lines are parsed by QIRCCore::Message; this class keeps the
+  /// buffer alive and decodes the fields.
+  class IrcMessage {
+  public:
+    /// \brief Maximum number of parameters in a message (RFC1459)
+    enum { MaxParams = QIRCCore::Message::MaxParams };
+
+    IrcMessage();
+    IrcMessage(const QByteArray& buffer, int offset=0, int length=-1);
+    IrcMessage(const IrcMessage& other);
+    IrcMessage& operator =(const IrcMessage& other);
+
+    bool parse(const QByteArray& buffer, int offset=0, int length=-1);
+    bool isValid() const;
+
+    QByteArray buffer() const;
+    QByteArray raw() const;
+    QString toString() const;
+
+    bool hasTags() const;
+    QString tags() const;
+
+    bool hasPrefix() const;
+    bool hasUserPrefix() const;
+    QString prefix() const;
+    QString senderNick() const;
+    bool senderNickEquals(const QString& nick) const;
+    HostMask sender() const;
+
+    QString command() const;
+    const char* commandData() const;
+    int commandLength() const;
+    bool isCommand(const char* cmd) const;
+    bool isNumeric() const;
+    int numeric() const;
+
+    int paramCount() const;
+    QString param(int i) const;
+    QStringList params() const;
+    const char* paramData(int i) const;
+    int paramLength(int i) const;
+    bool paramEquals(int i, const char* s) const;
+
+    bool hasTrailing() const;
+    QString trailing() const;
+
+    static QString decode(const char* data, int length);
+
+  protected:
+    /// \brief Location of a single field within m_buffer
+    typedef QIRCCore::Span Span;
+
+    /// \brief Buffer the message was parsed from
+    QByteArray m_buffer;
+
+    /// \brief Field locations within m_buffer
+    QIRCCore::Message m_message;
+
+    QString decode(const Span& s) const;
+  };
+};
+
+Q_DECLARE_METATYPE(QIRC::IrcMessage)
+Q_DECLARE_METATYPE(QVector<QIRC::IrcMessage>)
+
+QDebug& operator <<(QDebug& dbg, const QIRC::IrcMessage& m);
+
+#endif // !IRCMESSAGE_H
@@ -0,0 +1,115 @@
+/// \file
+/// \brief Implementation of LineFramer utility class
+///
+/// \author png!das-system
+#include "LineFramer"
+
+using namespace QIRC;
+
+
+/// \brief Construct framer with default line length limits
+LineFramer::LineFramer() {
+  m_lines.reserve(64);
+}
+
+
+/// \brief Maximum length of a line including CR/LF
+int LineFramer::maxLineLength() const {
+  return m_framer.maxLineLength();
+}
+
+
+/// \brief Set maximum length of a line including CR/LF
+void LineFramer::setMaxLineLength(int length) {
+  m_framer.setMaxLineLength(length);
+}
+
+
+/// \brief Maximum length of IRCv3 message tags
+///
+/// Lines starting with '@' may exceed maxLineLength() by this many bytes.
+int LineFramer::maxTagsLength() const {
+  return m_framer.maxTagsLength();
+}
+
+
+/// \brief Set maximum length of IRCv3 message tags
+void LineFramer::setMaxTagsLength(int length) {
+  m_framer.setMaxTagsLength(length);
+}
+
+
+/// \brief Record a line found by m_framer
+void LineFramer::addLine(void* context, const char* line, int length) {
+  LineFramer* self = static_cast<LineFramer*>(context);
+
+  Line l;
+  l.offset = line - self->m_buffer.constData();
+  l.length = length;
+  self->m_lines.append(l);
+}
+
+
+/// \brief Append received data and split it into lines
+///
+/// Any complete lines found in the pending data from the last call and
+/// the given chunk are made available through buffer() and lines()
+/// until the next call. Empty lines are skipped. Line terminators may
+/// be either CR/LF or a bare LF.
+///
+/// \param data Chunk of data as read from the socket
+///
+/// \return Number of complete lines found
+int LineFramer::append(const QByteArray& data) {
+  m_lines.resize(0);
+
+  if (m_pending.isEmpty()) {
+    // common case: share the chunk instead of copying it
+    m_buffer = data;
+  } else {
+    m_buffer = m_pending;
+    m_buffer.append(data);
+    m_pending.clear();
+  }
+
+  const int size = m_buffer.size();
+  int consumed;
+  m_framer.scan(m_buffer.constData(), size, &LineFramer::addLine, this,
+		consumed);
+
+  if (consumed < size) {
+    // keep incomplete tail for the next call
+    m_pending = m_buffer.mid(consumed);
+  }
+
+  return m_lines.size();
+}
+
+
+/// \brief Buffer holding the lines found by the last append()
+const QByteArray& LineFramer::buffer() const {
+  return m_buffer;
+}
+
+
+/// \brief Lines found by the last append()
+const QVector<LineFramer::Line>& LineFramer::lines() const {
+  return m_lines;
+}
+
+
+/// \brief Number of overlong lines discarded so far
+quint64 LineFramer::discardedLines() const {
+  return m_framer.discardedLines();
+}
+
+
+/// \brief Drop all pending data
+///
+/// Used when the underlying connection is reset.
+void LineFramer::clear() {
+  m_buffer.clear();
+  m_pending.clear();
+  m_lines.resize(0);
+  m_framer.clear();
+}
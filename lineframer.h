@@ -0,0 +1,77 @@
+/// \file
+/// \brief Declaration of LineFramer utility class
+///
+/// \author png!das-system
+#ifndef LINEFRAMER_H
+#define LINEFRAMER_H 1
+
+#include <QByteArray>
+#include <QVector>
+
+#include "core/framer.h"
+
+#include "qirc.h"
+
+namespace QIRC {
+  /// \brief Splits the inbound byte stream into message lines
+  ///
+  /// The framer takes whatever chunk of data was read from the socket,
+  /// locates the line terminators and reports the complete lines as
+  /// offsets into a single buffer. An incomplete line at the end of a
+  /// chunk is kept and completed by the next call to append().
+  ///
+  /// Lines that exceed the configured length limit are discarded, so a
+  /// misbehaving server can't make the buffer grow without bounds.
+  ///
+  /// The lines are located by QIRCCore::Framer; this class keeps them
+  /// in an implicitly shared buffer for IrcMessage.
+  class LineFramer {
+  public:
+    /// \brief Default limits (RFC1459 / IRCv3 message tags)
+    enum {
+      DefaultMaxLineLength = QIRCCore::Framer::DefaultMaxLineLength,
+      DefaultMaxTagsLength = QIRCCore::Framer::DefaultMaxTagsLength
+    };
+
+    /// \brief Location of a complete line within buffer()
+    struct Line {
+      /// \brief Offset of the first byte
+      int offset;
+
+      /// \brief Length in bytes, without line terminator
+      int length;
+    };
+
+    LineFramer();
+
+    int maxLineLength() const;
+    void setMaxLineLength(int length);
+
+    int maxTagsLength() const;
+    void setMaxTagsLength(int length);
+
+    int append(const QByteArray& data);
+    const QByteArray& buffer() const;
+    const QVector<Line>& lines() const;
+
+    quint64 discardedLines() const;
+    void clear();
+
+  protected:
+    /// \brief Locates the lines and applies the length limits
+    QIRCCore::Framer m_framer;
+
+    /// \brief Buffer holding the lines found by the last append()
+    QByteArray m_buffer;
+
+    /// \brief Incomplete line left over from the last append()
+    QByteArray m_pending;
+
+    /// \brief Lines found by the last append()
+    QVector<Line> m_lines;
+
+    static void addLine(void* context, const char* line, int length);
+  };
+};
+
+#endif // !LINEFRAMER_H
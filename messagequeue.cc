@@ -0,0 +1,532 @@
+/// \file
+/// \brief Implementation of MessageQueue utility class
+///
+/// \author png!das-system
+#include <cstring>
+
+#include "MessageQueue"
+
+using namespace QIRC;
+
+
+/// \brief Construct empty queue without depth limits
+MessageQueue::MessageQueue() :
+  m_bulkCursor(0), m_bulkSize(0), m_lastBulk(NULL), m_dropped(0),
+  m_merged(0), m_coalescing(true), m_maxLineLength(512) {
+  for (int i = 0; i < LaneCount; ++i) {
+    m_maxDepth[i] = 0;
+    m_policy[i] = DropOldest;
+  }
+
+  resetMaxTargets();
+}
+
+
+MessageQueue::~MessageQueue() {
+  clear();
+}
+
+
+/// \brief Maximum number of messages in a lane (0 for no limit)
+int MessageQueue::maxDepth(Lane lane) const {
+  return m_maxDepth[lane];
+}
+
+
+/// \brief Set maximum number of messages in a lane (0 for no limit)
+///
+/// Messages already queued beyond the new limit are kept.
+void MessageQueue::setMaxDepth(Lane lane, int depth) {
+  m_maxDepth[lane] = depth;
+}
+
+
+/// \brief Behaviour of a lane when full
+MessageQueue::OverflowPolicy MessageQueue::overflowPolicy(Lane lane) const {
+  return m_policy[lane];
+}
+
+
+/// \brief Set behaviour of a lane when full
+void MessageQueue::setOverflowPolicy(Lane lane, OverflowPolicy policy) {
+  m_policy[lane] = policy;
+}
+
+
+/// \brief Choose lane for a message line
+///
+/// Keepalive and session control commands go to the control lane,
+/// PRIVMSG and NOTICE go to the bulk lane and everything else to the
+/// interactive lane.
+///
+/// \param line Encoded message line
+/// \param target If not NULL, receives the target of bulk lane messages
+MessageQueue::Lane MessageQueue::laneFor(const QByteArray& line,
+					 QByteArray* target) {
+  static const char* const controlCommands[] = {
+    "PONG", "PING", "QUIT", "NICK", "PASS", "USER", "CAP", "AUTHENTICATE"
+  };
+  static const int controlCount =
+    sizeof(controlCommands) / sizeof(controlCommands[0]);
+
+  const char* d = line.constData();
+  const int size = line.size();
+
+  int cmdEnd = 0;
+  while (cmdEnd < size && d[cmdEnd] != ' ' && d[cmdEnd] != '\r' &&
+	 d[cmdEnd] != '\n')
+    ++cmdEnd;
+
+  if ((cmdEnd == 7 && std::memcmp(d, "PRIVMSG", 7) == 0) ||
+      (cmdEnd == 6 && std::memcmp(d, "NOTICE", 6) == 0)) {
+    if (target != NULL) {
+      int begin = cmdEnd;
+      while (begin < size && d[begin] == ' ')
+	++begin;
+      int end = begin;
+      while (end < size && d[end] != ' ' && d[end] != '\r' && d[end] != '\n')
+	++end;
+      *target = line.mid(begin, end - begin);
+    }
+
+    return BulkLane;
+  }
+
+  for (int i = 0; i < controlCount; ++i) {
+    if (cmdEnd == static_cast<int>(qstrlen(controlCommands[i])) &&
+	std::memcmp(d, controlCommands[i], cmdEnd) == 0) {
+      return ControlLane;
+    }
+  }
+
+  return InteractiveLane;
+}
+
+
+/// \brief Queue a message in the lane chosen by laneFor()
+///
+/// \return true if the message was queued, false if it was rejected
+bool MessageQueue::enqueue(const QByteArray& line, qint64 queuedAt) {
+  QByteArray target;
+  Lane lane = laneFor(line, &target);
+
+  return enqueue(line, lane, target, queuedAt);
+}
+
+
+/// \brief Queue a message in the given lane
+///
+/// \param line Encoded message line
+/// \param lane Lane to queue the message in
+/// \param target Target of the message for round-robin scheduling in
+/// the bulk lane
+/// \param queuedAt Current time in any unit, returned by takeHead();
+/// a message merged into a queued one keeps the older time
+///
+/// \return true if the message was queued, false if it was rejected
+bool MessageQueue::enqueue(const QByteArray& line, Lane lane,
+			   const QByteArray& target, qint64 queuedAt) {
+  if (m_coalescing && coalesce(line, lane, target)) {
+    ++m_merged;
+    return true;
+  }
+
+  if (m_maxDepth[lane] > 0 && size(lane) >= m_maxDepth[lane]) {
+    ++m_dropped;
+
+    if (m_policy[lane] == Reject)
+      return false;
+
+    if (lane == BulkLane) {
+      dropOldestBulk();
+    } else {
+      m_lanes[lane].removeFirst();
+      m_laneTimes[lane].removeFirst();
+    }
+  }
+
+  if (lane != BulkLane) {
+    m_lanes[lane].append(line);
+    m_laneTimes[lane].append(queuedAt);
+    return true;
+  }
+
+  TargetQueue* q = m_bulkIndex.value(target, NULL);
+  if (q == NULL) {
+    q = new TargetQueue;
+    q->target = target;
+    m_bulkIndex.insert(target, q);
+
+    // new targets are served after all targets already waiting
+    if (m_bulkTargets.isEmpty()) {
+      m_bulkTargets.append(q);
+    } else {
+      m_bulkTargets.insert(m_bulkCursor, q);
+      ++m_bulkCursor;
+    }
+  }
+
+  q->lines.append(line);
+  q->times.append(queuedAt);
+  ++m_bulkSize;
+  m_lastBulk = q;
+
+  return true;
+}
+
+
+/// \brief Drop a message from a full bulk lane
+///
+/// Drops the oldest message of the target that has the most messages
+/// queued, so a single busy target can't evict the messages of others.
+void MessageQueue::dropOldestBulk() {
+  int victim = -1;
+  int victimSize = 0;
+
+  for (int i = 0; i < m_bulkTargets.size(); ++i) {
+    if (m_bulkTargets.at(i)->lines.size() > victimSize) {
+      victim = i;
+      victimSize = m_bulkTargets.at(i)->lines.size();
+    }
+  }
+
+  if (victim < 0)
+    return;
+
+  m_bulkTargets.at(victim)->lines.removeFirst();
+  m_bulkTargets.at(victim)->times.removeFirst();
+  --m_bulkSize;
+
+  if (m_bulkTargets.at(victim)->lines.isEmpty())
+    removeBulkTarget(victim);
+}
+
+
+/// \brief Remove an (empty) target from the bulk lane
+void MessageQueue::removeBulkTarget(int index) {
+  TargetQueue* q = m_bulkTargets.takeAt(index);
+  m_bulkIndex.remove(q->target);
+  for (int i = 0; i < q->aliases.size(); ++i) {
+    m_bulkIndex.remove(q->aliases.at(i));
+  }
+  if (q == m_lastBulk)
+    m_lastBulk = NULL;
+  delete q;
+
+  if (index < m_bulkCursor)
+    --m_bulkCursor;
+  if (m_bulkCursor >= m_bulkTargets.size())
+    m_bulkCursor = 0;
+}
+
+
+/// \brief Are there no queued messages?
+bool MessageQueue::isEmpty() const {
+  return (size() == 0);
+}
+
+
+/// \brief Number of queued messages in all lanes
+int MessageQueue::size() const {
+  return m_lanes[ControlLane].size() + m_lanes[InteractiveLane].size() +
+    m_bulkSize;
+}
+
+
+/// \brief Number of queued messages in one lane
+int MessageQueue::size(Lane lane) const {
+  if (lane == BulkLane)
+    return m_bulkSize;
+
+  return m_lanes[lane].size();
+}
+
+
+/// \brief Message that will be sent next
+///
+/// \attention Must not be called on an empty queue
+const QByteArray& MessageQueue::head() const {
+  for (int i = 0; i < BulkLane; ++i) {
+    if (!m_lanes[i].isEmpty())
+      return m_lanes[i].first();
+  }
+
+  Q_ASSERT(!m_bulkTargets.isEmpty());
+  return m_bulkTargets.at(m_bulkCursor)->lines.first();
+}
+
+
+/// \brief Remove and return the message that will be sent next
+///
+/// \param queuedAt Receives the time passed to enqueue() (optional)
+///
+/// \attention Must not be called on an empty queue
+QByteArray MessageQueue::takeHead(qint64* queuedAt) {
+  for (int i = 0; i < BulkLane; ++i) {
+    if (!m_lanes[i].isEmpty()) {
+      qint64 t = m_laneTimes[i].takeFirst();
+      if (queuedAt != NULL)
+	*queuedAt = t;
+      return m_lanes[i].takeFirst();
+    }
+  }
+
+  Q_ASSERT(!m_bulkTargets.isEmpty());
+  TargetQueue* q = m_bulkTargets.at(m_bulkCursor);
+  QByteArray line = q->lines.takeFirst();
+  qint64 t = q->times.takeFirst();
+  if (queuedAt != NULL)
+    *queuedAt = t;
+  --m_bulkSize;
+
+  if (q->lines.isEmpty()) {
+    removeBulkTarget(m_bulkCursor);
+  } else if (++m_bulkCursor >= m_bulkTargets.size()) {
+    m_bulkCursor = 0;
+  }
+
+  return line;
+}
+
+
+/// \brief Remove all queued messages
+void MessageQueue::clear() {
+  for (int i = 0; i < BulkLane; ++i) {
+    m_lanes[i].clear();
+    m_laneTimes[i].clear();
+  }
+
+  qDeleteAll(m_bulkTargets);
+  m_bulkTargets.clear();
+  m_bulkIndex.clear();
+  m_bulkCursor = 0;
+  m_bulkSize = 0;
+  m_lastBulk = NULL;
+}
+
+
+/// \brief Number of messages dropped or rejected because a lane was full
+quint64 MessageQueue::droppedMessages() const {
+  return m_dropped;
+}
+
+
+/// \brief Number of messages merged into already queued ones
+quint64 MessageQueue::mergedMessages() const {
+  return m_merged;
+}
+
+
+/// \brief Are compatible messages merged?
+bool MessageQueue::coalescing() const {
+  return m_coalescing;
+}
+
+
+/// \brief Enable or disable merging of compatible messages
+void MessageQueue::setCoalescing(bool enabled) {
+  m_coalescing = enabled;
+}
+
+
+/// \brief Maximum number of targets for a command (0 for no limit)
+int MessageQueue::maxTargets(const QByteArray& command) const {
+  return m_maxTargets.value(command, 0);
+}
+
+
+/// \brief Set maximum number of targets for a command
+///
+/// Usually set from the TARGMAX or MAXTARGETS tokens announced by the
+/// server in its ISUPPORT (005) reply.
+///
+/// \param command Command name, e.g. "PRIVMSG"
+/// \param count Maximum number of targets (0 for no limit)
+void MessageQueue::setMaxTargets(const QByteArray& command, int count) {
+  m_maxTargets.insert(command, count);
+}
+
+
+/// \brief Restore the default target limits
+///
+/// Until the server announces its limits, JOIN and PART may carry any
+/// number of channels while NAMES, PRIVMSG and NOTICE are limited to a
+/// single target.
+void MessageQueue::resetMaxTargets() {
+  m_maxTargets.clear();
+  m_maxTargets.insert("NAMES", 1);
+  m_maxTargets.insert("PRIVMSG", 1);
+  m_maxTargets.insert("NOTICE", 1);
+}
+
+
+/// \brief Maximum length of a merged line including CR/LF
+int MessageQueue::maxLineLength() const {
+  return m_maxLineLength;
+}
+
+
+/// \brief Set maximum length of a merged line including CR/LF
+void MessageQueue::setMaxLineLength(int length) {
+  m_maxLineLength = length;
+}
+
+
+/// \brief Parts of a queued line relevant for merging
+struct LineParts {
+  /// \brief Command name
+  QByteArray command;
+
+  /// \brief First parameter (comma-separated list of targets)
+  QByteArray targets;
+
+  /// \brief Everything after the first parameter
+  QByteArray rest;
+
+  /// \brief Line terminator
+  QByteArray terminator;
+};
+
+
+/// \brief Split a queued line into command, target list and the rest
+static bool splitLine(const QByteArray& line, LineParts& parts) {
+  const char* d = line.constData();
+  int end = line.size();
+  while (end > 0 && (d[end - 1] == '\n' || d[end - 1] == '\r'))
+    --end;
+
+  int pos = 0;
+  while (pos < end && d[pos] != ' ')
+    ++pos;
+  parts.command = line.left(pos);
+
+  while (pos < end && d[pos] == ' ')
+    ++pos;
+  int begin = pos;
+  while (pos < end && d[pos] != ' ')
+    ++pos;
+  parts.targets = line.mid(begin, pos - begin);
+
+  while (pos < end && d[pos] == ' ')
+    ++pos;
+  parts.rest = line.mid(pos, end - pos);
+  parts.terminator = line.mid(end);
+
+  return (!parts.command.isEmpty() && !parts.targets.isEmpty() &&
+	  !parts.targets.startsWith(':'));
+}
+
+
+/// \brief Try to merge a message into one that is already queued
+///
+/// Only the last message of the interactive lane, or the last message
+/// queued in the bulk lane, are considered, so the order in which
+/// messages reach the server doesn't change. A bulk lane target that
+/// was merged into another target's queue is served from that queue
+/// until it drains, so later messages to it can't overtake the merged
+/// one. To keep the round-robin fair, bulk messages are only merged
+/// into a queue holding nothing but that last message; otherwise the
+/// new target would wait for the other target's whole backlog.
+///
+/// \return true if the message was merged and must not be queued
+bool MessageQueue::coalesce(const QByteArray& line, Lane lane,
+			    const QByteArray& target) {
+  if (lane == InteractiveLane) {
+    if (m_lanes[lane].isEmpty())
+      return false;
+
+    return mergeLists(m_lanes[lane].last(), line);
+  }
+
+  if (lane == BulkLane) {
+    if (m_lastBulk == NULL || m_lastBulk->lines.size() != 1 ||
+	target.isEmpty() || m_bulkIndex.contains(target))
+      return false;
+
+    if (!mergeTargets(m_lastBulk->lines.last(), line))
+      return false;
+
+    m_bulkIndex.insert(target, m_lastBulk);
+    m_lastBulk->aliases.append(target);
+    return true;
+  }
+
+  return false;
+}
+
+
+/// \brief Merge JOIN, PART and NAMES messages
+///
+/// JOIN keys apply to the channels in order, so a keyed JOIN can only
+/// be merged behind JOINs whose channels all have keys.
+bool MessageQueue::mergeLists(QByteArray& queued, const QByteArray& line) const {
+  LineParts q, l;
+  if (!splitLine(queued, q) || !splitLine(line, l) || q.command != l.command)
+    return false;
+
+  int limit = maxTargets(q.command);
+  int targets = q.targets.count(',') + l.targets.count(',') + 2;
+  if (limit > 0 && targets > limit)
+    return false;
+
+  QByteArray merged = q.command + " " + q.targets + "," + l.targets;
+
+  if (q.command == "JOIN") {
+    if (q.targets == "0" || l.targets == "0")
+      return false;
+
+    if (!l.rest.isEmpty()) {
+      // keys must line up with the channels
+      if (q.rest.isEmpty() ||
+	  q.rest.count(',') != q.targets.count(','))
+	return false;
+      merged += " " + q.rest + "," + l.rest;
+    } else if (!q.rest.isEmpty()) {
+      merged += " " + q.rest;
+    }
+  } else if (q.command == "PART") {
+    // the part message applies to all channels
+    if (q.rest != l.rest)
+      return false;
+    if (!q.rest.isEmpty())
+      merged += " " + q.rest;
+  } else if (q.command == "NAMES") {
+    if (!q.rest.isEmpty() || !l.rest.isEmpty())
+      return false;
+  } else {
+    return false;
+  }
+
+  if (merged.size() + 2 > m_maxLineLength)
+    return false;
+
+  queued = merged + q.terminator;
+  return true;
+}
+
+
+/// \brief Merge PRIVMSG and NOTICE messages with identical text
+bool MessageQueue::mergeTargets(QByteArray& queued,
+				const QByteArray& line) const {
+  LineParts q, l;
+  if (!splitLine(queued, q) || !splitLine(line, l) ||
+      q.command != l.command || q.rest != l.rest)
+    return false;
+
+  int limit = maxTargets(q.command);
+  int targets = q.targets.count(',') + l.targets.count(',') + 2;
+  if (limit > 0 && targets > limit)
+    return false;
+
+  QList<QByteArray> existing = q.targets.split(',');
+  if (existing.contains(l.targets))
+    return false;
+
+  QByteArray merged = q.command + " " + q.targets + "," + l.targets + " " +
+    q.rest;
+  if (merged.size() + 2 > m_maxLineLength)
+    return false;
+
+  queued = merged + q.terminator;
+  return true;
+}
@@ -0,0 +1,153 @@
+/// \file
+/// \brief Declaration of MessageQueue utility class
+///
+/// \author png!das-system
+#ifndef MESSAGEQUEUE_H
+#define MESSAGEQUEUE_H 1
+
+#include <QByteArray>
+#include <QHash>
+#include <QList>
+
+#include "qirc.h"
+
+namespace QIRC {
+  /// \brief Outbound message queue with priority lanes
+  ///
+  /// Messages are queued in one of three lanes. The control lane (e.g.
+  /// PONG, NICK, QUIT) is always served first, then the interactive
+  /// lane (JOIN, MODE, ...) and finally the bulk lane (PRIVMSG and
+  /// NOTICE). Inside the bulk lane every target gets its own queue and
+  /// the targets are served round-robin, so a flood of replies to one
+  /// channel doesn't delay replies to another one.
+  ///
+  /// Each lane can be limited to a maximum number of messages. When a
+  /// full lane receives another message it either drops its oldest
+  /// message or rejects the new one, depending on its OverflowPolicy.
+  ///
+  /// Compatible messages are merged while they wait: a JOIN, PART or
+  /// NAMES queued right behind another one of the same kind becomes a
+  /// single comma-separated command, and a PRIVMSG or NOTICE with the
+  /// same text as the previous one is sent to both targets at once.
+  /// Merging never reorders messages and respects both the line length
+  /// limit and the per-command target limits set with setMaxTargets().
+  class MessageQueue {
+  public:
+    /// \brief Priority lanes, in the order they are served
+    enum Lane {
+      ControlLane = 0,
+      InteractiveLane,
+      BulkLane,
+      LaneCount
+    };
+
+    /// \brief Behaviour of a full lane
+    enum OverflowPolicy {
+      DropOldest,
+      Reject
+    };
+
+    MessageQueue();
+    ~MessageQueue();
+
+    int maxDepth(Lane lane) const;
+    void setMaxDepth(Lane lane, int depth);
+
+    OverflowPolicy overflowPolicy(Lane lane) const;
+    void setOverflowPolicy(Lane lane, OverflowPolicy policy);
+
+    bool enqueue(const QByteArray& line, qint64 queuedAt=0);
+    bool enqueue(const QByteArray& line, Lane lane,
+		 const QByteArray& target=QByteArray(), qint64 queuedAt=0);
+
+    bool isEmpty() const;
+    int size() const;
+    int size(Lane lane) const;
+
+    const QByteArray& head() const;
+    QByteArray takeHead(qint64* queuedAt=NULL);
+    void clear();
+
+    quint64 droppedMessages() const;
+    quint64 mergedMessages() const;
+
+    bool coalescing() const;
+    void setCoalescing(bool enabled);
+
+    int maxTargets(const QByteArray& command) const;
+    void setMaxTargets(const QByteArray& command, int count);
+    void resetMaxTargets();
+
+    int maxLineLength() const;
+    void setMaxLineLength(int length);
+
+    static Lane laneFor(const QByteArray& line, QByteArray* target=NULL);
+
+  protected:
+    /// \brief Pending messages for one target in the bulk lane
+    struct TargetQueue {
+      /// \brief Target (nick or channel) of the messages
+      QByteArray target;
+
+      /// \brief Queued messages in order
+      QList<QByteArray> lines;
+
+      /// \brief Time each message of lines was queued at
+      QList<qint64> times;
+
+      /// \brief Other targets whose messages were merged into lines
+      QList<QByteArray> aliases;
+    };
+
+    /// \brief Messages in the control and interactive lanes
+    QList<QByteArray> m_lanes[BulkLane];
+
+    /// \brief Time each message of m_lanes was queued at
+    QList<qint64> m_laneTimes[BulkLane];
+
+    /// \brief Targets in the bulk lane that have messages, in serving order
+    QList<TargetQueue*> m_bulkTargets;
+
+    /// \brief Lookup of bulk lane targets by name
+    QHash<QByteArray, TargetQueue*> m_bulkIndex;
+
+    /// \brief Index in m_bulkTargets of the target to serve next
+    int m_bulkCursor;
+
+    /// \brief Number of messages in the bulk lane
+    int m_bulkSize;
+
+    /// \brief Maximum number of messages per lane (0 for no limit)
+    int m_maxDepth[LaneCount];
+
+    /// \brief Behaviour of each lane when full
+    OverflowPolicy m_policy[LaneCount];
+
+    /// \brief Target queue that received the last bulk lane message
+    TargetQueue* m_lastBulk;
+
+    /// \brief Number of messages dropped or rejected so far
+    quint64 m_dropped;
+
+    /// \brief Number of messages merged into already queued ones
+    quint64 m_merged;
+
+    /// \brief Flag indicating wether compatible messages get merged
+    bool m_coalescing;
+
+    /// \brief Maximum number of targets per command (0 for no limit)
+    QHash<QByteArray, int> m_maxTargets;
+
+    /// \brief Maximum length of a merged line including CR/LF
+    int m_maxLineLength;
+
+    void dropOldestBulk();
+    void removeBulkTarget(int index);
+
+    bool coalesce(const QByteArray& line, Lane lane, const QByteArray& target);
+    bool mergeLists(QByteArray& queued, const QByteArray& line) const;
+    bool mergeTargets(QByteArray& queued, const QByteArray& line) const;
+  };
+};
+
+#endif // !MESSAGEQUEUE_H
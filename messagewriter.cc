@@ -0,0 +1,126 @@
+/// \file
+/// \brief Implementation of MessageWriter utility class
+///
+/// \author png!das-system
+#include "MessageWriter"
+
+using namespace QIRC;
+
+
+/// \brief QChars as UTF-16 code units
+static inline const ushort* utf16(const QChar* s) {
+  return reinterpret_cast<const ushort*>(s);
+}
+
+
+/// \brief Construct writer with a buffer for one protocol line
+MessageWriter::MessageWriter() {}
+
+
+/// \brief Start a new line with the given command
+MessageWriter& MessageWriter::begin(const char* command) {
+  m_writer.begin(command);
+  return (*this);
+}
+
+
+/// \brief Append text as-is
+///
+/// Used for complete lines given as a string; the text is encoded but
+/// not otherwise interpreted.
+MessageWriter& MessageWriter::raw(const QString& text) {
+  m_writer.rawUtf16(text.utf16(), text.size());
+  return (*this);
+}
+
+
+/// \brief Append a middle parameter
+MessageWriter& MessageWriter::param(const QString& p) {
+  m_writer.paramUtf16(p.utf16(), p.size());
+  return (*this);
+}
+
+
+/// \brief Append the trailing parameter
+MessageWriter& MessageWriter::trailing(const QString& t) {
+  m_writer.trailingUtf16(t.utf16(), t.size());
+  return (*this);
+}
+
+
+/// \brief Terminate the current line and return it
+///
+/// The line is built in the writer's buffer; only the finished line
+/// is copied, once, into the array the outbound queue keeps.
+///
+/// \return Encoded line including CR/LF
+QByteArray MessageWriter::line() {
+  m_writer.line();
+  return QByteArray(m_writer.data(), m_writer.length());
+}
+
+
+/// \brief Number of bytes in the current line
+int MessageWriter::length() const {
+  return m_writer.length();
+}
+
+
+/// \brief Number of bytes needed to encode UTF-16 text as UTF-8
+int MessageWriter::utf8Length(const QChar* s, int count) {
+  return QIRCCore::LineWriter::utf8Length(utf16(s), count);
+}
+
+
+/// \brief Split text into chunks that fit into a message
+///
+/// Every chunk encodes to at most maxBytes bytes of UTF-8. Chunks end
+/// at the last space that fits if there is one, so words are only
+/// broken when a single word is longer than a whole chunk. Characters
+/// (including surrogate pairs) are never split.
+///
+/// \param text Text to split
+/// \param maxBytes Maximum length of a chunk in bytes
+///
+/// \return List of chunks; a single chunk if the whole text fits
+QStringList MessageWriter::split(const QString& text, int maxBytes) {
+  QStringList chunks;
+  const QChar* s = text.constData();
+  const int count = text.size();
+
+  if (maxBytes < 4 || utf8Length(s, count) <= maxBytes) {
+    chunks.append(text);
+    return chunks;
+  }
+
+  int begin = 0;
+  while (begin < count) {
+    int end = begin;
+    int bytes = 0;
+    int lastSpace = -1;
+
+    while (end < count) {
+      int n;
+      int w = QIRCCore::LineWriter::charWidth(utf16(s), end, count, n);
+
+      if (bytes + w > maxBytes)
+	break;
+
+      if (s[end] == ' ')
+	lastSpace = end;
+      bytes += w;
+      end += n;
+    }
+
+    if (end < count && lastSpace > begin) {
+      // break after the last word that fits and drop the space
+      chunks.append(QString(s + begin, lastSpace - begin));
+      begin = lastSpace + 1;
+    } else {
+      chunks.append(QString(s + begin, end - begin));
+      begin = end;
+    }
+  }
+
+  return chunks;
+}
@@ -0,0 +1,51 @@
+/// \file
+/// \brief Declaration of MessageWriter utility class
+///
+/// \author png!das-system
+#ifndef MESSAGEWRITER_H
+#define MESSAGEWRITER_H 1
+
+#include <QByteArray>
+#include <QString>
+#include <QStringList>
+
+#include "core/linewriter.h"
+
+#include "qirc.h"
+
+namespace QIRC {
+  /// \brief Builds outbound message lines
+  ///
+  /// The writer encodes the command and its parameters straight into a
+  /// reusable UTF-8 buffer, without building intermediate strings, and
+  /// terminates the line with CR/LF. line() then returns the finished
+  /// line as the QByteArray that is queued for sending:
+  ///
+  /// \code
+  /// QByteArray line = writer.begin("PRIVMSG").param(target)
+  ///   .trailing(text).line();
+  /// \endcode
+  ///
+  /// The encoding is done by QIRCCore::LineWriter.
+  class MessageWriter {
+  public:
+    MessageWriter();
+
+    MessageWriter& begin(const char* command);
+    MessageWriter& raw(const QString& text);
+    MessageWriter& param(const QString& p);
+    MessageWriter& trailing(const QString& t);
+
+    QByteArray line();
+    int length() const;
+
+    static int utf8Length(const QChar* s, int count);
+    static QStringList split(const QString& text, int maxBytes);
+
+  protected:
+    /// \brief Builds the line in a reusable buffer
+    QIRCCore::LineWriter m_writer;
+  };
+};
+
+#endif // !MESSAGEWRITER_H
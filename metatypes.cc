@@ -0,0 +1,30 @@
+/// \file
+/// \brief Registration of QIRC types with the Qt meta type system
+///
+/// \author png!das-system
+#include <QAbstractSocket>
+#include <QMetaType>
+
+#include "ConnectionStatistics"
+#include "HostMask"
+#include "IrcMessage"
+#include "ServerInfo"
+
+#include "qirc.h"
+
+
+/// \brief Register QIRC types for queued signal/slot connections
+///
+/// Needed before QIRC signals can be delivered across threads, e.g.
+/// from a ConnectionPool worker to the application thread. Calling it
+/// more than once is harmless.
+void QIRC::registerMetaTypes() {
+  qRegisterMetaType<QIRC::HostMask>("QIRC::HostMask");
+  qRegisterMetaType<QIRC::IrcMessage>("QIRC::IrcMessage");
+  qRegisterMetaType<QVector<QIRC::IrcMessage> >("QVector<QIRC::IrcMessage>");
+  qRegisterMetaType<QIRC::ServerInfo>("QIRC::ServerInfo");
+  qRegisterMetaType<QIRC::ConnectionStatistics>(
+    "QIRC::ConnectionStatistics");
+  qRegisterMetaType<QAbstractSocket::SocketError>(
+    "QAbstractSocket::SocketError");
+}
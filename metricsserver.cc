@@ -0,0 +1,502 @@
+/// \file
+/// \brief Implementation of MetricsServer class
+///
+/// \author png!das-system
+#include <QThread>
+
+#include "MetricsServer"
+
+using namespace QIRC;
+
+
+/// \brief Construct server (not listening yet)
+MetricsServer::MetricsServer(QObject* parent) :
+  QObject(parent), m_server(NULL), m_pendingReplies(0),
+  m_scrapeTimer(NULL) {
+  registerMetaTypes();
+
+  m_server = new QTcpServer(this);
+  QObject::connect(m_server, SIGNAL(newConnection()),
+		   this, SLOT(server_newConnection()));
+
+  m_scrapeTimer = new QTimer(this);
+  m_scrapeTimer->setSingleShot(true);
+  m_scrapeTimer->setInterval(ScrapeTimeout);
+  QObject::connect(m_scrapeTimer, SIGNAL(timeout()),
+		   this, SLOT(finishScrape()));
+}
+
+
+MetricsServer::~MetricsServer() {}
+
+
+/// \brief Start accepting HTTP clients
+///
+/// \param address Address to listen on (localhost by default)
+/// \param port Port to listen on; 0 picks a free one, see port()
+///
+/// \return false if the server couldn't listen, see errorString()
+bool MetricsServer::listen(const QHostAddress& address, quint16 port) {
+  if (!m_server->listen(address, port)) {
+    qWarning() << "MetricsServer: Unable to listen on port" << port << ":"
+	       << m_server->errorString();
+    return false;
+  }
+
+  return true;
+}
+
+
+/// \brief Stop accepting HTTP clients
+void MetricsServer::close() {
+  m_server->close();
+}
+
+
+/// \brief Is the server accepting HTTP clients?
+bool MetricsServer::isListening() const {
+  return m_server->isListening();
+}
+
+
+/// \brief Port the server listens on
+quint16 MetricsServer::port() const {
+  return m_server->serverPort();
+}
+
+
+/// \brief Description of the last error of listen()
+QString MetricsServer::errorString() const {
+  return m_server->errorString();
+}
+
+
+/// \brief Report the statistics of a connection
+///
+/// The connection must live in the server's thread; add connections
+/// running in a ConnectionPool by their id instead. Connections that
+/// get deleted are dropped from the report.
+///
+/// \param conn The connection
+/// \param name Value of the connection label of its metrics
+void MetricsServer::addConnection(Connection* conn, const QString& name) {
+  if (conn->thread() != thread()) {
+    qWarning() << "MetricsServer: Connection must live in the server's"
+	       << "thread; add pooled connections by their id!";
+    return;
+  }
+
+  Entry e;
+  e.connection = conn;
+  e.name = name;
+  m_connections.append(e);
+}
+
+
+/// \brief Report the statistics of a connection in a ConnectionPool
+///
+/// The pool must live in the server's thread. Connections removed from
+/// the pool are dropped from the report.
+///
+/// \param pool The pool running the connection
+/// \param id Id of the connection within pool
+/// \param name Value of the connection label of its metrics
+void MetricsServer::addConnection(ConnectionPool* pool, int id,
+				  const QString& name) {
+  Entry e;
+  e.pool = pool;
+  e.id = id;
+  e.name = name;
+  m_connections.append(e);
+
+  QObject::connect(pool,
+		   SIGNAL(connectionStatistics(int,QIRC::ConnectionStatistics)),
+		   this,
+		   SLOT(pool_connectionStatistics(int,QIRC::ConnectionStatistics)),
+		   Qt::UniqueConnection);
+}
+
+
+/// \brief Stop reporting the statistics of a connection
+void MetricsServer::removeConnection(Connection* conn) {
+  for (int i = m_connections.size() - 1; i >= 0; --i) {
+    if (m_connections.at(i).pool.isNull() &&
+	m_connections.at(i).connection == conn) {
+      m_connections.removeAt(i);
+    }
+  }
+}
+
+
+/// \brief Stop reporting the statistics of a connection in a pool
+void MetricsServer::removeConnection(ConnectionPool* pool, int id) {
+  for (int i = m_connections.size() - 1; i >= 0; --i) {
+    const Entry& e = m_connections.at(i);
+    if (!e.pool.isNull() && e.pool == pool && e.id == id) {
+      if (e.pending) {
+	--m_pendingReplies;
+      }
+      m_connections.removeAt(i);
+    }
+  }
+}
+
+
+/// \brief Render the statistics of all connections
+///
+/// Pooled connections are reported with the statistics received by the
+/// last scrape; they are left out until they answered once.
+///
+/// \return Metrics in Prometheus text exposition format (version 0.0.4)
+QByteArray MetricsServer::metrics() {
+  QList<QByteArray> labels;
+  QList<ConnectionStatistics> stats;
+
+  for (int i = m_connections.size() - 1; i >= 0; --i) {
+    const Entry& e = m_connections.at(i);
+    if (e.connection.isNull() && e.pool.isNull()) {
+      if (e.pending) {
+	--m_pendingReplies;
+      }
+      m_connections.removeAt(i);
+    }
+  }
+
+  for (int i = 0; i < m_connections.size(); ++i) {
+    const Entry& e = m_connections.at(i);
+    if (e.connection.isNull() && !e.received) {
+      continue;
+    }
+
+    labels.append("connection=\"" + escape(e.name) + "\"");
+    stats.append(e.connection.isNull() ? e.stats : e.connection->statistics());
+  }
+
+  QByteArray out;
+
+  // counters and gauges
+  static const struct {
+    const char* name;
+    const char* type;
+    const char* help;
+  } scalars[] = {
+    { "qirc_received_bytes_total", "counter", "Bytes received from the server" },
+    { "qirc_sent_bytes_total", "counter", "Bytes sent to the server" },
+    { "qirc_received_lines_total", "counter", "Lines received from the server" },
+    { "qirc_sent_lines_total", "counter", "Lines sent to the server" },
+    { "qirc_discarded_lines_total", "counter", "Overlong lines discarded" },
+    { "qirc_dropped_messages_total", "counter",
+      "Outbound messages dropped by the full queue" },
+    { "qirc_queue_depth", "gauge", "Messages waiting in the outbound queue" },
+    { "qirc_queue_depth_max", "gauge",
+      "Largest number of messages waiting in the outbound queue" },
+    { "qirc_pings_sent_total", "counter", "Keepalive PINGs sent" },
+    { "qirc_ping_timeouts_total", "counter",
+      "Keepalive PINGs that weren't answered in time" }
+  };
+  const int scalarCount = sizeof(scalars) / sizeof(scalars[0]);
+
+  for (int m = 0; m < scalarCount; ++m) {
+    out += QByteArray("# HELP ") + scalars[m].name + " " + scalars[m].help +
+      "\n# TYPE " + scalars[m].name + " " + scalars[m].type + "\n";
+
+    for (int i = 0; i < stats.size(); ++i) {
+      const ConnectionStatistics& s = stats.at(i);
+      const quint64 values[] = {
+	s.bytesIn, s.bytesOut, s.linesIn, s.linesOut, s.discardedLines,
+	s.droppedMessages, quint64(s.queueDepth), quint64(s.maxQueueDepth),
+	s.pingsSent, s.pingTimeouts
+      };
+
+      out += QByteArray(scalars[m].name) + "{" + labels.at(i) + "} " +
+	QByteArray::number(values[m]) + "\n";
+    }
+  }
+
+  out += "# HELP qirc_parse_failures_total Received lines that couldn't be"
+    " parsed or handled\n# TYPE qirc_parse_failures_total counter\n";
+  for (int i = 0; i < stats.size(); ++i) {
+    const QHash<QByteArray, quint64>& failures =
+      stats.at(i).parseFailuresByCommand;
+
+    for (QHash<QByteArray, quint64>::const_iterator it = failures.constBegin();
+	 it != failures.constEnd(); ++it) {
+      out += "qirc_parse_failures_total{" + labels.at(i) + ",command=\"" +
+	escape(QString::fromUtf8(it.key())) + "\"} " +
+	QByteArray::number(it.value()) + "\n";
+    }
+  }
+
+  // round trip times, only for connections that measured any
+  static const struct {
+    const char* name;
+    const char* help;
+  } rtts[] = {
+    { "qirc_lag_seconds", "Round trip time of the last keepalive PING" },
+    { "qirc_rtt_min_seconds",
+      "Smallest round trip time of the recent keepalive PINGs" },
+    { "qirc_rtt_avg_seconds",
+      "Average round trip time of the recent keepalive PINGs" },
+    { "qirc_rtt_p99_seconds",
+      "99th percentile of the round trip times of the recent keepalive PINGs" }
+  };
+  const int rttCount = sizeof(rtts) / sizeof(rtts[0]);
+
+  for (int m = 0; m < rttCount; ++m) {
+    out += QByteArray("# HELP ") + rtts[m].name + " " + rtts[m].help +
+      "\n# TYPE " + rtts[m].name + " gauge\n";
+
+    for (int i = 0; i < stats.size(); ++i) {
+      const ConnectionStatistics& s = stats.at(i);
+      const int values[] = { s.lag, s.rttMin, s.rttAverage, s.rttP99 };
+
+      if (values[m] >= 0) {
+	out += QByteArray(rtts[m].name) + "{" + labels.at(i) + "} " +
+	  QByteArray::number(values[m] * 1e-3, 'g', 6) + "\n";
+      }
+    }
+  }
+
+  // histograms, converted to seconds
+  static const struct {
+    const char* name;
+    const char* help;
+    double scale;
+  } histograms[] = {
+    { "qirc_parse_duration_seconds",
+      "Time to parse and handle a received line", 1e-9 },
+    { "qirc_queue_latency_seconds",
+      "Time queued messages waited before they were written", 1e-6 }
+  };
+
+  for (int m = 0; m < 2; ++m) {
+    const QByteArray name(histograms[m].name);
+    const double scale = histograms[m].scale;
+
+    out += "# HELP " + name + " " + histograms[m].help + "\n# TYPE " +
+      name + " histogram\n";
+
+    for (int i = 0; i < stats.size(); ++i) {
+      const Histogram& h = (m == 0) ? stats.at(i).parseTime :
+	stats.at(i).queueLatency;
+
+      quint64 cumulative = 0;
+      for (int b = 0; b < Histogram::BucketCount - 1; ++b) {
+	cumulative += h.bucket(b);
+	out += name + "_bucket{" + labels.at(i) + ",le=\"" +
+	  QByteArray::number(Histogram::upperBound(b) * scale, 'g', 6) +
+	  "\"} " + QByteArray::number(cumulative) + "\n";
+      }
+
+      out += name + "_bucket{" + labels.at(i) + ",le=\"+Inf\"} " +
+	QByteArray::number(h.count()) + "\n";
+      out += name + "_sum{" + labels.at(i) + "} " +
+	QByteArray::number(h.sum() * scale, 'g', 9) + "\n";
+      out += name + "_count{" + labels.at(i) + "} " +
+	QByteArray::number(h.count()) + "\n";
+    }
+  }
+
+  return out;
+}
+
+
+/// \brief Request the statistics of all pooled connections
+///
+/// finishScrape() answers the waiting clients once all of them arrived
+/// or ScrapeTimeout passed. A connection deleted before the request
+/// reaches it never answers.
+void MetricsServer::startScrape() {
+  m_pendingReplies = 0;
+
+  for (int i = m_connections.size() - 1; i >= 0; --i) {
+    Entry& e = m_connections[i];
+    e.pending = false;
+
+    if (e.pool.isNull()) {
+      if (e.connection.isNull()) {
+	m_connections.removeAt(i);
+      }
+      continue;
+    }
+
+    if (!e.pool->requestStatistics(e.id)) {
+      // removed from the pool
+      m_connections.removeAt(i);
+      continue;
+    }
+
+    e.pending = true;
+    ++m_pendingReplies;
+  }
+
+  if (m_pendingReplies == 0) {
+    finishScrape();
+  } else {
+    m_scrapeTimer->start();
+  }
+}
+
+
+/// \brief Slot for ConnectionPool::connectionStatistics()
+void MetricsServer::pool_connectionStatistics(int id,
+					      QIRC::ConnectionStatistics stats) {
+  ConnectionPool* pool = qobject_cast<ConnectionPool*>(sender());
+
+  for (int i = 0; i < m_connections.size(); ++i) {
+    Entry& e = m_connections[i];
+    if (e.pool.isNull() || e.pool != pool || e.id != id) {
+      continue;
+    }
+
+    e.stats = stats;
+    e.received = true;
+    if (e.pending) {
+      e.pending = false;
+      --m_pendingReplies;
+    }
+  }
+
+  if (m_pendingReplies <= 0 && m_scrapeTimer->isActive()) {
+    finishScrape();
+  }
+}
+
+
+/// \brief Answer all clients waiting for the current scrape
+///
+/// Also the slot for m_scrapeTimer::timeout(); connections that didn't
+/// answer in time are reported with their previous statistics.
+void MetricsServer::finishScrape() {
+  m_scrapeTimer->stop();
+  m_pendingReplies = 0;
+  for (int i = 0; i < m_connections.size(); ++i) {
+    m_connections[i].pending = false;
+  }
+
+  const QByteArray body = metrics();
+
+  QHash<QTcpSocket*, bool> waiting = m_waiting;
+  m_waiting.clear();
+
+  for (QHash<QTcpSocket*, bool>::const_iterator it = waiting.constBegin();
+       it != waiting.constEnd(); ++it) {
+    reply(it.key(), "200 OK", body, it.value());
+  }
+}
+
+
+/// \brief Escape a label value
+QByteArray MetricsServer::escape(const QString& label) {
+  QByteArray utf8 = label.toUtf8();
+  QByteArray r;
+  r.reserve(utf8.size());
+
+  for (int i = 0; i < utf8.size(); ++i) {
+    switch (utf8.at(i)) {
+    case '\\':
+      r += "\\\\";
+      break;
+    case '"':
+      r += "\\\"";
+      break;
+    case '\n':
+      r += "\\n";
+      break;
+    default:
+      r += utf8.at(i);
+    }
+  }
+
+  return r;
+}
+
+
+/// \brief Slot for m_server::newConnection()
+void MetricsServer::server_newConnection() {
+  while (m_server->hasPendingConnections()) {
+    QTcpSocket* client = m_server->nextPendingConnection();
+
+    QObject::connect(client, SIGNAL(readyRead()),
+		     this, SLOT(client_readyRead()));
+    QObject::connect(client, SIGNAL(disconnected()),
+		     this, SLOT(client_disconnected()));
+    m_requests.insert(client, QByteArray());
+  }
+}
+
+
+/// \brief Slot for readyRead() of HTTP clients
+///
+/// Collects the request until its header is complete.
+void MetricsServer::client_readyRead() {
+  QTcpSocket* client = qobject_cast<QTcpSocket*>(sender());
+  if (client == NULL || !m_requests.contains(client)) {
+    return;
+  }
+
+  QByteArray& request = m_requests[client];
+  request += client->readAll();
+
+  if (request.contains("\r\n\r\n") || request.contains("\n\n")) {
+    QByteArray r = request;
+    m_requests.remove(client);
+    respond(client, r);
+  } else if (request.size() > MaxRequestSize) {
+    m_requests.remove(client);
+    client->abort();
+  }
+}
+
+
+/// \brief Slot for disconnected() of HTTP clients
+void MetricsServer::client_disconnected() {
+  QTcpSocket* client = qobject_cast<QTcpSocket*>(sender());
+  if (client == NULL) {
+    return;
+  }
+
+  m_requests.remove(client);
+  m_waiting.remove(client);
+  client->deleteLater();
+}
+
+
+/// \brief Answer a complete request
+///
+/// Requests for the metrics wait for the current scrape.
+void MetricsServer::respond(QTcpSocket* client, const QByteArray& request) {
+  // request line: <method> <path> <version>
+  QList<QByteArray> parts = request.left(request.indexOf('\n')).trimmed()
+    .split(' ');
+  const bool head = (parts.at(0) == "HEAD");
+
+  if (parts.size() < 2 || (parts.at(0) != "GET" && !head)) {
+    reply(client, "405 Method Not Allowed", QByteArray(), head);
+  } else if (parts.at(1) != "/metrics" && !parts.at(1).startsWith("/metrics?")) {
+    reply(client, "404 Not Found", QByteArray(), head);
+  } else {
+    m_waiting.insert(client, head);
+    if (!m_scrapeTimer->isActive()) {
+      startScrape();
+    }
+  }
+}
+
+
+/// \brief Send a response and close the connection
+///
+/// \param head Leave out the body (answer to a HEAD request)
+void MetricsServer::reply(QTcpSocket* client, const QByteArray& status,
+			  const QByteArray& body, bool head) {
+  QByteArray response = "HTTP/1.0 " + status + "\r\n"
+    "Content-Type: text/plain; version=0.0.4; charset=utf-8\r\n"
+    "Content-Length: " + QByteArray::number(body.size()) + "\r\n"
+    "Connection: close\r\n\r\n";
+  if (!head) {
+    response += body;
+  }
+
+  client->write(response);
+  client->disconnectFromHost();
+}
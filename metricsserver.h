@@ -0,0 +1,124 @@
+/// \file
+/// \brief Declaration of MetricsServer class
+///
+/// \author png!das-system
+#ifndef METRICSSERVER_H
+#define METRICSSERVER_H 1
+
+#include <QByteArray>
+#include <QHash>
+#include <QHostAddress>
+#include <QList>
+#include <QObject>
+#include <QPointer>
+#include <QString>
+#include <QTcpServer>
+#include <QTcpSocket>
+#include <QTimer>
+
+#include "Connection"
+#include "ConnectionPool"
+
+#include "qirc.h"
+
+namespace QIRC {
+  /// \brief Serves connection statistics in Prometheus text format
+  ///
+  /// A minimal HTTP server answering every GET request for /metrics
+  /// with the ConnectionStatistics of all added connections, labeled
+  /// with their names. It listens on localhost by default; put it
+  /// behind a proxy to expose it elsewhere.
+  ///
+  /// Connections added directly must live in the server's thread.
+  /// Connections running in a ConnectionPool are added by their id;
+  /// for every scrape their statistics are requested through the pool,
+  /// and the response is sent once all of them answered or
+  /// ScrapeTimeout passed.
+  class MetricsServer : public QObject {
+    Q_OBJECT
+  public:
+    MetricsServer(QObject* parent=NULL);
+    virtual ~MetricsServer();
+
+    bool listen(const QHostAddress& address=QHostAddress::LocalHost,
+		quint16 port=0);
+    void close();
+    bool isListening() const;
+    quint16 port() const;
+    QString errorString() const;
+
+    void addConnection(Connection* conn, const QString& name);
+    void addConnection(ConnectionPool* pool, int id, const QString& name);
+    void removeConnection(Connection* conn);
+    void removeConnection(ConnectionPool* pool, int id);
+
+    QByteArray metrics();
+
+  protected:
+    /// \brief Largest request accepted in bytes
+    enum { MaxRequestSize = 8192 };
+
+    /// \brief Time to wait for the statistics of pooled connections in ms
+    enum { ScrapeTimeout = 2000 };
+
+    /// \brief A connection and its label
+    struct Entry {
+      Entry() : id(-1), received(false), pending(false) {}
+
+      /// \brief The connection, if added directly (NULL once deleted)
+      QPointer<Connection> connection;
+
+      /// \brief Pool of the connection, if added by id
+      QPointer<ConnectionPool> pool;
+
+      /// \brief Id of the connection within pool
+      int id;
+
+      /// \brief Value of the connection label
+      QString name;
+
+      /// \brief Statistics last received from pool
+      ConnectionStatistics stats;
+
+      /// \brief Flag indicating that stats were received at least once
+      bool received;
+
+      /// \brief Flag indicating that the current scrape waits for stats
+      bool pending;
+    };
+
+    /// \brief Accepts HTTP clients
+    QTcpServer* m_server;
+
+    /// \brief Connections to report
+    QList<Entry> m_connections;
+
+    /// \brief Partial requests by client
+    QHash<QTcpSocket*, QByteArray> m_requests;
+
+    /// \brief Clients waiting for the current scrape; true for HEAD
+    QHash<QTcpSocket*, bool> m_waiting;
+
+    /// \brief Number of pooled connections the current scrape waits for
+    int m_pendingReplies;
+
+    /// \brief Ends a scrape whose answers don't arrive
+    QTimer* m_scrapeTimer;
+
+    void respond(QTcpSocket* client, const QByteArray& request);
+    void reply(QTcpSocket* client, const QByteArray& status,
+	       const QByteArray& body, bool head);
+    void startScrape();
+
+    static QByteArray escape(const QString& label);
+
+  protected slots:
+    void server_newConnection();
+    void client_readyRead();
+    void client_disconnected();
+    void pool_connectionStatistics(int id, QIRC::ConnectionStatistics stats);
+    void finishScrape();
+  };
+};
+
+#endif // !METRICSSERVER_H
@@ -0,0 +1,68 @@
+/// \file
+/// \brief Compile-time table of numeric reply kinds
+///
+/// \author png!das-system
+#include "numerics.h"
+
+using namespace QIRC;
+
+namespace {
+  /// \brief Kind of numeric N
+  ///
+  /// Codes without a specialization are errors if they're in the error
+  /// range and unknown otherwise.
+  template<int N> struct NumericTraits {
+    enum {
+      kind = (N >= ERR_FIRST && N <= ERR_LAST) ? ErrorNumeric : UnknownNumeric
+    };
+  };
+
+#define QIRC_NUMERIC(n, k)					\
+  template<> struct NumericTraits<n> { enum { kind = k }; };
+
+  QIRC_NUMERIC(RPL_WELCOME, WelcomeNumeric)
+  QIRC_NUMERIC(RPL_YOURHOST, WelcomeNumeric)
+  QIRC_NUMERIC(RPL_CREATED, WelcomeNumeric)
+  QIRC_NUMERIC(RPL_MYINFO, MyInfoNumeric)
+  QIRC_NUMERIC(RPL_ISUPPORT, ISupportNumeric)
+  QIRC_NUMERIC(RPL_AWAY, AwayNumeric)
+  QIRC_NUMERIC(RPL_WHOISUSER, WhoisUserNumeric)
+  QIRC_NUMERIC(RPL_WHOISSERVER, WhoisServerNumeric)
+  QIRC_NUMERIC(RPL_WHOISOPERATOR, WhoisOperatorNumeric)
+  QIRC_NUMERIC(RPL_ENDOFWHO, EndOfWhoNumeric)
+  QIRC_NUMERIC(RPL_WHOISIDLE, WhoisIdleNumeric)
+  QIRC_NUMERIC(RPL_ENDOFWHOIS, EndOfWhoisNumeric)
+  QIRC_NUMERIC(RPL_WHOISCHANNELS, WhoisChannelsNumeric)
+  QIRC_NUMERIC(RPL_LISTSTART, ListStartNumeric)
+  QIRC_NUMERIC(RPL_LIST, ListNumeric)
+  QIRC_NUMERIC(RPL_LISTEND, ListEndNumeric)
+  QIRC_NUMERIC(RPL_NOTOPIC, NoTopicNumeric)
+  QIRC_NUMERIC(RPL_TOPIC, TopicNumeric)
+  QIRC_NUMERIC(RPL_TOPICWHOTIME, TopicWhoTimeNumeric)
+  QIRC_NUMERIC(RPL_WHOREPLY, WhoReplyNumeric)
+  QIRC_NUMERIC(RPL_NAMREPLY, NamesNumeric)
+  QIRC_NUMERIC(RPL_ENDOFNAMES, EndOfNamesNumeric)
+  QIRC_NUMERIC(RPL_MOTDSTART, MotdStartNumeric)
+  QIRC_NUMERIC(RPL_MOTD, MotdNumeric)
+  QIRC_NUMERIC(RPL_ENDOFMOTD, EndOfMotdNumeric)
+  QIRC_NUMERIC(ERR_NOMOTD, EndOfMotdNumeric)
+
+#undef QIRC_NUMERIC
+};
+
+// expand NumericTraits<0>::kind ... NumericTraits<999>::kind
+#define K1(n) NumericTraits<(n)>::kind,
+#define K10(n) K1(n) K1((n) + 1) K1((n) + 2) K1((n) + 3) K1((n) + 4) \
+  K1((n) + 5) K1((n) + 6) K1((n) + 7) K1((n) + 8) K1((n) + 9)
+#define K100(n) K10(n) K10((n) + 10) K10((n) + 20) K10((n) + 30) \
+  K10((n) + 40) K10((n) + 50) K10((n) + 60) K10((n) + 70)	 \
+  K10((n) + 80) K10((n) + 90)
+
+const unsigned char QIRC::numericKindTable[1000] = {
+  K100(0) K100(100) K100(200) K100(300) K100(400)
+  K100(500) K100(600) K100(700) K100(800) K100(900)
+};
+
+#undef K100
+#undef K10
+#undef K1
@@ -0,0 +1,94 @@
+/// \file
+/// \brief Numeric reply codes and their classification
+///
+/// \author png!das-system
+#ifndef NUMERICS_H
+#define NUMERICS_H 1
+
+#include "qirc.h"
+
+namespace QIRC {
+  /// \brief Numeric replies (RFC1459/RFC2812) handled by Connection
+  enum Numeric {
+    RPL_WELCOME = 1,
+    RPL_YOURHOST = 2,
+    RPL_CREATED = 3,
+    RPL_MYINFO = 4,
+    RPL_ISUPPORT = 5,
+
+    RPL_AWAY = 301,
+    RPL_WHOISUSER = 311,
+    RPL_WHOISSERVER = 312,
+    RPL_WHOISOPERATOR = 313,
+    RPL_ENDOFWHO = 315,
+    RPL_WHOISIDLE = 317,
+    RPL_ENDOFWHOIS = 318,
+    RPL_WHOISCHANNELS = 319,
+    RPL_LISTSTART = 321,
+    RPL_LIST = 322,
+    RPL_LISTEND = 323,
+    RPL_NOTOPIC = 331,
+    RPL_TOPIC = 332,
+    RPL_TOPICWHOTIME = 333,
+    RPL_WHOREPLY = 352,
+    RPL_NAMREPLY = 353,
+    RPL_ENDOFNAMES = 366,
+    RPL_MOTD = 372,
+    RPL_MOTDSTART = 375,
+    RPL_ENDOFMOTD = 376,
+
+    ERR_NOMOTD = 422,
+
+    /// \brief First and last code of the error reply range
+    ERR_FIRST = 400,
+    ERR_LAST = 599
+  };
+
+  /// \brief How a numeric reply is decoded
+  ///
+  /// Numerics that are decoded the same way share a kind, e.g. 001 to
+  /// 003 are all WelcomeNumeric. Every code in the error range that
+  /// has no kind of its own is an ErrorNumeric.
+  enum NumericKind {
+    UnknownNumeric = 0,
+    WelcomeNumeric,
+    MyInfoNumeric,
+    ISupportNumeric,
+    AwayNumeric,
+    WhoisUserNumeric,
+    WhoisServerNumeric,
+    WhoisOperatorNumeric,
+    WhoisIdleNumeric,
+    WhoisChannelsNumeric,
+    EndOfWhoisNumeric,
+    WhoReplyNumeric,
+    EndOfWhoNumeric,
+    ListStartNumeric,
+    ListNumeric,
+    ListEndNumeric,
+    NoTopicNumeric,
+    TopicNumeric,
+    TopicWhoTimeNumeric,
+    NamesNumeric,
+    EndOfNamesNumeric,
+    MotdStartNumeric,
+    MotdNumeric,
+    EndOfMotdNumeric,
+    ErrorNumeric,
+
+    NumericKindCount
+  };
+
+  /// \brief Kind of every numeric from 000 to 999, built at compile time
+  extern const unsigned char numericKindTable[1000];
+
+  /// \brief Look up the kind of a numeric reply
+  inline NumericKind numericKind(int numeric) {
+    if (numeric < 0 || numeric > 999)
+      return UnknownNumeric;
+
+    return static_cast<NumericKind>(numericKindTable[numeric]);
+  }
+};
+
+#endif // !NUMERICS_H
@@ -1,11 +1,83 @@
 #ifndef QIRC_H
 #define QIRC_H 1
 
+#include <QByteArray>
 #include <QString>
+#include <QVector>
 
 namespace QIRC {
+  /// \brief Rules for case-insensitive comparison of nicks and channels
+  ///
+  /// Announced by the server in the CASEMAPPING token of its ISUPPORT
+  /// (005) reply.
+  enum CaseMapping {
+    /// \brief Only A-Z and a-z are equivalent
+    AsciiCaseMapping,
+
+    /// \brief Like AsciiCaseMapping, plus four pairs of punctuation
+    ///
+    /// [ and {, ] and }, \\ and |, ~ and ^ are equivalent.
+    Rfc1459CaseMapping,
+
+    /// \brief Like Rfc1459CaseMapping, but without ~ and ^
+    ///
+    /// [ and {, ] and }, \\ and | are equivalent.
+    StrictRfc1459CaseMapping
+  };
+
+  /// \brief Formatting of a range of text
+  ///
+  /// Filled in by stripFormatInPlace() for every range of the stripped
+  /// text that isn't displayed with the default format.
+  struct FormatSpan {
+    /// \brief Text attributes
+    enum Flag {
+      Bold = 0x01,
+      Italic = 0x02,
+      Underline = 0x04,
+      Strikethrough = 0x08,
+      Monospace = 0x10,
+      Reverse = 0x20
+    };
+
+    /// \brief Set in a color value for hex colors (code 0x04)
+    ///
+    /// The lower 24 bits then hold the RGB value; otherwise a color is
+    /// an mIRC color index (0-99) or -1 for the default color.
+    enum { HexColor = 0x1000000 };
+
+    /// \brief Start of the range in the stripped text
+    int begin;
+
+    /// \brief Length of the range
+    int length;
+
+    /// \brief Combination of Flag values
+    int flags;
+
+    /// \brief Foreground color
+    int foreground;
+
+    /// \brief Background color
+    int background;
+  };
+
   QString stripFormat(QString s);
   QString stripColors(QString s);
+  void stripFormatInPlace(QString& s, QVector<FormatSpan>* spans=0);
+  void stripFormatInPlace(QByteArray& utf8, QVector<FormatSpan>* spans=0);
+  void stripColorsInPlace(QString& s);
+  void stripColorsInPlace(QByteArray& utf8);
+
+  CaseMapping caseMappingFromName(const QByteArray& name);
+  QString ircToLower(const QString& s,
+		     CaseMapping mapping=Rfc1459CaseMapping);
+  QByteArray ircToLower(const QByteArray& s,
+			CaseMapping mapping=Rfc1459CaseMapping);
+  bool ircEquals(const QString& a, const QString& b,
+		 CaseMapping mapping=Rfc1459CaseMapping);
+
+  void registerMetaTypes();
 };
 
 #endif // !QIRC_H
@@ -0,0 +1,75 @@
+/// \file
+/// \brief Implementation of QtTransport class
+///
+/// \author png!das-system
+#include "QtTransport"
+
+using namespace QIRC;
+
+
+/// \brief Construct transport with a new socket
+QtTransport::QtTransport(QObject* parent) :
+  Transport(parent) {
+  m_socket = new QTcpSocket(this);
+
+  // pass the socket's signals on
+  QObject::connect(m_socket, SIGNAL(connected()),
+		   this, SIGNAL(connected()));
+  QObject::connect(m_socket, SIGNAL(disconnected()),
+		   this, SIGNAL(disconnected()));
+  QObject::connect(m_socket, SIGNAL(error(QAbstractSocket::SocketError)),
+		   this, SIGNAL(error(QAbstractSocket::SocketError)));
+  QObject::connect(m_socket, SIGNAL(readyRead()),
+		   this, SIGNAL(readyRead()));
+}
+
+
+QtTransport::~QtTransport() {}
+
+
+/// \brief Start connecting to a server
+void QtTransport::connectToHost(const QString& host, quint16 port) {
+  m_socket->connectToHost(host, port);
+}
+
+
+/// \brief Close the connection after pending data has been written
+void QtTransport::disconnectFromHost() {
+  m_socket->disconnectFromHost();
+}
+
+
+/// \brief Close the connection at once, discarding pending data
+void QtTransport::abort() {
+  m_socket->abort();
+}
+
+
+/// \brief Is the connection established?
+bool QtTransport::isOpen() const {
+  return (m_socket->state() == QAbstractSocket::ConnectedState);
+}
+
+
+/// \brief Take all data received so far
+QByteArray QtTransport::readAll() {
+  return m_socket->readAll();
+}
+
+
+/// \brief Send data
+qint64 QtTransport::write(const QByteArray& data) {
+  return m_socket->write(data);
+}
+
+
+/// \brief Human-readable description of the last error
+QString QtTransport::errorString() const {
+  return m_socket->errorString();
+}
+
+
+/// \brief The underlying socket, e.g. for setting socket options
+QTcpSocket* QtTransport::socket() const {
+  return m_socket;
+}
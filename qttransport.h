@@ -0,0 +1,40 @@
+/// \file
+/// \brief Declaration of QtTransport class
+///
+/// \author png!das-system
+#ifndef QTTRANSPORT_H
+#define QTTRANSPORT_H 1
+
+#include <QTcpSocket>
+
+#include "Transport"
+
+#include "qirc.h"
+
+namespace QIRC {
+  /// \brief Transport using a QTcpSocket
+  ///
+  /// This is the default transport of a Connection.
+  class QtTransport : public Transport {
+    Q_OBJECT
+  public:
+    QtTransport(QObject* parent=NULL);
+    virtual ~QtTransport();
+
+    virtual void connectToHost(const QString& host, quint16 port);
+    virtual void disconnectFromHost();
+    virtual void abort();
+    virtual bool isOpen() const;
+    virtual QByteArray readAll();
+    virtual qint64 write(const QByteArray& data);
+    virtual QString errorString() const;
+
+    QTcpSocket* socket() const;
+
+  protected:
+    /// \brief The socket
+    QTcpSocket* m_socket;
+  };
+};
+
+#endif // !QTTRANSPORT_H
@@ -7,6 +7,11 @@
 using namespace QIRC;
 
 
+/// \brief Construct empty ServerInfo (default IRC port)
+ServerInfo::ServerInfo() :
+  m_host(""), m_port(6667) {}
+
+
 /// \brief Construct new ServerInfo
 ServerInfo::ServerInfo(QString host, quint16 port) :
   m_host(host), m_port(port) {}
@@ -6,6 +6,7 @@
 #define SERVERINFO_H
 
 #include <QDebug>
+#include <QMetaType>
 #include <QString>
 
 #include "qirc.h"
@@ -14,6 +15,7 @@ namespace QIRC {
   /// \brief Utility class to store a server address
   class ServerInfo {
   public:
+    ServerInfo();
     ServerInfo(QString host, quint16 port);
     ServerInfo(const ServerInfo& o);
     
@@ -40,6 +42,8 @@ namespace QIRC {
 };
 
 
+Q_DECLARE_METATYPE(QIRC::ServerInfo)
+
 QDebug& operator <<(QDebug& dbg, const QIRC::ServerInfo& si);
 
 #endif // !SERVERINFO_H
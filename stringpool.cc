@@ -0,0 +1,331 @@
+/// \file
+/// \brief Implementation of StringPool and PooledString classes
+///
+/// \author png!das-system
+#include <QDebug>
+#include <QMutexLocker>
+
+#include "StringPool"
+
+using namespace QIRC;
+
+/// \brief The pool returned by instance()
+///
+/// Deliberately never deleted: PooledStrings in static objects (e.g. a
+/// global HostMask) may release their handles after static destructors
+/// would have destroyed a Q_GLOBAL_STATIC.
+static QBasicAtomicPointer<StringPool> globalStringPool =
+  Q_BASIC_ATOMIC_INITIALIZER(0);
+
+
+/// \brief Construct shard with an empty block directory
+StringPool::Shard::Shard() :
+  blocks(new Entry*[InitialBlocks]), blockCapacity(InitialBlocks),
+  blockCount(0), used(0) {}
+
+
+StringPool::Shard::~Shard() {
+  Entry** b = blocks;
+  for (int i = 0; i < blockCount; ++i) {
+    delete[] b[i];
+  }
+  delete[] b;
+
+  for (int i = 0; i < retired.size(); ++i) {
+    delete[] retired.at(i);
+  }
+}
+
+
+/// \brief Allocate another block of entries
+///
+/// Must be called with mutex held.
+///
+/// \return false if all slots of the shard are in use
+bool StringPool::Shard::addBlock() {
+  if (blockCount == MaxBlocks)
+    return false;
+
+  Entry** b = blocks;
+  if (blockCount == blockCapacity) {
+    const int capacity = qMin(blockCapacity * 2, int(MaxBlocks));
+    Entry** grown = new Entry*[capacity];
+    for (int i = 0; i < blockCount; ++i) {
+      grown[i] = b[i];
+    }
+
+    retired.append(b);
+    blocks.fetchAndStoreOrdered(grown);
+    blockCapacity = capacity;
+    b = grown;
+  }
+
+  b[blockCount++] = new Entry[BlockSize];
+  return true;
+}
+
+
+/// \brief Construct empty pool
+///
+/// Handle 0 is reserved for the empty string and never released.
+StringPool::StringPool() {
+  Shard& shard = m_shards[0];
+  QMutexLocker lock(&shard.mutex);
+  insert(shard, 0, QByteArray());
+}
+
+
+StringPool::~StringPool() {}
+
+
+/// \brief Pool shared by all HostMask instances
+///
+/// Created on first use and valid until the process exits.
+StringPool* StringPool::instance() {
+  StringPool* pool = globalStringPool;
+  if (pool == NULL) {
+    StringPool* created = new StringPool();
+    if (!globalStringPool.testAndSetOrdered(NULL, created)) {
+      // another thread was faster
+      delete created;
+    }
+    pool = globalStringPool;
+  }
+
+  return pool;
+}
+
+
+/// \brief Entry for a handle
+inline StringPool::Entry& StringPool::entry(Handle h) const {
+  const quint32 slot = h >> ShardBits;
+  Entry** blocks = m_shards[h & (Shards - 1)].blocks;
+  return blocks[slot >> BlockBits][slot & (BlockSize - 1)];
+}
+
+
+/// \brief Shard a string is kept in
+inline StringPool::Shard& StringPool::shardFor(const QByteArray& utf8) {
+  return m_shards[qHash(utf8) & (Shards - 1)];
+}
+
+
+/// \brief Store a new string with a reference count of 1
+///
+/// Must be called with the shard's mutex held.
+///
+/// \param shard Shard to store the string in
+/// \param shardIndex Index of shard in m_shards
+///
+/// \return Handle of the string, or 0 (the empty string) if all
+/// handles of the shard are in use
+StringPool::Handle StringPool::insert(Shard& shard, int shardIndex,
+				      const QByteArray& utf8) {
+  quint32 slot;
+
+  if (!shard.free.isEmpty()) {
+    slot = shard.free.last();
+    shard.free.remove(shard.free.size() - 1);
+  } else {
+    if ((shard.used >> BlockBits) >= static_cast<quint32>(shard.blockCount)
+	&& !shard.addBlock()) {
+      qWarning() << "StringPool: Out of handles, not interning" << utf8;
+      return 0;
+    }
+    slot = shard.used++;
+  }
+
+  const Handle h = (slot << ShardBits) | Handle(shardIndex);
+
+  Entry& e = entry(h);
+  e.utf8 = utf8;
+  e.refs = 1;
+  e.live = true;
+  shard.index.insert(utf8, h);
+
+  return h;
+}
+
+
+/// \brief Get a handle for the given string
+///
+/// The returned handle holds a reference that must be given back with
+/// release(). If every handle is in use, the string isn't pooled and
+/// the handle of the empty string is returned.
+StringPool::Handle StringPool::intern(const QString& s) {
+  if (s.isEmpty())
+    return 0;
+
+  QByteArray utf8 = s.toUtf8();
+  Shard& shard = shardFor(utf8);
+  QMutexLocker lock(&shard.mutex);
+
+  // 0 (the empty string) is never looked up, so it means "not found"
+  Handle h = shard.index.value(utf8, 0);
+  if (h != 0) {
+    entry(h).refs.ref();
+    return h;
+  }
+
+  return insert(shard, &shard - m_shards, utf8);
+}
+
+
+/// \brief Get a handle for the given UTF-8 encoded string
+///
+/// Strings that are already pooled are found without decoding or
+/// copying the data.
+StringPool::Handle StringPool::intern(const char* data, int length) {
+  if (length <= 0)
+    return 0;
+
+  QByteArray key = QByteArray::fromRawData(data, length);
+  Shard& shard = shardFor(key);
+  QMutexLocker lock(&shard.mutex);
+
+  Handle h = shard.index.value(key, 0);
+  if (h != 0) {
+    entry(h).refs.ref();
+    return h;
+  }
+
+  return insert(shard, &shard - m_shards, QByteArray(data, length));
+}
+
+
+/// \brief Take another reference to a handle that is already held
+void StringPool::ref(Handle h) {
+  if (h != 0)
+    entry(h).refs.ref();
+}
+
+
+/// \brief Give back a reference
+///
+/// The string is removed from the pool when its last reference is
+/// released.
+void StringPool::release(Handle h) {
+  if (h == 0 || entry(h).refs.deref())
+    return;
+
+  Shard& shard = m_shards[h & (Shards - 1)];
+  QMutexLocker lock(&shard.mutex);
+
+  // the string may have been interned again (or already freed and
+  // reused) between the decrement and taking the lock
+  Entry& e = entry(h);
+  if (!e.live || e.refs != 0)
+    return;
+
+  shard.index.remove(e.utf8);
+  e.utf8 = QByteArray();
+  e.live = false;
+  shard.free.append(h >> ShardBits);
+}
+
+
+/// \brief String referred to by a handle, decoded from UTF-8
+QString StringPool::string(Handle h) const {
+  const QByteArray& utf8 = entry(h).utf8;
+  return QString::fromUtf8(utf8.constData(), utf8.size());
+}
+
+
+/// \brief UTF-8 encoding of the string referred to by a handle
+QByteArray StringPool::utf8(Handle h) const {
+  return entry(h).utf8;
+}
+
+
+/// \brief Number of references held to a handle
+int StringPool::refCount(Handle h) const {
+  return entry(h).refs;
+}
+
+
+/// \brief Number of distinct strings in the pool (without the empty one)
+int StringPool::size() const {
+  int size = 0;
+  for (int i = 0; i < Shards; ++i) {
+    QMutexLocker lock(&m_shards[i].mutex);
+    size += m_shards[i].index.size();
+  }
+
+  return size - 1;
+}
+
+
+/// \brief Construct empty string
+PooledString::PooledString() :
+  m_handle(0) {}
+
+
+/// \brief Construct from string, interning it
+PooledString::PooledString(const QString& s) :
+  m_handle(StringPool::instance()->intern(s)) {}
+
+
+/// \brief Construct from UTF-8 data, interning it
+PooledString::PooledString(const char* data, int length) :
+  m_handle(StringPool::instance()->intern(data, length)) {}
+
+
+/// \brief Copy constructor
+PooledString::PooledString(const PooledString& other) :
+  m_handle(other.m_handle) {
+  StringPool::instance()->ref(m_handle);
+}
+
+
+PooledString::~PooledString() {
+  StringPool::instance()->release(m_handle);
+}
+
+
+/// \brief Assignment operator
+PooledString& PooledString::operator =(const PooledString& other) {
+  if (m_handle != other.m_handle) {
+    StringPool* pool = StringPool::instance();
+    pool->ref(other.m_handle);
+    pool->release(m_handle);
+    m_handle = other.m_handle;
+  }
+
+  return *this;
+}
+
+
+/// \brief Handle into StringPool::instance()
+StringPool::Handle PooledString::handle() const {
+  return m_handle;
+}
+
+
+/// \brief Is this the empty string?
+bool PooledString::isEmpty() const {
+  return (m_handle == 0);
+}
+
+
+/// \brief Access the string
+QString PooledString::toString() const {
+  return StringPool::instance()->string(m_handle);
+}
+
+
+/// \brief Access the string's UTF-8 encoding
+QByteArray PooledString::toUtf8() const {
+  return StringPool::instance()->utf8(m_handle);
+}
+
+
+/// \brief Equality operator (compares handles)
+bool PooledString::operator ==(const PooledString& o) const {
+  return (m_handle == o.m_handle);
+}
+
+
+/// \brief Inequality operator (compares handles)
+bool PooledString::operator !=(const PooledString& o) const {
+  return (m_handle != o.m_handle);
+}
@@ -0,0 +1,159 @@
+/// \file
+/// \brief Declaration of StringPool and PooledString classes
+///
+/// \author png!das-system
+#ifndef STRINGPOOL_H
+#define STRINGPOOL_H 1
+
+#include <QAtomicInt>
+#include <QByteArray>
+#include <QAtomicPointer>
+#include <QHash>
+#include <QList>
+#include <QMutex>
+#include <QString>
+#include <QVector>
+
+#include "qirc.h"
+
+namespace QIRC {
+  /// \brief Process wide pool of interned strings
+  ///
+  /// Each distinct string is stored once and referred to by a small
+  /// integer handle, so equal strings have equal handles. Strings are
+  /// reference counted and removed from the pool when the last handle
+  /// referring to them is released. Handle 0 always refers to the empty
+  /// string.
+  ///
+  /// The pool is split into Shards shards by hash of the string, each
+  /// with its own lock, so threads interning different strings (e.g.
+  /// the workers of a ConnectionPool) rarely wait for each other. The
+  /// low bits of a handle select the shard. Interning and releasing the
+  /// last reference take the shard's lock; looking up and reference
+  /// counting a handle that is already held don't. Usually the pool is
+  /// used through PooledString rather than directly.
+  ///
+  /// Strings are only kept in UTF-8, the form they arrive in from the
+  /// server; string() decodes them.
+  class StringPool {
+  public:
+    /// \brief Reference to an interned string
+    typedef quint32 Handle;
+
+    StringPool();
+    ~StringPool();
+
+    static StringPool* instance();
+
+    Handle intern(const QString& s);
+    Handle intern(const char* data, int length);
+    void ref(Handle h);
+    void release(Handle h);
+
+    QString string(Handle h) const;
+    QByteArray utf8(Handle h) const;
+    int refCount(Handle h) const;
+
+    int size() const;
+
+  protected:
+    /// \brief Storage layout; blocks never move once allocated
+    enum {
+      ShardBits = 4,
+      Shards = 1 << ShardBits,
+      BlockBits = 10,
+      BlockSize = 1 << BlockBits,
+      InitialBlocks = 16,
+      MaxBlocks = (1 << (32 - ShardBits - BlockBits)) - 1
+    };
+
+    /// \brief One interned string
+    struct Entry {
+      /// \brief The string in UTF-8; Shard::index shares it as key
+      QByteArray utf8;
+
+      /// \brief Number of handles referring to this entry
+      QAtomicInt refs;
+
+      /// \brief Is the entry in use?
+      bool live;
+    };
+
+    /// \brief Part of the pool with its own lock
+    struct Shard {
+      Shard();
+      ~Shard();
+
+      bool addBlock();
+
+      /// \brief Block directory, BlockSize entries per block
+      ///
+      /// Grown by copying into a larger directory. Lock-free readers
+      /// may still use a replaced directory, so those are kept in
+      /// retired until the pool is destroyed.
+      QAtomicPointer<Entry*> blocks;
+
+      /// \brief Number of blocks the directory has room for
+      int blockCapacity;
+
+      /// \brief Number of allocated blocks
+      int blockCount;
+
+      /// \brief Directories replaced by growing blocks
+      QList<Entry**> retired;
+
+      /// \brief Number of entries ever used (live or free)
+      quint32 used;
+
+      /// \brief Released entries available for reuse (shard slots)
+      QVector<quint32> free;
+
+      /// \brief Lookup of live entries by UTF-8 encoding
+      QHash<QByteArray, Handle> index;
+
+      /// \brief Protects everything except the reference counts
+      mutable QMutex mutex;
+    };
+
+    Entry& entry(Handle h) const;
+    Shard& shardFor(const QByteArray& utf8);
+    Handle insert(Shard& shard, int shardIndex, const QByteArray& utf8);
+
+    /// \brief The shards
+    Shard m_shards[Shards];
+
+  private:
+    StringPool(const StringPool&);
+    StringPool& operator =(const StringPool&);
+  };
+
+
+  /// \brief Reference counted handle to a string in the StringPool
+  ///
+  /// Copies share the handle; comparing two PooledString instances
+  /// compares handles only.
+  class PooledString {
+  public:
+    PooledString();
+    PooledString(const QString& s);
+    PooledString(const char* data, int length);
+    PooledString(const PooledString& other);
+    ~PooledString();
+
+    PooledString& operator =(const PooledString& other);
+
+    StringPool::Handle handle() const;
+    bool isEmpty() const;
+    QString toString() const;
+    QByteArray toUtf8() const;
+
+    bool operator ==(const PooledString& o) const;
+    bool operator !=(const PooledString& o) const;
+
+  protected:
+    /// \brief Handle into StringPool::instance()
+    StringPool::Handle m_handle;
+  };
+};
+
+#endif // !STRINGPOOL_H
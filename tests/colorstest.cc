@@ -0,0 +1,372 @@
+/// \file
+/// \brief Regression tests for stripFormat() and friends
+///
+/// The strippers skip runs of text 16 bytes (or 8 QChars) at a time
+/// with SSE2. Their results are compared with a plain scalar
+/// implementation for every control code at every offset around the
+/// vector boundaries.
+///
+/// Exits with the number of failed checks.
+///
+/// \author png!das-system
+#include <cstdio>
+
+#include "qirc.h"
+
+using namespace QIRC;
+
+
+/// \brief Number of failed checks
+static int failures = 0;
+
+#define CHECK(cond) check((cond), #cond, __LINE__)
+
+
+/// \brief Report a failed check
+static void check(bool ok, const char* what, int line) {
+  if (!ok) {
+    std::fprintf(stderr, "colorstest.cc:%d: check failed: %s\n", line, what);
+    ++failures;
+  }
+}
+
+
+/// \brief Text as code units (bytes of UTF-8 or QChars)
+typedef QVector<uint> Units;
+
+
+/// \brief Parse up to maxDigits digits at i
+///
+/// \return Number of digits parsed
+static int digits(const Units& in, int i, bool hex, int maxDigits,
+		  int& value) {
+  int count = 0;
+  value = 0;
+
+  for (; i < in.size() && count < maxDigits; ++i, ++count) {
+    const uint c = in.at(i);
+    int v;
+    if (c >= '0' && c <= '9') {
+      v = c - '0';
+    } else if (hex && c >= 'a' && c <= 'f') {
+      v = c - 'a' + 10;
+    } else if (hex && c >= 'A' && c <= 'F') {
+      v = c - 'A' + 10;
+    } else {
+      break;
+    }
+    value = value * (hex ? 16 : 10) + v;
+  }
+
+  return count;
+}
+
+
+/// \brief Text attributes of a code that toggles one (0 for others)
+static int toggleFlag(uint c) {
+  switch (c) {
+  case 0x02: return FormatSpan::Bold;
+  case 0x11: return FormatSpan::Monospace;
+  case 0x16: return FormatSpan::Reverse;
+  case 0x1d: return FormatSpan::Italic;
+  case 0x1e: return FormatSpan::Strikethrough;
+  case 0x1f: return FormatSpan::Underline;
+  }
+
+  return 0;
+}
+
+
+/// \brief Scalar reference: strip codes one unit at a time
+///
+/// Records the format of every kept unit and derives the spans from
+/// runs of equal formats afterwards.
+static Units reference(const Units& in, bool colorsOnly,
+		       QVector<FormatSpan>* spans) {
+  Units out;
+  QVector<FormatSpan> formats;
+  FormatSpan f;
+  f.begin = 0;
+  f.length = 1;
+  f.flags = 0;
+  f.foreground = -1;
+  f.background = -1;
+
+  int i = 0;
+  while (i < in.size()) {
+    const uint c = in.at(i);
+    const bool color = (c == 0x03 || c == 0x04);
+
+    if (color) {
+      const bool hex = (c == 0x04);
+      const int width = hex ? 6 : 2;
+      const int minimum = hex ? 6 : 1;
+      int fg, bg;
+      int n = digits(in, i + 1, hex, width, fg);
+
+      if (n < minimum) {
+	f.foreground = -1;
+	f.background = -1;
+	i += 1;
+      } else {
+	f.foreground = hex ? (fg | FormatSpan::HexColor) : fg;
+	i += 1 + n;
+
+	if (i + 1 < in.size() && in.at(i) == ',') {
+	  n = digits(in, i + 1, hex, width, bg);
+	  if (n >= minimum) {
+	    f.background = hex ? (bg | FormatSpan::HexColor) : bg;
+	    i += 1 + n;
+	  }
+	}
+      }
+      continue;
+    }
+
+    if (!colorsOnly && c == 0x0f) {
+      f.flags = 0;
+      f.foreground = -1;
+      f.background = -1;
+      ++i;
+      continue;
+    }
+
+    if (!colorsOnly && toggleFlag(c) != 0) {
+      f.flags ^= toggleFlag(c);
+      ++i;
+      continue;
+    }
+
+    f.begin = out.size();
+    formats.append(f);
+    out.append(c);
+    ++i;
+  }
+
+  if (spans != NULL) {
+    spans->clear();
+    for (int j = 0; j < formats.size(); ++j) {
+      const FormatSpan& g = formats.at(j);
+      if (g.flags == 0 && g.foreground < 0 && g.background < 0)
+	continue;
+
+      if (!spans->isEmpty()) {
+	FormatSpan& last = (*spans)[spans->size() - 1];
+	if (last.begin + last.length == g.begin && last.flags == g.flags &&
+	    last.foreground == g.foreground &&
+	    last.background == g.background) {
+	  ++last.length;
+	  continue;
+	}
+      }
+      spans->append(g);
+    }
+  }
+
+  return out;
+}
+
+
+/// \brief Are two span lists the same?
+static bool sameSpans(const QVector<FormatSpan>& a,
+		      const QVector<FormatSpan>& b) {
+  if (a.size() != b.size())
+    return false;
+
+  for (int i = 0; i < a.size(); ++i) {
+    if (a.at(i).begin != b.at(i).begin || a.at(i).length != b.at(i).length ||
+	a.at(i).flags != b.at(i).flags ||
+	a.at(i).foreground != b.at(i).foreground ||
+	a.at(i).background != b.at(i).background)
+      return false;
+  }
+
+  return true;
+}
+
+
+/// \brief QString with the given QChars
+static QString toString(const Units& u) {
+  QString s;
+  for (int i = 0; i < u.size(); ++i) {
+    s.append(QChar(ushort(u.at(i))));
+  }
+  return s;
+}
+
+
+/// \brief QChars of a QString
+static Units fromString(const QString& s) {
+  Units u;
+  for (int i = 0; i < s.size(); ++i) {
+    u.append(s.at(i).unicode());
+  }
+  return u;
+}
+
+
+/// \brief Byte array with the given bytes
+static QByteArray toBytes(const Units& u) {
+  QByteArray b;
+  for (int i = 0; i < u.size(); ++i) {
+    b.append(char(u.at(i)));
+  }
+  return b;
+}
+
+
+/// \brief Bytes of a byte array
+static Units fromBytes(const QByteArray& b) {
+  Units u;
+  for (int i = 0; i < b.size(); ++i) {
+    u.append(uchar(b.at(i)));
+  }
+  return u;
+}
+
+
+/// \brief Ordinary text of the given length
+///
+/// Includes non-ASCII units, which must not be mistaken for codes by
+/// the unsigned vector compares.
+static Units filler(int length, bool wide) {
+  static const uint bytes[] = { 'a', 0xc3, 0xa9, ' ', '9', 0x7f, 0xff, 'Z' };
+  static const uint chars[] = { 'a', 0xe9, 0x4e2d, ' ', '9', 0x7f, 0xffff,
+				0x0120 };
+
+  Units u;
+  for (int i = 0; i < length; ++i) {
+    u.append(wide ? chars[i % 8] : bytes[i % 8]);
+  }
+  return u;
+}
+
+
+/// \brief Strip text with every function and compare with reference()
+///
+/// \return false if any result differs
+static bool compare(const Units& in) {
+  bool same = true;
+  QVector<FormatSpan> expectedSpans, spans;
+  const Units expected = reference(in, false, &expectedSpans);
+  const Units expectedColors = reference(in, true, NULL);
+
+  QString s = toString(in);
+  same &= (fromString(stripFormat(s)) == expected);
+  same &= (fromString(stripColors(s)) == expectedColors);
+
+  QString t = s;
+  stripFormatInPlace(t, &spans);
+  same &= (fromString(t) == expected);
+  same &= sameSpans(spans, expectedSpans);
+
+  t = s;
+  stripColorsInPlace(t);
+  same &= (fromString(t) == expectedColors);
+
+  return same;
+}
+
+
+/// \brief Like compare() for UTF-8 text
+static bool compareUtf8(const Units& in) {
+  bool same = true;
+  QVector<FormatSpan> expectedSpans, spans;
+  const Units expected = reference(in, false, &expectedSpans);
+  const Units expectedColors = reference(in, true, NULL);
+
+  QByteArray b = toBytes(in);
+  stripFormatInPlace(b, &spans);
+  same &= (fromBytes(b) == expected);
+  same &= sameSpans(spans, expectedSpans);
+
+  b = toBytes(in);
+  stripColorsInPlace(b);
+  same &= (fromBytes(b) == expectedColors);
+
+  return same;
+}
+
+
+/// \brief Control codes (with arguments) to place in the text
+static const char* const codes[] = {
+  "\x02", "\x03", "\x03" "5", "\x03" "12", "\x03" "123", "\x03" "5,3",
+  "\x03" "12,07", "\x03" "4,", "\x03" ",5", "\x03" "1,2,3",
+  "\x04" "ff8800", "\x04" "ff88", "\x0f", "\x11", "\x16", "\x1d", "\x1e",
+  "\x1f", "\x02\x02", "\x02\x1f\x0f", NULL
+};
+
+
+/// \brief Every code at every offset within the first 48 units
+///
+/// The code is followed by a unit of text, optionally more text and
+/// another code, so it lands before, on and after vector boundaries
+/// and in the scalar tail.
+static void testCodesAtOffsets() {
+  static const int tails[] = { 0, 1, 7, 15, 16, 17, 33 };
+
+  for (int wide = 0; wide < 2; ++wide) {
+    for (int c = 0; codes[c] != NULL; ++c) {
+      const Units code = fromBytes(QByteArray(codes[c]));
+
+      for (int offset = 0; offset < 48; ++offset) {
+	for (unsigned t = 0; t < sizeof(tails) / sizeof(tails[0]); ++t) {
+	  Units in = filler(offset, wide);
+	  in += code;
+	  if (tails[t] > 0) {
+	    in.append('x');
+	    in += filler(tails[t] - 1, wide);
+	    in += code;
+	    in += filler(tails[t], wide);
+	  }
+
+	  const bool same = wide ? compare(in) : compareUtf8(in);
+	  if (!same) {
+	    std::fprintf(stderr, "code %d at offset %d, tail %d (%s)\n", c,
+			 offset, tails[t], wide ? "QString" : "UTF-8");
+	  }
+	  CHECK(same);
+	}
+      }
+    }
+  }
+}
+
+
+/// \brief Known results, independent of reference()
+static void testExamples() {
+  QVector<FormatSpan> spans;
+
+  CHECK(stripFormat("\x02" "bold" "\x02" " plain") == "bold plain");
+  CHECK(stripColors("\x03" "4,12red" "\x03" " \x02" "b") == "red \x02" "b");
+  CHECK(stripFormat("\x03" "123") == "3");
+  CHECK(stripFormat("a\x03" "4,x") == "a,x");
+
+  QByteArray b("\x1d" "it" "\x0f" "x" "\x03" "3,5gc");
+  stripFormatInPlace(b, &spans);
+  CHECK(b == "itxgc");
+  CHECK(spans.size() == 2);
+  CHECK(spans.size() > 0 && spans.at(0).begin == 0 &&
+	spans.at(0).length == 2 && spans.at(0).flags == FormatSpan::Italic);
+  CHECK(spans.size() > 1 && spans.at(1).begin == 3 &&
+	spans.at(1).length == 2 && spans.at(1).foreground == 3 &&
+	spans.at(1).background == 5);
+
+  // text without codes is left alone
+  QString s("nothing to strip in this rather long line of text");
+  stripFormatInPlace(s, &spans);
+  CHECK(s == "nothing to strip in this rather long line of text");
+  CHECK(spans.isEmpty());
+}
+
+
+int main() {
+  testExamples();
+  testCodesAtOffsets();
+
+  if (failures > 0) {
+    std::fprintf(stderr, "%d check(s) failed\n", failures);
+  }
+
+  return failures;
+}
@@ -0,0 +1,251 @@
+/// \file
+/// \brief Regression tests for EventRing
+///
+/// Runs on a single thread: covers the index arithmetic and the
+/// notification protocol, not the memory ordering between threads.
+///
+/// Exits with the number of failed checks.
+///
+/// \author png!das-system
+#include <cstdio>
+
+#include "EventRing"
+
+using namespace QIRC;
+
+
+/// \brief Number of failed checks
+static int failures = 0;
+
+#define CHECK(cond) check((cond), #cond, __LINE__)
+
+
+/// \brief Report a failed check
+static void check(bool ok, const char* what, int line) {
+  if (!ok) {
+    std::fprintf(stderr, "eventringtest.cc:%d: check failed: %s\n", line,
+		 what);
+    ++failures;
+  }
+}
+
+
+/// \brief Ring whose read and write indices can be moved
+class TestRing : public EventRing {
+public:
+  TestRing(int capacity) :
+    EventRing(capacity) {}
+
+  /// \brief Move both indices of an empty ring
+  void setIndex(int index) {
+    m_head = index;
+    m_tail = index;
+  }
+};
+
+
+/// \brief Counts eventsAvailable() notifications
+class Counter : public QObject {
+  Q_OBJECT
+public:
+  Counter(EventRing* ring) :
+    count(0) {
+    QObject::connect(ring, SIGNAL(eventsAvailable()),
+		     this, SLOT(ring_eventsAvailable()));
+  }
+
+  /// \brief Number of notifications so far
+  int count;
+
+public slots:
+  void ring_eventsAvailable() {
+    ++count;
+  }
+};
+
+
+/// \brief Message with a sequence number as its only parameter
+static IrcMessage message(int i) {
+  return IrcMessage("PING " + QByteArray::number(i));
+}
+
+
+/// \brief Sequence number of a message()
+static int number(const IrcMessage& msg) {
+  return QByteArray(msg.paramData(0), msg.paramLength(0)).toInt();
+}
+
+
+/// \brief Capacities are rounded up to powers of two
+static void testCapacity() {
+  CHECK(EventRing(1).capacity() == 2);
+  CHECK(EventRing(4).capacity() == 4);
+  CHECK(EventRing(5).capacity() == 8);
+  CHECK(EventRing().capacity() == 4096);
+}
+
+
+/// \brief Messages come out in order while the slots wrap many times
+static void testFifo() {
+  EventRing ring(4);
+  int pushed = 0;
+  int popped = 0;
+  bool ordered = true;
+  IrcMessage msg;
+
+  for (int round = 0; round < 100; ++round) {
+    const int n = 1 + round % 4;
+    for (int i = 0; i < n; ++i) {
+      CHECK(ring.push(message(pushed++)));
+    }
+    CHECK(ring.size() == n);
+
+    while (ring.pop(msg)) {
+      ordered &= (number(msg) == popped++);
+    }
+    CHECK(ring.isEmpty());
+  }
+
+  CHECK(ordered);
+  CHECK(popped == pushed);
+  CHECK(ring.droppedEvents() == 0);
+}
+
+
+/// \brief A full ring rejects messages
+static void testFull() {
+  EventRing ring(4);
+  IrcMessage msg;
+
+  for (int i = 0; i < 4; ++i) {
+    CHECK(ring.push(message(i)));
+  }
+  CHECK(!ring.push(message(4)));
+  CHECK(!ring.push(message(5)));
+  CHECK(ring.size() == 4);
+  CHECK(ring.droppedEvents() == 2);
+
+  CHECK(ring.pop(msg) && number(msg) == 0);
+  CHECK(ring.push(message(6)));
+  CHECK(!ring.push(message(7)));
+
+  QVector<IrcMessage> out;
+  CHECK(ring.drain(out) == 4);
+  CHECK(out.size() == 4);
+  CHECK(number(out.at(0)) == 1 && number(out.at(3)) == 6);
+  CHECK(ring.droppedEvents() == 3);
+}
+
+
+/// \brief drain() takes at most max messages and appends them
+static void testDrain() {
+  EventRing ring(8);
+  QVector<IrcMessage> out;
+
+  CHECK(ring.drain(out) == 0);
+
+  for (int i = 0; i < 5; ++i) {
+    ring.push(message(i));
+  }
+  CHECK(ring.drain(out, 2) == 2);
+  CHECK(ring.size() == 3);
+  CHECK(ring.drain(out, 0) == 0);
+  CHECK(ring.drain(out) == 3);
+  CHECK(out.size() == 5);
+  for (int i = 0; i < out.size(); ++i) {
+    CHECK(number(out.at(i)) == i);
+  }
+  CHECK(ring.isEmpty());
+}
+
+
+/// \brief Indices overflowing the int range keep working
+static void testIndexOverflow() {
+  TestRing ring(4);
+  IrcMessage msg;
+
+  ring.setIndex(0x7ffffffe);
+  for (int i = 0; i < 4; ++i) {
+    CHECK(ring.push(message(i)));
+  }
+  CHECK(ring.size() == 4);
+  CHECK(!ring.push(message(4)));
+
+  CHECK(ring.pop(msg) && number(msg) == 0);
+  CHECK(ring.pop(msg) && number(msg) == 1);
+  CHECK(ring.size() == 2);
+  CHECK(ring.push(message(5)));
+
+  QVector<IrcMessage> out;
+  CHECK(ring.drain(out) == 3);
+  CHECK(out.size() == 3 && number(out.at(0)) == 2 &&
+	number(out.at(2)) == 5);
+
+  // and past the uint range as well
+  ring.setIndex(-2);
+  for (int i = 0; i < 3; ++i) {
+    CHECK(ring.push(message(i)));
+  }
+  CHECK(ring.size() == 3);
+  for (int i = 0; i < 3; ++i) {
+    CHECK(ring.pop(msg) && number(msg) == i);
+  }
+  CHECK(ring.isEmpty());
+}
+
+
+/// \brief One notification per transition from empty, none while busy
+static void testNotification() {
+  EventRing ring(8);
+  Counter counter(&ring);
+  IrcMessage msg;
+  QVector<IrcMessage> out;
+
+  ring.push(message(0));
+  CHECK(counter.count == 1);
+  ring.push(message(1));
+  CHECK(counter.count == 1);
+
+  // the consumer only waits once it found the ring empty
+  CHECK(ring.pop(msg));
+  CHECK(ring.pop(msg));
+  CHECK(counter.count == 1);
+  CHECK(!ring.pop(msg));
+  ring.push(message(2));
+  CHECK(counter.count == 2);
+
+  // stopping at max doesn't wait either
+  CHECK(ring.drain(out, 1) == 1);
+  ring.push(message(3));
+  CHECK(counter.count == 2);
+
+  CHECK(ring.drain(out) == 1);
+  ring.push(message(4));
+  CHECK(counter.count == 3);
+
+  // a rejected message doesn't notify
+  CHECK(ring.drain(out) == 1);
+  for (int i = 0; i < 9; ++i) {
+    ring.push(message(i));
+  }
+  CHECK(counter.count == 4);
+  CHECK(ring.droppedEvents() == 1);
+}
+
+
+int main() {
+  testCapacity();
+  testFifo();
+  testFull();
+  testDrain();
+  testIndexOverflow();
+  testNotification();
+
+  if (failures > 0) {
+    std::fprintf(stderr, "%d check(s) failed\n", failures);
+  }
+
+  return failures;
+}
+
+#include "eventringtest.moc"
@@ -0,0 +1,87 @@
+/// \file
+/// \brief Regression tests for QIRCCore::Framer
+///
+/// Exits with the number of failed checks.
+///
+/// \author png!das-system
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "core/framer.h"
+
+using namespace QIRCCore;
+
+
+/// \brief Number of failed checks
+static int failures = 0;
+
+#define CHECK(cond) check((cond), #cond, __LINE__)
+
+
+/// \brief Report a failed check
+static void check(bool ok, const char* what, int line) {
+  if (!ok) {
+    std::fprintf(stderr, "framertest.cc:%d: check failed: %s\n", line, what);
+    ++failures;
+  }
+}
+
+
+/// \brief Collects the lines reported by the framer
+static void collect(void* context, const char* line, int length) {
+  static_cast<std::vector<std::string>*>(context)->push_back(
+    std::string(line, length));
+}
+
+
+/// \brief A line of exactly the limit split between CR and LF is kept
+static void testSplitTerminatorAtLimit() {
+  Framer framer;
+  std::vector<std::string> lines;
+
+  const int limit = Framer::DefaultMaxLineLength - 2;
+  const std::string line(limit, 'x');
+  const std::string first = line + "\r";
+  const std::string second = "\n:next PRIVMSG #c :hi\r\n";
+
+  CHECK(framer.feed(first.data(), first.size(), collect, &lines) == 0);
+  CHECK(!framer.isDiscarding());
+  CHECK(framer.feed(second.data(), second.size(), collect, &lines) == 2);
+
+  CHECK(lines.size() == 2);
+  CHECK(lines.size() > 0 && lines[0] == line);
+  CHECK(lines.size() > 1 && lines[1] == ":next PRIVMSG #c :hi");
+  CHECK(framer.discardedLines() == 0);
+}
+
+
+/// \brief A line one byte over the limit is still discarded when split
+static void testSplitTerminatorOverLimit() {
+  Framer framer;
+  std::vector<std::string> lines;
+
+  const int limit = Framer::DefaultMaxLineLength - 2;
+  const std::string first = std::string(limit + 1, 'x') + "\r";
+  const std::string second = "\n:next PRIVMSG #c :hi\r\n";
+
+  CHECK(framer.feed(first.data(), first.size(), collect, &lines) == 0);
+  CHECK(framer.isDiscarding());
+  CHECK(framer.feed(second.data(), second.size(), collect, &lines) == 1);
+
+  CHECK(lines.size() == 1);
+  CHECK(lines.size() > 0 && lines[0] == ":next PRIVMSG #c :hi");
+  CHECK(framer.discardedLines() == 1);
+}
+
+
+int main() {
+  testSplitTerminatorAtLimit();
+  testSplitTerminatorOverLimit();
+
+  if (failures > 0) {
+    std::fprintf(stderr, "%d check(s) failed\n", failures);
+  }
+
+  return failures;
+}
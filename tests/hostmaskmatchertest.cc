@@ -0,0 +1,247 @@
+/// \file
+/// \brief Regression tests for HostMaskMatcher
+///
+/// Exits with the number of failed checks.
+///
+/// \author png!das-system
+#include <cstdio>
+
+#include "HostMaskMatcher"
+
+using namespace QIRC;
+
+
+/// \brief Number of failed checks
+static int failures = 0;
+
+#define CHECK(cond) check((cond), #cond, __LINE__)
+
+
+/// \brief Report a failed check
+static void check(bool ok, const char* what, int line) {
+  if (!ok) {
+    std::fprintf(stderr, "hostmaskmatchertest.cc:%d: check failed: %s\n",
+		 line, what);
+    ++failures;
+  }
+}
+
+
+/// \brief Matcher with access to the automaton cache
+class TestMatcher : public HostMaskMatcher {
+public:
+  TestMatcher(CaseMapping mapping=Rfc1459CaseMapping) :
+    HostMaskMatcher(mapping) {}
+
+  /// \brief Number of cached automaton states
+  int cachedStates() const {
+    return m_states.size();
+  }
+
+  /// \brief Upper limit for cachedStates()
+  static int maxCachedStates() {
+    return MaxCachedStates;
+  }
+};
+
+
+/// \brief Does the mask with the given id match nick!user\@host?
+static bool matches(const HostMaskMatcher& m, int id, const char* nick,
+		    const char* user, const char* host) {
+  return m.matches(HostMask(QString::fromUtf8(nick), QString::fromUtf8(user),
+			    QString::fromUtf8(host))).contains(id);
+}
+
+
+/// \brief '*' matches any run of characters, '?' exactly one
+static void testWildcards() {
+  HostMaskMatcher m;
+
+  const int domain = m.add("*!*@*.example.com");
+  const int nick = m.add("n?ck!*@*");
+  const int user = m.add("*!~user@host");
+  const int any = m.add("*");
+
+  CHECK(matches(m, domain, "a", "b", "irc.example.com"));
+  CHECK(matches(m, domain, "a", "b", "x.y.example.com"));
+  CHECK(!matches(m, domain, "a", "b", "example.com"));
+  CHECK(!matches(m, domain, "a", "b", "irc.example.org"));
+
+  CHECK(matches(m, nick, "nick", "u", "h"));
+  CHECK(matches(m, nick, "neck", "u", "h"));
+  CHECK(!matches(m, nick, "nck", "u", "h"));
+  CHECK(!matches(m, nick, "niick", "u", "h"));
+
+  CHECK(matches(m, user, "x", "~user", "host"));
+  CHECK(!matches(m, user, "x", "user", "host"));
+  CHECK(!matches(m, user, "x", "~user", "host2"));
+
+  // a bare "*" is normalized to "*!*@*"
+  CHECK(m.mask(any) == "*!*@*");
+  CHECK(matches(m, any, "a", "b", "c"));
+
+  HostMask hm("nick", "~user", "host");
+  QVector<int> ids = m.matches(hm);
+  CHECK(ids.size() == 3);
+  CHECK(ids.contains(nick) && ids.contains(user) && ids.contains(any));
+  CHECK(m.matchesAny(hm));
+}
+
+
+/// \brief '?' matches a whole UTF-8 character, not a single byte
+static void testWildcardUtf8() {
+  HostMaskMatcher m;
+
+  const int nick = m.add("n?ck!*@*");
+  const int twice = m.add("n??ck!*@*");
+  const int host = m.add("*!*@h?st");
+
+  // 2, 3 and 4 byte characters
+  CHECK(matches(m, nick, "n\xc3\xbc" "ck", "u", "h"));
+  CHECK(matches(m, nick, "n\xe2\x82\xac" "ck", "u", "h"));
+  CHECK(matches(m, nick, "n\xf0\x9f\x98\x80" "ck", "u", "h"));
+  CHECK(!matches(m, twice, "n\xc3\xbc" "ck", "u", "h"));
+  CHECK(matches(m, twice, "n\xc3\xbc" "\xc3\xbc" "ck", "u", "h"));
+  CHECK(matches(m, twice, "nu\xc3\xbc" "ck", "u", "h"));
+
+  CHECK(matches(m, host, "a", "b", "h\xc3\xb6st"));
+  CHECK(!matches(m, host, "a", "b", "h\xc3\xb6\xc3\xb6st"));
+}
+
+
+/// \brief Comparisons follow the case mapping
+static void testCaseMapping() {
+  HostMaskMatcher m(Rfc1459CaseMapping);
+
+  const int id = m.add("[Foo]^!*@*");
+
+  CHECK(matches(m, id, "{foo}~", "u", "h"));
+  CHECK(matches(m, id, "[FOO]^", "u", "h"));
+  CHECK(m.find("{FOO}~") == id);
+
+  m.setCaseMapping(AsciiCaseMapping);
+  CHECK(m.caseMapping() == AsciiCaseMapping);
+  CHECK(m.mask(id) == "[Foo]^!*@*");
+  CHECK(matches(m, id, "[foo]^", "u", "h"));
+  CHECK(!matches(m, id, "{foo}~", "u", "h"));
+  CHECK(m.find("{FOO}~") == -1);
+}
+
+
+/// \brief Adding an existing mask returns its id, removing frees it
+static void testAddRemove() {
+  HostMaskMatcher m;
+
+  const int a = m.add("nick");
+  const int b = m.add("*!*@host");
+  CHECK(a != b);
+  CHECK(m.add("NICK!*@*") == a);
+  CHECK(m.size() == 2);
+  CHECK(m.find("nick!*@*") == a);
+
+  CHECK(m.remove(a));
+  CHECK(!m.remove(a));
+  CHECK(!m.remove(12345));
+  CHECK(m.size() == 1);
+  CHECK(m.find("nick") == -1);
+  CHECK(!matches(m, a, "nick", "u", "x"));
+  CHECK(matches(m, b, "nick", "u", "host"));
+
+  // masks sharing a prefix keep their nodes when one is removed
+  const int c = m.add("*!*@hostname");
+  CHECK(m.remove("*!*@HOST"));
+  CHECK(matches(m, c, "n", "u", "hostname"));
+  CHECK(!matches(m, c, "n", "u", "host"));
+  CHECK(m.matches(HostMask("n", "u", "host")).isEmpty());
+
+  CHECK(m.remove(c));
+  CHECK(m.size() == 0);
+  CHECK(m.masks().isEmpty());
+
+  // freed ids and nodes are reused
+  const int d = m.add("*!*@other");
+  CHECK(d == a || d == b || d == c);
+  CHECK(matches(m, d, "n", "u", "other"));
+  CHECK(m.masks() == QStringList("*!*@other"));
+
+  m.clear();
+  CHECK(m.size() == 0);
+  CHECK(!m.matchesAny(HostMask("n", "u", "other")));
+}
+
+
+/// \brief Masks folding to the same pattern after setCaseMapping()
+static void testDuplicates() {
+  HostMaskMatcher m(AsciiCaseMapping);
+
+  const int a = m.add("[a]!*@*");
+  const int b = m.add("{a}!*@*");
+  CHECK(a != b);
+
+  m.setCaseMapping(Rfc1459CaseMapping);
+  CHECK(m.size() == 2);
+  CHECK(m.matches(HostMask("[A]", "u", "h")).size() == 2);
+
+  const int first = m.find("[a]");
+  CHECK(first == a || first == b);
+  const int second = (first == a) ? b : a;
+
+  // the other one is still found after one of them is removed
+  CHECK(m.remove(first));
+  CHECK(m.find("[a]") == second);
+  CHECK(m.add("{A}") == second);
+  CHECK(m.size() == 1);
+  CHECK(matches(m, second, "{a}", "u", "h"));
+
+  CHECK(m.remove(second));
+  CHECK(m.find("[a]") == -1);
+  CHECK(!m.matchesAny(HostMask("[a]", "u", "h")));
+}
+
+
+/// \brief Results stay right when the state cache is discarded
+static void testCacheEviction() {
+  TestMatcher m;
+  const int count = 3000;
+
+  QVector<int> ids;
+  for (int i = 0; i < count; ++i) {
+    ids.append(m.add(QString("*!*@host%1.example").arg(i)));
+  }
+
+  // every host walks through states of its own
+  bool right = true;
+  bool bounded = true;
+  for (int round = 0; round < 2; ++round) {
+    for (int i = 0; i < count; ++i) {
+      const QString host = QString("host%1.example").arg(i);
+      const QVector<int> r = m.matches(HostMask("n", "u", host));
+      if (r.size() != 1 || r.at(0) != ids.at(i)) {
+	right = false;
+      }
+      if (m.cachedStates() > TestMatcher::maxCachedStates()) {
+	bounded = false;
+      }
+    }
+  }
+
+  CHECK(right);
+  CHECK(bounded);
+  CHECK(m.matches(HostMask("n", "u", "host.example")).isEmpty());
+}
+
+
+int main() {
+  testWildcards();
+  testWildcardUtf8();
+  testCaseMapping();
+  testAddRemove();
+  testDuplicates();
+  testCacheEviction();
+
+  if (failures > 0) {
+    std::fprintf(stderr, "%d check(s) failed\n", failures);
+  }
+
+  return failures;
+}
@@ -0,0 +1,245 @@
+/// \file
+/// \brief Regression tests for ChannelStateTracker::MemberTable
+///
+/// Exits with the number of failed checks.
+///
+/// \author png!das-system
+#include <cstdio>
+
+#include "ChannelStateTracker"
+
+using namespace QIRC;
+
+
+/// \brief Number of failed checks
+static int failures = 0;
+
+#define CHECK(cond) check((cond), #cond, __LINE__)
+
+
+/// \brief Report a failed check
+static void check(bool ok, const char* what, int line) {
+  if (!ok) {
+    std::fprintf(stderr, "membertabletest.cc:%d: check failed: %s\n", line,
+		 what);
+    ++failures;
+  }
+}
+
+
+/// \brief Tracker giving access to its member table class
+class TestTracker : public ChannelStateTracker {
+public:
+  typedef MemberTable Table;
+};
+
+
+/// \brief Member table with access to its slots
+class TestTable : public TestTracker::Table {
+public:
+  /// \brief Preferred slot for a user id at the current capacity
+  int homeOf(int id) const {
+    return home(id);
+  }
+
+  /// \brief Does the table hold exactly size() reachable entries?
+  ///
+  /// Every entry must be found by probing from its home slot, i.e. no
+  /// empty slot may lie between the two.
+  bool consistent() const {
+    int used = 0;
+    for (int i = 0; i < m_slots.size(); ++i) {
+      if (m_slots.at(i) == 0)
+	continue;
+      ++used;
+
+      const int id = slotId(m_slots.at(i));
+      if (find(id) != i)
+	return false;
+      for (int j = home(id); j != i; j = (j + 1) & (m_slots.size() - 1)) {
+	if (m_slots.at(j) == 0)
+	  return false;
+      }
+    }
+
+    // stay below 3/4 load
+    return (used == m_size && m_size * 4 <= m_slots.size() * 3);
+  }
+};
+
+
+/// \brief Insert, update, look up and remove single members
+static void testBasics() {
+  TestTable t;
+
+  CHECK(t.size() == 0);
+  CHECK(t.capacity() == 0);
+  CHECK(!t.contains(0));
+  CHECK(t.modes(0) == 0);
+  CHECK(!t.remove(0));
+
+  t.insert(0, 0x01);
+  CHECK(t.size() == 1);
+  CHECK(t.capacity() == 8);
+  CHECK(t.contains(0));
+  CHECK(t.modes(0) == 0x01);
+
+  // inserting again only updates the modes
+  t.insert(0, 0x82);
+  CHECK(t.size() == 1);
+  CHECK(t.modes(0) == 0x82);
+
+  // the largest id that fits into a slot
+  const int maxId = (1 << 24) - 2;
+  t.insert(maxId, 0xff);
+  CHECK(t.contains(maxId));
+  CHECK(t.modes(maxId) == 0xff);
+  CHECK(t.modes(0) == 0x82);
+
+  const quint32 s = (quint32(maxId + 1) << 8) | 0xff;
+  CHECK(TestTable::slotId(s) == maxId);
+  CHECK(TestTable::slotModes(s) == 0xff);
+
+  CHECK(t.remove(0));
+  CHECK(!t.remove(0));
+  CHECK(!t.contains(0));
+  CHECK(t.size() == 1);
+  CHECK(t.consistent());
+
+  t.clear();
+  CHECK(t.size() == 0);
+  CHECK(!t.contains(maxId));
+}
+
+
+/// \brief Removing from a cluster that wraps around the table end
+///
+/// Backward shift deletion must move the later entries of the cluster
+/// into the hole, but leave entries alone whose home slot lies between
+/// the hole and their own slot.
+static void testWrappingCluster() {
+  TestTable t;
+
+  // removing doesn't shrink a table of 8 slots
+  t.insert(0, 0);
+  t.remove(0);
+  const int last = t.capacity() - 1;
+
+  // three ids homed at the last slot, one homed at slot 0
+  int ids[3];
+  int found = 0;
+  int zero = -1;
+  for (int id = 0; id < 1000 && (found < 3 || zero < 0); ++id) {
+    if (t.homeOf(id) == last && found < 3)
+      ids[found++] = id;
+    else if (t.homeOf(id) == 0 && zero < 0)
+      zero = id;
+  }
+  CHECK(found == 3 && zero >= 0);
+  if (found < 3 || zero < 0)
+    return;
+
+  t.insert(ids[0], 1);
+  t.insert(ids[1], 2);
+  t.insert(zero, 3);
+  t.insert(ids[2], 4);
+  CHECK(t.capacity() == 8);
+  CHECK(t.consistent());
+
+  CHECK(t.remove(ids[0]));
+  CHECK(t.consistent());
+  CHECK(t.modes(ids[1]) == 2);
+  CHECK(t.modes(ids[2]) == 4);
+  CHECK(t.modes(zero) == 3);
+
+  CHECK(t.remove(zero));
+  CHECK(t.consistent());
+  CHECK(t.modes(ids[1]) == 2);
+  CHECK(t.modes(ids[2]) == 4);
+
+  CHECK(t.remove(ids[1]));
+  CHECK(t.remove(ids[2]));
+  CHECK(t.consistent());
+  CHECK(t.size() == 0);
+}
+
+
+/// \brief Random inserts and removals against a plain array
+///
+/// Grows the table well beyond its initial capacity and empties it
+/// again, so both rehash directions are covered.
+static void testRandom() {
+  static const int ids = 300;
+  int model[ids];
+  int modelSize = 0;
+  for (int i = 0; i < ids; ++i) {
+    model[i] = -1;
+  }
+
+  TestTable t;
+  quint32 seed = 12345;
+  int maxCapacity = 0;
+  bool same = true;
+  bool consistent = true;
+
+  for (int round = 0; round < 40000 && same && consistent; ++round) {
+    seed = seed * 1103515245u + 12345u;
+    const int id = (seed >> 8) % ids;
+    const int modes = (seed >> 20) & 0xff;
+
+    // fill during the first half, drain during the second
+    const bool filling = (round < 20000);
+    const bool insert = ((seed >> 28) % 4 != 0) == filling;
+
+    if (insert) {
+      if (model[id] < 0)
+	++modelSize;
+      model[id] = modes;
+      t.insert(id, quint8(modes));
+    } else {
+      const bool removed = t.remove(id);
+      same &= (removed == (model[id] >= 0));
+      if (model[id] >= 0)
+	--modelSize;
+      model[id] = -1;
+    }
+
+    same &= (t.size() == modelSize);
+    same &= (t.contains(id) == (model[id] >= 0));
+    same &= (t.modes(id) == (model[id] < 0 ? 0 : model[id]));
+    consistent &= t.consistent();
+
+    if (t.capacity() > maxCapacity)
+      maxCapacity = t.capacity();
+  }
+
+  for (int id = 0; id < ids; ++id) {
+    same &= (t.contains(id) == (model[id] >= 0));
+  }
+
+  CHECK(same);
+  CHECK(consistent);
+  CHECK(maxCapacity >= 256);
+  CHECK(t.size() == modelSize);
+
+  // removing the rest shrinks the table again
+  for (int id = 0; id < ids; ++id) {
+    t.remove(id);
+  }
+  CHECK(t.size() == 0);
+  CHECK(t.capacity() <= 32);
+  CHECK(t.consistent());
+}
+
+
+int main() {
+  testBasics();
+  testWrappingCluster();
+  testRandom();
+
+  if (failures > 0) {
+    std::fprintf(stderr, "%d check(s) failed\n", failures);
+  }
+
+  return failures;
+}
@@ -0,0 +1,265 @@
+/// \file
+/// \brief Regression tests for MessageQueue
+///
+/// Exits with the number of failed checks.
+///
+/// \author png!das-system
+#include <cstdio>
+
+#include "MessageQueue"
+
+using namespace QIRC;
+
+
+/// \brief Number of failed checks
+static int failures = 0;
+
+#define CHECK(cond) check((cond), #cond, __LINE__)
+
+
+/// \brief Report a failed check
+static void check(bool ok, const char* what, int line) {
+  if (!ok) {
+    std::fprintf(stderr, "messagequeuetest.cc:%d: check failed: %s\n", line,
+		 what);
+    ++failures;
+  }
+}
+
+
+/// \brief Remove all messages and return them in the order they are sent
+static QList<QByteArray> drain(MessageQueue& q) {
+  QList<QByteArray> sent;
+  while (!q.isEmpty()) {
+    sent.append(q.takeHead());
+  }
+  return sent;
+}
+
+
+/// \brief List of the given lines
+static QList<QByteArray> lines(const char* a, const char* b=NULL,
+			       const char* c=NULL, const char* d=NULL,
+			       const char* e=NULL) {
+  const char* all[] = { a, b, c, d, e };
+  QList<QByteArray> l;
+  for (int i = 0; i < 5 && all[i] != NULL; ++i) {
+    l.append(QByteArray(all[i]));
+  }
+  return l;
+}
+
+
+/// \brief Lane and target chosen for a line
+static void testLaneFor() {
+  QByteArray target;
+
+  CHECK(MessageQueue::laneFor("PRIVMSG #c :hi\r\n", &target) ==
+	MessageQueue::BulkLane);
+  CHECK(target == "#c");
+  CHECK(MessageQueue::laneFor("NOTICE  nick :hi\r\n", &target) ==
+	MessageQueue::BulkLane);
+  CHECK(target == "nick");
+
+  CHECK(MessageQueue::laneFor("PONG :srv\r\n") == MessageQueue::ControlLane);
+  CHECK(MessageQueue::laneFor("NICK x\r\n") == MessageQueue::ControlLane);
+  CHECK(MessageQueue::laneFor("QUIT\r\n") == MessageQueue::ControlLane);
+  CHECK(MessageQueue::laneFor("JOIN #c\r\n") ==
+	MessageQueue::InteractiveLane);
+
+  // prefixes of other commands are not mistaken for them
+  CHECK(MessageQueue::laneFor("PRIVMSGX #c :hi\r\n") ==
+	MessageQueue::InteractiveLane);
+  CHECK(MessageQueue::laneFor("PONGS\r\n") == MessageQueue::InteractiveLane);
+}
+
+
+/// \brief Control before interactive before bulk
+static void testLanes() {
+  MessageQueue q;
+
+  q.enqueue("PRIVMSG #a :x\r\n");
+  q.enqueue("MODE #a +i\r\n");
+  q.enqueue("PONG :srv\r\n");
+  CHECK(q.size() == 3);
+  CHECK(q.size(MessageQueue::ControlLane) == 1);
+  CHECK(q.size(MessageQueue::InteractiveLane) == 1);
+  CHECK(q.size(MessageQueue::BulkLane) == 1);
+  CHECK(q.head() == "PONG :srv\r\n");
+
+  CHECK(drain(q) == lines("PONG :srv\r\n", "MODE #a +i\r\n",
+			  "PRIVMSG #a :x\r\n"));
+}
+
+
+/// \brief Bulk targets are served round-robin, new ones last
+static void testRoundRobin() {
+  MessageQueue q;
+
+  q.enqueue("PRIVMSG #a :1\r\n");
+  q.enqueue("PRIVMSG #a :2\r\n");
+  q.enqueue("PRIVMSG #b :1\r\n");
+  CHECK(drain(q) == lines("PRIVMSG #a :1\r\n", "PRIVMSG #b :1\r\n",
+			  "PRIVMSG #a :2\r\n"));
+
+  q.enqueue("PRIVMSG #a :1\r\n");
+  q.enqueue("PRIVMSG #a :2\r\n");
+  q.enqueue("PRIVMSG #b :1\r\n");
+  q.enqueue("PRIVMSG #b :2\r\n");
+  q.enqueue("PRIVMSG #c :1\r\n");
+  CHECK(drain(q) == lines("PRIVMSG #a :1\r\n", "PRIVMSG #b :1\r\n",
+			  "PRIVMSG #c :1\r\n", "PRIVMSG #a :2\r\n",
+			  "PRIVMSG #b :2\r\n"));
+}
+
+
+/// \brief Full lanes drop their oldest message or reject new ones
+static void testDepth() {
+  MessageQueue q;
+
+  q.setMaxDepth(MessageQueue::ControlLane, 1);
+  CHECK(q.enqueue("PONG :a\r\n"));
+  CHECK(q.enqueue("PONG :b\r\n"));
+  CHECK(q.size() == 1);
+  CHECK(q.head() == "PONG :b\r\n");
+  CHECK(q.droppedMessages() == 1);
+
+  q.setMaxDepth(MessageQueue::InteractiveLane, 2);
+  q.setOverflowPolicy(MessageQueue::InteractiveLane, MessageQueue::Reject);
+  CHECK(q.enqueue("MODE #a +i\r\n"));
+  CHECK(q.enqueue("MODE #b +i\r\n"));
+  CHECK(!q.enqueue("MODE #c +i\r\n"));
+  CHECK(q.size(MessageQueue::InteractiveLane) == 2);
+  CHECK(q.droppedMessages() == 2);
+  q.clear();
+  CHECK(q.isEmpty());
+
+  // the busiest bulk target loses its oldest message
+  q.setMaxDepth(MessageQueue::BulkLane, 3);
+  q.enqueue("PRIVMSG #a :1\r\n");
+  q.enqueue("PRIVMSG #a :2\r\n");
+  q.enqueue("PRIVMSG #b :1\r\n");
+  q.enqueue("PRIVMSG #c :1\r\n");
+  CHECK(q.size(MessageQueue::BulkLane) == 3);
+  CHECK(q.droppedMessages() == 3);
+  CHECK(drain(q) == lines("PRIVMSG #a :2\r\n", "PRIVMSG #b :1\r\n",
+			  "PRIVMSG #c :1\r\n"));
+}
+
+
+/// \brief JOIN, PART and NAMES are merged behind each other
+static void testMergeLists() {
+  MessageQueue q;
+
+  q.enqueue("JOIN #a\r\n", 5);
+  q.enqueue("JOIN #b\r\n", 9);
+  CHECK(q.size() == 1);
+  CHECK(q.mergedMessages() == 1);
+
+  // the merged message keeps the older time
+  qint64 t = 0;
+  CHECK(q.takeHead(&t) == "JOIN #a,#b\r\n");
+  CHECK(t == 5);
+
+  q.enqueue("JOIN #a k1\r\n");
+  q.enqueue("JOIN #b k2\r\n");
+  q.enqueue("JOIN #c\r\n");
+  CHECK(drain(q) == lines("JOIN #a,#b,#c k1,k2\r\n"));
+
+  // keys would end up on the wrong channels
+  q.enqueue("JOIN #a\r\n");
+  q.enqueue("JOIN #b k2\r\n");
+  CHECK(drain(q) == lines("JOIN #a\r\n", "JOIN #b k2\r\n"));
+
+  q.enqueue("PART #a :bye\r\n");
+  q.enqueue("PART #b :bye\r\n");
+  q.enqueue("PART #c :later\r\n");
+  CHECK(drain(q) == lines("PART #a,#b :bye\r\n", "PART #c :later\r\n"));
+
+  // NAMES defaults to a single target
+  q.enqueue("NAMES #a\r\n");
+  q.enqueue("NAMES #b\r\n");
+  CHECK(q.size() == 2);
+  q.clear();
+
+  // only the last message is considered
+  q.enqueue("JOIN #a\r\n");
+  q.enqueue("MODE #a +i\r\n");
+  q.enqueue("JOIN #b\r\n");
+  CHECK(q.size() == 3);
+  q.clear();
+
+  q.setMaxLineLength(11);
+  q.enqueue("JOIN #a\r\n");
+  q.enqueue("JOIN #b\r\n");
+  CHECK(q.size() == 2);
+  q.clear();
+
+  q.setMaxLineLength(512);
+  q.setMaxTargets("JOIN", 2);
+  q.enqueue("JOIN #a\r\n");
+  q.enqueue("JOIN #b\r\n");
+  q.enqueue("JOIN #c\r\n");
+  CHECK(drain(q) == lines("JOIN #a,#b\r\n", "JOIN #c\r\n"));
+
+  q.setCoalescing(false);
+  q.enqueue("PART #a\r\n");
+  q.enqueue("PART #b\r\n");
+  CHECK(q.size() == 2);
+}
+
+
+/// \brief PRIVMSGs with the same text are sent to several targets
+static void testMergeTargets() {
+  MessageQueue q;
+
+  // PRIVMSG defaults to a single target
+  q.enqueue("PRIVMSG #a :hi\r\n");
+  q.enqueue("PRIVMSG #b :hi\r\n");
+  CHECK(q.size() == 2);
+  q.clear();
+
+  q.setMaxTargets("PRIVMSG", 4);
+  q.enqueue("PRIVMSG #a :hi\r\n");
+  q.enqueue("PRIVMSG #b :hi\r\n");
+  q.enqueue("PRIVMSG #a :hi\r\n");
+  CHECK(q.mergedMessages() == 1);
+
+  // later messages to a merged target wait behind the merged one
+  q.enqueue("PRIVMSG #b :more\r\n");
+  q.enqueue("PRIVMSG #c :x\r\n");
+  CHECK(drain(q) == lines("PRIVMSG #a,#b :hi\r\n", "PRIVMSG #c :x\r\n",
+			  "PRIVMSG #a :hi\r\n", "PRIVMSG #b :more\r\n"));
+
+  // a drained target can be merged again
+  q.enqueue("PRIVMSG #c :hi\r\n");
+  q.enqueue("PRIVMSG #b :hi\r\n");
+  CHECK(drain(q) == lines("PRIVMSG #c,#b :hi\r\n"));
+
+  // a target with a backlog doesn't delay the new one
+  q.enqueue("PRIVMSG #a :x\r\n");
+  q.enqueue("PRIVMSG #a :hi\r\n");
+  q.enqueue("PRIVMSG #b :hi\r\n");
+  CHECK(drain(q) == lines("PRIVMSG #a :x\r\n", "PRIVMSG #b :hi\r\n",
+			  "PRIVMSG #a :hi\r\n"));
+
+  q.enqueue("NOTICE #a :hi\r\n");
+  q.enqueue("PRIVMSG #b :hi\r\n");
+  CHECK(q.size() == 2);
+}
+
+
+int main() {
+  testLaneFor();
+  testLanes();
+  testRoundRobin();
+  testDepth();
+  testMergeLists();
+  testMergeTargets();
+
+  if (failures > 0) {
+    std::fprintf(stderr, "%d check(s) failed\n", failures);
+  }
+
+  return failures;
+}
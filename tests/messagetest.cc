@@ -0,0 +1,233 @@
+/// \file
+/// \brief Regression tests for QIRCCore::Message
+///
+/// Exits with the number of failed checks.
+///
+/// \author png!das-system
+#include <cstdio>
+#include <cstring>
+#include <string>
+
+#include "core/message.h"
+
+using namespace QIRCCore;
+
+
+/// \brief Number of failed checks
+static int failures = 0;
+
+#define CHECK(cond) check((cond), #cond, __LINE__)
+
+
+/// \brief Report a failed check
+static void check(bool ok, const char* what, int line) {
+  if (!ok) {
+    std::fprintf(stderr, "messagetest.cc:%d: check failed: %s\n", line, what);
+    ++failures;
+  }
+}
+
+
+/// \brief Parse a whole NUL terminated line
+static bool parse(Message& msg, const char* line) {
+  return msg.parse(line, 0, std::strlen(line));
+}
+
+
+/// \brief Text of a field
+static std::string text(const Message& msg, const Span& s) {
+  return std::string(msg.data(s), s.length);
+}
+
+
+/// \brief Text of a parameter
+static std::string param(const Message& msg, int i) {
+  return text(msg, msg.param(i));
+}
+
+
+/// \brief Tags, prefix, command and trailing parameter
+static void testFullLine() {
+  Message msg;
+
+  CHECK(parse(msg, "@time=12:00;id=1 :nick!user@host PRIVMSG #c :hi there"));
+  CHECK(msg.isValid());
+  CHECK(msg.hasTags());
+  CHECK(text(msg, msg.tags()) == "time=12:00;id=1");
+  CHECK(msg.hasPrefix());
+  CHECK(msg.hasUserPrefix());
+  CHECK(text(msg, msg.prefix()) == "nick!user@host");
+  CHECK(text(msg, msg.nick()) == "nick");
+  CHECK(text(msg, msg.user()) == "user");
+  CHECK(text(msg, msg.host()) == "host");
+  CHECK(msg.isCommand("PRIVMSG"));
+  CHECK(!msg.isCommand("PRIVMS"));
+  CHECK(!msg.isNumeric());
+  CHECK(msg.paramCount() == 2);
+  CHECK(param(msg, 0) == "#c");
+  CHECK(param(msg, 1) == "hi there");
+  CHECK(msg.paramEquals(0, "#c"));
+  CHECK(msg.hasTrailing());
+}
+
+
+/// \brief Tags without prefix, and prefixes without user part
+static void testTagsAndPrefixes() {
+  Message msg;
+
+  CHECK(parse(msg, "@a=b PING :x"));
+  CHECK(text(msg, msg.tags()) == "a=b");
+  CHECK(!msg.hasPrefix());
+  CHECK(msg.isCommand("PING"));
+  CHECK(param(msg, 0) == "x");
+
+  // server prefix: nick() is the whole name, no user or host
+  CHECK(parse(msg, ":irc.example.net 001 me :Welcome"));
+  CHECK(!msg.hasTags());
+  CHECK(!msg.hasUserPrefix());
+  CHECK(text(msg, msg.nick()) == "irc.example.net");
+  CHECK(msg.user().length == 0);
+  CHECK(msg.host().length == 0);
+  CHECK(msg.isNumeric());
+  CHECK(msg.numeric() == 1);
+
+  CHECK(parse(msg, ":nick!user NOTICE me :x"));
+  CHECK(!msg.hasUserPrefix());
+  CHECK(text(msg, msg.nick()) == "nick");
+
+  // '@' before '!' belongs to the nick part
+  CHECK(parse(msg, ":a@b!c@d NICK e"));
+  CHECK(msg.hasUserPrefix());
+  CHECK(text(msg, msg.nick()) == "a@b");
+  CHECK(text(msg, msg.user()) == "c");
+  CHECK(text(msg, msg.host()) == "d");
+
+  // empty nick before '!'
+  CHECK(parse(msg, ":!u@h X"));
+  CHECK(!msg.hasUserPrefix());
+}
+
+
+/// \brief Trailing parameters may be empty or contain anything
+static void testTrailing() {
+  Message msg;
+
+  CHECK(parse(msg, "PRIVMSG #c :"));
+  CHECK(msg.paramCount() == 2);
+  CHECK(msg.hasTrailing());
+  CHECK(msg.paramLength(1) == 0);
+
+  CHECK(parse(msg, "PRIVMSG #c ::-) a  :b "));
+  CHECK(msg.paramCount() == 2);
+  CHECK(param(msg, 1) == ":-) a  :b ");
+
+  CHECK(parse(msg, "TOPIC :"));
+  CHECK(msg.paramCount() == 1);
+  CHECK(msg.hasTrailing());
+  CHECK(param(msg, 0) == "");
+
+  CHECK(parse(msg, "MODE #c +o x"));
+  CHECK(!msg.hasTrailing());
+  CHECK(param(msg, 2) == "x");
+}
+
+
+/// \brief Runs of spaces separate parameters but never make empty ones
+static void testEmptyParams() {
+  Message msg;
+
+  CHECK(parse(msg, "CMD  a   b  "));
+  CHECK(msg.paramCount() == 2);
+  CHECK(param(msg, 0) == "a");
+  CHECK(param(msg, 1) == "b");
+  CHECK(!msg.hasTrailing());
+
+  CHECK(parse(msg, "QUIT"));
+  CHECK(msg.paramCount() == 0);
+  CHECK(msg.paramData(0) == NULL);
+  CHECK(msg.paramLength(0) == -1);
+  CHECK(msg.param(0).length == 0);
+  CHECK(!msg.paramEquals(0, ""));
+
+  CHECK(parse(msg, "QUIT   "));
+  CHECK(msg.paramCount() == 0);
+}
+
+
+/// \brief Lines without a command are rejected
+static void testNoCommand() {
+  Message msg;
+
+  CHECK(!parse(msg, ""));
+  CHECK(!msg.isValid());
+  CHECK(!parse(msg, ":prefix"));
+  CHECK(!parse(msg, ":prefix "));
+  CHECK(!parse(msg, "@tags"));
+  CHECK(!parse(msg, "@tags :prefix   "));
+  CHECK(!parse(msg, " "));
+}
+
+
+/// \brief Only three digit commands are numerics
+static void testNumerics() {
+  Message msg;
+
+  CHECK(parse(msg, "433 * nick :in use") && msg.numeric() == 433);
+  CHECK(parse(msg, "005 me A B :are supported") && msg.numeric() == 5);
+  CHECK(parse(msg, "4333 x") && !msg.isNumeric());
+  CHECK(parse(msg, "43 x") && !msg.isNumeric());
+  CHECK(parse(msg, "4a3 x") && !msg.isNumeric());
+}
+
+
+/// \brief The last of MaxParams parameters takes the rest of the line
+static void testMaxParams() {
+  Message msg;
+
+  CHECK(parse(msg, "CMD 1 2 3 4 5 6 7 8 9 10 11 12 13 14 15 16 :17"));
+  CHECK(msg.paramCount() == Message::MaxParams);
+  CHECK(param(msg, 13) == "14");
+  CHECK(param(msg, 14) == "15 16 :17");
+  CHECK(!msg.hasTrailing());
+
+  CHECK(parse(msg, "CMD 1 2 3 4 5 6 7 8 9 10 11 12 13 14 :a b"));
+  CHECK(msg.paramCount() == Message::MaxParams);
+  CHECK(param(msg, 14) == "a b");
+  CHECK(msg.hasTrailing());
+}
+
+
+/// \brief Lines are parsed in place within a larger buffer
+static void testOffset() {
+  const char buffer[] = ":a!b@c JOIN #x\r\nPING :srv\r\n";
+  Message msg;
+
+  CHECK(msg.parse(buffer, 16, 9));
+  CHECK(msg.isCommand("PING"));
+  CHECK(param(msg, 0) == "srv");
+  CHECK(msg.line().begin == 16 && msg.line().length == 9);
+
+  CHECK(msg.parse(buffer, 0, 14));
+  CHECK(msg.isCommand("JOIN"));
+  CHECK(msg.paramCount() == 1);
+  CHECK(param(msg, 0) == "#x");
+  CHECK(msg.prefix().begin == 1);
+}
+
+
+int main() {
+  testFullLine();
+  testTagsAndPrefixes();
+  testTrailing();
+  testEmptyParams();
+  testNoCommand();
+  testNumerics();
+  testMaxParams();
+  testOffset();
+
+  if (failures > 0) {
+    std::fprintf(stderr, "%d check(s) failed\n", failures);
+  }
+
+  return failures;
+}
@@ -0,0 +1,241 @@
+/// \file
+/// \brief End-to-end tests of Connection against mockircd
+///
+/// Usage: mockircdtest <mockircd> <test> [script]
+///
+/// Starts the mock server on a free port with the given script (by
+/// default clients are just registered), connects a Connection to it
+/// and checks the outcome of the test:
+/// \code
+/// registration   the server accepts the registration, QUIT closes
+///                the connection
+/// keepalive      keepalive PINGs measure the lag, and a server that
+///                stops answering (stall.mock) is detected by the ping
+///                timeout
+/// flood          after joining the channel, every line of the flood
+///                arrives before the server closes the connection
+///                (shortflood.mock)
+/// \endcode
+///
+/// Exits with 0 if the test passed.
+///
+/// \author png!das-system
+#include <cstdio>
+
+#include <QCoreApplication>
+#include <QProcess>
+#include <QStringList>
+#include <QTimer>
+
+#include "Connection"
+
+using namespace QIRC;
+
+
+/// \brief Time a test may take in ms
+static const int TestTimeout = 30000;
+
+/// \brief Lines the flood test expects at least (see shortflood.mock)
+static const quint64 FloodLines = 20000;
+
+
+/// \brief Drives a Connection through one test
+class Tester : public QObject {
+  Q_OBJECT
+public:
+  Tester(Connection* conn, const QString& test) :
+    m_conn(conn), m_test(test), m_registered(false), m_lagMeasured(false),
+    m_passed(false) {
+    QObject::connect(conn, SIGNAL(irc_welcome(int, QString)),
+		     this, SLOT(conn_welcome()));
+    QObject::connect(conn, SIGNAL(lagMeasured(int)),
+		     this, SLOT(conn_lagMeasured(int)));
+    QObject::connect(conn, SIGNAL(socketError(QAbstractSocket::SocketError,
+					      QString)),
+		     this, SLOT(conn_socketError(QAbstractSocket::SocketError,
+						 QString)));
+    QObject::connect(conn, SIGNAL(disconnected(QIRC::ServerInfo)),
+		     this, SLOT(conn_disconnected()));
+  }
+
+  /// \brief Did the test pass?
+  bool passed() const {
+    return m_passed;
+  }
+
+public slots:
+  void timer_timeout() {
+    fail("timed out");
+  }
+
+  void conn_welcome() {
+    m_registered = true;
+
+    if (m_test == "registration") {
+      m_conn->quit("registration test done");
+    } else if (m_test == "flood") {
+      m_conn->joinChannel("#mock");
+    }
+  }
+
+  void conn_lagMeasured(int msec) {
+    std::printf("lag %d ms\n", msec);
+    m_lagMeasured = true;
+  }
+
+  void conn_socketError(QAbstractSocket::SocketError err, QString msg) {
+    if (m_test != "keepalive") {
+      return;
+    }
+
+    if (err != QAbstractSocket::SocketTimeoutError) {
+      fail("unexpected error: " + msg);
+    } else if (!m_registered || !m_lagMeasured) {
+      fail("ping timeout before registration or lag measurement");
+    } else {
+      pass();
+    }
+  }
+
+  void conn_disconnected() {
+    if (m_test == "registration") {
+      if (m_registered) {
+	pass();
+      } else {
+	fail("disconnected before registration");
+      }
+    } else if (m_test == "flood") {
+      const ConnectionStatistics stats = m_conn->statistics();
+      std::printf("%llu lines received\n",
+		  (unsigned long long) stats.linesIn);
+
+      if (stats.linesIn >= FloodLines) {
+	pass();
+      } else {
+	fail("flood incomplete");
+      }
+    }
+  }
+
+protected:
+  void pass() {
+    m_passed = true;
+    finish();
+  }
+
+  void fail(const QString& reason) {
+    std::fprintf(stderr, "%s: %s\n", qPrintable(m_test),
+		 qPrintable(reason));
+    finish();
+  }
+
+  /// \brief Stop the connection (without reconnects) and the event loop
+  void finish() {
+    m_conn->blockSignals(true);
+    m_conn->disconnect();
+    QCoreApplication::quit();
+  }
+
+  /// \brief Connection under test
+  Connection* m_conn;
+
+  /// \brief Name of the test
+  QString m_test;
+
+  /// \brief Flag set once the server accepted the registration
+  bool m_registered;
+
+  /// \brief Flag set by lagMeasured()
+  bool m_lagMeasured;
+
+  /// \brief Result
+  bool m_passed;
+};
+
+
+/// \brief Start mockircd and find out its port
+///
+/// \return Port or 0 on failure
+static quint16 startServer(QProcess& server, const QString& program,
+			   const QString& script) {
+  QStringList args;
+  args << "--port" << "0" << "--exit-when-idle";
+  if (!script.isEmpty()) {
+    args << script;
+  }
+
+  server.setProcessChannelMode(QProcess::ForwardedErrorChannel);
+  server.start(program, args);
+  if (!server.waitForStarted() || !server.waitForReadyRead(10000)) {
+    std::fprintf(stderr, "Unable to start %s\n", qPrintable(program));
+    return 0;
+  }
+
+  // "listening on <address> port <port>"
+  const QByteArray line = server.readLine().trimmed();
+  const int space = line.lastIndexOf(' ');
+  bool ok;
+  const int port = line.mid(space + 1).toInt(&ok);
+  if (!line.startsWith("listening on") || !ok || port <= 0) {
+    std::fprintf(stderr, "Unexpected output of %s: %s\n",
+		 qPrintable(program), line.constData());
+    return 0;
+  }
+
+  return quint16(port);
+}
+
+
+int main(int argc, char** argv) {
+  QCoreApplication app(argc, argv);
+
+  const QStringList args = app.arguments();
+  if (args.size() < 3 || args.size() > 4) {
+    std::fprintf(stderr, "usage: %s <mockircd> registration|keepalive|flood "
+		 "[script]\n", argv[0]);
+    return 1;
+  }
+
+  const QString test = args.at(2);
+  if (test != "registration" && test != "keepalive" && test != "flood") {
+    std::fprintf(stderr, "Unknown test %s\n", qPrintable(test));
+    return 1;
+  }
+
+  QProcess server;
+  const quint16 port = startServer(server, args.at(1),
+				   args.size() > 3 ? args.at(3) : QString());
+  if (port == 0) {
+    return 1;
+  }
+
+  Connection conn("127.0.0.1", port);
+  conn.setNick("mocktest");
+  conn.setRegistrationTimeout(10000);
+  if (test == "keepalive") {
+    conn.setKeepaliveInterval(1000);
+    conn.setPingTimeout(2000);
+  }
+
+  Tester tester(&conn, test);
+
+  QTimer timer;
+  timer.setSingleShot(true);
+  QObject::connect(&timer, SIGNAL(timeout()), &tester, SLOT(timer_timeout()));
+  timer.start(TestTimeout);
+
+  conn.connect();
+  app.exec();
+
+  server.terminate();
+  if (!server.waitForFinished(5000)) {
+    server.kill();
+    server.waitForFinished();
+  }
+
+  std::printf("%s: %s\n", qPrintable(test),
+	      tester.passed() ? "passed" : "FAILED");
+  return tester.passed() ? 0 : 1;
+}
+
+#include "mockircdtest.moc"
@@ -0,0 +1,171 @@
+/// \file
+/// \brief Regression tests for StringPool and PooledString
+///
+/// Exits with the number of failed checks.
+///
+/// \author png!das-system
+#include <cstdio>
+#include <cstring>
+
+#include "StringPool"
+
+using namespace QIRC;
+
+
+/// \brief Number of failed checks
+static int failures = 0;
+
+#define CHECK(cond) check((cond), #cond, __LINE__)
+
+
+/// \brief Report a failed check
+static void check(bool ok, const char* what, int line) {
+  if (!ok) {
+    std::fprintf(stderr, "stringpooltest.cc:%d: check failed: %s\n", line,
+		 what);
+    ++failures;
+  }
+}
+
+
+/// \brief Equal strings share a handle and count their references
+static void testRefCount() {
+  StringPool pool;
+  CHECK(pool.size() == 0);
+
+  const StringPool::Handle a = pool.intern(QString("nick"));
+  CHECK(a != 0);
+  CHECK(pool.refCount(a) == 1);
+  CHECK(pool.size() == 1);
+
+  // both overloads find the same entry
+  CHECK(pool.intern("nick", 4) == a);
+  CHECK(pool.intern(QString("nick")) == a);
+  CHECK(pool.refCount(a) == 3);
+  CHECK(pool.size() == 1);
+
+  pool.ref(a);
+  CHECK(pool.refCount(a) == 4);
+
+  const StringPool::Handle b = pool.intern("other", 5);
+  CHECK(b != a);
+  CHECK(pool.size() == 2);
+
+  pool.release(a);
+  pool.release(a);
+  pool.release(a);
+  CHECK(pool.refCount(a) == 1);
+  CHECK(pool.string(a) == "nick");
+  CHECK(pool.size() == 2);
+
+  pool.release(b);
+  pool.release(a);
+  CHECK(pool.size() == 0);
+}
+
+
+/// \brief Released strings are removed and their handles reused
+static void testRelease() {
+  StringPool pool;
+
+  const StringPool::Handle a = pool.intern(QString("first"));
+  pool.release(a);
+  CHECK(pool.size() == 0);
+
+  // a new entry for the same string starts over at one reference
+  const StringPool::Handle b = pool.intern(QString("first"));
+  CHECK(pool.refCount(b) == 1);
+  CHECK(pool.string(b) == "first");
+
+  pool.release(b);
+
+  // once freed, a slot may hold a different string
+  const StringPool::Handle c = pool.intern(QString("second"));
+  CHECK(pool.string(c) == "second");
+  CHECK(pool.intern("first", 5) != c);
+  CHECK(pool.size() == 2);
+}
+
+
+/// \brief The empty string is handle 0 and never counted
+static void testEmpty() {
+  StringPool pool;
+
+  CHECK(pool.intern(QString()) == 0);
+  CHECK(pool.intern(QString("")) == 0);
+  CHECK(pool.intern("", 0) == 0);
+  CHECK(pool.string(0).isEmpty());
+  CHECK(pool.utf8(0).isEmpty());
+
+  pool.ref(0);
+  pool.release(0);
+  pool.release(0);
+  CHECK(pool.string(0).isEmpty());
+  CHECK(pool.size() == 0);
+}
+
+
+/// \brief Strings are kept in UTF-8 and decoded by string()
+static void testUtf8() {
+  StringPool pool;
+
+  const char* utf8 = "n\xc3\xbc" "ck\xe2\x82\xac";
+  const QString s = QString::fromUtf8(utf8);
+
+  const StringPool::Handle h = pool.intern(utf8, std::strlen(utf8));
+  CHECK(pool.intern(s) == h);
+  CHECK(pool.string(h) == s);
+  CHECK(pool.utf8(h) == QByteArray(utf8));
+
+  pool.release(h);
+  pool.release(h);
+}
+
+
+/// \brief PooledString copies share the reference of the global pool
+static void testPooledString() {
+  StringPool* pool = StringPool::instance();
+  const int size = pool->size();
+
+  {
+    PooledString a(QString("pooledstringtest"));
+    const StringPool::Handle h = a.handle();
+    CHECK(pool->refCount(h) == 1);
+    CHECK(pool->size() == size + 1);
+
+    PooledString b(a);
+    CHECK(b == a);
+    CHECK(pool->refCount(h) == 2);
+
+    PooledString c("pooledstringtest", 16);
+    CHECK(c == a);
+    CHECK(pool->refCount(h) == 3);
+
+    c = PooledString(QString("pooledstringtest2"));
+    CHECK(c != a);
+    CHECK(pool->refCount(h) == 2);
+
+    b = PooledString();
+    CHECK(b.isEmpty());
+    CHECK(pool->refCount(h) == 1);
+    CHECK(a.toString() == "pooledstringtest");
+    CHECK(a.toUtf8() == "pooledstringtest");
+  }
+
+  CHECK(pool->size() == size);
+}
+
+
+int main() {
+  testRefCount();
+  testRelease();
+  testEmpty();
+  testUtf8();
+  testPooledString();
+
+  if (failures > 0) {
+    std::fprintf(stderr, "%d check(s) failed\n", failures);
+  }
+
+  return failures;
+}
@@ -0,0 +1,311 @@
+/// \file
+/// \brief Regression tests for QIRCCore::TimerWheel
+///
+/// Exits with the number of failed checks.
+///
+/// \author png!das-system
+#include <cstdio>
+#include <vector>
+
+#include "core/timerwheel.h"
+
+using namespace QIRCCore;
+
+
+/// \brief Number of failed checks
+static int failures = 0;
+
+#define CHECK(cond) check((cond), #cond, __LINE__)
+
+
+/// \brief Report a failed check
+static void check(bool ok, const char* what, int line) {
+  if (!ok) {
+    std::fprintf(stderr, "timerwheeltest.cc:%d: check failed: %s\n", line,
+		 what);
+    ++failures;
+  }
+}
+
+
+/// \brief Timer that records when it fired
+struct Probe {
+  Probe() :
+    timer(fired, this), now(NULL), firedAt(-1), count(0), log(NULL) {}
+
+  static void fired(void* context) {
+    Probe* p = static_cast<Probe*>(context);
+    p->firedAt = *p->now;
+    ++p->count;
+    if (p->log != NULL)
+      p->log->push_back(p->timer.deadline());
+  }
+
+  WheelTimer timer;
+
+  /// \brief Time passed to the current advance()
+  const long long* now;
+
+  /// \brief Time of the last expiry or -1
+  long long firedAt;
+
+  /// \brief Number of expiries
+  int count;
+
+  /// \brief Receives the deadlines in the order the timers fired
+  std::vector<long long>* log;
+};
+
+
+/// \brief Deadlines at and around the slot boundaries of every level
+static const long long deadlines[] = {
+  0, 1, 63, 64, 65, 127, 128, 4095, 4096, 4097, 8191, 8192, 262143,
+  262144, 262145, 300000
+};
+static const int deadlineCount = sizeof(deadlines) / sizeof(deadlines[0]);
+
+
+/// \brief Stepping 1 ms at a time fires every timer exactly on time
+static void testExactExpiry() {
+  TimerWheel wheel;
+  long long now = 0;
+  Probe probes[deadlineCount];
+
+  for (int i = 0; i < deadlineCount; ++i) {
+    probes[i].now = &now;
+    wheel.start(&probes[i].timer, deadlines[i]);
+  }
+  CHECK(wheel.size() == deadlineCount);
+
+  for (now = 0; now <= 300000; ++now) {
+    wheel.advance(now);
+  }
+
+  for (int i = 0; i < deadlineCount; ++i) {
+    if (probes[i].firedAt != deadlines[i]) {
+      std::fprintf(stderr, "deadline %lld fired at %lld\n", deadlines[i],
+		   probes[i].firedAt);
+    }
+    CHECK(probes[i].firedAt == deadlines[i]);
+    CHECK(probes[i].count == 1);
+    CHECK(!probes[i].timer.isActive());
+  }
+  CHECK(wheel.isEmpty());
+}
+
+
+/// \brief One large step fires everything due, in deadline order
+static void testOrder() {
+  TimerWheel wheel(1000);
+  long long now = 1000;
+  std::vector<long long> log;
+  Probe probes[deadlineCount];
+
+  // start them in reverse order
+  for (int i = deadlineCount - 1; i >= 0; --i) {
+    probes[i].now = &now;
+    probes[i].log = &log;
+    wheel.start(&probes[i].timer, 1000 + deadlines[i]);
+  }
+
+  now = 1000 + 8192;
+  CHECK(wheel.advance(now) == 12);
+  CHECK(log.size() == 12);
+  for (size_t i = 0; i < log.size(); ++i) {
+    CHECK(log[i] == 1000 + deadlines[i]);
+  }
+  CHECK(wheel.size() == deadlineCount - 12);
+
+  now = 1000 + 1000000;
+  CHECK(wheel.advance(now) == deadlineCount - 12);
+  CHECK(log.size() == size_t(deadlineCount));
+  for (size_t i = 12; i < log.size(); ++i) {
+    CHECK(log[i] == 1000 + deadlines[i]);
+  }
+}
+
+
+/// \brief Sleeping until nextExpiry() reaches every deadline exactly
+///
+/// nextExpiry() may wake the owner early to cascade timers down a
+/// level, but never late and never in the past.
+static void testNextExpiry() {
+  static const long long far[] = {
+    5, 70, 4100, 262200, 16777215, 16777216, 40000000
+  };
+  const int count = sizeof(far) / sizeof(far[0]);
+
+  TimerWheel wheel;
+  long long now = 0;
+  Probe probes[count];
+
+  CHECK(wheel.nextExpiry() == -1);
+
+  for (int i = 0; i < count; ++i) {
+    probes[i].now = &now;
+    wheel.start(&probes[i].timer, far[i]);
+  }
+  CHECK(wheel.nextExpiry() == 5);
+
+  int wakeups = 0;
+  bool ordered = true;
+  while (!wheel.isEmpty() && wakeups < 10000) {
+    const long long next = wheel.nextExpiry();
+    if (next < now) {
+      ordered = false;
+    }
+
+    // never after the earliest pending deadline
+    for (int i = 0; i < count; ++i) {
+      if (probes[i].timer.isActive() && next > far[i]) {
+	ordered = false;
+      }
+    }
+
+    now = next;
+    wheel.advance(now);
+    ++wakeups;
+  }
+
+  CHECK(ordered);
+  CHECK(wheel.isEmpty());
+  for (int i = 0; i < count; ++i) {
+    CHECK(probes[i].firedAt == far[i]);
+  }
+}
+
+
+/// \brief Callback that restarts its own timer every period ms
+struct Periodic {
+  Periodic() :
+    timer(fired, this), wheel(NULL), period(0), count(0), other(NULL) {}
+
+  static void fired(void* context) {
+    Periodic* p = static_cast<Periodic*>(context);
+    ++p->count;
+    p->wheel->start(&p->timer, p->timer.deadline() + p->period);
+    if (p->other != NULL)
+      p->other->stop();
+  }
+
+  WheelTimer timer;
+  TimerWheel* wheel;
+  long long period;
+  int count;
+
+  /// \brief Timer stopped by the first expiry
+  WheelTimer* other;
+};
+
+
+/// \brief Callbacks may restart their timer and stop others
+static void testCallbacks() {
+  TimerWheel wheel;
+  long long now = 0;
+
+  Periodic periodic;
+  periodic.wheel = &wheel;
+  periodic.period = 100;
+
+  Probe victim;
+  victim.now = &now;
+  periodic.other = &victim.timer;
+
+  wheel.start(&periodic.timer, 100);
+  wheel.start(&victim.timer, 150);
+
+  now = 1050;
+  CHECK(wheel.advance(now) == 10);
+  CHECK(periodic.count == 10);
+  CHECK(periodic.timer.isActive());
+  CHECK(periodic.timer.deadline() == 1100);
+  CHECK(victim.count == 0);
+  CHECK(!victim.timer.isActive());
+  CHECK(wheel.size() == 1);
+}
+
+
+/// \brief Stopping, restarting and destroying timers
+static void testStop() {
+  TimerWheel wheel;
+  long long now = 0;
+  Probe a, b;
+  a.now = &now;
+  b.now = &now;
+
+  wheel.start(&a.timer, 10);
+  wheel.start(&b.timer, 10);
+  CHECK(wheel.size() == 2);
+
+  a.timer.stop();
+  CHECK(!a.timer.isActive());
+  CHECK(wheel.size() == 1);
+  a.timer.stop();
+  CHECK(wheel.size() == 1);
+
+  // restarting moves the timer
+  wheel.start(&b.timer, 5000);
+  CHECK(wheel.size() == 1);
+  CHECK(b.timer.deadline() == 5000);
+
+  now = 4999;
+  CHECK(wheel.advance(now) == 0);
+  now = 5000;
+  CHECK(wheel.advance(now) == 1);
+  CHECK(a.count == 0);
+  CHECK(b.firedAt == 5000);
+
+  // a destroyed timer leaves the wheel
+  {
+    Probe c;
+    c.now = &now;
+    wheel.start(&c.timer, 6000);
+    CHECK(wheel.size() == 1);
+  }
+  CHECK(wheel.isEmpty());
+  CHECK(wheel.nextExpiry() == -1);
+
+  // a deadline in the past fires with the next advance()
+  wheel.start(&a.timer, 10);
+  now = 5001;
+  CHECK(wheel.advance(now) == 1);
+  CHECK(a.firedAt == 5001);
+}
+
+
+/// \brief skipTo() moves an idle wheel's time, but not past deadlines
+static void testSkipTo() {
+  TimerWheel wheel;
+  long long now = 0;
+  Probe a;
+  a.now = &now;
+
+  wheel.skipTo(100000);
+  wheel.start(&a.timer, 100010);
+
+  // placed relative to the skipped time: due within level 0
+  CHECK(wheel.nextExpiry() == 100010);
+
+  wheel.skipTo(200000);
+  CHECK(wheel.nextExpiry() == 100010);
+
+  now = 100010;
+  CHECK(wheel.advance(now) == 1);
+  CHECK(a.firedAt == 100010);
+}
+
+
+int main() {
+  testExactExpiry();
+  testOrder();
+  testNextExpiry();
+  testCallbacks();
+  testStop();
+  testSkipTo();
+
+  if (failures > 0) {
+    std::fprintf(stderr, "%d check(s) failed\n", failures);
+  }
+
+  return failures;
+}
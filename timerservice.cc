@@ -0,0 +1,97 @@
+/// \file
+/// \brief Implementation of TimerService class
+///
+/// \author png!das-system
+#include <QThreadStorage>
+
+#include "TimerService"
+
+using namespace QIRC;
+
+
+/// \brief One TimerService per thread, deleted when the thread exits
+Q_GLOBAL_STATIC(QThreadStorage<TimerService*>, timerServices)
+
+
+/// \brief Construct service with an empty wheel
+TimerService::TimerService() :
+  m_timer(NULL), m_armedFor(-1) {
+  m_clock.start();
+
+  m_timer = new QTimer(this);
+  m_timer->setSingleShot(true);
+  QObject::connect(m_timer, SIGNAL(timeout()),
+		   this, SLOT(timer_timeout()));
+}
+
+
+TimerService::~TimerService() {}
+
+
+/// \brief Service of the calling thread (created on first use)
+TimerService* TimerService::instance() {
+  QThreadStorage<TimerService*>* services = timerServices();
+  if (!services->hasLocalData()) {
+    services->setLocalData(new TimerService());
+  }
+
+  return services->localData();
+}
+
+
+/// \brief Start (or restart) a timer
+///
+/// Stop it with WheelTimer::stop().
+///
+/// \param timer The timer
+/// \param msec Time until the timer expires in milliseconds
+void TimerService::start(WheelTimer* timer, int msec) {
+  const qint64 t = now();
+
+  // catch up on idle time so the timer goes into the right slot
+  m_wheel.skipTo(t);
+  m_wheel.start(timer, t + qMax(msec, 0));
+
+  rearm();
+}
+
+
+/// \brief Current time of the service's clock in milliseconds
+qint64 TimerService::now() const {
+  return m_clock.elapsed();
+}
+
+
+/// \brief Number of active timers
+int TimerService::timerCount() const {
+  return m_wheel.size();
+}
+
+
+/// \brief Arm m_timer for the next deadline on the wheel
+///
+/// Stopped timers don't disarm m_timer; it runs out without
+/// expiring anything and is then armed for the next deadline.
+void TimerService::rearm() {
+  const qint64 next = m_wheel.nextExpiry();
+  if (next < 0) {
+    return;
+  }
+
+  if (m_armedFor >= 0 && m_armedFor <= next) {
+    return;
+  }
+
+  m_armedFor = next;
+  m_timer->start(static_cast<int>(qMax(next - now(), qint64(0))));
+}
+
+
+/// \brief Slot for m_timer::timeout()
+///
+/// Expires all timers that are due.
+void TimerService::timer_timeout() {
+  m_armedFor = -1;
+  m_wheel.advance(now());
+  rearm();
+}
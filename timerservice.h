@@ -0,0 +1,67 @@
+/// \file
+/// \brief Declaration of TimerService class
+///
+/// \author png!das-system
+#ifndef TIMERSERVICE_H
+#define TIMERSERVICE_H 1
+
+#include <QElapsedTimer>
+#include <QObject>
+#include <QTimer>
+
+#include "core/timerwheel.h"
+
+#include "qirc.h"
+
+namespace QIRC {
+  /// \brief Timer run by the TimerService of a thread
+  typedef QIRCCore::WheelTimer WheelTimer;
+
+
+  /// \brief Runs the timers of all connections of a thread
+  ///
+  /// Every thread gets one TimerService (see instance()) with one
+  /// TimerWheel for the timers of all objects living in that thread,
+  /// e.g. outbound queue drains, registration timeouts and reconnect
+  /// backoff of every Connection. A single QTimer is armed for the
+  /// next deadline on the wheel, so idle connections don't cause any
+  /// wakeups.
+  ///
+  /// Timers are started from the thread whose service runs them and
+  /// call back in that thread. An object moved to another thread must
+  /// stop its active timers before the move and restart them in the
+  /// new thread, as Connection does on QEvent::ThreadChange.
+  class TimerService : public QObject {
+    Q_OBJECT
+  public:
+    static TimerService* instance();
+    virtual ~TimerService();
+
+    void start(WheelTimer* timer, int msec);
+
+    qint64 now() const;
+    int timerCount() const;
+
+  protected:
+    TimerService();
+
+    void rearm();
+
+    /// \brief Monotonic clock the wheel's times are based on
+    QElapsedTimer m_clock;
+
+    /// \brief The timers
+    QIRCCore::TimerWheel m_wheel;
+
+    /// \brief Armed for the next deadline on m_wheel
+    QTimer* m_timer;
+
+    /// \brief Time m_timer is armed for or -1
+    qint64 m_armedFor;
+
+  protected slots:
+    void timer_timeout();
+  };
+};
+
+#endif // !TIMERSERVICE_H
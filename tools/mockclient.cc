@@ -0,0 +1,541 @@
+/// \file
+/// \brief Implementation of MockClient class
+///
+/// \author png!das-system
+#include <QDateTime>
+
+#include "mockclient.h"
+#include "mockserver.h"
+
+
+/// \brief Take over an accepted connection
+///
+/// The script starts with start().
+MockClient::MockClient(QTcpSocket* socket, MockServer* server, int id) :
+  QObject(server), m_socket(socket), m_server(server), m_id(id),
+  m_nick("*"), m_user("mock"), m_channel("#mock"), m_registered(false),
+  m_pc(0), m_loopStart(0), m_loopPass(0), m_floodRemaining(0),
+  m_floodRate(0), m_floodLength(0), m_floodBudget(0.0), m_floodTick(0),
+  m_seq(0), m_random(quint32(id) * 2654435761u + 1), m_messageTimer(0),
+  m_slowRead(0), m_stalled(false), m_closing(false) {
+  m_socket->setParent(this);
+  m_clock.start();
+
+  m_mix.append(qMakePair(QByteArray("PRIVMSG"), 1));
+
+  m_scriptTimer.setSingleShot(true);
+  m_holdTimer.setSingleShot(true);
+
+  QObject::connect(m_socket, SIGNAL(readyRead()),
+		   this, SLOT(socket_readyRead()));
+  QObject::connect(m_socket, SIGNAL(bytesWritten(qint64)),
+		   this, SLOT(socket_bytesWritten(qint64)));
+  QObject::connect(m_socket, SIGNAL(disconnected()),
+		   this, SLOT(socket_disconnected()));
+  QObject::connect(&m_scriptTimer, SIGNAL(timeout()),
+		   this, SLOT(scriptTimer_timeout()));
+  QObject::connect(&m_floodTimer, SIGNAL(timeout()),
+		   this, SLOT(floodTimer_timeout()));
+  QObject::connect(&m_holdTimer, SIGNAL(timeout()),
+		   this, SLOT(holdTimer_timeout()));
+  QObject::connect(&m_slowReadTimer, SIGNAL(timeout()),
+		   this, SLOT(slowReadTimer_timeout()));
+}
+
+
+MockClient::~MockClient() {}
+
+
+/// \brief Run the script from the top
+void MockClient::start() {
+  runScript();
+
+  // data may have arrived before the signals were connected
+  socket_readyRead();
+}
+
+
+/// \brief Execute script steps until one has to wait
+void MockClient::runScript() {
+  const MockScript& script = m_server->script();
+
+  while (m_pc < script.size() && !m_closing) {
+    const MockScript::Step& s = script.step(m_pc);
+
+    switch (s.op) {
+    case MockScript::Expect: {
+      const QByteArray command = s.args.at(0).toUpper();
+      if (m_received.value(command) == 0) {
+	m_waitFor = command;
+	return;
+      }
+      --m_received[command];
+      break;
+    }
+
+    case MockScript::Send:
+      sendLine(expand(s.text));
+      break;
+
+    case MockScript::Register:
+      sendRegistration();
+      break;
+
+    case MockScript::Sleep:
+      ++m_pc;
+      m_scriptTimer.start(s.args.at(0).toInt());
+      return;
+
+    case MockScript::Channel:
+      m_channel = s.args.at(0);
+      break;
+
+    case MockScript::Mix:
+      setMix(s.args);
+      break;
+
+    case MockScript::Flood:
+      ++m_pc;
+      startFlood(s.args.at(0).toInt(),
+		 (s.args.size() > 1) ? s.args.at(1).toInt() : 0,
+		 (s.args.size() > 2) ? s.args.at(2).toInt() : 0);
+      return;
+
+    case MockScript::NetJoin:
+      for (int i = 0; i < s.args.at(0).toInt(); ++i) {
+	sendLine(":" + fakeUser(i) + " JOIN " + m_channel);
+      }
+      break;
+
+    case MockScript::NetSplit:
+      for (int i = 0; i < s.args.at(0).toInt(); ++i) {
+	sendLine(":" + fakeUser(i) +
+		 " QUIT :irc.left.mock irc.right.mock");
+      }
+      break;
+
+    case MockScript::SlowRead:
+      m_slowRead = s.args.at(0).toInt();
+      if (m_slowRead > 0) {
+	// let TCP push back instead of buffering everything in Qt
+	m_socket->setReadBufferSize(qMax(m_slowRead * TickInterval / 1000,
+					 1));
+	m_slowReadTimer.start(TickInterval);
+      } else {
+	m_socket->setReadBufferSize(0);
+	m_slowReadTimer.stop();
+
+	// not directly, this may run from within processInput()
+	QTimer::singleShot(0, this, SLOT(socket_readyRead()));
+      }
+      break;
+
+    case MockScript::Stall:
+      m_stalled = true;
+      m_socket->setReadBufferSize(1);
+      m_slowReadTimer.stop();
+      m_holdTimer.stop();
+      m_floodTimer.stop();
+      break;
+
+    case MockScript::Close:
+      closeLink(s.text.isEmpty() ? QByteArray("Closed by script") : s.text);
+      return;
+
+    case MockScript::Loop:
+      m_loopStart = m_pc + 1;
+      m_loopPass = 0;
+      break;
+
+    case MockScript::EndLoop: {
+      const int passes = s.args.isEmpty() ? 0 : s.args.at(0).toInt();
+      if (passes == 0 || ++m_loopPass < passes) {
+	// through the event loop, so a loop without waits can't hang
+	m_pc = m_loopStart;
+	m_scriptTimer.start(0);
+	return;
+      }
+      m_loopPass = 0;
+      break;
+    }
+    }
+
+    ++m_pc;
+  }
+}
+
+
+/// \brief Start sending messages from the mix
+void MockClient::startFlood(int count, int rate, int length) {
+  m_floodRemaining = count;
+  m_floodRate = rate;
+  m_floodLength = length;
+  m_floodBudget = 1.0;
+  m_floodTick = m_clock.elapsed();
+
+  if (count <= 0) {
+    // nothing to send, socket_bytesWritten() would never finish it
+    finishFlood();
+  } else if (m_floodRate > 0) {
+    m_floodTimer.start(TickInterval);
+    floodTimer_timeout();
+  } else {
+    socket_bytesWritten(0);
+  }
+}
+
+
+/// \brief Send the next message of the flood
+///
+/// \return false if the flood is over
+bool MockClient::floodOne() {
+  if (m_floodRemaining <= 0 || m_closing) {
+    return false;
+  }
+  --m_floodRemaining;
+
+  // pick a command by weight
+  m_random = m_random * 1103515245u + 12345u;
+  const int r = int((m_random >> 16) % quint32(m_mix.last().second));
+  int i = 0;
+  while (m_mix.at(i).second <= r) {
+    ++i;
+  }
+  const QByteArray& command = m_mix.at(i).first;
+
+  const QByteArray user = fakeUser(int(m_seq % FakeUsers));
+  QByteArray text = "seq " + QByteArray::number(m_seq) + " ts " +
+    QByteArray::number(QDateTime::currentMSecsSinceEpoch());
+  if (text.size() < m_floodLength) {
+    text.append(QByteArray(m_floodLength - text.size(), 'x'));
+  }
+  ++m_seq;
+
+  QByteArray line;
+  if (command == "PRIVMSG" || command == "NOTICE" || command == "TOPIC") {
+    line = ":" + user + " " + command + " " + m_channel + " :" + text;
+  } else if (command == "JOIN") {
+    line = ":" + user + " JOIN " + m_channel;
+  } else if (command == "PART") {
+    line = ":" + user + " PART " + m_channel + " :" + text;
+  } else if (command == "QUIT") {
+    line = ":" + user + " QUIT :" + text;
+  } else if (command == "NICK") {
+    line = ":" + user + " NICK :" + user.left(user.indexOf('!')) + "_";
+  } else {
+    line = ":" + m_server->serverName() + " MODE " + m_channel + " +v " +
+      user.left(user.indexOf('!'));
+  }
+
+  sendLine(line);
+
+  return true;
+}
+
+
+/// \brief Continue the script after a flood
+void MockClient::finishFlood() {
+  m_floodTimer.stop();
+  m_floodRemaining = 0;
+  runScript();
+}
+
+
+/// \brief Take the weights of a mix step
+void MockClient::setMix(const QList<QByteArray>& entries) {
+  m_mix.clear();
+
+  int total = 0;
+  for (int i = 0; i < entries.size(); ++i) {
+    const QList<QByteArray> entry = entries.at(i).split('=');
+    total += entry.at(1).toInt();
+    m_mix.append(qMakePair(entry.at(0), total));
+  }
+}
+
+
+/// \brief Handle the received lines the flood limits allow
+void MockClient::processInput() {
+  const MockServer::Limits limits = m_server->limits();
+  const qint64 now = m_clock.elapsed();
+  int offset = 0;
+
+  while (!m_closing && !m_stalled) {
+    const int eol = m_recvq.indexOf('\n', offset);
+    if (eol < 0) {
+      break;
+    }
+
+    if (limits.penalty > 0) {
+      if (m_messageTimer < now) {
+	m_messageTimer = now;
+      }
+
+      if (m_messageTimer - now > limits.burst) {
+	// held until the message timer caught up
+	m_holdTimer.start(int(m_messageTimer - now - limits.burst));
+	break;
+      }
+      m_messageTimer += limits.penalty;
+    }
+
+    QByteArray line = m_recvq.mid(offset, eol - offset);
+    if (line.endsWith('\r')) {
+      line.chop(1);
+    }
+    offset = eol + 1;
+
+    ++m_server->statistics().linesIn;
+    handleLine(line);
+  }
+
+  m_recvq.remove(0, offset);
+
+  if (!m_closing && limits.recvq > 0 && m_recvq.size() > limits.recvq) {
+    ++m_server->statistics().excessFloods;
+    closeLink("Excess Flood");
+  }
+}
+
+
+/// \brief Handle a line received from the client
+void MockClient::handleLine(const QByteArray& line) {
+  QList<QByteArray> params;
+  QByteArray trailing;
+  bool hasTrailing = false;
+
+  // [:prefix] <command> <params> [:<trailing>]
+  QByteArray rest = line;
+  if (rest.startsWith(':')) {
+    const int space = rest.indexOf(' ');
+    rest = (space < 0) ? QByteArray() : rest.mid(space + 1);
+  }
+
+  const int colon = rest.indexOf(" :");
+  if (colon >= 0) {
+    trailing = rest.mid(colon + 2);
+    hasTrailing = true;
+    rest = rest.left(colon);
+  }
+
+  params = rest.simplified().split(' ');
+  if (hasTrailing) {
+    params.append(trailing);
+  }
+
+  const QByteArray command = params.takeFirst().toUpper();
+  if (command.isEmpty()) {
+    return;
+  }
+
+  if (command == "PING") {
+    sendLine(":" + m_server->serverName() + " PONG " +
+	     m_server->serverName() + " :" + params.value(0));
+  } else if (command == "NICK" && !params.isEmpty()) {
+    if (m_registered) {
+      sendLine(":" + hostMask() + " NICK :" + params.at(0));
+    }
+    m_nick = params.at(0);
+  } else if (command == "USER" && !params.isEmpty()) {
+    m_user = params.at(0);
+  } else if (command == "JOIN" && !params.isEmpty()) {
+    const QList<QByteArray> channels = params.at(0).split(',');
+    for (int i = 0; i < channels.size(); ++i) {
+      sendLine(":" + hostMask() + " JOIN " + channels.at(i));
+      sendNumeric("353", "= " + channels.at(i) + " :@" + m_nick);
+      sendNumeric("366", channels.at(i) + " :End of /NAMES list.");
+    }
+  } else if (command == "PART" && !params.isEmpty()) {
+    sendLine(":" + hostMask() + " PART " + params.at(0));
+  } else if (command == "QUIT") {
+    closeLink("Quit: " + params.value(0));
+    return;
+  }
+
+  ++m_received[command];
+  if (command == m_waitFor) {
+    m_waitFor.clear();
+    --m_received[command];
+    ++m_pc;
+    runScript();
+  }
+}
+
+
+/// \brief Send a line to the client
+///
+/// Disconnects the client if its send queue is exceeded.
+void MockClient::sendLine(const QByteArray& line) {
+  if (m_stalled || m_closing) {
+    return;
+  }
+
+  m_socket->write(line + "\r\n");
+
+  MockServer::Statistics& stats = m_server->statistics();
+  ++stats.linesOut;
+  stats.bytesOut += line.size() + 2;
+
+  const int sendq = m_server->limits().sendq;
+  if (sendq > 0 && m_socket->bytesToWrite() > sendq) {
+    ++stats.sendqExceeded;
+    closeLink("Max SendQ exceeded");
+  }
+}
+
+
+/// \brief Send a numeric reply to the client
+void MockClient::sendNumeric(const char* numeric, const QByteArray& text) {
+  sendLine(":" + m_server->serverName() + " " + numeric + " " + m_nick +
+	   " " + text);
+}
+
+
+/// \brief Send the welcome burst and the MOTD
+void MockClient::sendRegistration() {
+  const QByteArray server = m_server->serverName();
+
+  sendNumeric("001", ":Welcome to the mock IRC network " + hostMask());
+  sendNumeric("002", ":Your host is " + server + ", running mockircd");
+  sendNumeric("003", ":This server was created for testing");
+  sendNumeric("004", server + " mockircd iow biklmnopstv");
+  sendNumeric("005", "CASEMAPPING=rfc1459 CHANTYPES=# PREFIX=(ov)@+ "
+	      "CHANMODES=b,k,l,imnpst NICKLEN=30 TARGMAX=PRIVMSG:4,NOTICE:4 "
+	      ":are supported by this server");
+  sendNumeric("375", ":- " + server + " Message of the Day -");
+  sendNumeric("372", ":- This server only exists for testing libQIRC.");
+  sendNumeric("376", ":End of /MOTD command.");
+
+  m_registered = true;
+}
+
+
+/// \brief Tell the client why and close the connection
+void MockClient::closeLink(const QByteArray& reason) {
+  if (m_closing) {
+    return;
+  }
+  m_closing = true;
+
+  // not through sendLine(), the send queue may be what's exceeded
+  if (!m_stalled) {
+    const QByteArray error = "ERROR :Closing Link: " + m_nick + " (" +
+      reason + ")\r\n";
+    m_socket->write(error);
+
+    ++m_server->statistics().linesOut;
+    m_server->statistics().bytesOut += error.size();
+  }
+
+  m_scriptTimer.stop();
+  m_floodTimer.stop();
+  m_holdTimer.stop();
+  m_slowReadTimer.stop();
+
+  m_socket->disconnectFromHost();
+}
+
+
+/// \brief Replace the variables of a send step
+QByteArray MockClient::expand(const QByteArray& text) const {
+  QByteArray r = text;
+  r.replace("{nick}", m_nick);
+  r.replace("{user}", m_user);
+  r.replace("{server}", m_server->serverName());
+  r.replace("{channel}", m_channel);
+  return r;
+}
+
+
+/// \brief nick!user@host of the client
+QByteArray MockClient::hostMask() const {
+  return m_nick + "!" + m_user + "@mock.client";
+}
+
+
+/// \brief nick!user@host of fake user i
+QByteArray MockClient::fakeUser(int i) {
+  return "mock" + QByteArray::number(i) + "!mock@mock.host";
+}
+
+
+/// \brief Slot for m_socket::readyRead()
+void MockClient::socket_readyRead() {
+  if (m_stalled || m_slowRead > 0) {
+    // left in the socket; see slowReadTimer_timeout()
+    return;
+  }
+
+  const QByteArray data = m_socket->readAll();
+  m_server->statistics().bytesIn += data.size();
+  m_recvq.append(data);
+
+  processInput();
+}
+
+
+/// \brief Slot for m_socket::bytesWritten()
+///
+/// Refills floods running at full speed.
+void MockClient::socket_bytesWritten(qint64) {
+  if (m_floodRemaining <= 0 || m_floodRate > 0 || m_stalled) {
+    return;
+  }
+
+  while (m_socket->bytesToWrite() < FloodWatermark) {
+    if (!floodOne()) {
+      finishFlood();
+      return;
+    }
+  }
+}
+
+
+/// \brief Slot for m_socket::disconnected()
+void MockClient::socket_disconnected() {
+  m_closing = true;
+  deleteLater();
+}
+
+
+/// \brief Slot for m_scriptTimer::timeout()
+void MockClient::scriptTimer_timeout() {
+  runScript();
+}
+
+
+/// \brief Slot for m_floodTimer::timeout()
+void MockClient::floodTimer_timeout() {
+  const qint64 now = m_clock.elapsed();
+  m_floodBudget += m_floodRate * (now - m_floodTick) / 1000.0;
+  m_floodTick = now;
+
+  while (m_floodBudget >= 1.0) {
+    if (!floodOne()) {
+      finishFlood();
+      return;
+    }
+    m_floodBudget -= 1.0;
+  }
+
+  if (m_floodRemaining <= 0) {
+    finishFlood();
+  }
+}
+
+
+/// \brief Slot for m_holdTimer::timeout()
+void MockClient::holdTimer_timeout() {
+  processInput();
+}
+
+
+/// \brief Slot for m_slowReadTimer::timeout()
+void MockClient::slowReadTimer_timeout() {
+  const QByteArray data =
+    m_socket->read(qMax(m_slowRead * TickInterval / 1000, 1));
+  m_server->statistics().bytesIn += data.size();
+  m_recvq.append(data);
+
+  processInput();
+}
@@ -0,0 +1,161 @@
+/// \file
+/// \brief Declaration of MockClient class
+///
+/// \author png!das-system
+#ifndef MOCKCLIENT_H
+#define MOCKCLIENT_H 1
+
+#include <QByteArray>
+#include <QElapsedTimer>
+#include <QHash>
+#include <QList>
+#include <QObject>
+#include <QPair>
+#include <QTcpSocket>
+#include <QTimer>
+
+#include "mockscript.h"
+
+class MockServer;
+
+/// \brief A client of the MockServer
+///
+/// Runs the server's script for one connection, handles the commands
+/// of the client and enforces the flood limits. Deletes itself once
+/// the connection is closed.
+class MockClient : public QObject {
+  Q_OBJECT
+public:
+  MockClient(QTcpSocket* socket, MockServer* server, int id);
+  virtual ~MockClient();
+
+  void start();
+
+protected:
+  /// \brief Interval of the flood and slow read timers in ms
+  enum { TickInterval = 10 };
+
+  /// \brief Unwritten bytes up to which floods at full speed refill
+  enum { FloodWatermark = 65536 };
+
+  /// \brief Number of fake users sending flooded messages
+  enum { FakeUsers = 100 };
+
+  /// \brief Connection to the client (child of this object)
+  QTcpSocket* m_socket;
+
+  /// \brief The server
+  MockServer* m_server;
+
+  /// \brief Number of the client, seeds its flood mix
+  int m_id;
+
+  /// \brief Nick sent by the client
+  QByteArray m_nick;
+
+  /// \brief User name sent by the client
+  QByteArray m_user;
+
+  /// \brief Channel used by the script
+  QByteArray m_channel;
+
+  /// \brief Flag indicating that the welcome burst was sent
+  bool m_registered;
+
+  /// \brief Index of the next script step
+  int m_pc;
+
+  /// \brief Command an expect step waits for (empty if none)
+  QByteArray m_waitFor;
+
+  /// \brief Commands received and not consumed by expect yet
+  QHash<QByteArray, int> m_received;
+
+  /// \brief Index of the first step of the loop
+  int m_loopStart;
+
+  /// \brief Completed passes of the loop
+  int m_loopPass;
+
+  /// \brief Resumes the script after sleep and endloop
+  QTimer m_scriptTimer;
+
+  /// \brief Message mix as (command, cumulative weight)
+  QList<QPair<QByteArray, int> > m_mix;
+
+  /// \brief Messages of the current flood still to send
+  int m_floodRemaining;
+
+  /// \brief Messages per second (0: as fast as the client reads)
+  int m_floodRate;
+
+  /// \brief Length of flooded texts
+  int m_floodLength;
+
+  /// \brief Messages that may be sent at the current rate
+  double m_floodBudget;
+
+  /// \brief m_clock time of the last flood tick in ms
+  qint64 m_floodTick;
+
+  /// \brief Drives rate limited floods
+  QTimer m_floodTimer;
+
+  /// \brief Sequence number of the next flooded message
+  quint64 m_seq;
+
+  /// \brief State of the random generator for the mix
+  quint32 m_random;
+
+  /// \brief Received data not processed yet
+  QByteArray m_recvq;
+
+  /// \brief Message timer of the flood limits in m_clock ms
+  qint64 m_messageTimer;
+
+  /// \brief Monotonic clock of the client
+  QElapsedTimer m_clock;
+
+  /// \brief Resumes processing once the message timer caught up
+  QTimer m_holdTimer;
+
+  /// \brief Bytes read per second (0: unlimited)
+  int m_slowRead;
+
+  /// \brief Reads with slowread
+  QTimer m_slowReadTimer;
+
+  /// \brief Flag set by the stall step
+  bool m_stalled;
+
+  /// \brief Flag set once the connection is being closed
+  bool m_closing;
+
+  void runScript();
+  void startFlood(int count, int rate, int length);
+  bool floodOne();
+  void finishFlood();
+  void setMix(const QList<QByteArray>& entries);
+
+  void processInput();
+  void handleLine(const QByteArray& line);
+  void sendLine(const QByteArray& line);
+  void sendNumeric(const char* numeric, const QByteArray& text);
+  void sendRegistration();
+  void closeLink(const QByteArray& reason);
+
+  QByteArray expand(const QByteArray& text) const;
+  QByteArray hostMask() const;
+  static QByteArray fakeUser(int i);
+
+protected slots:
+  void socket_readyRead();
+  void socket_bytesWritten(qint64);
+  void socket_disconnected();
+  void scriptTimer_timeout();
+  void floodTimer_timeout();
+  void holdTimer_timeout();
+  void slowReadTimer_timeout();
+};
+
+#endif // !MOCKCLIENT_H
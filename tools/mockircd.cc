@@ -0,0 +1,204 @@
+/// \file
+/// \brief Scriptable mock IRC server
+///
+/// Usage: mockircd [options] [script]
+///
+/// Runs the script (see mockscript.h; by default clients are just
+/// registered) for every client that connects. Options:
+/// \code
+/// --listen <address>   address to listen on (default 127.0.0.1)
+/// --port <port>        port to listen on (default 6667, 0: any)
+/// --name <name>        server name (default irc.mock)
+/// --penalty <ms>       flood limit: penalty per line (default 2000,
+///                      0: no flood limits)
+/// --burst <ms>         flood limit: burst (default 10000)
+/// --recvq <bytes>      excess flood limit (default 8192, 0: none)
+/// --sendq <bytes>      send queue limit (default 1048576, 0: none)
+/// --report <seconds>   print statistics periodically
+/// --exit-when-idle     exit once the last client disconnected
+/// \endcode
+///
+/// The port is printed on startup, so scripts can use --port 0.
+/// Statistics are printed on exit as well.
+///
+/// \author png!das-system
+#include <cstdio>
+
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QStringList>
+#include <QTimer>
+
+#include "mockserver.h"
+
+
+/// \brief Prints statistics and implements --exit-when-idle
+class Reporter : public QObject {
+  Q_OBJECT
+public:
+  Reporter(MockServer* server, bool exitWhenIdle) :
+    m_server(server), m_exitWhenIdle(exitWhenIdle), m_lastLinesIn(0),
+    m_lastLinesOut(0), m_lastReport(0) {
+    m_clock.start();
+    QObject::connect(server, SIGNAL(clientCountChanged(int)),
+		     this, SLOT(server_clientCountChanged(int)));
+  }
+
+  /// \brief Print the counters and the rates since the last report
+  void report() {
+    const MockServer::Statistics& s = m_server->statistics();
+    const qint64 now = m_clock.elapsed();
+    const double seconds = qMax(now - m_lastReport, qint64(1)) / 1000.0;
+
+    std::printf("clients %d (%llu total), in %llu lines (%.0f/s) %llu "
+		"bytes, out %llu lines (%.0f/s) %llu bytes, excess flood %llu, "
+		"sendq exceeded %llu\n", s.clients,
+		(unsigned long long) s.connections,
+		(unsigned long long) s.linesIn,
+		(s.linesIn - m_lastLinesIn) / seconds,
+		(unsigned long long) s.bytesIn,
+		(unsigned long long) s.linesOut,
+		(s.linesOut - m_lastLinesOut) / seconds,
+		(unsigned long long) s.bytesOut,
+		(unsigned long long) s.excessFloods,
+		(unsigned long long) s.sendqExceeded);
+    std::fflush(stdout);
+
+    m_lastLinesIn = s.linesIn;
+    m_lastLinesOut = s.linesOut;
+    m_lastReport = now;
+  }
+
+public slots:
+  void timer_timeout() {
+    report();
+  }
+
+  void server_clientCountChanged(int clients) {
+    if (clients == 0 && m_exitWhenIdle) {
+      QCoreApplication::quit();
+    }
+  }
+
+protected:
+  /// \brief The server
+  MockServer* m_server;
+
+  /// \brief Flag set by --exit-when-idle
+  bool m_exitWhenIdle;
+
+  /// \brief Started with the server
+  QElapsedTimer m_clock;
+
+  /// \brief Counters at the last report
+  quint64 m_lastLinesIn;
+  quint64 m_lastLinesOut;
+
+  /// \brief m_clock time of the last report
+  qint64 m_lastReport;
+};
+
+
+/// \brief Print the usage
+///
+/// \return Exit code for wrong arguments
+static int usage(const char* name) {
+  std::fprintf(stderr, "usage: %s [--listen <address>] [--port <port>] "
+	       "[--name <name>]\n  [--penalty <ms>] [--burst <ms>] "
+	       "[--recvq <bytes>] [--sendq <bytes>]\n  [--report <seconds>] "
+	       "[--exit-when-idle] [script]\n", name);
+  return 1;
+}
+
+
+int main(int argc, char** argv) {
+  QCoreApplication app(argc, argv);
+
+  QHostAddress address(QHostAddress::LocalHost);
+  int port = 6667;
+  QByteArray name("irc.mock");
+  MockServer::Limits limits;
+  int report = 0;
+  bool exitWhenIdle = false;
+  QString scriptFile;
+
+  const QStringList args = app.arguments();
+  for (int i = 1; i < args.size(); ++i) {
+    const QString& a = args.at(i);
+
+    if (a == "--exit-when-idle") {
+      exitWhenIdle = true;
+      continue;
+    }
+
+    if (!a.startsWith("--")) {
+      if (!scriptFile.isEmpty()) {
+	return usage(argv[0]);
+      }
+      scriptFile = a;
+      continue;
+    }
+
+    if (i + 1 >= args.size()) {
+      return usage(argv[0]);
+    }
+    const QString value = args.at(++i);
+
+    bool ok = true;
+    if (a == "--listen") {
+      ok = address.setAddress(value);
+    } else if (a == "--port") {
+      port = value.toInt(&ok);
+    } else if (a == "--name") {
+      name = value.toLatin1();
+    } else if (a == "--penalty") {
+      limits.penalty = value.toInt(&ok);
+    } else if (a == "--burst") {
+      limits.burst = value.toInt(&ok);
+    } else if (a == "--recvq") {
+      limits.recvq = value.toInt(&ok);
+    } else if (a == "--sendq") {
+      limits.sendq = value.toInt(&ok);
+    } else if (a == "--report") {
+      report = value.toInt(&ok);
+    } else {
+      ok = false;
+    }
+
+    if (!ok) {
+      return usage(argv[0]);
+    }
+  }
+
+  MockScript script = MockScript::registration();
+  if (!scriptFile.isEmpty() && !script.load(scriptFile)) {
+    std::fprintf(stderr, "%s\n", qPrintable(script.errorString()));
+    return 1;
+  }
+
+  MockServer server(script);
+  server.setServerName(name);
+  server.setLimits(limits);
+  if (!server.listen(address, quint16(port))) {
+    return 1;
+  }
+
+  std::printf("listening on %s port %u\n", qPrintable(address.toString()),
+	      unsigned(server.port()));
+  std::fflush(stdout);
+
+  Reporter reporter(&server, exitWhenIdle);
+  QTimer timer;
+  if (report > 0) {
+    QObject::connect(&timer, SIGNAL(timeout()),
+		     &reporter, SLOT(timer_timeout()));
+    timer.start(report * 1000);
+  }
+
+  const int result = app.exec();
+  reporter.report();
+
+  return result;
+}
+
+#include "mockircd.moc"
@@ -0,0 +1,226 @@
+/// \file
+/// \brief Implementation of MockScript class
+///
+/// \author png!das-system
+#include <QFile>
+
+#include "mockscript.h"
+
+
+/// \brief Construct empty script
+MockScript::MockScript() {}
+
+
+/// \brief Read and check a script file
+///
+/// \return false if the file couldn't be read or has errors, see
+/// errorString()
+bool MockScript::load(const QString& fileName) {
+  QFile file(fileName);
+  if (!file.open(QIODevice::ReadOnly)) {
+    m_error = fileName + ": " + file.errorString();
+    return false;
+  }
+
+  return parse(file.readAll(), fileName);
+}
+
+
+/// \brief Check and take over the steps of a script
+///
+/// \param source Script text
+/// \param name Name used in error messages
+///
+/// \return false if the script has errors, see errorString()
+bool MockScript::parse(const QByteArray& source, const QString& name) {
+  static const struct {
+    const char* keyword;
+    Op op;
+  } keywords[] = {
+    { "expect", Expect }, { "send", Send }, { "register", Register },
+    { "sleep", Sleep }, { "channel", Channel }, { "mix", Mix },
+    { "flood", Flood }, { "netjoin", NetJoin }, { "netsplit", NetSplit },
+    { "slowread", SlowRead }, { "stall", Stall }, { "close", Close },
+    { "loop", Loop }, { "endloop", EndLoop }
+  };
+  const int keywordCount = sizeof(keywords) / sizeof(keywords[0]);
+
+  QList<Step> steps;
+  const QList<QByteArray> lines = source.split('\n');
+  int openLoop = -1;
+
+  for (int i = 0; i < lines.size(); ++i) {
+    const QByteArray line = lines.at(i).trimmed();
+    if (line.isEmpty() || line.startsWith('#')) {
+      continue;
+    }
+
+    const int space = line.indexOf(' ');
+    const QByteArray keyword = (space < 0) ? line : line.left(space);
+
+    Step s;
+    s.line = i + 1;
+    s.text = (space < 0) ? QByteArray() : line.mid(space + 1).trimmed();
+    s.args = s.text.simplified().split(' ');
+    if (s.text.isEmpty()) {
+      s.args.clear();
+    }
+
+    int k = 0;
+    while (k < keywordCount && keyword != keywords[k].keyword) {
+      ++k;
+    }
+
+    QString error;
+    if (k == keywordCount) {
+      error = "unknown step " + QString::fromLatin1(keyword);
+    } else {
+      s.op = keywords[k].op;
+      check(s, &error);
+    }
+
+    if (error.isEmpty() && s.op == Loop) {
+      if (openLoop >= 0) {
+	error = "loops can't be nested";
+      }
+      openLoop = s.line;
+    } else if (error.isEmpty() && s.op == EndLoop) {
+      if (openLoop < 0) {
+	error = "endloop without loop";
+      }
+      openLoop = -1;
+    }
+
+    if (!error.isEmpty()) {
+      m_error = QString("%1:%2: %3").arg(name).arg(s.line).arg(error);
+      return false;
+    }
+
+    steps.append(s);
+  }
+
+  if (openLoop >= 0) {
+    m_error = QString("%1:%2: loop without endloop").arg(name).arg(openLoop);
+    return false;
+  }
+
+  m_steps = steps;
+  m_error.clear();
+
+  return true;
+}
+
+
+/// \brief Description of the last error of load() or parse()
+QString MockScript::errorString() const {
+  return m_error;
+}
+
+
+/// \brief Number of steps
+int MockScript::size() const {
+  return m_steps.size();
+}
+
+
+/// \brief Step i
+const MockScript::Step& MockScript::step(int i) const {
+  return m_steps.at(i);
+}
+
+
+/// \brief The default script: register the client, then idle
+MockScript MockScript::registration() {
+  MockScript s;
+  s.parse("expect NICK\n"
+	  "expect USER\n"
+	  "register\n", "(built-in)");
+  return s;
+}
+
+
+/// \brief Check the arguments of a step
+///
+/// \param error Receives the problem
+///
+/// \return false if the arguments are wrong
+bool MockScript::check(const Step& s, QString* error) const {
+  // allowed number of arguments, -1 for any
+  int minArgs = 0;
+  int maxArgs = 0;
+  int numbers = 0;
+
+  switch (s.op) {
+  case Expect:
+  case Channel:
+    minArgs = maxArgs = 1;
+    break;
+  case Send:
+    minArgs = 1;
+    maxArgs = -1;
+    break;
+  case Sleep:
+  case NetJoin:
+  case NetSplit:
+  case SlowRead:
+    minArgs = maxArgs = numbers = 1;
+    break;
+  case Mix:
+    minArgs = 1;
+    maxArgs = -1;
+    break;
+  case Flood:
+    minArgs = 1;
+    maxArgs = numbers = 3;
+    break;
+  case Close:
+    maxArgs = -1;
+    break;
+  case EndLoop:
+    maxArgs = numbers = 1;
+    break;
+  case Register:
+  case Stall:
+  case Loop:
+    break;
+  }
+
+  if (s.args.size() < minArgs || (maxArgs >= 0 && s.args.size() > maxArgs)) {
+    *error = "wrong number of arguments";
+    return false;
+  }
+
+  for (int i = 0; i < numbers && i < s.args.size(); ++i) {
+    bool ok;
+    if (s.args.at(i).toInt(&ok) < 0 || !ok) {
+      *error = "not a number: " + QString::fromLatin1(s.args.at(i));
+      return false;
+    }
+  }
+
+  if (s.op == Mix) {
+    static const char* const commands[] = {
+      "PRIVMSG", "NOTICE", "JOIN", "PART", "QUIT", "NICK", "MODE", "TOPIC"
+    };
+
+    for (int i = 0; i < s.args.size(); ++i) {
+      const QList<QByteArray> entry = s.args.at(i).split('=');
+      bool ok = (entry.size() == 2);
+      if (ok) {
+	ok = (entry.at(1).toInt(&ok) > 0 && ok);
+      }
+
+      bool known = false;
+      for (int c = 0; c < 8 && !known; ++c) {
+	known = (entry.at(0) == commands[c]);
+      }
+
+      if (!ok || !known) {
+	*error = "bad mix entry " + QString::fromLatin1(s.args.at(i));
+	return false;
+      }
+    }
+  }
+
+  return true;
+}
@@ -0,0 +1,108 @@
+/// \file
+/// \brief Declaration of MockScript class
+///
+/// \author png!das-system
+#ifndef MOCKSCRIPT_H
+#define MOCKSCRIPT_H 1
+
+#include <QByteArray>
+#include <QList>
+#include <QString>
+
+/// \brief What the mock server does with each client
+///
+/// A script is a text file with one step per line; empty lines and
+/// lines starting with # are ignored. Every client runs the script on
+/// its own, from the top, as soon as it connects. Independent of the
+/// script, PINGs are answered and the client's commands are handled
+/// like a minimal ircd would (NICK, JOIN, PART, QUIT).
+///
+/// \code
+/// expect <COMMAND>             wait until the client sent COMMAND
+/// send <line>                  send a line (see below for variables)
+/// register                     send 001-005 and the MOTD
+/// sleep <ms>                   pause
+/// channel <name>               channel used by the following steps
+/// mix <COMMAND>=<weight> ...   message mix for flood, from PRIVMSG,
+///                              NOTICE, JOIN, PART, QUIT, NICK, MODE
+///                              and TOPIC (default PRIVMSG=1)
+/// flood <count> [<rate> [<length>]]
+///                              send count messages from the mix at
+///                              rate messages/s (0: as fast as the
+///                              client reads), PRIVMSG/NOTICE/TOPIC
+///                              texts padded to length bytes
+/// netjoin <users>              users fake users join the channel
+/// netsplit <users>             users fake users quit with a netsplit
+///                              reason
+/// slowread <bytes/s>           read at most that much from the client
+///                              (0: unlimited again)
+/// stall                        stop reading, writing and answering
+///                              PINGs, like a dead link
+/// close [<reason>]             send ERROR and close the connection
+/// loop                         start of a repeated block
+/// endloop [<passes>]           repeat the block passes times in
+///                              total (0: forever)
+/// \endcode
+///
+/// In send lines, {nick}, {user}, {server} and {channel} are replaced
+/// by the client's nick, user name, the server name and the current
+/// channel. Flooded PRIVMSGs, NOTICEs and TOPICs carry "seq <n> ts <t>"
+/// with a per-client sequence number and the send time in ms since the
+/// epoch, so clients can check for loss and measure latency.
+class MockScript {
+public:
+  /// \brief Kind of step
+  enum Op {
+    Expect,
+    Send,
+    Register,
+    Sleep,
+    Channel,
+    Mix,
+    Flood,
+    NetJoin,
+    NetSplit,
+    SlowRead,
+    Stall,
+    Close,
+    Loop,
+    EndLoop
+  };
+
+  /// \brief One line of the script
+  struct Step {
+    /// \brief Kind of step
+    Op op;
+
+    /// \brief Arguments split at spaces
+    QList<QByteArray> args;
+
+    /// \brief Everything after the keyword (for send and close)
+    QByteArray text;
+
+    /// \brief Line number in the script file
+    int line;
+  };
+
+  MockScript();
+
+  bool load(const QString& fileName);
+  bool parse(const QByteArray& source, const QString& name);
+  QString errorString() const;
+
+  int size() const;
+  const Step& step(int i) const;
+
+  static MockScript registration();
+
+protected:
+  /// \brief The steps in order
+  QList<Step> m_steps;
+
+  /// \brief Description of the last parse error
+  QString m_error;
+
+  bool check(const Step& s, QString* error) const;
+};
+
+#endif // !MOCKSCRIPT_H
@@ -0,0 +1,125 @@
+/// \file
+/// \brief Implementation of MockServer class
+///
+/// \author png!das-system
+#include <QDebug>
+#include <QTcpSocket>
+
+#include "mockclient.h"
+#include "mockserver.h"
+
+
+/// \brief Construct with the limits of RFC 1459
+MockServer::Limits::Limits() :
+  penalty(2000), burst(10000), recvq(8192), sendq(1048576) {}
+
+
+/// \brief Construct with all counters set to zero
+MockServer::Statistics::Statistics() :
+  clients(0), connections(0), linesIn(0), linesOut(0), bytesIn(0),
+  bytesOut(0), excessFloods(0), sendqExceeded(0) {}
+
+
+/// \brief Construct server (not listening yet)
+///
+/// \param script Script to run for every client
+MockServer::MockServer(const MockScript& script, QObject* parent) :
+  QObject(parent), m_server(NULL), m_script(script),
+  m_serverName("irc.mock") {
+  m_server = new QTcpServer(this);
+  QObject::connect(m_server, SIGNAL(newConnection()),
+		   this, SLOT(server_newConnection()));
+}
+
+
+MockServer::~MockServer() {}
+
+
+/// \brief Start accepting clients
+///
+/// \param port Port to listen on; 0 picks a free one, see port()
+///
+/// \return false if the server couldn't listen, see errorString()
+bool MockServer::listen(const QHostAddress& address, quint16 port) {
+  if (!m_server->listen(address, port)) {
+    qWarning() << "MockServer: Unable to listen on port" << port << ":"
+	       << m_server->errorString();
+    return false;
+  }
+
+  return true;
+}
+
+
+/// \brief Port the server listens on
+quint16 MockServer::port() const {
+  return m_server->serverPort();
+}
+
+
+/// \brief Description of the last error of listen()
+QString MockServer::errorString() const {
+  return m_server->errorString();
+}
+
+
+/// \brief Name in the prefix of server messages
+QByteArray MockServer::serverName() const {
+  return m_serverName;
+}
+
+
+/// \brief Set name in the prefix of server messages (default irc.mock)
+void MockServer::setServerName(const QByteArray& name) {
+  m_serverName = name;
+}
+
+
+/// \brief Flood limits for new clients
+MockServer::Limits MockServer::limits() const {
+  return m_limits;
+}
+
+
+/// \brief Set flood limits for new clients
+void MockServer::setLimits(const Limits& limits) {
+  m_limits = limits;
+}
+
+
+/// \brief Script run for every client
+const MockScript& MockServer::script() const {
+  return m_script;
+}
+
+
+/// \brief Counters over all clients (updated by the clients)
+MockServer::Statistics& MockServer::statistics() {
+  return m_stats;
+}
+
+
+/// \brief Slot for m_server::newConnection()
+void MockServer::server_newConnection() {
+  while (m_server->hasPendingConnections()) {
+    QTcpSocket* socket = m_server->nextPendingConnection();
+
+    MockClient* client = new MockClient(socket, this,
+					static_cast<int>(m_stats.connections));
+    QObject::connect(client, SIGNAL(destroyed()),
+		     this, SLOT(client_destroyed()));
+
+    ++m_stats.connections;
+    ++m_stats.clients;
+    emit clientCountChanged(m_stats.clients);
+
+    client->start();
+  }
+}
+
+
+/// \brief Slot for destroyed() of the clients
+void MockServer::client_destroyed() {
+  --m_stats.clients;
+  emit clientCountChanged(m_stats.clients);
+}
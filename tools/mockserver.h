@@ -0,0 +1,121 @@
+/// \file
+/// \brief Declaration of MockServer class
+///
+/// \author png!das-system
+#ifndef MOCKSERVER_H
+#define MOCKSERVER_H 1
+
+#include <QByteArray>
+#include <QHostAddress>
+#include <QObject>
+#include <QString>
+#include <QTcpServer>
+
+#include "mockscript.h"
+
+/// \brief Scriptable IRC server for end-to-end tests of Connection
+///
+/// Accepts any number of clients and runs the MockScript for each of
+/// them in a MockClient. The ircd-style limits of setLimits() apply to
+/// all clients.
+class MockServer : public QObject {
+  Q_OBJECT
+public:
+  /// \brief Flood limits, like a traditional ircd applies them
+  ///
+  /// Every line received from a client adds penalty to its message
+  /// timer (RFC 1459, section 8.10). Once the timer is more than burst
+  /// ahead of the current time, lines are left in the receive queue
+  /// until it caught up; if the queue grows beyond recvq, the client is
+  /// disconnected for excess flood. A client that doesn't read what
+  /// is sent to it is disconnected once more than sendq bytes wait to
+  /// be written.
+  struct Limits {
+    Limits();
+
+    /// \brief Message timer increment per line in ms (0: no limit)
+    int penalty;
+
+    /// \brief How far the message timer may run ahead in ms
+    int burst;
+
+    /// \brief Receive queue limit in bytes (0: unlimited)
+    int recvq;
+
+    /// \brief Send queue limit in bytes (0: unlimited)
+    int sendq;
+  };
+
+  /// \brief Counters over all clients
+  struct Statistics {
+    Statistics();
+
+    /// \brief Clients connected right now
+    int clients;
+
+    /// \brief Clients accepted since the start
+    quint64 connections;
+
+    /// \brief Lines received from clients
+    quint64 linesIn;
+
+    /// \brief Lines sent to clients
+    quint64 linesOut;
+
+    /// \brief Bytes received from clients
+    quint64 bytesIn;
+
+    /// \brief Bytes sent to clients
+    quint64 bytesOut;
+
+    /// \brief Clients disconnected for exceeding recvq
+    quint64 excessFloods;
+
+    /// \brief Clients disconnected for exceeding sendq
+    quint64 sendqExceeded;
+  };
+
+  MockServer(const MockScript& script, QObject* parent=NULL);
+  virtual ~MockServer();
+
+  bool listen(const QHostAddress& address, quint16 port);
+  quint16 port() const;
+  QString errorString() const;
+
+  QByteArray serverName() const;
+  void setServerName(const QByteArray& name);
+
+  Limits limits() const;
+  void setLimits(const Limits& limits);
+
+  const MockScript& script() const;
+  Statistics& statistics();
+
+signals:
+  /// \brief A client connected or disconnected
+  ///
+  /// \param clients Number of clients connected now
+  void clientCountChanged(int clients);
+
+protected:
+  /// \brief Accepts the clients
+  QTcpServer* m_server;
+
+  /// \brief Script run for every client
+  MockScript m_script;
+
+  /// \brief Name in the prefix of server messages
+  QByteArray m_serverName;
+
+  /// \brief Flood limits
+  Limits m_limits;
+
+  /// \brief Counters
+  Statistics m_stats;
+
+protected slots:
+  void server_newConnection();
+  void client_destroyed();
+};
+
+#endif // !MOCKSERVER_H
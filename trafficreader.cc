@@ -0,0 +1,128 @@
+/// \file
+/// \brief Implementation of TrafficReader class
+///
+/// \author png!das-system
+#include <QDebug>
+
+#include "TrafficReader"
+#include "TrafficRecorder"
+
+using namespace QIRC;
+
+
+/// \brief Construct reader without a file
+TrafficReader::TrafficReader() :
+  m_time(0) {}
+
+
+TrafficReader::~TrafficReader() {
+  close();
+}
+
+
+/// \brief Open a recording and check its magic
+///
+/// \return false if the file couldn't be opened or isn't a recording,
+/// see errorString()
+bool TrafficReader::open(const QString& fileName) {
+  close();
+
+  m_file.setFileName(fileName);
+  if (!m_file.open(QIODevice::ReadOnly)) {
+    m_error = m_file.errorString();
+    qWarning() << "TrafficReader: Unable to open" << fileName << ":" << m_error;
+    return false;
+  }
+
+  if (m_file.read(8) != QByteArray(TrafficRecorder::Magic, 8)) {
+    m_error = "Not a traffic recording";
+    qWarning() << "TrafficReader:" << fileName << "is not a traffic recording";
+    m_file.close();
+    return false;
+  }
+
+  m_time = 0;
+  m_error.clear();
+
+  return true;
+}
+
+
+/// \brief Close the recording
+void TrafficReader::close() {
+  if (m_file.isOpen()) {
+    m_file.close();
+  }
+}
+
+
+/// \brief Is a recording open?
+bool TrafficReader::isOpen() const {
+  return m_file.isOpen();
+}
+
+
+/// \brief Have all records been read?
+bool TrafficReader::atEnd() const {
+  return (!m_file.isOpen() || m_file.atEnd());
+}
+
+
+/// \brief Description of the last error
+QString TrafficReader::errorString() const {
+  return m_error;
+}
+
+
+/// \brief Read the next record
+///
+/// \param time Receives the time of the chunk in nanoseconds since the
+/// recording started
+/// \param data Receives the chunk
+///
+/// \return false at the end of the recording or if the record is
+/// truncated (errorString() is set then)
+bool TrafficReader::next(qint64* time, QByteArray* data) {
+  if (atEnd()) {
+    return false;
+  }
+
+  quint64 delta;
+  quint64 length;
+  if (!readVarint(&delta) || !readVarint(&length) ||
+      length > quint64(m_file.bytesAvailable())) {
+    m_error = "Truncated record";
+    qWarning() << "TrafficReader: truncated record in" << m_file.fileName();
+    close();
+    return false;
+  }
+
+  *data = m_file.read(qint64(length));
+  m_time += qint64(delta);
+  *time = m_time;
+
+  return true;
+}
+
+
+/// \brief Read an unsigned LEB128 value
+///
+/// \return false if the file ended within the value
+bool TrafficReader::readVarint(quint64* value) {
+  quint64 v = 0;
+  char c;
+
+  for (int shift = 0; shift < 64; shift += 7) {
+    if (!m_file.getChar(&c)) {
+      return false;
+    }
+
+    v |= quint64(c & 0x7f) << shift;
+    if ((c & 0x80) == 0) {
+      *value = v;
+      return true;
+    }
+  }
+
+  return false;
+}
@@ -0,0 +1,54 @@
+/// \file
+/// \brief Declaration of TrafficReader class
+///
+/// \author png!das-system
+#ifndef TRAFFICREADER_H
+#define TRAFFICREADER_H 1
+
+#include <QByteArray>
+#include <QFile>
+#include <QString>
+
+#include "qirc.h"
+
+namespace QIRC {
+  /// \brief Reads recordings written by TrafficRecorder
+  ///
+  /// \code
+  /// TrafficReader reader;
+  /// qint64 time;
+  /// QByteArray data;
+  /// if (reader.open("traffic.rec")) {
+  ///   while (reader.next(&time, &data)) {
+  ///     conn.feed(data);
+  ///   }
+  /// }
+  /// \endcode
+  class TrafficReader {
+  public:
+    TrafficReader();
+    ~TrafficReader();
+
+    bool open(const QString& fileName);
+    void close();
+    bool isOpen() const;
+    bool atEnd() const;
+    QString errorString() const;
+
+    bool next(qint64* time, QByteArray* data);
+
+  protected:
+    /// \brief The file being read
+    QFile m_file;
+
+    /// \brief Time of the last record in ns since the recording started
+    qint64 m_time;
+
+    /// \brief Description of the last format error
+    QString m_error;
+
+    bool readVarint(quint64* value);
+  };
+};
+
+#endif // !TRAFFICREADER_H
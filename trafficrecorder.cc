@@ -0,0 +1,128 @@
+/// \file
+/// \brief Implementation of TrafficRecorder class
+///
+/// \author png!das-system
+#include <QDebug>
+
+#include "TrafficRecorder"
+
+using namespace QIRC;
+
+
+/// \brief First bytes of every recording
+const char TrafficRecorder::Magic[9] = "QIRCTRC1";
+
+
+/// \brief Construct recorder without a file
+TrafficRecorder::TrafficRecorder() :
+  m_lastTime(0), m_chunks(0), m_bytes(0) {}
+
+
+TrafficRecorder::~TrafficRecorder() {
+  close();
+}
+
+
+/// \brief Start a new recording
+///
+/// An existing file is overwritten.
+///
+/// \return false if the file couldn't be opened, see errorString()
+bool TrafficRecorder::open(const QString& fileName) {
+  close();
+
+  m_file.setFileName(fileName);
+  if (!m_file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+    qWarning() << "TrafficRecorder: Unable to open" << fileName << ":"
+	       << m_file.errorString();
+    return false;
+  }
+
+  m_file.write(Magic, 8);
+
+  m_clock.start();
+  m_lastTime = 0;
+  m_chunks = 0;
+  m_bytes = 0;
+
+  return true;
+}
+
+
+/// \brief Finish the recording
+void TrafficRecorder::close() {
+  if (m_file.isOpen()) {
+    m_file.close();
+  }
+}
+
+
+/// \brief Is a recording in progress?
+bool TrafficRecorder::isOpen() const {
+  return m_file.isOpen();
+}
+
+
+/// \brief Description of the last error
+QString TrafficRecorder::errorString() const {
+  return m_file.errorString();
+}
+
+
+/// \brief Append a chunk of received data
+///
+/// Does nothing unless a recording is in progress.
+void TrafficRecorder::record(const QByteArray& data) {
+  if (!m_file.isOpen() || data.isEmpty()) {
+    return;
+  }
+
+  const qint64 now = m_clock.nsecsElapsed();
+
+  // at most two 10 byte varints
+  char header[20];
+  int length = encodeVarint(header,
+			    quint64(qMax(now - m_lastTime, qint64(0))));
+  length += encodeVarint(header + length, quint64(data.size()));
+
+  if (m_file.write(header, length) != length ||
+      m_file.write(data) != data.size()) {
+    qWarning() << "TrafficRecorder: Unable to write to" << m_file.fileName()
+	       << ":" << m_file.errorString();
+    close();
+    return;
+  }
+
+  m_lastTime = now;
+  ++m_chunks;
+  m_bytes += data.size();
+}
+
+
+/// \brief Number of chunks recorded since open()
+quint64 TrafficRecorder::chunksRecorded() const {
+  return m_chunks;
+}
+
+
+/// \brief Number of data bytes recorded since open()
+quint64 TrafficRecorder::bytesRecorded() const {
+  return m_bytes;
+}
+
+
+/// \brief Write value as unsigned LEB128
+///
+/// \param out Buffer with room for at least 10 bytes
+///
+/// \return Number of bytes written
+int TrafficRecorder::encodeVarint(char* out, quint64 value) {
+  int n = 0;
+  while (value >= 0x80) {
+    out[n++] = char((value & 0x7f) | 0x80);
+    value >>= 7;
+  }
+  out[n++] = char(value);
+
+  return n;
+}
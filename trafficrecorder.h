@@ -0,0 +1,70 @@
+/// \file
+/// \brief Declaration of TrafficRecorder class
+///
+/// \author png!das-system
+#ifndef TRAFFICRECORDER_H
+#define TRAFFICRECORDER_H 1
+
+#include <QByteArray>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QString>
+
+#include "qirc.h"
+
+namespace QIRC {
+  /// \brief Writes the inbound byte stream of a Connection to a file
+  ///
+  /// Attached with Connection::setTrafficRecorder(), the recorder gets
+  /// every chunk of data exactly as it was read from the transport,
+  /// before any framing. The file can be read with TrafficReader, e.g.
+  /// to replay production traffic through the parser (see
+  /// benchmarks/replaybench.cc).
+  ///
+  /// File format: the 8 byte magic "QIRCTRC1", followed by one record
+  /// per chunk:
+  /// \code
+  /// varint  nanoseconds since the previous record (first: since open())
+  /// varint  length of the data
+  /// bytes   data
+  /// \endcode
+  /// Varints are unsigned LEB128 (7 bits per byte, least significant
+  /// group first), so a typical record header takes 4 or 5 bytes.
+  class TrafficRecorder {
+  public:
+    TrafficRecorder();
+    ~TrafficRecorder();
+
+    bool open(const QString& fileName);
+    void close();
+    bool isOpen() const;
+    QString errorString() const;
+
+    void record(const QByteArray& data);
+
+    quint64 chunksRecorded() const;
+    quint64 bytesRecorded() const;
+
+    static const char Magic[9];
+
+  protected:
+    /// \brief The file being written
+    QFile m_file;
+
+    /// \brief Started by open()
+    QElapsedTimer m_clock;
+
+    /// \brief m_clock time of the previous record in ns
+    qint64 m_lastTime;
+
+    /// \brief Number of records written
+    quint64 m_chunks;
+
+    /// \brief Number of data bytes written (without record headers)
+    quint64 m_bytes;
+
+    static int encodeVarint(char* out, quint64 value);
+  };
+};
+
+#endif // !TRAFFICRECORDER_H
@@ -0,0 +1,15 @@
+/// \file
+/// \brief Implementation of Transport class
+///
+/// \author png!das-system
+#include "Transport"
+
+using namespace QIRC;
+
+
+/// \brief Construct transport
+Transport::Transport(QObject* parent) :
+  QObject(parent) {}
+
+
+Transport::~Transport() {}
@@ -0,0 +1,78 @@
+/// \file
+/// \brief Declaration of Transport class
+///
+/// \author png!das-system
+#ifndef TRANSPORT_H
+#define TRANSPORT_H 1
+
+#include <QAbstractSocket>
+#include <QByteArray>
+#include <QObject>
+#include <QString>
+
+#include "qirc.h"
+
+namespace QIRC {
+  /// \brief Byte stream a Connection talks to its server through
+  ///
+  /// A Transport offers the part of the QTcpSocket interface that
+  /// Connection uses, so the socket implementation can be exchanged
+  /// (see Connection::setTransport()). QtTransport uses a QTcpSocket
+  /// and is the default; EpollTransport (Linux only) scales to many
+  /// thousands of connections per thread.
+  ///
+  /// Implementations emit the signals with the same semantics as the
+  /// QTcpSocket signals of the same name.
+  class Transport : public QObject {
+    Q_OBJECT
+  public:
+    Transport(QObject* parent=NULL);
+    virtual ~Transport();
+
+    /// \brief Start connecting to a server
+    ///
+    /// connected() or error() is emitted once the attempt finished.
+    virtual void connectToHost(const QString& host, quint16 port) = 0;
+
+    /// \brief Close the connection after pending data has been written
+    virtual void disconnectFromHost() = 0;
+
+    /// \brief Close the connection at once, discarding pending data
+    ///
+    /// Emits disconnected() if the connection was established.
+    virtual void abort() = 0;
+
+    /// \brief Is the connection established?
+    virtual bool isOpen() const = 0;
+
+    /// \brief Take all data received so far
+    virtual QByteArray readAll() = 0;
+
+    /// \brief Send data (or queue it until it can be sent)
+    ///
+    /// Data that can't be sent right away is copied, so the caller may
+    /// reuse the buffer behind data (e.g. one from
+    /// QByteArray::fromRawData()) once write() returned.
+    ///
+    /// \return Number of bytes accepted or -1 on error
+    virtual qint64 write(const QByteArray& data) = 0;
+
+    /// \brief Human-readable description of the last error
+    virtual QString errorString() const = 0;
+
+  signals:
+    /// \brief Connection established
+    void connected();
+
+    /// \brief Connection closed
+    void disconnected();
+
+    /// \brief An error occurred
+    void error(QAbstractSocket::SocketError err);
+
+    /// \brief New data can be fetched with readAll()
+    void readyRead();
+  };
+};
+
+#endif // !TRANSPORT_H